@@ -19,16 +19,59 @@ CONFIG += c++11
 INCLUDEPATH += src
 
 SOURCES += \
+    src/bandwidth_estimator.cpp \
+    src/buffer_pool.cpp \
+    src/encode_cache.cpp \
+    src/histogram.cpp \
+    src/host_service.cpp \
+    src/host_settings.cpp \
+    src/input_latency.cpp \
+    src/input_queue.cpp \
+    src/input_replay.cpp \
     src/input_simulator.cpp \
+    src/metrics.cpp \
+    src/metrics_server.cpp \
+    src/packet_builder.cpp \
+    src/packet_parser.cpp \
     src/qv_main.cpp \
+    src/quality_ladder.cpp \
     src/qv_mainwindow.cpp \
     src/screen_capture.cpp \
+    src/send_scheduler.cpp \
+    src/session_recorder.cpp \
+    src/tile_ack_tracker.cpp \
+    src/tile_store.cpp \
+    src/trace.cpp \
+    src/viewer_session.cpp \
     src/ws_handler.cpp
 
 HEADERS += \
+    src/bandwidth_estimator.h \
+    src/buffer_pool.h \
+    src/encode_cache.h \
+    src/histogram.h \
+    src/host_service.h \
+    src/host_settings.h \
+    src/input_latency.h \
+    src/input_queue.h \
+    src/input_replay.h \
     src/input_simulator.h \
+    src/key_map.h \
+    src/metrics.h \
+    src/metrics_server.h \
+    src/packet_builder.h \
+    src/packet_parser.h \
+    src/protocol.h \
+    src/quality_ladder.h \
     src/qv_mainwindow.h \
     src/screen_capture.h \
+    src/send_scheduler.h \
+    src/session_recorder.h \
+    src/stream_profile.h \
+    src/tile_ack_tracker.h \
+    src/tile_store.h \
+    src/trace.h \
+    src/viewer_session.h \
     src/ws_handler.h
 
 FORMS += \
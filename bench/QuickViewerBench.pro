@@ -0,0 +1,82 @@
+#-------------------------------------------------
+#
+# Offline benchmarks for the QuickViewer host, no network needed, the
+# "input" one injects through XTest and wants an X server (xvfb-run).
+#   QuickViewerBench [name ...]
+#
+#-------------------------------------------------
+
+QT += core
+QT -= gui
+
+TARGET = QuickViewerBench
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    bench_dispatch.cpp \
+    bench_fanout.cpp \
+    bench_input.cpp \
+    bench_input_batch.cpp \
+    bench_ladder.cpp \
+    bench_main.cpp \
+    bench_metrics.cpp \
+    bench_parser.cpp \
+    bench_recorder.cpp \
+    bench_resume.cpp \
+    bench_scheduler.cpp \
+    bench_trace.cpp \
+    host_packet_reader.cpp \
+    ../src/bandwidth_estimator.cpp \
+    ../src/buffer_pool.cpp \
+    ../src/histogram.cpp \
+    ../src/input_replay.cpp \
+    ../src/metrics.cpp \
+    ../src/packet_builder.cpp \
+    ../src/packet_parser.cpp \
+    ../src/quality_ladder.cpp \
+    ../src/send_scheduler.cpp \
+    ../src/session_recorder.cpp \
+    ../src/tile_ack_tracker.cpp \
+    ../src/tile_store.cpp \
+    ../src/trace.cpp \
+    ../src/viewer_session.cpp
+
+HEADERS += \
+    bench.h \
+    host_packet_reader.h \
+    ../src/bandwidth_estimator.h \
+    ../src/buffer_pool.h \
+    ../src/histogram.h \
+    ../src/input_replay.h \
+    ../src/key_map.h \
+    ../src/metrics.h \
+    ../src/packet_builder.h \
+    ../src/packet_parser.h \
+    ../src/protocol.h \
+    ../src/quality_ladder.h \
+    ../src/send_scheduler.h \
+    ../src/session_recorder.h \
+    ../src/stream_profile.h \
+    ../src/tile_ack_tracker.h \
+    ../src/tile_store.h \
+    ../src/trace.h \
+    ../src/viewer_session.h
+
+linux-g++: \
+    LIBS += -lX11 -lXtst
+
+# === build parameters ===
+CONFIG(debug, debug|release) {
+    BUILD_FLAG = debug
+} else {
+    BUILD_FLAG = release
+}
+
+MOC_DIR = $${PWD}/../build/bench/$${BUILD_FLAG}
+OBJECTS_DIR = $${PWD}/../build/bench/$${BUILD_FLAG}
+DESTDIR = $${PWD}/../bin/$${BUILD_FLAG}
@@ -0,0 +1,55 @@
+#-------------------------------------------------
+#
+# ScreenCapture's diff and encode on made up or recorded frame sequences,
+# no display or network needed. Links QtGui for the real image encoders,
+# WEBP wants the QtWebP image format plugin.
+#   QuickViewerCaptureBench [workload ...] [--frames=N] [--csv] ...
+#
+#-------------------------------------------------
+
+QT += core gui widgets
+
+TARGET = QuickViewerCaptureBench
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    capture_main.cpp \
+    capture_workloads.cpp \
+    ../src/buffer_pool.cpp \
+    ../src/encode_cache.cpp \
+    ../src/histogram.cpp \
+    ../src/metrics.cpp \
+    ../src/packet_builder.cpp \
+    ../src/screen_capture.cpp \
+    ../src/tile_store.cpp \
+    ../src/trace.cpp
+
+HEADERS += \
+    capture_bench.h \
+    ../src/buffer_pool.h \
+    ../src/encode_cache.h \
+    ../src/histogram.h \
+    ../src/input_queue.h \
+    ../src/metrics.h \
+    ../src/packet_builder.h \
+    ../src/protocol.h \
+    ../src/screen_capture.h \
+    ../src/stream_profile.h \
+    ../src/tile_store.h \
+    ../src/trace.h
+
+# === build parameters ===
+CONFIG(debug, debug|release) {
+    BUILD_FLAG = debug
+} else {
+    BUILD_FLAG = release
+}
+
+MOC_DIR = $${PWD}/../build/capture_bench/$${BUILD_FLAG}
+OBJECTS_DIR = $${PWD}/../build/capture_bench/$${BUILD_FLAG}
+DESTDIR = $${PWD}/../bin/$${BUILD_FLAG}
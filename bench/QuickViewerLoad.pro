@@ -0,0 +1,45 @@
+#-------------------------------------------------
+#
+# Puts a host under the load of simulated viewers, standing in for the
+# proxy on localhost, optionally starting the host on an Xvfb display.
+#   QuickViewerLoad --viewers=8 --duration=30 --input=120
+#   QuickViewerLoad --host=../bin/release/QuickViewerApp --xvfb --app="xclock -update 1" --csv
+#
+#-------------------------------------------------
+
+QT += core network websockets
+
+TARGET = QuickViewerLoad
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    host_launcher.cpp \
+    host_packet_reader.cpp \
+    load_main.cpp \
+    load_proxy.cpp \
+    load_viewer.cpp \
+    ../src/histogram.cpp
+
+HEADERS += \
+    host_launcher.h \
+    host_packet_reader.h \
+    load_proxy.h \
+    load_viewer.h \
+    ../src/histogram.h \
+    ../src/protocol.h
+
+# === build parameters ===
+CONFIG(debug, debug|release) {
+    BUILD_FLAG = debug
+} else {
+    BUILD_FLAG = release
+}
+
+MOC_DIR = $${PWD}/../build/load/$${BUILD_FLAG}
+OBJECTS_DIR = $${PWD}/../build/load/$${BUILD_FLAG}
+DESTDIR = $${PWD}/../bin/$${BUILD_FLAG}
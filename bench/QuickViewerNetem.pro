@@ -0,0 +1,47 @@
+#-------------------------------------------------
+#
+# Runs a host's send path through scripted network conditions, bandwidth,
+# latency, jitter and loss between the host and stand-in viewers.
+#   QuickViewerNetem --profile=3g --input=60
+#   QuickViewerNetem --profile=wifi --host=../bin/release/QuickViewerApp --xvfb --app="xclock -update 1" --csv
+#
+#-------------------------------------------------
+
+QT += core network websockets
+
+TARGET = QuickViewerNetem
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    host_launcher.cpp \
+    host_packet_reader.cpp \
+    link_shaper.cpp \
+    load_proxy.cpp \
+    load_viewer.cpp \
+    netem_main.cpp \
+    ../src/histogram.cpp
+
+HEADERS += \
+    host_launcher.h \
+    host_packet_reader.h \
+    link_shaper.h \
+    load_proxy.h \
+    load_viewer.h \
+    ../src/histogram.h \
+    ../src/protocol.h
+
+# === build parameters ===
+CONFIG(debug, debug|release) {
+    BUILD_FLAG = debug
+} else {
+    BUILD_FLAG = release
+}
+
+MOC_DIR = $${PWD}/../build/netem/$${BUILD_FLAG}
+OBJECTS_DIR = $${PWD}/../build/netem/$${BUILD_FLAG}
+DESTDIR = $${PWD}/../bin/$${BUILD_FLAG}
@@ -0,0 +1,43 @@
+#-------------------------------------------------
+#
+# Plays back host sessions recorded with QV_RECORD_DIR, offline through the
+# parsers and image decoders or live as a viewer on a host's LAN listener.
+#   QuickViewerReplay file.qvsr [--timeline] [--decode] [--passes=N] ...
+#   QuickViewerReplay file.qvsr --connect=ws://host:port --login=id --password=pw
+#
+#-------------------------------------------------
+
+QT += core gui network websockets
+
+TARGET = QuickViewerReplay
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+
+SOURCES += \
+    host_packet_reader.cpp \
+    replay_main.cpp \
+    ../src/histogram.cpp \
+    ../src/packet_parser.cpp \
+    ../src/session_recorder.cpp
+
+HEADERS += \
+    host_packet_reader.h \
+    ../src/histogram.h \
+    ../src/packet_parser.h \
+    ../src/protocol.h \
+    ../src/session_recorder.h
+
+# === build parameters ===
+CONFIG(debug, debug|release) {
+    BUILD_FLAG = debug
+} else {
+    BUILD_FLAG = release
+}
+
+MOC_DIR = $${PWD}/../build/replay/$${BUILD_FLAG}
+OBJECTS_DIR = $${PWD}/../build/replay/$${BUILD_FLAG}
+DESTDIR = $${PWD}/../bin/$${BUILD_FLAG}
@@ -0,0 +1,19 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QStringList>
+
+// Each benchmark prints its results and returns non-zero if a consistency check failed
+int benchParser(const QStringList &args);
+int benchDispatch(const QStringList &args);
+int benchScheduler(const QStringList &args);
+int benchFanout(const QStringList &args);
+int benchLadder(const QStringList &args);
+int benchInput(const QStringList &args); // XTest, wants an X server (xvfb-run)
+int benchInputBatch(const QStringList &args);
+int benchMetrics(const QStringList &args);
+int benchRecorder(const QStringList &args);
+int benchResume(const QStringList &args);
+int benchTrace(const QStringList &args); // leaves tracing on, runs last
+
+#endif // BENCH_H
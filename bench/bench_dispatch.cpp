@@ -0,0 +1,210 @@
+#include "bench.h"
+#include "protocol.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+
+#include <random>
+
+/* Command dispatch cost over a typical viewer packet mix: the former chain of
+ * QByteArray compares with QByteArray::mid() payload reads, against the FourCC
+ * switch with the bounds checked payload decoders. Both handlers fold what
+ * they decode into a sum so the results can be compared and nothing is
+ * optimized away. */
+
+static const char *COMMANDS[] = {"SCUP", "SCUP", "SCUP", "SCUP", "SCUD", "SKST", "SMKS", "SMWH", "TLRD", "TLRD", "GIMG", "REFH"};
+static const int COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+struct BenchPacket
+{
+    QByteArray command;
+    QByteArray payload;
+};
+
+static quint16 legacyUint16(const QByteArray &buf)
+{
+    if(buf.size() < 2)
+        return 0;
+
+    return static_cast<quint16>(static_cast<quint8>(buf.at(0)) | static_cast<quint8>(buf.at(1)) << 8);
+}
+
+// the if/else chain of WebSocketHandler::newData before the switch
+static quint32 dispatchLegacy(const QByteArray &command, const QByteArray &data)
+{
+    static const QByteArray LEGACY_IMAGE_TILE("IMGT");
+    static const QByteArray LEGACY_IMAGE_SCREEN("IMGS");
+    static const QByteArray LEGACY_GET_IMAGE("GIMG");
+    static const QByteArray LEGACY_TILE_RECEIVED("TLRD");
+    static const QByteArray LEGACY_CHANGE_DISPLAY("CHDP");
+    static const QByteArray LEGACY_REFRESH_DISPLAY("REFH");
+    static const QByteArray LEGACY_SET_CURSOR_POS("SCUP");
+    static const QByteArray LEGACY_SET_CURSOR_DELTA("SCUD");
+    static const QByteArray LEGACY_SET_KEY_STATE("SKST");
+    static const QByteArray LEGACY_SET_MOUSE_KEY("SMKS");
+    static const QByteArray LEGACY_SET_MOUSE_WHEEL("SMWH");
+
+    if(command == LEGACY_IMAGE_TILE || command == LEGACY_IMAGE_SCREEN)
+        return 0;
+    else if(command == LEGACY_GET_IMAGE)
+        return 1;
+    else if(command == LEGACY_TILE_RECEIVED)
+        return legacyUint16(data.mid(0,2));
+    else if(command == LEGACY_CHANGE_DISPLAY)
+        return 2;
+    else if(command == LEGACY_REFRESH_DISPLAY)
+        return 3;
+    else if(command == LEGACY_SET_CURSOR_POS)
+    {
+        if(data.size() >= 4)
+            return legacyUint16(data.mid(0,2)) + legacyUint16(data.mid(2,2));
+    }
+    else if(command == LEGACY_SET_CURSOR_DELTA)
+    {
+        if(data.size() >= 4)
+            return static_cast<quint32>(static_cast<qint16>(legacyUint16(data.mid(0,2))) + static_cast<qint16>(legacyUint16(data.mid(2,2))));
+    }
+    else if(command == LEGACY_SET_KEY_STATE || command == LEGACY_SET_MOUSE_KEY)
+    {
+        if(data.size() >= 4)
+            return legacyUint16(data.mid(0,2)) + legacyUint16(data.mid(2,2));
+    }
+    else if(command == LEGACY_SET_MOUSE_WHEEL)
+    {
+        if(data.size() >= 4)
+            return legacyUint16(data.mid(2,2));
+    }
+
+    return 0;
+}
+
+static quint32 dispatchSwitch(quint32 command, const char *data, int size)
+{
+    switch(command)
+    {
+        case KEY_IMAGE_TILE:
+        case KEY_IMAGE_SCREEN:
+            return 0;
+        case KEY_GET_IMAGE:
+            return 1;
+        case KEY_TILE_RECEIVED:
+        {
+            TileReceivedPayload payload;
+            return payload.decode(data, size) ? payload.tileNum : 0;
+        }
+        case KEY_CHANGE_DISPLAY:
+            return 2;
+        case KEY_REFRESH_DISPLAY:
+            return 3;
+        case KEY_SET_CURSOR_POS:
+        {
+            CursorPosPayload payload;
+            return payload.decode(data, size) ? static_cast<quint32>(payload.posX) + payload.posY : 0;
+        }
+        case KEY_SET_CURSOR_DELTA:
+        {
+            CursorDeltaPayload payload;
+            return payload.decode(data, size) ? static_cast<quint32>(payload.deltaX + payload.deltaY) : 0;
+        }
+        case KEY_SET_KEY_STATE:
+        case KEY_SET_MOUSE_KEY:
+        {
+            KeyStatePayload payload;
+            return payload.decode(data, size) ? static_cast<quint32>(payload.keyCode) + payload.keyState : 0;
+        }
+        case KEY_SET_MOUSE_WHEEL:
+        {
+            KeyStatePayload payload;
+            return payload.decode(data, size) ? payload.keyState : 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+int benchDispatch(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    const int packetCount = 100000;
+    const int repeat = 20;
+
+    std::mt19937 random(2019);
+
+    QVector<BenchPacket> packets;
+    packets.reserve(packetCount);
+
+    for(int i=0;i<packetCount;++i)
+    {
+        BenchPacket packet;
+        packet.command = QByteArray(COMMANDS[random() % COMMAND_COUNT]);
+
+        int payloadSize = (packet.command == "GIMG" || packet.command == "REFH") ? 0 :
+                          (packet.command == "TLRD") ? 2 : 4;
+
+        for(int k=0;k<payloadSize;++k)
+            packet.payload.append(static_cast<char>(random()));
+
+        packets.append(packet);
+    }
+
+    QTextStream out(stdout);
+
+    // legacy: both sides wrapped as QByteArray, as binaryMessageReceived handed them over
+    quint32 legacySum = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int r=0;r<repeat;++r)
+    {
+        for(int i=0;i<packets.size();++i)
+        {
+            const BenchPacket &packet = packets.at(i);
+            legacySum += dispatchLegacy(QByteArray::fromRawData(packet.command.constData(), 4),
+                                        QByteArray::fromRawData(packet.payload.constData(), packet.payload.size()));
+        }
+    }
+
+    qint64 legacyNsecs = timer.nsecsElapsed();
+
+    quint32 switchSum = 0;
+    timer.restart();
+
+    for(int r=0;r<repeat;++r)
+    {
+        for(int i=0;i<packets.size();++i)
+        {
+            const BenchPacket &packet = packets.at(i);
+            switchSum += dispatchSwitch(fourCCFromData(packet.command.constData()),
+                                        packet.payload.constData(), packet.payload.size());
+        }
+    }
+
+    qint64 switchNsecs = timer.nsecsElapsed();
+
+    double dispatched = static_cast<double>(packetCount) * repeat;
+
+    out << "legacy compare chain: " << QString::number(legacyNsecs / dispatched, 'f', 1) << " ns/packet\n";
+    out << "fourcc switch:        " << QString::number(switchNsecs / dispatched, 'f', 1) << " ns/packet"
+        << " (" << QString::number(static_cast<double>(legacyNsecs) / qMax<qint64>(switchNsecs, 1), 'f', 1) << "x)\n";
+
+    // truncated payloads must be rejected, never read past the end
+    int failed = 0;
+    const char shortPayload[3] = {1, 2, 3};
+
+    for(int size=0;size<4;++size)
+    {
+        CursorPosPayload payload;
+        if(payload.decode(shortPayload, size))
+            ++failed;
+    }
+
+    if(legacySum != switchSum)
+    {
+        out << "dispatch mismatch: " << legacySum << " != " << switchSum << "\n";
+        ++failed;
+    }
+
+    return failed;
+}
@@ -0,0 +1,310 @@
+#include "bench.h"
+#include "buffer_pool.h"
+#include "packet_builder.h"
+#include "protocol.h"
+#include "send_scheduler.h"
+#include "stream_profile.h"
+#include "tile_store.h"
+#include "viewer_session.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+
+#include <random>
+
+/* Host cost per frame of serving N viewers at once. Every frame a tenth of the
+ * 64 px tiles of a 1280x768 screen change, every viewer gets them batched into
+ * IMGB packets through its own ViewerSession and SendScheduler, drained as if
+ * the socket took everything.
+ *
+ * Compared: encoding a changed tile once into the shared TileStore and handing
+ * every viewer the same packet, against encoding it again for every viewer.
+ * The bench links QtCore only, so the WEBP encoder is stood in for by a
+ * quantizing run length coder. WEBP is a lot slower, which widens the gap. */
+
+static const int SCREEN_WIDTH   = 1280;
+static const int SCREEN_HEIGHT  = 768;
+static const int RECT_SIZE      = 64;
+static const int TILE_COLUMNS   = SCREEN_WIDTH / RECT_SIZE;
+static const int TILE_COUNT     = TILE_COLUMNS * (SCREEN_HEIGHT / RECT_SIZE);
+static const int DIRTY_TILES    = TILE_COUNT / 10;
+static const int FRAME_COUNT    = 200;
+static const int FRAME_MS       = 100;
+
+struct BenchScreen
+{
+    QVector<quint32> pixels;
+    std::mt19937     random;
+
+    BenchScreen() : pixels(SCREEN_WIDTH * SCREEN_HEIGHT), random(2019)
+    {
+        for(int y=0;y<SCREEN_HEIGHT;++y)
+            for(int x=0;x<SCREEN_WIDTH;++x)
+                pixels[y * SCREEN_WIDTH + x] = background(x, y);
+    }
+
+    static quint32 background(int x, int y)
+    {
+        return 0xff000000u | static_cast<quint32>((x / 8) << 16 | (y / 8) << 8 | 0x40);
+    }
+
+    // new text like noise over a few random tiles, returns their numbers
+    void change(QVector<quint16> &tiles)
+    {
+        tiles.resize(0);
+
+        while(tiles.size() < DIRTY_TILES)
+        {
+            quint16 tileNum = static_cast<quint16>(random() % TILE_COUNT);
+
+            bool known = false;
+            for(int i=0;i<tiles.size();++i)
+                known = known || tiles.at(i) == tileNum;
+
+            if(known)
+                continue;
+
+            tiles.append(tileNum);
+
+            int left = (tileNum % TILE_COLUMNS) * RECT_SIZE;
+            int top = (tileNum / TILE_COLUMNS) * RECT_SIZE;
+
+            for(int y=top;y<top+RECT_SIZE;++y)
+                for(int x=left;x<left+RECT_SIZE;++x)
+                    pixels[y * SCREEN_WIDTH + x] = background(x, y);
+
+            for(int k=0;k<200;++k)
+            {
+                int x = left + static_cast<int>(random() % RECT_SIZE);
+                int y = top + static_cast<int>(random() % RECT_SIZE);
+                pixels[y * SCREEN_WIDTH + x] = (random() & 1) ? 0xff000000u : 0xffffffffu;
+            }
+        }
+    }
+};
+
+// stand-in for the WEBP writer: drop low bits by quality, then runs of equal pixels
+static void encodeTile(const BenchScreen &screen, int tileNum, int quality, QByteArray &output)
+{
+    const int shift = qBound(0, (100 - quality) / 20, 4);
+    const quint32 mask = (0xffu << shift) & 0xffu;
+    const quint32 channelMask = mask << 16 | mask << 8 | mask;
+
+    int left = (tileNum % TILE_COLUMNS) * RECT_SIZE;
+    int top = (tileNum / TILE_COLUMNS) * RECT_SIZE;
+
+    output.resize(0);
+
+    for(int y=0;y<RECT_SIZE;++y)
+    {
+        const quint32 *line = screen.pixels.constData() + (top + y) * SCREEN_WIDTH + left;
+        int x = 0;
+
+        while(x < RECT_SIZE)
+        {
+            quint32 pixel = line[x] & channelMask;
+            int run = 1;
+
+            while(x + run < RECT_SIZE && run < 255 && (line[x + run] & channelMask) == pixel)
+                ++run;
+
+            const char entry[4] = {static_cast<char>(run), static_cast<char>(pixel >> 16),
+                                   static_cast<char>(pixel >> 8), static_cast<char>(pixel)};
+            output.append(entry, 4);
+            x += run;
+        }
+    }
+}
+
+// an IMGT packet the way ScreenCapture::sendImage() builds it
+static const QByteArray &tilePacket(const BenchScreen &screen, int tileNum, int quality,
+                                    BufferPool &pool, QByteArray &scratch, quint32 &hash)
+{
+    PacketBuilder packet(pool.acquire());
+    packet.begin(KEY_IMAGE_TILE);
+    packet.appendUint32(static_cast<quint32>((tileNum % TILE_COLUMNS) * RECT_SIZE));
+    packet.appendUint32(static_cast<quint32>((tileNum / TILE_COLUMNS) * RECT_SIZE));
+    packet.appendUint32(static_cast<quint32>(tileNum));
+
+    encodeTile(screen, tileNum, quality, scratch);
+    packet.append(scratch);
+
+    hash = tileHash(scratch.constData(), scratch.size());
+    return packet.finish();
+}
+
+struct BenchViewer
+{
+    ViewerSession       session;
+    SendScheduler       scheduler;
+    BufferPool          batchPool;
+    QVector<QByteArray> batchTiles;
+    BufferPool          encodePool; // per viewer encoding only
+    qint64              sentBytes;
+
+    BenchViewer() : batchPool(BATCH_SIZE_DEFAULT + 16 * 1024), sentBytes(0)
+    {
+        session.reset(TILE_COUNT);
+    }
+
+    void queueTile(quint16 tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq, qint64 nowMs)
+    {
+        session.tileSent(tileNum, hash, frameSeq, nowMs);
+        batchTiles.append(packet);
+    }
+
+    // WebSocketHandler::sendImageBatch() and the socket taking it at once
+    void flush(quint32 frameSeq, qint64 nowMs)
+    {
+        PacketBuilder packet(batchPool.acquire());
+        packet.begin(KEY_IMAGE_BATCH);
+        packet.appendUint32(frameSeq);
+        packet.appendUint16(static_cast<quint16>(batchTiles.size()));
+        packet.appendUint16(BATCH_FLAG_FINAL);
+
+        for(int i=0;i<batchTiles.size();++i)
+        {
+            const QByteArray &tile = batchTiles.at(i);
+            packet.append(tile.constData() + PREAMBLE_SIZE, tile.size() - PREAMBLE_SIZE);
+        }
+
+        batchTiles.resize(0);
+        scheduler.enqueue(SendScheduler::Tile, packet.finish(), nowMs * 1000);
+
+        QByteArray sent;
+        while(scheduler.next(sent, nowMs * 1000))
+            sentBytes += sent.size();
+
+        sent.clear(); // hands the batch buffer back to the pool
+        session.ackFrame(frameSeq, nowMs);
+    }
+};
+
+// microseconds per frame, the bytes each viewer received are added to sentBytes
+static double simulate(int viewerCount, bool encodeOnce, QVector<qint64> &sentBytes)
+{
+    const int quality = STREAM_PROFILES[STREAM_PROFILE_NORMAL].tileQuality;
+
+    BenchScreen screen;
+    QVector<BenchViewer*> viewers;
+
+    TileStore store;
+    store.setGeometry(QSize(SCREEN_WIDTH, SCREEN_HEIGHT), RECT_SIZE, TILE_COUNT);
+    store.setScreen(STREAM_PROFILE_NORMAL, QByteArray(PREAMBLE_SIZE + 8, 's'), 0, 0);
+
+    for(int i=0;i<viewerCount;++i)
+    {
+        viewers.append(new BenchViewer);
+
+        TileStore::Snapshot snapshot;
+        store.addViewer(STREAM_PROFILE_NORMAL, snapshot);
+        viewers.last()->session.screenSent(snapshot.screenHash);
+    }
+
+    BufferPool tilePool(16 * 1024);
+    QByteArray scratch;
+    QVector<quint16> tiles;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int frame=0;frame<FRAME_COUNT;++frame)
+    {
+        const quint32 frameSeq = static_cast<quint32>(frame + 1);
+        const qint64 nowMs = frame * FRAME_MS;
+
+        screen.change(tiles);
+
+        if(encodeOnce)
+        {
+            for(int i=0;i<tiles.size();++i)
+            {
+                quint32 hash;
+                const QByteArray &packet = tilePacket(screen, tiles.at(i), quality, tilePool, scratch, hash);
+                store.setTile(STREAM_PROFILE_NORMAL, tiles.at(i), packet, hash, frameSeq);
+
+                for(int v=0;v<viewers.size();++v)
+                    viewers.at(v)->queueTile(tiles.at(i), packet, hash, frameSeq, nowMs);
+            }
+        }
+        else
+        {
+            for(int v=0;v<viewers.size();++v)
+            {
+                BenchViewer *viewer = viewers.at(v);
+
+                for(int i=0;i<tiles.size();++i)
+                {
+                    quint32 hash;
+                    const QByteArray &packet = tilePacket(screen, tiles.at(i), quality, viewer->encodePool, scratch, hash);
+                    viewer->queueTile(tiles.at(i), packet, hash, frameSeq, nowMs);
+                }
+            }
+        }
+
+        for(int v=0;v<viewers.size();++v)
+            viewers.at(v)->flush(frameSeq, nowMs);
+    }
+
+    double usPerFrame = timer.nsecsElapsed() / 1000.0 / FRAME_COUNT;
+
+    for(int v=0;v<viewers.size();++v)
+    {
+        sentBytes.append(viewers.at(v)->sentBytes);
+        store.removeViewer(STREAM_PROFILE_NORMAL);
+        delete viewers.at(v);
+    }
+
+    return usPerFrame;
+}
+
+int benchFanout(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    const int viewerCounts[] = {1, 2, 4, 8, 16};
+
+    QTextStream out(stdout);
+    out << TILE_COUNT << " tiles, " << DIRTY_TILES << " changed per frame, " << FRAME_COUNT << " frames, us per frame\n";
+
+    int failed = 0;
+    double onceSingle = 0;
+
+    for(int viewerCount : viewerCounts)
+    {
+        QVector<qint64> onceBytes;
+        QVector<qint64> eachBytes;
+
+        double once = simulate(viewerCount, true, onceBytes);
+        double each = simulate(viewerCount, false, eachBytes);
+
+        if(viewerCount == 1)
+            onceSingle = once;
+
+        out << viewerCount << " viewers: encode once " << QString::number(once, 'f', 1)
+            << ", per viewer " << QString::number(each, 'f', 1)
+            << " (" << QString::number(each / qMax(once, 0.001), 'f', 1) << "x), "
+            << onceBytes.at(0) / FRAME_COUNT << " bytes per viewer and frame\n";
+
+        // sharing the packets must not change what a viewer receives
+        for(int v=0;v<viewerCount;++v)
+        {
+            if(onceBytes.at(v) != eachBytes.at(v) || onceBytes.at(v) != onceBytes.at(0))
+            {
+                out << viewerCount << " viewers: viewer " << v << " received different data\n";
+                ++failed;
+                break;
+            }
+        }
+
+        // the encoding is shared, only the batching is paid per viewer
+        if(viewerCount == 8 && once >= 0.5 * viewerCount * onceSingle)
+        {
+            out << viewerCount << " viewers: encode once cost grows linearly with the viewers\n";
+            ++failed;
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,213 @@
+#include "bench.h"
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTextStream>
+#include <QVector>
+
+#ifdef Q_OS_UNIX
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+
+#include "key_map.h"
+#endif
+
+/* Input injection the way InputSimulator did it before and does it now, over
+ * a burst of typing, wheel clicks and pointer moves:
+ *  - reconnect: XOpenDisplay, the XTest call, XFlush and XCloseDisplay per event
+ *  - flush each: one connection, XFlush per event
+ *  - batched: one connection, one XFlush per burst of BURST_EVENTS
+ * Every run ends with an XSync so the server handled all of it. The keysym
+ * lookup is timed on its own, the QMap it was against the flat table.
+ *
+ * Needs an X server, a virtual one does:
+ *   xvfb-run -a QuickViewerBench input
+ * without one the injection part is skipped. */
+
+#ifdef Q_OS_UNIX
+
+static const int EVENT_COUNT    = 3000;
+static const int BURST_EVENTS   = 8;    // what a viewer sends in a frame when typing fast
+static const int LOOKUP_REPEAT  = 20000;
+
+enum InjectMode
+{
+    INJECT_RECONNECT,
+    INJECT_FLUSH_EACH,
+    INJECT_BATCHED
+};
+
+struct InputEvent
+{
+    int kind;       // 0 key, 1 wheel, 2 move
+    quint32 value;  // keysym, button, position
+    bool state;
+};
+
+// typing with a wheel click and a few pointer moves in between
+static QVector<InputEvent> eventMix()
+{
+    QVector<InputEvent> events;
+    events.reserve(EVENT_COUNT);
+
+    for(int i=0;events.size()<EVENT_COUNT;++i)
+    {
+        InputEvent event;
+
+        switch(i % 8)
+        {
+            case 0: case 1: case 2: case 3:
+                event.kind = 0;
+                event.value = XK_a + (i / 8) % 26;
+                event.state = i % 2 == 0;
+                break;
+            case 4: case 5:
+                event.kind = 1;
+                event.value = (i / 8) % 2 ? Button4 : Button5;
+                event.state = i % 2 == 0;
+                break;
+            default:
+                event.kind = 2;
+                event.value = static_cast<quint32>((i * 37) % 640) << 16 | static_cast<quint32>((i * 17) % 480);
+                event.state = false;
+                break;
+        }
+
+        events.append(event);
+    }
+
+    return events;
+}
+
+static void injectEvent(Display *display, const InputEvent &event)
+{
+    if(event.kind == 0)
+        XTestFakeKeyEvent(display, XKeysymToKeycode(display, event.value), event.state ? True : False, 0);
+    else if(event.kind == 1)
+        XTestFakeButtonEvent(display, event.value, event.state ? True : False, 0);
+    else XTestFakeMotionEvent(display, -1, static_cast<int>(event.value >> 16), static_cast<int>(event.value & 0xffff), 0);
+}
+
+// ns for the events, -1 if the display can't be opened
+static qint64 injectEvents(const QVector<InputEvent> &events, InjectMode mode)
+{
+    Display *display = XOpenDisplay(Q_NULLPTR);
+
+    if(!display)
+        return -1;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int i=0;i<events.size();++i)
+    {
+        if(mode == INJECT_RECONNECT)
+        {
+            Display *eventDisplay = XOpenDisplay(Q_NULLPTR);
+            injectEvent(eventDisplay, events.at(i));
+            XFlush(eventDisplay);
+            XCloseDisplay(eventDisplay);
+        }
+        else
+        {
+            injectEvent(display, events.at(i));
+
+            if(mode == INJECT_FLUSH_EACH || (i + 1) % BURST_EVENTS == 0)
+                XFlush(display);
+        }
+    }
+
+    XSync(display, False);
+    qint64 nsecs = timer.nsecsElapsed();
+
+    XCloseDisplay(display);
+    return nsecs;
+}
+
+static void benchLookup(QTextStream &out)
+{
+    QMap<quint16,quint16> keysMap; // as createKeysMap() built it
+    quint32 keySyms[KEY_CODE_COUNT] = {0};
+
+    for(int i=0;i<KEY_MAP_SIZE;++i)
+    {
+        keysMap.insert(KEY_MAP[i].keyCode, static_cast<quint16>(KEY_MAP[i].keySym));
+        keySyms[KEY_MAP[i].keyCode] = KEY_MAP[i].keySym;
+    }
+
+    quint32 mapSum = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int r=0;r<LOOKUP_REPEAT;++r)
+        for(quint16 keyCode=0;keyCode<KEY_CODE_COUNT;++keyCode)
+            if(keysMap.contains(keyCode))
+                mapSum += keysMap.value(keyCode);
+
+    qint64 mapNsecs = timer.nsecsElapsed();
+
+    quint32 tableSum = 0;
+    timer.restart();
+
+    for(int r=0;r<LOOKUP_REPEAT;++r)
+        for(quint16 keyCode=0;keyCode<KEY_CODE_COUNT;++keyCode)
+            tableSum += static_cast<quint16>(keySyms[keyCode]);
+
+    qint64 tableNsecs = timer.nsecsElapsed();
+
+    double lookups = static_cast<double>(LOOKUP_REPEAT) * KEY_CODE_COUNT;
+
+    out << "keysym lookup, QMap:  " << QString::number(mapNsecs / lookups, 'f', 2) << " ns\n";
+    out << "keysym lookup, table: " << QString::number(tableNsecs / lookups, 'f', 2) << " ns"
+        << (mapSum == tableSum ? "" : " (results differ)") << "\n";
+}
+
+int benchInput(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream out(stdout);
+
+    benchLookup(out);
+
+    const QVector<InputEvent> events = eventMix();
+
+    static const char *MODE_NAMES[] = {"reconnect", "flush each", "batched"};
+    qint64 nsecs[3];
+
+    for(int mode=INJECT_RECONNECT;mode<=INJECT_BATCHED;++mode)
+    {
+        nsecs[mode] = injectEvents(events, static_cast<InjectMode>(mode));
+
+        if(nsecs[mode] < 0)
+        {
+            out << "no X display, injection skipped (xvfb-run -a QuickViewerBench input)\n";
+            return 0;
+        }
+
+        out << "inject, " << MODE_NAMES[mode] << ": "
+            << QString::number(nsecs[mode] / 1000.0 / events.size(), 'f', 2) << " us/event, "
+            << QString::number(events.size() * 1000000000.0 / qMax<qint64>(nsecs[mode], 1), 'f', 0) << " events/s\n";
+    }
+
+    // a connection setup less per event has to show
+    if(nsecs[INJECT_BATCHED] >= nsecs[INJECT_RECONNECT])
+    {
+        out << "batched injection isn't faster than a connection per event\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+#else
+
+int benchInput(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream(stdout) << "XTest injection, X11 only\n";
+    return 0;
+}
+
+#endif
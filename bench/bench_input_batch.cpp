@@ -0,0 +1,294 @@
+#include "bench.h"
+#include "histogram.h"
+#include "input_replay.h"
+#include "packet_parser.h"
+#include "protocol.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+
+#include <random>
+
+/* Viewer input as a packet per event against INPB batches.
+ *
+ * Cost: a drag, pointer moves at 250 Hz with a button press now and then,
+ * parsed and decoded the way WebSocketHandler does it, per event on the wire
+ * and in time. Bytes include the WebSocket framing of the viewer's messages,
+ * once per event for single packets.
+ *
+ * Timing: the same drag batched every INPUT_BATCH_INTERVAL_MS over a link of
+ * BASE_DELAY_MS plus random jitter. The events are injected when InputReplay
+ * says they are due, or at arrival if that has passed. An event goes out no
+ * earlier than the one before it, as the input queue would have it. The
+ * spacing error is how far the gap between two injected events is off the gap
+ * between them on the viewer. Injecting at arrival is the comparison. */
+
+static const int    EVENT_COUNT     = 200000;
+static const int    REPEAT          = 10;
+static const int    EVENT_MS        = 4;    // 250 Hz mouse
+static const int    BATCH_EVENTS    = INPUT_BATCH_INTERVAL_MS / EVENT_MS;
+static const qint64 BASE_DELAY_MS   = 40;
+static const qint64 REPLAY_MS       = 60 * 1000;
+
+static void appendUint16(QByteArray &buf, quint16 number)
+{
+    buf.append(static_cast<char>(number));
+    buf.append(static_cast<char>(number >> 8));
+}
+
+static void appendUint32(QByteArray &buf, quint32 number)
+{
+    appendUint16(buf, static_cast<quint16>(number));
+    appendUint16(buf, static_cast<quint16>(number >> 16));
+}
+
+struct DragEvent
+{
+    quint16 type;   // INPUT_*
+    quint16 value1;
+    quint16 value2;
+};
+
+static QVector<DragEvent> dragEvents()
+{
+    QVector<DragEvent> events;
+    events.reserve(EVENT_COUNT);
+
+    for(int i=0;i<EVENT_COUNT;++i)
+    {
+        DragEvent event;
+
+        if(i % 100 == 0 || i % 100 == 99)
+        {
+            event.type = INPUT_MOUSE_KEY;
+            event.value1 = 0;
+            event.value2 = i % 100 == 0 ? 1 : 0;
+        }
+        else
+        {
+            event.type = INPUT_MOVE;
+            event.value1 = static_cast<quint16>(100 + i % 800);
+            event.value2 = static_cast<quint16>(100 + (i / 4) % 600);
+        }
+
+        events.append(event);
+    }
+
+    return events;
+}
+
+static QByteArray singlePacket(const DragEvent &event)
+{
+    QByteArray packet;
+    appendUint32(packet, event.type == INPUT_MOVE ? KEY_SET_CURSOR_POS : KEY_SET_MOUSE_KEY);
+    appendUint32(packet, 4);
+    appendUint16(packet, event.value1);
+    appendUint16(packet, event.value2);
+    return packet;
+}
+
+static QByteArray batchPacket(const QVector<DragEvent> &events, int first, int count)
+{
+    QByteArray packet;
+    appendUint32(packet, KEY_INPUT_BATCH);
+    appendUint32(packet, static_cast<quint32>(INPUT_BATCH_HEADER_SIZE + count * INPUT_EVENT_SIZE));
+    appendUint32(packet, static_cast<quint32>(first * EVENT_MS));
+    appendUint16(packet, static_cast<quint16>(count));
+    appendUint16(packet, 0);
+
+    for(int i=0;i<count;++i)
+    {
+        const DragEvent &event = events.at(first + i);
+        appendUint16(packet, static_cast<quint16>(i * EVENT_MS));
+        appendUint16(packet, event.type);
+        appendUint16(packet, event.value1);
+        appendUint16(packet, event.value2);
+    }
+
+    return packet;
+}
+
+// what WebSocketHandler::newData() hands to the input queue, folded into a sum
+static quint32 dispatch(const PacketParser::Packet &packet)
+{
+    switch(fourCCFromData(packet.command))
+    {
+        case KEY_SET_CURSOR_POS:
+        {
+            CursorPosPayload payload;
+            return payload.decode(packet.payload, packet.size) ? static_cast<quint32>(payload.posX) + payload.posY : 0;
+        }
+        case KEY_SET_MOUSE_KEY:
+        {
+            KeyStatePayload payload;
+            return payload.decode(packet.payload, packet.size) ? static_cast<quint32>(payload.keyCode) + payload.keyState : 0;
+        }
+        case KEY_INPUT_BATCH:
+        {
+            InputBatchPayload payload;
+            if(!payload.decode(packet.payload, packet.size))
+                return 0;
+
+            quint32 sum = 0;
+            InputBatchEvent event;
+
+            for(int i=0;i<payload.count;++i)
+            {
+                event.decode(payload, i);
+                sum += static_cast<quint32>(event.value1) + event.value2;
+            }
+
+            return sum;
+        }
+        default:
+            return 0;
+    }
+}
+
+static qint64 parseMessages(const QVector<QByteArray> &messages, quint32 &sum)
+{
+    PacketParser parser;
+    PacketParser::Packet packet;
+
+    sum = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int r=0;r<REPEAT;++r)
+    {
+        for(int i=0;i<messages.size();++i)
+        {
+            parser.append(messages.at(i));
+
+            while(parser.next(packet))
+                sum += dispatch(packet);
+        }
+    }
+
+    return timer.nsecsElapsed();
+}
+
+static qint64 messageBytes(const QVector<QByteArray> &messages)
+{
+    qint64 bytes = 0;
+
+    // a masked client frame: 2 header bytes, 2 more from 126 bytes on, and the 4 byte mask
+    for(int i=0;i<messages.size();++i)
+        bytes += messages.at(i).size() + (messages.at(i).size() < 126 ? 6 : 8);
+
+    return bytes;
+}
+
+struct ReplayResult
+{
+    Histogram spacingError;     // ms
+    Histogram addedDelay;       // ms over the link's base delay
+};
+
+static void replay(qint64 jitterMs, bool timed, ReplayResult &result)
+{
+    std::mt19937 random(7);
+    InputReplay inputReplay;
+
+    const qint64 clockOffsetMs = 123456; // host minus viewer clock
+    const int eventCount = static_cast<int>(REPLAY_MS / EVENT_MS);
+
+    qint64 lastInjectedMs = 0;
+    qint64 lastViewerMs = -1;
+
+    for(int first=0;first<eventCount;first+=BATCH_EVENTS)
+    {
+        const qint64 baseMs = first * EVENT_MS;
+        const int spanMs = (BATCH_EVENTS - 1) * EVENT_MS;
+        const qint64 jitter = jitterMs > 0 ? static_cast<qint64>(random() % (jitterMs + 1)) : 0;
+        const qint64 arrivalMs = baseMs + spanMs + clockOffsetMs + BASE_DELAY_MS + jitter;
+
+        inputReplay.batchArrived(static_cast<quint32>(baseMs), spanMs, arrivalMs);
+
+        for(int i=0;i<BATCH_EVENTS;++i)
+        {
+            const qint64 viewerMs = baseMs + i * EVENT_MS;
+            const qint64 dueMs = timed ? inputReplay.dueMs(i * EVENT_MS) : 0;
+            const qint64 injectedMs = qMax(qMax(dueMs, arrivalMs), lastInjectedMs);
+
+            if(lastViewerMs >= 0)
+                result.spacingError.add(static_cast<quint64>(qAbs((injectedMs - lastInjectedMs) - (viewerMs - lastViewerMs))));
+
+            result.addedDelay.add(static_cast<quint64>(injectedMs - (viewerMs + clockOffsetMs + BASE_DELAY_MS)));
+
+            lastInjectedMs = injectedMs;
+            lastViewerMs = viewerMs;
+        }
+    }
+}
+
+int benchInputBatch(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream out(stdout);
+    int failed = 0;
+
+    const QVector<DragEvent> events = dragEvents();
+
+    QVector<QByteArray> singles;
+    QVector<QByteArray> batches;
+    singles.reserve(events.size());
+
+    for(int i=0;i<events.size();++i)
+        singles.append(singlePacket(events.at(i)));
+
+    for(int i=0;i<events.size();i+=BATCH_EVENTS)
+        batches.append(batchPacket(events, i, qMin(BATCH_EVENTS, events.size() - i)));
+
+    quint32 singleSum = 0;
+    quint32 batchSum = 0;
+    const qint64 singleNsecs = parseMessages(singles, singleSum);
+    const qint64 batchNsecs = parseMessages(batches, batchSum);
+    const double dispatched = static_cast<double>(events.size()) * REPEAT;
+
+    out << "packet per event: " << QString::number(static_cast<double>(messageBytes(singles)) / events.size(), 'f', 1) << " bytes/event, "
+        << singles.size() << " messages, " << QString::number(singleNsecs / dispatched, 'f', 1) << " ns/event\n";
+    out << "batches of " << BATCH_EVENTS << ":     " << QString::number(static_cast<double>(messageBytes(batches)) / events.size(), 'f', 1) << " bytes/event, "
+        << batches.size() << " messages, " << QString::number(batchNsecs / dispatched, 'f', 1) << " ns/event\n";
+
+    if(singleSum != batchSum)
+    {
+        out << "decoded events differ: " << singleSum << " != " << batchSum << "\n";
+        ++failed;
+    }
+
+    out << "replay of a " << EVENT_MS << " ms drag, batches every " << INPUT_BATCH_INTERVAL_MS << " ms, "
+        << BASE_DELAY_MS << " ms link, spacing error and added delay in ms (count mean p50 p90 p99 max)\n";
+
+    const qint64 JITTERS[] = {0, 10, 30};
+
+    for(int j=0;j<3;++j)
+    {
+        ReplayResult atArrival;
+        ReplayResult timed;
+        replay(JITTERS[j], false, atArrival);
+        replay(JITTERS[j], true, timed);
+
+        out << "  jitter " << JITTERS[j] << " ms\n";
+        out << "    at arrival: spacing " << atArrival.spacingError.summary() << ", delay " << atArrival.addedDelay.summary() << "\n";
+        out << "    replayed:   spacing " << timed.spacingError.summary() << ", delay " << timed.addedDelay.summary() << "\n";
+
+        // once the jitter is measured every gap comes out as it was made
+        if(timed.spacingError.percentile(99) > 1)
+        {
+            out << "jitter " << JITTERS[j] << " ms: replayed spacing off by " << timed.spacingError.percentile(99) << " ms at p99\n";
+            ++failed;
+        }
+
+        if(timed.addedDelay.max() > static_cast<quint64>(InputReplay::MAX_PLAYOUT_MS + JITTERS[j]))
+        {
+            out << "jitter " << JITTERS[j] << " ms: an event was held " << timed.addedDelay.max() << " ms\n";
+            ++failed;
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,380 @@
+#include "bench.h"
+#include "histogram.h"
+#include "send_scheduler.h"
+#include "stream_profile.h"
+#include "viewer_session.h"
+
+#include <QFile>
+#include <QQueue>
+#include <QTextStream>
+#include <QVector>
+
+#include <random>
+
+/* The quality ladder of one viewer replayed over link capacity traces, in
+ * virtual time at 1 ms steps so the numbers are repeatable. The link drains
+ * a socket window like WebSocketHandler's, frame acks come back a round trip
+ * after a frame's last byte went over the link. The stream is typing with a
+ * scroll burst every 5 s, on a congested link frames are skipped and their
+ * bytes go out with the next frame, a profile switch costs a full screen.
+ *
+ * Built in traces:
+ *  - step: 8 Mbit/s, 1 Mbit/s from 20 s to 60 s, 8 Mbit/s again
+ *  - oscillating: 2 and 6 Mbit/s, alternating every 5 s
+ *  - cellular: 3G like random walk between 0.3 and 3 Mbit/s, 150 ms rtt
+ *
+ *   QuickViewerBench ladder [--trace=file] [--rtt=ms]
+ * replays a trace file instead, lines of "ms kbit/s". */
+
+static const qint64 FRAME_MS            = 100;
+static const qint64 SOCKET_WINDOW       = SendScheduler::SEND_WINDOW;
+static const qint64 SCREEN_BYTES        = 150 * 1024;   // full screen image on "normal"
+static const int    MAX_SWITCHES_PER_MIN = 6;
+
+struct TracePoint
+{
+    qint64 ms;
+    qint64 bytesPerSecond;
+};
+
+struct LinkTrace
+{
+    QString             name;
+    QVector<TracePoint> points;
+    qint64              rttMs;
+    qint64              durationMs;
+
+    qint64 bytesPerSecond(qint64 ms) const
+    {
+        qint64 rate = points.isEmpty() ? 0 : points.first().bytesPerSecond;
+
+        for(int i=0;i<points.size() && points.at(i).ms <= ms;++i)
+            rate = points.at(i).bytesPerSecond;
+
+        return rate;
+    }
+
+    void append(qint64 ms, qint64 kbps)
+    {
+        TracePoint point;
+        point.ms = ms;
+        point.bytesPerSecond = kbps * 1000 / 8;
+        points.append(point);
+    }
+};
+
+static LinkTrace stepTrace()
+{
+    LinkTrace trace;
+    trace.name = "step";
+    trace.rttMs = 40;
+    trace.durationMs = 120 * 1000;
+    trace.append(0, 8000);
+    trace.append(20 * 1000, 1000);
+    trace.append(60 * 1000, 8000);
+    return trace;
+}
+
+static LinkTrace oscillatingTrace()
+{
+    LinkTrace trace;
+    trace.name = "oscillating";
+    trace.rttMs = 60;
+    trace.durationMs = 120 * 1000;
+
+    for(qint64 ms=0;ms<trace.durationMs;ms+=5000)
+        trace.append(ms, (ms / 5000) % 2 ? 6000 : 2000);
+
+    return trace;
+}
+
+static LinkTrace cellularTrace()
+{
+    LinkTrace trace;
+    trace.name = "cellular";
+    trace.rttMs = 150;
+    trace.durationMs = 120 * 1000;
+
+    std::mt19937 random(3);
+    qint64 kbps = 1500;
+
+    for(qint64 ms=0;ms<trace.durationMs;ms+=500)
+    {
+        kbps = qBound<qint64>(300, kbps + static_cast<qint64>(random() % 601) - 300, 3000);
+        trace.append(ms, kbps);
+    }
+
+    return trace;
+}
+
+static bool loadTrace(const QString &fileName, qint64 rttMs, LinkTrace &trace)
+{
+    QFile file(fileName);
+
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    trace.name = fileName;
+    trace.rttMs = rttMs;
+    trace.points.clear();
+
+    QTextStream in(&file);
+
+    while(!in.atEnd())
+    {
+        QStringList fields = in.readLine().simplified().split(' ');
+
+        if(fields.size() < 2 || fields.at(0).startsWith('#'))
+            continue;
+
+        trace.append(fields.at(0).toLongLong(), fields.at(1).toLongLong());
+    }
+
+    if(trace.points.isEmpty())
+        return false;
+
+    trace.durationMs = trace.points.last().ms + 1000;
+    return true;
+}
+
+// bytes of a frame on the "normal" rung, typing with a second of scrolling every 5 s
+static qint64 contentBytes(int frame)
+{
+    return frame % 50 < 10 ? 52 * 1024 : 12 * 1024;
+}
+
+struct SimulationResult
+{
+    int         switches;
+    qint64      rungMs[STREAM_PROFILE_COUNT];
+    QVector<int> rungPerSecond;
+    qint64      capacityBytes;
+    qint64      deliveredBytes;
+    int         frameCount;
+    int         skippedFrames;
+    Histogram   queueDelay; // ms from queueing a frame until its last byte went over the link
+};
+
+struct QueuedFrame
+{
+    quint32 frameSeq;
+    qint64  endOffset;  // of its last byte in everything queued
+    qint64  queuedMs;
+};
+
+struct PendingAck
+{
+    qint64  arrivalMs;
+    quint32 frameSeq;
+};
+
+static void simulate(const LinkTrace &trace, SimulationResult &result)
+{
+    ViewerSession session(STREAM_PROFILE_HIGH, STREAM_PROFILE_NORMAL);
+    session.reset(1);
+
+    result.switches = 0;
+    result.rungPerSecond.resize(0);
+    result.capacityBytes = 0;
+    result.deliveredBytes = 0;
+    result.frameCount = 0;
+    result.skippedFrames = 0;
+    result.queueDelay.clear();
+
+    for(int i=0;i<STREAM_PROFILE_COUNT;++i)
+        result.rungMs[i] = 0;
+
+    QQueue<QueuedFrame> frames;
+    QQueue<PendingAck> acks;
+
+    qint64 schedulerBytes = 0;  // waiting for the socket window
+    qint64 inFlightBytes = 0;   // in the window
+    qint64 queuedTotal = 0;
+    qint64 linkCredit = 0;      // bytes * 1000
+    qint64 owedBytes = 0;       // skipped frames and switch images, go out with the next frame
+    quint32 frameSeq = 0;
+
+    for(qint64 nowMs=0;nowMs<trace.durationMs;++nowMs)
+    {
+        while(!acks.isEmpty() && acks.head().arrivalMs <= nowMs)
+            session.ackFrame(acks.dequeue().frameSeq, nowMs);
+
+        // the link
+        const qint64 bytesPerSecond = trace.bytesPerSecond(nowMs);
+        linkCredit += bytesPerSecond;
+        result.capacityBytes += bytesPerSecond / 1000;
+
+        qint64 sent = qMin(inFlightBytes, linkCredit / 1000);
+        linkCredit = inFlightBytes > sent ? linkCredit % 1000 : 0; // an idle link saves nothing up
+        inFlightBytes -= sent;
+        result.deliveredBytes += sent;
+
+        if(sent > 0)
+            session.bytesDrained(sent, schedulerBytes > 0, nowMs);
+
+        qint64 moved = qMin(schedulerBytes, SOCKET_WINDOW - inFlightBytes);
+        schedulerBytes -= moved;
+        inFlightBytes += moved;
+
+        const qint64 deliveredOffset = queuedTotal - schedulerBytes - inFlightBytes;
+
+        while(!frames.isEmpty() && frames.head().endOffset <= deliveredOffset)
+        {
+            QueuedFrame frame = frames.dequeue();
+            result.queueDelay.add(static_cast<quint64>(nowMs - frame.queuedMs));
+
+            PendingAck ack;
+            ack.arrivalMs = nowMs + trace.rttMs;
+            ack.frameSeq = frame.frameSeq;
+            acks.enqueue(ack);
+        }
+
+        // a frame, the way WebSocketHandler::flushImageBatch() handles it
+        if(nowMs % FRAME_MS == 0)
+        {
+            const int profile = session.profile();
+            const qint64 queuedBytes = schedulerBytes + inFlightBytes;
+            const bool backlogged = schedulerBytes > 0;
+            const qint64 content = contentBytes(result.frameCount++) * STREAM_PROFILES[profile].relativeCost / 100;
+
+            qint64 frameBytes = 0;
+
+            if(session.isCongested())
+            {
+                // the store keeps the latest tiles, at most a screen is owed
+                owedBytes = qMin(owedBytes + content, SCREEN_BYTES * STREAM_PROFILES[profile].relativeCost / 100);
+                ++result.skippedFrames;
+            }
+            else
+            {
+                frameBytes = content + owedBytes;
+                owedBytes = 0;
+            }
+
+            if(session.updateCongestion(queuedBytes, frameBytes, nowMs))
+            {
+                ++result.switches;
+                owedBytes = SCREEN_BYTES * STREAM_PROFILES[session.profile()].relativeCost / 100;
+            }
+
+            if(frameBytes > 0)
+            {
+                schedulerBytes += frameBytes;
+                queuedTotal += frameBytes;
+
+                QueuedFrame frame;
+                frame.frameSeq = ++frameSeq;
+                frame.endOffset = queuedTotal;
+                frame.queuedMs = nowMs;
+                frames.enqueue(frame);
+
+                session.frameSent(frameSeq, frameBytes, backlogged, nowMs);
+            }
+        }
+
+        ++result.rungMs[session.profile()];
+
+        if(nowMs % 1000 == 0)
+            result.rungPerSecond.append(session.profile());
+    }
+}
+
+static void printResult(QTextStream &out, const LinkTrace &trace, const SimulationResult &result)
+{
+    out << trace.name << ": " << result.switches << " switches,";
+
+    for(int i=0;i<STREAM_PROFILE_COUNT;++i)
+        out << " " << STREAM_PROFILES[i].name << " "
+            << QString::number(100.0 * result.rungMs[i] / trace.durationMs, 'f', 0) << "%";
+
+    out << ", link used " << QString::number(100.0 * result.deliveredBytes / qMax<qint64>(1, result.capacityBytes), 'f', 0) << "%"
+        << ", skipped " << result.skippedFrames << "/" << result.frameCount << " frames\n";
+    out << "  queue delay (ms) " << result.queueDelay.summary() << "\n";
+
+    out << "  rung per 5 s:";
+    for(int i=0;i<result.rungPerSecond.size();i+=5)
+        out << " " << result.rungPerSecond.at(i);
+    out << "\n";
+}
+
+int benchLadder(const QStringList &args)
+{
+    QTextStream out(stdout);
+
+    QVector<LinkTrace> traces;
+    QString traceFile;
+    qint64 rttMs = 80;
+
+    for(int i=0;i<args.size();++i)
+    {
+        if(args.at(i).startsWith("--trace="))
+            traceFile = args.at(i).mid(8);
+        else if(args.at(i).startsWith("--rtt="))
+            rttMs = args.at(i).mid(6).toLongLong();
+    }
+
+    if(!traceFile.isEmpty())
+    {
+        LinkTrace trace;
+
+        if(!loadTrace(traceFile, rttMs, trace))
+        {
+            out << "can't read trace " << traceFile << "\n";
+            return 1;
+        }
+
+        traces.append(trace);
+    }
+    else
+    {
+        traces.append(stepTrace());
+        traces.append(oscillatingTrace());
+        traces.append(cellularTrace());
+    }
+
+    out << "frames every " << FRAME_MS << " ms, " << contentBytes(10) / 1024 << " KB typing, " << contentBytes(0) / 1024
+        << " KB scrolling on \"normal\", rungs best first:";
+    for(int i=0;i<STREAM_PROFILE_COUNT;++i)
+        out << " " << i << "=" << STREAM_PROFILES[i].name;
+    out << "\n";
+
+    int failed = 0;
+
+    for(int t=0;t<traces.size();++t)
+    {
+        const LinkTrace &trace = traces.at(t);
+
+        SimulationResult result;
+        simulate(trace, result);
+        printResult(out, trace, result);
+
+        // a ladder that flaps costs a full screen per switch
+        if(result.switches * 60 * 1000 > MAX_SWITCHES_PER_MIN * trace.durationMs)
+        {
+            out << trace.name << ": over " << MAX_SWITCHES_PER_MIN << " switches per minute\n";
+            ++failed;
+        }
+
+        if(trace.name != "step")
+            continue;
+
+        // down within 5 s of the drop, back on the top rung before the end
+        for(int s=25;s<60;++s)
+        {
+            if(result.rungPerSecond.at(s) < STREAM_PROFILE_LOW)
+            {
+                out << "step: still on " << STREAM_PROFILES[result.rungPerSecond.at(s)].name << " at " << s << " s\n";
+                ++failed;
+                break;
+            }
+        }
+
+        if(result.rungPerSecond.last() != STREAM_PROFILE_HIGH)
+        {
+            out << "step: ended on " << STREAM_PROFILES[result.rungPerSecond.last()].name << " after the link recovered\n";
+            ++failed;
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,57 @@
+#include "bench.h"
+
+#include <QCoreApplication>
+#include <QTextStream>
+
+struct BenchEntry
+{
+    const char *name;
+    int (*run)(const QStringList &args);
+};
+
+static const BenchEntry BENCHMARKS[] =
+{
+    {"parser", benchParser},
+    {"dispatch", benchDispatch},
+    {"scheduler", benchScheduler},
+    {"fanout", benchFanout},
+    {"ladder", benchLadder},
+    {"input", benchInput},
+    {"inputbatch", benchInputBatch},
+    {"metrics", benchMetrics},
+    {"recorder", benchRecorder},
+    {"resume", benchResume},
+    {"trace", benchTrace}
+};
+
+static const int BENCHMARK_COUNT = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList args = app.arguments().mid(1);
+    QStringList names;
+
+    for(int i=0;i<args.size();++i)
+        if(!args.at(i).startsWith("--"))
+            names.append(args.at(i));
+
+    int result = 0;
+
+    for(int i=0;i<BENCHMARK_COUNT;++i)
+    {
+        if(!names.isEmpty() && !names.contains(BENCHMARKS[i].name))
+            continue;
+
+        QTextStream(stdout) << "== " << BENCHMARKS[i].name << " ==" << "\n";
+
+        if(BENCHMARKS[i].run(args) != 0)
+        {
+            QTextStream(stdout) << BENCHMARKS[i].name << ": FAILED" << "\n";
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,148 @@
+#include "bench.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "protocol.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+/* What recording a metric costs the capture and the handler threads.
+ *
+ * Single thread: a plain Histogram against the shared MetricHistogram and
+ * MetricCounter, the capture records about a dozen values per frame plus one
+ * per compared tile. Contended: WRITER_COUNTS threads adding to the same
+ * histogram at once, the worst case of several handlers acking together. The
+ * count must come out exact, relaxed adds lose nothing. Then the cost of a
+ * scrape with everything filled, and that its text adds up. */
+
+static const int ADDS           = 4000000;
+static const int WRITER_COUNTS[] = {2, 4};
+
+// spread over a few buckets like frame times in us would be
+static quint64 sampleValue(int i)
+{
+    return 2000 + static_cast<quint64>((i * 2654435761u) >> 20);
+}
+
+class MetricWriter : public QThread
+{
+public:
+    MetricWriter(MetricHistogram *histogram, int adds) : m_histogram(histogram), m_adds(adds) {}
+
+protected:
+    void run()
+    {
+        for(int i=0;i<m_adds;++i)
+            m_histogram->add(sampleValue(i));
+    }
+
+private:
+    MetricHistogram *m_histogram;
+    int              m_adds;
+};
+
+static double nsPerAdd(qint64 nsecs, int adds)
+{
+    return static_cast<double>(nsecs) / adds;
+}
+
+int benchMetrics(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream out(stdout);
+    int failed = 0;
+
+    QElapsedTimer timer;
+
+    Histogram plain;
+    timer.start();
+    for(int i=0;i<ADDS;++i)
+        plain.add(sampleValue(i));
+    const qint64 plainNsecs = timer.nsecsElapsed();
+
+    MetricHistogram shared;
+    timer.start();
+    for(int i=0;i<ADDS;++i)
+        shared.add(sampleValue(i));
+    const qint64 sharedNsecs = timer.nsecsElapsed();
+
+    MetricCounter counter;
+    timer.start();
+    for(int i=0;i<ADDS;++i)
+        counter.add(sampleValue(i));
+    const qint64 counterNsecs = timer.nsecsElapsed();
+
+    out << "single thread, ns per add: Histogram " << QString::number(nsPerAdd(plainNsecs, ADDS), 'f', 1)
+        << ", MetricHistogram " << QString::number(nsPerAdd(sharedNsecs, ADDS), 'f', 1)
+        << ", MetricCounter " << QString::number(nsPerAdd(counterNsecs, ADDS), 'f', 1) << "\n";
+
+    if(shared.count() != plain.count() || shared.bucket(Histogram::bucketIndex(sampleValue(0))) == 0)
+    {
+        out << "MetricHistogram holds " << shared.count() << " values, Histogram " << plain.count() << "\n";
+        ++failed;
+    }
+
+    for(int w=0;w<static_cast<int>(sizeof(WRITER_COUNTS) / sizeof(WRITER_COUNTS[0]));++w)
+    {
+        const int writers = WRITER_COUNTS[w];
+        const int adds = ADDS / writers;
+
+        MetricHistogram contended;
+        QVector<MetricWriter*> threads;
+
+        for(int i=0;i<writers;++i)
+            threads.append(new MetricWriter(&contended, adds));
+
+        timer.start();
+
+        for(int i=0;i<writers;++i)
+            threads.at(i)->start();
+
+        for(int i=0;i<writers;++i)
+            threads.at(i)->wait();
+
+        const qint64 nsecs = timer.nsecsElapsed();
+        qDeleteAll(threads);
+
+        out << writers << " threads on one histogram: " << QString::number(nsPerAdd(nsecs, adds), 'f', 1)
+            << " ns per add and thread\n";
+
+        if(contended.count() != static_cast<quint64>(adds) * writers)
+        {
+            out << writers << " threads: " << contended.count() << " values of " << static_cast<quint64>(adds) * writers << "\n";
+            ++failed;
+        }
+    }
+
+    Metrics metrics;
+
+    for(int i=0;i<100000;++i)
+    {
+        metrics.captureUs.add(sampleValue(i));
+        metrics.diffTileNs.add(sampleValue(i) * 10);
+        metrics.ackRttMs.add(sampleValue(i) / 50);
+        metrics.sentBytes[i % Metrics::PACKET_TYPE_COUNT].add(100);
+    }
+
+    metrics.sentBytes[Metrics::packetType(KEY_IMAGE_BATCH)].add(1);
+
+    QByteArray text;
+    timer.start();
+    for(int i=0;i<100;++i)
+        text = metrics.prometheusText();
+    const qint64 scrapeNsecs = timer.nsecsElapsed();
+
+    out << "scrape: " << text.size() << " bytes in " << QString::number(scrapeNsecs / 100 / 1000.0, 'f', 1) << " us\n";
+
+    if(!text.contains("qv_capture_seconds_count 100000\n") || !text.contains("qv_capture_seconds_bucket{le=\"+Inf\"} 100000\n")
+       || !text.contains("command=\"IMGB\"} "))
+    {
+        out << "scrape text is missing the values put in\n";
+        ++failed;
+    }
+
+    return failed;
+}
@@ -0,0 +1,218 @@
+#include "bench.h"
+#include "packet_parser.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+
+#include <random>
+
+/* Inbound parse throughput over a typical viewer stream (mostly mouse moves),
+ * delivered whole, coalesced like the proxy does, and split at random points.
+ * Every run checks that each packet comes out intact, the random splits and
+ * a final round of random garbage double as a fuzz pass. */
+
+static const char *COMMANDS[] = {"SCUP", "SCUP", "SCUP", "SCUD", "SKST", "SMKS", "TLRD", "SARQ"};
+static const int COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+static void appendUint32(QByteArray &buf, quint32 number)
+{
+    buf.append(static_cast<char>(number));
+    buf.append(static_cast<char>(number >> 8));
+    buf.append(static_cast<char>(number >> 16));
+    buf.append(static_cast<char>(number >> 24));
+}
+
+static quint32 checksum(quint32 sum, const char *data, int size)
+{
+    for(int i=0;i<size;++i)
+        sum = (sum ^ static_cast<quint8>(data[i])) * 16777619u; // FNV-1a
+
+    return sum;
+}
+
+struct ParseResult
+{
+    qint64  nsecs;
+    quint32 packets;
+    quint32 checksum;
+};
+
+static ParseResult parseMessages(const QVector<QByteArray> &messages, int repeat)
+{
+    ParseResult result = {0, 0, 2166136261u};
+    PacketParser parser;
+    PacketParser::Packet packet;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int r=0;r<repeat;++r)
+    {
+        for(int i=0;i<messages.size();++i)
+        {
+            parser.append(messages.at(i));
+
+            while(parser.next(packet))
+            {
+                ++result.packets;
+
+                if(r == 0)
+                {
+                    result.checksum = checksum(result.checksum, packet.command, PacketParser::COMMAND_SIZE);
+                    result.checksum = checksum(result.checksum, packet.payload, packet.size);
+                }
+            }
+        }
+    }
+
+    result.nsecs = timer.nsecsElapsed();
+    return result;
+}
+
+int benchParser(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    const int packetCount = 200000;
+    const int repeat = 10;
+
+    std::mt19937 random(2019);
+
+    // one message per packet, like the browser sends them
+    QVector<QByteArray> whole;
+    whole.reserve(packetCount);
+
+    QByteArray stream;
+    quint32 expectedChecksum = 2166136261u;
+
+    for(int i=0;i<packetCount;++i)
+    {
+        const char *command = COMMANDS[random() % COMMAND_COUNT];
+        int payloadSize = (command[1] == 'A') ? 16 : 4;
+
+        QByteArray message(command, PacketParser::COMMAND_SIZE);
+        appendUint32(message, static_cast<quint32>(payloadSize));
+
+        for(int k=0;k<payloadSize;++k)
+            message.append(static_cast<char>(random()));
+
+        expectedChecksum = checksum(expectedChecksum, message.constData(), PacketParser::COMMAND_SIZE);
+        expectedChecksum = checksum(expectedChecksum, message.constData() + PacketParser::HEADER_SIZE, payloadSize);
+
+        whole.append(message);
+        stream.append(message);
+    }
+
+    // several packets per message, the proxy batches whatever is queued
+    QVector<QByteArray> coalesced;
+    for(int i=0;i<whole.size();)
+    {
+        int count = 1 + static_cast<int>(random() % 16);
+        QByteArray message;
+
+        for(int k=0;k<count && i<whole.size();++k,++i)
+            message.append(whole.at(i));
+
+        coalesced.append(message);
+    }
+
+    // arbitrary fragmentation
+    QVector<QByteArray> fragmented;
+    for(int pos=0;pos<stream.size();)
+    {
+        int size = 1 + static_cast<int>(random() % 64);
+        fragmented.append(stream.mid(pos, size));
+        pos += size;
+    }
+
+    struct Workload
+    {
+        const char *name;
+        const QVector<QByteArray> *messages;
+    };
+
+    const Workload workloads[] =
+    {
+        {"whole", &whole},
+        {"coalesced", &coalesced},
+        {"fragmented", &fragmented}
+    };
+
+    int failed = 0;
+    QTextStream out(stdout);
+
+    for(const Workload &workload : workloads)
+    {
+        ParseResult result = parseMessages(*workload.messages, repeat);
+        quint32 expectedPackets = static_cast<quint32>(packetCount * repeat);
+
+        double seconds = result.nsecs / 1e9;
+        double mbytes = static_cast<double>(stream.size()) * repeat / (1024.0 * 1024.0);
+
+        out << workload.name << ": "
+            << QString::number(result.packets / seconds / 1e6, 'f', 2) << " Mpackets/s, "
+            << QString::number(mbytes / seconds, 'f', 1) << " MB/s, "
+            << QString::number(static_cast<double>(result.nsecs) / result.packets, 'f', 1) << " ns/packet\n";
+
+        if(result.packets != expectedPackets || result.checksum != expectedChecksum)
+        {
+            out << workload.name << ": packet mismatch, " << result.packets << " of " << expectedPackets << "\n";
+            ++failed;
+        }
+    }
+
+    // garbage must fail the parser without growing the buffer, and clear() start it over
+    PacketParser parser;
+    PacketParser::Packet packet;
+    int garbageFailures = 0;
+
+    for(int i=0;i<100000;++i)
+    {
+        QByteArray message;
+        int size = static_cast<int>(random() % 128);
+
+        for(int k=0;k<size;++k)
+            message.append(static_cast<char>(random() % 4 == 0 ? 'A' + random() % 26 : random()));
+
+        parser.append(message);
+        while(parser.next(packet)) {}
+
+        if(parser.hasFailed())
+        {
+            if(parser.bufferedSize() != 0)
+                ++failed;
+
+            ++garbageFailures;
+            parser.clear();
+        }
+    }
+
+    out << "garbage: " << garbageFailures << " failures, " << parser.errorCount() << " errors, buffered "
+        << parser.bufferedSize() << " bytes\n";
+
+    if(garbageFailures == 0 || parser.bufferedSize() > static_cast<int>(PacketParser::MAX_PAYLOAD_SIZE) + PacketParser::HEADER_SIZE + 128)
+        ++failed;
+
+    // a failed parser takes nothing more until it is cleared, lower case is no command
+    parser.clear();
+    parser.append(QByteArray("scup\x04\0\0\0abcd", 12));
+    parser.append(stream);
+
+    if(parser.next(packet) || !parser.hasFailed() || parser.bufferedSize() != 0)
+    {
+        out << "garbage: parser went on after a bad header\n";
+        ++failed;
+    }
+
+    parser.clear();
+    parser.append(stream);
+
+    if(!parser.next(packet) || parser.hasFailed())
+    {
+        out << "garbage: parser did not start over after clear()\n";
+        ++failed;
+    }
+
+    return failed;
+}
@@ -0,0 +1,197 @@
+#include "bench.h"
+#include "host_packet_reader.h"
+#include "protocol.h"
+#include "session_recorder.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+/* What recording a session (QV_RECORD_DIR) costs the handler thread per
+ * message, for a mix like a streaming session's: acks and input in, image
+ * batches out. Then the recording is read back, while still open as after a
+ * host crash and once closed with its index, and must give every message.
+ * A session through the proxy, from the host's registration on, must split
+ * into the host's packets without errors. */
+
+static const int MESSAGES = 40000;
+
+static int messageSize(int i)
+{
+    return i % 4 == 0 ? 24 * 1024 + (i % 7) * 1024 : 12 + i % 16; // a batch, or an ack or input batch
+}
+
+static bool readAll(SessionRecording &recording, int expected, const QByteArray &fill)
+{
+    SessionRecording::Record record;
+    qint64 lastUs = 0;
+    int count = 0;
+
+    while(recording.next(record))
+    {
+        if(record.size != messageSize(count) || record.outbound != (count % 4 == 0) ||
+           record.timeUs < lastUs || record.data[record.size - 1] != fill.at(record.size - 1))
+            return false;
+
+        lastUs = record.timeUs;
+        ++count;
+    }
+
+    return count == expected;
+}
+
+static QByteArray hostPacket(quint32 command, const QByteArray &payload)
+{
+    QByteArray packet;
+    appendFourCC(packet, KEY_PKT_HEADR);
+    appendFourCC(packet, command);
+    appendFourCC(packet, static_cast<quint32>(payload.size()));
+    packet.append(payload);
+    return packet;
+}
+
+// as WebSocketHandler talks to the proxy: the text registration, the proxy's answer, a viewer's handshake
+static bool readsProxySession(const QString &path)
+{
+    SessionRecorder recorder;
+
+    if(!recorder.open(path))
+        return false;
+
+    QByteArray registration;
+    appendFourCC(registration, KEY_PKT_HEADR);
+    appendFourCC(registration, KEY_REGISTER);
+    registration.append("|123456789|" + QByteArray::number(CLIENT_VERSION) + "|");
+
+    QByteArray registered;
+    appendFourCC(registered, KEY_REGISTER);
+    appendFourCC(registered, 9);
+    registered.append("123456789");
+
+    QByteArray imageParams;
+    appendFourCC(imageParams, 1920);
+    appendFourCC(imageParams, 1080);
+
+    const QByteArray nonce = hostPacket(KEY_SET_NONCE, QByteArray(16, 'n'));
+    const QByteArray params = hostPacket(KEY_IMAGE_PARAM, imageParams);
+
+    recorder.record(true, SessionFile::Binary, registration.constData(), registration.size());
+    recorder.record(false, SessionFile::Binary, registered.constData(), registered.size());
+    recorder.record(true, SessionFile::Binary, nonce.constData(), nonce.size());
+    recorder.record(true, SessionFile::Binary, params.constData(), params.size());
+    recorder.close();
+
+    SessionRecording recording;
+
+    if(!recording.open(path))
+        return false;
+
+    HostPacketReader reader;
+    SessionRecording::Record record;
+    HostPacketReader::Packet packet;
+    int packets = 0;
+
+    while(recording.next(record))
+    {
+        if(!record.outbound)
+            continue;
+
+        if(!reader.append(record.data, record.size))
+            return false;
+
+        while(reader.next(packet))
+            ++packets;
+    }
+
+    recording.close();
+    return reader.errorCount() == 0 && reader.registrationCount() == 1 && packets == 2;
+}
+
+int benchRecorder(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream out(stdout);
+    int failed = 0;
+
+    const QString path = QDir::temp().filePath("quickviewer-bench.qvsr");
+    QByteArray fill(32 * 1024, 0);
+
+    for(int i=0;i<fill.size();++i)
+        fill[i] = static_cast<char>(i * 31);
+
+    SessionRecorder recorder;
+
+    if(!recorder.open(path))
+    {
+        out << "can't write " << path << "\n";
+        return 1;
+    }
+
+    quint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int i=0;i<MESSAGES;++i)
+    {
+        recorder.record(i % 4 == 0, SessionFile::Binary, fill.constData(), messageSize(i));
+        bytes += static_cast<quint64>(messageSize(i));
+    }
+
+    const qint64 nsecs = timer.nsecsElapsed();
+
+    out << "ns per message: " << QString::number(static_cast<double>(nsecs) / MESSAGES, 'f', 0)
+        << ", " << QString::number(bytes / 1048576.0 / (nsecs / 1e9), 'f', 0) << " MB/s, "
+        << recorder.size() / 1048576 << " MB\n";
+
+    // as a crashed host leaves it, without an index
+    SessionRecording recording;
+
+    if(!recording.open(path) || recording.isComplete() || !readAll(recording, MESSAGES, fill))
+    {
+        out << "a recording still open doesn't read back\n";
+        ++failed;
+    }
+
+    recording.close();
+    recorder.close();
+
+    if(!recording.open(path) || !recording.isComplete() || recording.recordCount() != static_cast<quint32>(MESSAGES))
+    {
+        out << "the closed recording has no index\n";
+        ++failed;
+    }
+
+    timer.restart();
+
+    if(!readAll(recording, MESSAGES, fill))
+    {
+        out << "the closed recording doesn't read back\n";
+        ++failed;
+    }
+
+    out << "read back: " << QString::number(bytes / 1048576.0 / (timer.nsecsElapsed() / 1e9), 'f', 0) << " MB/s\n";
+
+    // the middle of the session, and past its end
+    const qint64 middleUs = recording.durationUs() / 2;
+    SessionRecording::Record record;
+
+    if(!recording.seek(middleUs) || !recording.next(record) || record.timeUs < middleUs || recording.seek(recording.durationUs() + 1))
+    {
+        out << "seek went wrong\n";
+        ++failed;
+    }
+
+    recording.close();
+    QFile::remove(path);
+
+    if(!readsProxySession(path))
+    {
+        out << "a session through the proxy doesn't split into the host's packets\n";
+        ++failed;
+    }
+
+    QFile::remove(path);
+    return failed;
+}
@@ -0,0 +1,106 @@
+#include "bench.h"
+#include "protocol.h"
+#include "viewer_session.h"
+
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+/* A session parked by one handler and resumed by another, the way a viewer
+ * whose link dropped comes back through whichever proxy connection is free.
+ * Every handler times the session with ViewerSession::clockMs(), so what one
+ * handler sent is overdue, acknowledged and held against the ladder's hold
+ * times on the next one as if it had never moved. Runs in real time, the
+ * handlers are some ms apart. */
+
+static const int     TILE_COUNT  = 16;
+static const quint32 FRAME_BYTES = 20000;
+
+static QByteArray resumeToken(char fill)
+{
+    return QByteArray(RESUME_TOKEN_SIZE, fill);
+}
+
+// moves the session over to the next handler, a few ms later
+static bool handOver(ViewerSessionRegistry &registry, const QByteArray &token, const ViewerSession &from, ViewerSession &to)
+{
+    registry.park(token, from);
+    QThread::msleep(20);
+    return registry.claim(token, to);
+}
+
+int benchResume(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream out(stdout);
+    ViewerSessionRegistry registry;
+    int failed = 0;
+
+    // handler A sends a tile in frame 1, the link drops before its ack
+    ViewerSession first;
+    first.reset(TILE_COUNT);
+
+    const qint64 sentMs = ViewerSession::clockMs();
+    first.tileSent(0, 0x1234, 1, sentMs);
+    first.frameSent(1, FRAME_BYTES, true, sentMs);
+
+    // handler B gets the viewer back
+    ViewerSession second;
+
+    if(!handOver(registry, resumeToken('a'), first, second))
+    {
+        out << "resume: the parked session could not be claimed\n";
+        return 1;
+    }
+
+    const qint64 resumedMs = ViewerSession::clockMs();
+    QVector<quint16> resends;
+
+    second.collectResends(resumedMs, resends);
+    const bool earlyResend = !resends.isEmpty();
+
+    second.collectResends(sentMs + ViewerSession::ACK_TIMEOUT_MS + 1, resends);
+    const bool overdue = resends.size() == 1 && resends.first() == 0;
+
+    const qint64 rttMs = second.ackFrame(1, resumedMs);
+
+    out << "resume: claimed after " << resumedMs - sentMs << " ms, frame rtt " << rttMs << " ms, "
+        << (overdue && !earlyResend ? "tile overdue on time" : "tile overdue at the wrong time") << "\n";
+
+    if(earlyResend || !overdue)
+        ++failed;
+
+    if(rttMs < resumedMs - sentMs || rttMs > resumedMs - sentMs + 1000)
+    {
+        out << "resume: the rtt is not the time since handler A sent the frame\n";
+        ++failed;
+    }
+
+    // B's link is congested, the ladder's down hold runs on with handler C
+    const int profile = second.profile();
+    const qint64 congestedMs = ViewerSession::clockMs();
+    second.updateCongestion(ViewerSession::CONGESTION_HIGH + 1, FRAME_BYTES, congestedMs);
+
+    ViewerSession third;
+
+    if(!handOver(registry, resumeToken('b'), second, third))
+    {
+        out << "resume: the parked session could not be claimed again\n";
+        return 1;
+    }
+
+    const bool heldEarly = third.updateCongestion(ViewerSession::CONGESTION_HIGH + 1, FRAME_BYTES, ViewerSession::clockMs());
+    const bool movedDown = third.updateCongestion(ViewerSession::CONGESTION_HIGH + 1, FRAME_BYTES, congestedMs + QualityLadder::DOWN_HOLD_MS);
+
+    out << "resume: profile " << STREAM_PROFILES[profile].name << " -> " << STREAM_PROFILES[third.profile()].name
+        << " after the down hold\n";
+
+    if(heldEarly || !movedDown || third.profile() <= profile)
+    {
+        out << "resume: the down hold did not carry over to the next handler\n";
+        ++failed;
+    }
+
+    return failed;
+}
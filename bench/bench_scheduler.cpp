@@ -0,0 +1,160 @@
+#include "bench.h"
+#include "packet_builder.h"
+#include "protocol.h"
+#include "send_scheduler.h"
+
+#include <QTextStream>
+#include <QVector>
+
+#include <random>
+
+/* Send queueing latency per priority class over a bandwidth limited link,
+ * simulated in virtual time so the numbers are repeatable. The host sends
+ * a 500 KB keyframe every 5 s, tile batches every 100 ms, and small control
+ * packets in between, names, input echoes and stats, on a 2 Mbit/s uplink.
+ * The scheduler feeds a socket window like WebSocketHandler does, latency is
+ * measured from queueing to the hand over to the socket.
+ *
+ * Compared: one FIFO (the former sendBinaryMessage()), priority classes with
+ * whole packets, and priority classes with fragmented images. */
+
+static const qint64 DURATION_US     = 60 * 1000 * 1000;
+static const qint64 STEP_US         = 1000;
+static const int    LINK_BYTES_PER_MS = 250;        // 2 Mbit/s
+static const int    SOCKET_WINDOW   = SendScheduler::SEND_WINDOW;
+
+struct Source
+{
+    SendScheduler::Priority priority;
+    quint32 command;
+    qint64  intervalUs;
+    int     minSize;
+    int     maxSize;
+};
+
+static const Source SOURCES[] =
+{
+    {SendScheduler::Tile,    KEY_IMAGE_SCREEN, 5000 * 1000, 500 * 1000, 500 * 1000},
+    {SendScheduler::Tile,    KEY_IMAGE_BATCH,   100 * 1000,   2 * 1000,  16 * 1000},
+    {SendScheduler::Control, KEY_SET_NAME,      500 * 1000,         32,         64},
+    {SendScheduler::Control, KEY_INPUT_ECHO,     50 * 1000,          8,          8},
+    {SendScheduler::Control, KEY_HOST_STATS,   2000 * 1000,         52,         52}
+};
+
+static const int SOURCE_COUNT = sizeof(SOURCES) / sizeof(SOURCES[0]);
+
+static QByteArray makePacket(quint32 command, int payloadSize)
+{
+    QByteArray buffer;
+
+    PacketBuilder packet(buffer);
+    packet.begin(command);
+    packet.append(QByteArray(payloadSize, 'x'));
+
+    return packet.finish();
+}
+
+struct SimulationResult
+{
+    Histogram latency[SendScheduler::PriorityCount];
+    qint64    sentBytes;
+    quint32   packets;
+};
+
+static void simulate(bool prioritized, int fragmentSize, SimulationResult &result)
+{
+    std::mt19937 random(2019);
+
+    SendScheduler scheduler;
+    scheduler.setPrioritized(prioritized);
+    scheduler.setFragmentSize(fragmentSize);
+
+    qint64 nextArrival[SOURCE_COUNT];
+    for(int i=0;i<SOURCE_COUNT;++i)
+        nextArrival[i] = 0;
+
+    qint64 inFlight = 0;
+    result.sentBytes = 0;
+    result.packets = 0;
+
+    QByteArray packet;
+
+    for(qint64 now=0;now<DURATION_US;now+=STEP_US)
+    {
+        for(int i=0;i<SOURCE_COUNT;++i)
+        {
+            const Source &source = SOURCES[i];
+
+            while(nextArrival[i] <= now)
+            {
+                int size = source.minSize + static_cast<int>(random() % static_cast<quint32>(source.maxSize - source.minSize + 1));
+                scheduler.enqueue(source.priority, makePacket(source.command, size), now);
+                nextArrival[i] += source.intervalUs;
+            }
+        }
+
+        inFlight = qMax<qint64>(0, inFlight - LINK_BYTES_PER_MS);
+
+        while(inFlight < SOCKET_WINDOW && scheduler.next(packet, now))
+        {
+            inFlight += packet.size();
+            result.sentBytes += packet.size();
+            ++result.packets;
+        }
+    }
+
+    for(int i=0;i<SendScheduler::PriorityCount;++i)
+        result.latency[i] = scheduler.latency(static_cast<SendScheduler::Priority>(i));
+}
+
+int benchScheduler(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    struct Mode
+    {
+        const char *name;
+        bool prioritized;
+        int  fragmentSize;
+    };
+
+    const Mode modes[] =
+    {
+        {"fifo", false, 0},
+        {"priority", true, 0},
+        {"priority+fragments", true, FRAGMENT_SIZE_DEFAULT}
+    };
+
+    QTextStream out(stdout);
+    out << "link " << LINK_BYTES_PER_MS * 8 << " kbit/s, socket window " << SOCKET_WINDOW
+        << " bytes, latency in us\n";
+
+    int failed = 0;
+    quint64 fifoControlP99 = 0;
+
+    for(const Mode &mode : modes)
+    {
+        SimulationResult result;
+        simulate(mode.prioritized, mode.fragmentSize, result);
+
+        out << mode.name << ": " << result.packets << " packets, " << result.sentBytes << " bytes\n";
+
+        for(int i=0;i<SendScheduler::PriorityCount;++i)
+        {
+            out << "  " << SendScheduler::priorityName(static_cast<SendScheduler::Priority>(i))
+                << ": " << result.latency[i].summary() << "\n";
+        }
+
+        quint64 controlP99 = result.latency[SendScheduler::Control].percentile(99);
+
+        if(!mode.prioritized)
+            fifoControlP99 = controlP99;
+        else if(mode.fragmentSize > 0 && controlP99 >= fifoControlP99)
+        {
+            out << mode.name << ": control packets are not overtaking images\n";
+            ++failed;
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,73 @@
+#include "bench.h"
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+
+/* What a TraceSpan costs with QV_TRACE unset and set, the capture opens one
+ * per compared and encoded tile. Then a dump of the full ring buffer, which
+ * must hold the newest spans in order. Tracing stays on for the rest of the
+ * run, so this one goes last. */
+
+static const int SPANS  = 4000000;
+static const int EVENTS = 64 * 1024;
+
+static qint64 openSpans(int count, quint64 &sum)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int i=0;i<count;++i)
+    {
+        TraceSpan span("diff", "tile", i);
+        sum += static_cast<quint64>(i); // something for the span to wrap
+    }
+
+    return timer.nsecsElapsed();
+}
+
+int benchTrace(const QStringList &args)
+{
+    Q_UNUSED(args)
+
+    QTextStream out(stdout);
+    int failed = 0;
+    quint64 sum = 0;
+
+    if(Trace::isEnabled())
+    {
+        out << "tracing was started before, the cost when off can't be measured\n";
+        return 1;
+    }
+
+    const qint64 offNsecs = openSpans(SPANS, sum);
+
+    Trace::start(EVENTS);
+    const qint64 onNsecs = openSpans(SPANS, sum);
+
+    out << "ns per span: off " << QString::number(static_cast<double>(offNsecs) / SPANS, 'f', 2)
+        << ", on " << QString::number(static_cast<double>(onNsecs) / SPANS, 'f', 1) << "\n";
+
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray json = Trace::chromeJson();
+    const qint64 dumpNsecs = timer.nsecsElapsed();
+
+    out << "dump: " << json.size() / 1024 << " KB in " << dumpNsecs / 1000000 << " ms\n";
+
+    // the last span of the run, and the one before it left in the ring
+    const QByteArray last = QByteArray("\"args\":{\"tile\":") + QByteArray::number(SPANS - 1) + "}";
+    const QByteArray oldest = QByteArray("\"args\":{\"tile\":") + QByteArray::number(SPANS - EVENTS + 1) + "}";
+    const QByteArray dropped = QByteArray("\"args\":{\"tile\":") + QByteArray::number(SPANS - EVENTS - 1) + "}";
+
+    if(!json.startsWith("{\"displayTimeUnit\"") || !json.endsWith("]}\n") || !json.contains(last) || !json.contains(oldest) || json.contains(dropped))
+    {
+        out << "the dump doesn't hold the newest " << EVENTS << " spans\n";
+        ++failed;
+    }
+
+    if(sum == 0)
+        ++failed;
+
+    return failed;
+}
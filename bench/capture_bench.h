@@ -0,0 +1,46 @@
+#ifndef CAPTURE_BENCH_H
+#define CAPTURE_BENCH_H
+
+#include <QImage>
+#include <QStringList>
+
+#include "screen_capture.h"
+
+quint64 heapAllocationCount(); // operator new calls so far, capture_main.cpp
+
+/* A frame sequence for the capture bench. Every frame is drawn into the one
+ * screen image handed out, ScreenCapture copies it into its frame ring
+ * before the next is drawn. The time and allocations drawing takes are kept
+ * apart so the bench can leave them out. */
+class Workload : public FrameSource
+{
+public:
+    static const int SCREEN_WIDTH   = 1280;
+    static const int SCREEN_HEIGHT  = 800;
+
+    explicit Workload(const QString &name);
+
+    QString name() const {return m_name;}
+    QImage nextFrame();
+    bool isExhausted() const {return m_exhausted;} // a recording ran out of frames
+
+    qint64  sourceNsecs() const {return m_sourceNsecs;}
+    quint64 sourceAllocations() const {return m_sourceAllocations;}
+
+    static QStringList syntheticNames(); // idle, typing, scrolling, dragging, video, noise
+    static Workload *createSynthetic(const QString &name); // Q_NULLPTR for an unknown name
+    static Workload *createRecorded(const QString &dir); // the images in dir in name order, Q_NULLPTR if none
+
+protected:
+    virtual bool drawFrame(QImage &screen, int index) = 0; // false when the sequence is over
+
+private:
+    QString m_name;
+    QImage  m_screen;
+    int     m_index;
+    bool    m_exhausted;
+    qint64  m_sourceNsecs;
+    quint64 m_sourceAllocations;
+};
+
+#endif // CAPTURE_BENCH_H
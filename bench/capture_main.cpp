@@ -0,0 +1,299 @@
+#include "capture_bench.h"
+#include "metrics.h"
+#include "stream_profile.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include <cstdlib>
+#include <new>
+
+/* ScreenCapture's diff and encode on made up or recorded frame sequences, no
+ * display or network needed. Every workload runs through a ScreenCapture of
+ * its own with one viewer on a stream profile, the frame source stands in
+ * for the screen grab and is left out of the numbers.
+ *
+ *   QuickViewerCaptureBench [workload ...] [--frames=N] [--rect=N]
+ *                           [--profile=name] [--no-cache] [--recorded=dir] [--csv]
+ *
+ * Per workload, after a first frame that is always a full image:
+ *  - fps: frames ScreenCapture gets through per second, diff and encode
+ *  - bytes/frame: of the IMGT and IMGS packets it hands to the viewers
+ *  - dirty: changed tiles of all compared, full: frames sent as one image
+ *  - diff us/frame, encode us/image: per tile or full screen image
+ *  - buffers/frame: frame ring, packet buffers and encode cache entries ScreenCapture allocated
+ *  - heap/frame: operator new calls, Qt's and the encoders' included
+ * --csv prints the same as comma separated values to keep and compare.
+ * Fails if a tile packet came out larger than a batch takes, TILE_SIZE_MAX;
+ * "noise --rect=512 --profile=lan" is the worst case. */
+
+static QAtomicInteger<quint64> s_heapAllocations(0);
+
+void *operator new(std::size_t size)
+{
+    s_heapAllocations.fetchAndAddRelaxed(1);
+
+    if(void *pointer = std::malloc(size > 0 ? size : 1))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) Q_DECL_NOTHROW
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) Q_DECL_NOTHROW
+{
+    std::free(pointer);
+}
+
+quint64 heapAllocationCount()
+{
+    return s_heapAllocations.load();
+}
+
+struct CaptureOptions
+{
+    int     frames;
+    int     rectSize;   // 0 for ScreenCapture's own
+    int     profile;
+    bool    encodeCache;
+    bool    csv;
+    QString recordedDir;
+
+    CaptureOptions() : frames(100), rectSize(0), profile(STREAM_PROFILE_NORMAL), encodeCache(true), csv(false) {}
+};
+
+struct CaptureResult
+{
+    int     frames;
+    qint64  nsecs;
+    quint64 bytes;
+    quint64 images;
+    quint64 tiles;
+    quint64 dirtyTiles;
+    quint64 fullFrames;
+    quint64 diffUs;
+    quint64 encodeUs;
+    quint64 bufferAllocations;
+    quint64 heapAllocations;
+    int     largestTile;    // as counted in a batch, without KEY_PKT_HEADR
+
+    CaptureResult() : frames(0), nsecs(0), bytes(0), images(0), tiles(0), dirtyTiles(0), fullFrames(0),
+        diffUs(0), encodeUs(0), bufferAllocations(0), heapAllocations(0), largestTile(0) {}
+};
+
+static CaptureResult runWorkload(Workload *workload, const CaptureOptions &options)
+{
+    CaptureResult result;
+    Metrics metrics;
+
+    ScreenCapture capture;
+    capture.setMetrics(&metrics);
+    capture.setFrameSource(workload);
+
+    if(options.rectSize > 0)
+        capture.setRectSize(options.rectSize);
+
+    if(!options.encodeCache)
+        capture.setEncodeCacheSize(0);
+
+    TileStore::Snapshot snapshot;
+    capture.tileStore()->addViewer(options.profile, snapshot);
+
+    QObject::connect(&capture, &ScreenCapture::imageTile, [&result](quint16, const QByteArray &packet, quint32, quint32, int) {
+        result.bytes += static_cast<quint64>(packet.size());
+        result.largestTile = qMax(result.largestTile, packet.size() - PREAMBLE_SIZE);
+        ++result.images;
+    });
+    QObject::connect(&capture, &ScreenCapture::imageScreen, [&result](const QByteArray &packet, quint32, int) {
+        result.bytes += static_cast<quint64>(packet.size());
+        ++result.images;
+    });
+
+    capture.updateImage(); // the full image every viewer starts with
+
+    const int largestTile = result.largestTile;
+    result = CaptureResult();
+    result.largestTile = largestTile;
+    capture.takeAllocationCount();
+
+    const quint64 tiles = metrics.tiles.value();
+    const quint64 dirtyTiles = metrics.dirtyTiles.value();
+    const quint64 fullFrames = metrics.fullFrames.value();
+    const quint64 diffUs = metrics.diffUs.sum();
+    const quint64 encodeUs = metrics.encodeTileUs.sum();
+    const qint64 sourceNsecs = workload->sourceNsecs();
+    const quint64 sourceAllocations = workload->sourceAllocations();
+    const quint64 heapAllocations = heapAllocationCount();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int i=0;i<options.frames;++i)
+    {
+        capture.updateImage();
+
+        if(workload->isExhausted())
+            break;
+
+        ++result.frames;
+    }
+
+    result.nsecs = timer.nsecsElapsed() - (workload->sourceNsecs() - sourceNsecs);
+    result.heapAllocations = heapAllocationCount() - heapAllocations - (workload->sourceAllocations() - sourceAllocations);
+    result.bufferAllocations = capture.takeAllocationCount();
+    result.tiles = metrics.tiles.value() - tiles;
+    result.dirtyTiles = metrics.dirtyTiles.value() - dirtyTiles;
+    result.fullFrames = metrics.fullFrames.value() - fullFrames;
+    result.diffUs = metrics.diffUs.sum() - diffUs;
+    result.encodeUs = metrics.encodeTileUs.sum() - encodeUs;
+
+    capture.tileStore()->removeViewer(options.profile);
+    return result;
+}
+
+static QString perFrame(quint64 value, int frames, int precision = 0)
+{
+    return QString::number(frames > 0 ? static_cast<double>(value) / frames : 0.0, 'f', precision);
+}
+
+static void printResult(QTextStream &out, const QString &name, const CaptureResult &result, bool csv)
+{
+    const double seconds = static_cast<double>(result.nsecs) / 1e9;
+    const QString fps = QString::number(seconds > 0 ? result.frames / seconds : 0.0, 'f', 1);
+    const QString dirty = QString::number(result.tiles > 0 ? 100.0 * result.dirtyTiles / result.tiles : 0.0, 'f', 1);
+    const QString encodeUs = QString::number(result.images > 0 ? static_cast<double>(result.encodeUs) / result.images : 0.0, 'f', 0);
+
+    if(csv)
+    {
+        out << name << "," << result.frames << "," << fps << "," << perFrame(result.bytes, result.frames) << "," << dirty
+            << "," << result.fullFrames << "," << perFrame(result.diffUs, result.frames) << "," << encodeUs
+            << "," << perFrame(result.bufferAllocations, result.frames, 2) << "," << perFrame(result.heapAllocations, result.frames, 1) << "\n";
+        return;
+    }
+
+    out << name.leftJustified(10) << " " << QString::number(result.frames).rightJustified(6)
+        << fps.rightJustified(8) << perFrame(result.bytes, result.frames).rightJustified(12)
+        << (dirty + " %").rightJustified(9) << QString::number(result.fullFrames).rightJustified(6)
+        << perFrame(result.diffUs, result.frames).rightJustified(9) << encodeUs.rightJustified(10)
+        << perFrame(result.bufferAllocations, result.frames, 2).rightJustified(10)
+        << perFrame(result.heapAllocations, result.frames, 1).rightJustified(10) << "\n";
+}
+
+static bool parseOptions(const QStringList &args, CaptureOptions &options, QStringList &workloads)
+{
+    for(int i=0;i<args.size();++i)
+    {
+        const QString &arg = args.at(i);
+
+        if(arg.startsWith("--frames="))
+            options.frames = qMax(1, arg.mid(9).toInt());
+        else if(arg.startsWith("--rect="))
+            options.rectSize = qBound(STREAM_RECT_SIZE_MIN, arg.mid(7).toInt(), STREAM_RECT_SIZE_MAX);
+        else if(arg.startsWith("--profile="))
+        {
+            options.profile = -1;
+
+            for(int profile=0;profile<STREAM_PROFILE_COUNT;++profile)
+                if(arg.mid(10) == STREAM_PROFILES[profile].name)
+                    options.profile = profile;
+
+            if(options.profile < 0)
+                return false;
+        }
+        else if(arg == "--no-cache")
+            options.encodeCache = false;
+        else if(arg == "--csv")
+            options.csv = true;
+        else if(arg.startsWith("--recorded="))
+            options.recordedDir = arg.mid(11);
+        else if(arg.startsWith("--"))
+            return false;
+        else if(Workload::syntheticNames().contains(arg))
+            workloads.append(arg);
+        else return false;
+    }
+
+    if(workloads.isEmpty() && options.recordedDir.isEmpty())
+        workloads = Workload::syntheticNames();
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    CaptureOptions options;
+    QStringList names;
+
+    if(!parseOptions(app.arguments().mid(1), options, names))
+    {
+        out << "usage: QuickViewerCaptureBench [" << Workload::syntheticNames().join("|") << " ...] [--frames=N] [--rect=N]\n"
+            << "       [--profile=lan|high|normal|low|half] [--no-cache] [--recorded=dir] [--csv]\n";
+        return 2;
+    }
+
+    if(options.csv)
+        out << "workload,frames,fps,bytes_per_frame,dirty_percent,full_frames,diff_us_per_frame,encode_us_per_image,buffers_per_frame,heap_per_frame\n";
+    else
+    {
+        out << "profile " << STREAM_PROFILES[options.profile].name << ", " << options.frames << " frames of "
+            << Workload::SCREEN_WIDTH << "x" << Workload::SCREEN_HEIGHT << (options.encodeCache ? "" : ", no encode cache") << "\n";
+        out << "workload   frames     fps bytes/frame    dirty  full  diff us encode us   buffers      heap\n";
+    }
+
+    QList<Workload*> workloads;
+
+    for(int i=0;i<names.size();++i)
+        workloads.append(Workload::createSynthetic(names.at(i)));
+
+    if(!options.recordedDir.isEmpty())
+    {
+        Workload *recorded = Workload::createRecorded(options.recordedDir);
+
+        if(!recorded)
+        {
+            out << "no images in " << options.recordedDir << "\n";
+            qDeleteAll(workloads);
+            return 1;
+        }
+
+        workloads.append(recorded);
+    }
+
+    int failed = 0;
+
+    for(int i=0;i<workloads.size();++i)
+    {
+        const CaptureResult result = runWorkload(workloads.at(i), options);
+        printResult(out, workloads.at(i)->name(), result, options.csv);
+        out.flush();
+
+        // every workload changes something, without output the encoder is missing (QtWebP plugin for WEBP)
+        if(result.frames > 0 && result.dirtyTiles > 0 && result.bytes == 0)
+        {
+            out << workloads.at(i)->name() << ": nothing encoded, is the " << STREAM_PROFILES[options.profile].format << " image plugin installed?\n";
+            ++failed;
+        }
+
+        if(result.largestTile > TILE_SIZE_MAX)
+        {
+            out << workloads.at(i)->name() << ": a tile of " << result.largestTile << " bytes, a batch takes " << TILE_SIZE_MAX << "\n";
+            ++failed;
+        }
+    }
+
+    qDeleteAll(workloads);
+    return failed;
+}
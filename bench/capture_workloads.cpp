@@ -0,0 +1,509 @@
+#include "capture_bench.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+
+#include <cstring>
+#include <random>
+
+/* Made up desktops, drawn pixel by pixel so no fonts or display are needed.
+ * Text is 8x16 cells of glyph-like bit patterns, photos and video are
+ * gradients with noise: what matters to the diff and the encoders is how much
+ * changes and how well it compresses, not what it shows. */
+
+static const int CELL_WIDTH     = 8;
+static const int CELL_HEIGHT    = 16;
+static const int TITLE_HEIGHT   = 24;
+
+static const QRgb DESKTOP_TOP       = qRgb(32, 72, 120);
+static const QRgb DESKTOP_BOTTOM    = qRgb(18, 36, 64);
+static const QRgb WINDOW_FACE       = qRgb(246, 246, 246);
+static const QRgb WINDOW_TITLE      = qRgb(60, 64, 72);
+static const QRgb TEXT_DARK         = qRgb(30, 30, 30);
+static const QRgb TEXT_LIGHT        = qRgb(200, 220, 200);
+static const QRgb TERMINAL_FACE     = qRgb(12, 12, 12);
+static const QRgb LINK              = qRgb(20, 80, 200);
+
+static void fillRect(QImage &image, int x, int y, int width, int height, QRgb color)
+{
+    const int left = qMax(x, 0);
+    const int right = qMin(x + width, image.width());
+
+    for(int row=qMax(y, 0);row<qMin(y + height, image.height());++row)
+    {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(row));
+
+        for(int column=left;column<right;++column)
+            line[column] = color;
+    }
+}
+
+static quint32 mix(quint32 value)
+{
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+// a glyph of code's pattern in the cell at x, y, a space is background only
+static void drawGlyph(QImage &image, int x, int y, quint32 code, QRgb foreground, QRgb background)
+{
+    fillRect(image, x, y, CELL_WIDTH, CELL_HEIGHT, background);
+
+    if(code == ' ')
+        return;
+
+    for(int row=3;row<CELL_HEIGHT-3;++row)
+    {
+        if(y + row < 0 || y + row >= image.height())
+            continue;
+
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y + row));
+        const quint32 bits = mix(code * 31 + static_cast<quint32>(row)) & 0x7e;
+
+        for(int column=0;column<CELL_WIDTH;++column)
+        {
+            if((bits >> column & 1) && x + column >= 0 && x + column < image.width())
+                line[x + column] = foreground;
+        }
+    }
+}
+
+// a line of words, seed picks them
+static void drawTextLine(QImage &image, int x, int y, int cells, quint32 seed, QRgb foreground, QRgb background)
+{
+    int wordLeft = 0;
+
+    for(int i=0;i<cells;++i)
+    {
+        if(wordLeft == 0)
+        {
+            wordLeft = 2 + static_cast<int>(mix(seed + static_cast<quint32>(i)) % 9);
+            drawGlyph(image, x + i * CELL_WIDTH, y, ' ', foreground, background);
+            continue;
+        }
+
+        --wordLeft;
+        drawGlyph(image, x + i * CELL_WIDTH, y, 'a' + mix(seed * 7 + static_cast<quint32>(i)) % 26, foreground, background);
+    }
+}
+
+// a photo like block, smooth with some grain
+static void drawPhoto(QImage &image, int x, int y, int width, int height, quint32 seed, int shift = 0)
+{
+    const int r0 = static_cast<int>(mix(seed) % 160);
+    const int g0 = static_cast<int>(mix(seed + 1) % 160);
+    const int b0 = static_cast<int>(mix(seed + 2) % 160);
+
+    for(int row=qMax(y, 0);row<qMin(y + height, image.height());++row)
+    {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(row));
+
+        for(int column=qMax(x, 0);column<qMin(x + width, image.width());++column)
+        {
+            const int u = (column - x + shift) * 96 / qMax(width, 1);
+            const int v = (row - y + shift / 2) * 96 / qMax(height, 1);
+            const int grain = static_cast<int>(mix(static_cast<quint32>(row * 4099 + column) + seed + static_cast<quint32>(shift) * 131) % 17) - 8;
+
+            line[column] = qRgb(qBound(0, r0 + u + grain, 255), qBound(0, g0 + v + grain, 255), qBound(0, b0 + (u + v) / 2 + grain, 255));
+        }
+    }
+}
+
+static void drawDesktop(QImage &image)
+{
+    for(int row=0;row<image.height();++row)
+    {
+        const int t = row * 256 / image.height();
+        fillRect(image, 0, row, image.width(), 1,
+                 qRgb((qRed(DESKTOP_TOP) * (256 - t) + qRed(DESKTOP_BOTTOM) * t) / 256,
+                      (qGreen(DESKTOP_TOP) * (256 - t) + qGreen(DESKTOP_BOTTOM) * t) / 256,
+                      (qBlue(DESKTOP_TOP) * (256 - t) + qBlue(DESKTOP_BOTTOM) * t) / 256));
+    }
+
+    // icons down the left, a task bar at the bottom
+    for(int i=0;i<6;++i)
+    {
+        drawPhoto(image, 24, 24 + i * 96, 48, 48, 100 + static_cast<quint32>(i));
+        drawTextLine(image, 16, 76 + i * 96, 8, 200 + static_cast<quint32>(i), qRgb(255, 255, 255), DESKTOP_TOP);
+    }
+
+    fillRect(image, 0, image.height() - 40, image.width(), 40, qRgb(40, 40, 44));
+}
+
+static void drawWindow(QImage &image, int x, int y, int width, int height, quint32 seed, QRgb face, QRgb text)
+{
+    fillRect(image, x, y, width, TITLE_HEIGHT, WINDOW_TITLE);
+    drawTextLine(image, x + 8, y + 4, qMin(24, (width - 16) / CELL_WIDTH), seed, qRgb(255, 255, 255), WINDOW_TITLE);
+    fillRect(image, x, y + TITLE_HEIGHT, width, height - TITLE_HEIGHT, face);
+
+    for(int line=0;(line + 1) * CELL_HEIGHT + 8<height - TITLE_HEIGHT;++line)
+    {
+        const int cells = static_cast<int>(mix(seed + static_cast<quint32>(line)) % static_cast<quint32>((width - 16) / CELL_WIDTH));
+        drawTextLine(image, x + 8, y + TITLE_HEIGHT + 8 + line * CELL_HEIGHT, cells, seed * 13 + static_cast<quint32>(line), text, face);
+    }
+}
+
+// copies the rows of source at sourceY on image at x, y, clipped to image
+static void blit(QImage &image, int x, int y, const QImage &source, int sourceY, int height)
+{
+    const int left = qMax(x, 0);
+    const int right = qMin(x + source.width(), image.width());
+
+    if(right <= left)
+        return;
+
+    for(int row=0;row<height;++row)
+    {
+        if(y + row < 0 || y + row >= image.height() || sourceY + row >= source.height())
+            continue;
+
+        memcpy(reinterpret_cast<QRgb*>(image.scanLine(y + row)) + left,
+               reinterpret_cast<const QRgb*>(source.constScanLine(sourceY + row)) + (left - x),
+               static_cast<size_t>(right - left) * sizeof(QRgb));
+    }
+}
+
+/* Nothing but a blinking caret in a text editor and a clock ticking now and then */
+class IdleWorkload : public Workload
+{
+public:
+    IdleWorkload() : Workload("idle") {}
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        static const int CARET_X = 380;
+        static const int CARET_Y = 260;
+
+        if(index == 0)
+        {
+            drawDesktop(screen);
+            drawWindow(screen, 140, 60, 720, 520, 11, WINDOW_FACE, TEXT_DARK);
+            drawWindow(screen, 900, 120, 340, 300, 12, WINDOW_FACE, LINK);
+        }
+
+        fillRect(screen, CARET_X, CARET_Y, 2, CELL_HEIGHT, (index / 3) % 2 ? WINDOW_FACE : TEXT_DARK);
+
+        if(index % 20 == 0) // the minutes of the clock in the task bar
+        {
+            for(int i=0;i<5;++i)
+                drawGlyph(screen, SCREEN_WIDTH - 60 + i * CELL_WIDTH, SCREEN_HEIGHT - 28, i == 2 ? ':' : '0' + (index / 20 + i) % 10,
+                          qRgb(255, 255, 255), qRgb(40, 40, 44));
+        }
+
+        return true;
+    }
+};
+
+/* A shell: a few characters per frame, a new line now and then, the terminal
+ * scrolls a line once it is full */
+class TypingWorkload : public Workload
+{
+public:
+    TypingWorkload() : Workload("typing"), m_random(42), m_column(0), m_row(0), m_lineLength(40) {}
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        static const int LEFT       = 160;
+        static const int TOP        = 80;
+        static const int WIDTH      = 880;
+        static const int HEIGHT     = 600;
+        static const int TEXT_LEFT  = LEFT + 8;
+        static const int TEXT_TOP   = TOP + TITLE_HEIGHT + 8;
+        static const int ROWS       = (HEIGHT - TITLE_HEIGHT - 16) / CELL_HEIGHT;
+
+        if(index == 0)
+        {
+            drawDesktop(screen);
+            drawWindow(screen, LEFT, TOP, WIDTH, HEIGHT, 21, TERMINAL_FACE, TEXT_LIGHT);
+            m_row = ROWS - 1;
+        }
+
+        for(int i=0;i<2;++i)
+        {
+            const quint32 code = m_random() % 6 == 0 ? ' ' : 'a' + m_random() % 26;
+            drawGlyph(screen, TEXT_LEFT + m_column * CELL_WIDTH, TEXT_TOP + m_row * CELL_HEIGHT, code, TEXT_LIGHT, TERMINAL_FACE);
+
+            if(++m_column < m_lineLength)
+                continue;
+
+            m_column = 0;
+            m_lineLength = 20 + static_cast<int>(m_random() % 80);
+
+            if(m_row + 1 < ROWS)
+            {
+                ++m_row;
+                continue;
+            }
+
+            // scroll the terminal a line up
+            for(int row=TEXT_TOP;row<TEXT_TOP + (ROWS - 1) * CELL_HEIGHT;++row)
+                memcpy(reinterpret_cast<QRgb*>(screen.scanLine(row)) + TEXT_LEFT,
+                       reinterpret_cast<const QRgb*>(screen.constScanLine(row + CELL_HEIGHT)) + TEXT_LEFT,
+                       (WIDTH - 16) * sizeof(QRgb));
+
+            fillRect(screen, TEXT_LEFT, TEXT_TOP + (ROWS - 1) * CELL_HEIGHT, WIDTH - 16, CELL_HEIGHT, TERMINAL_FACE);
+        }
+
+        fillRect(screen, TEXT_LEFT + m_column * CELL_WIDTH, TEXT_TOP + m_row * CELL_HEIGHT, CELL_WIDTH, CELL_HEIGHT, TEXT_LIGHT); // caret
+        return true;
+    }
+
+private:
+    std::mt19937 m_random;
+    int          m_column;
+    int          m_row;
+    int          m_lineLength;
+};
+
+/* A long web page of text, headings and photos scrolled under the browser's
+ * tool bar, a wheel notch per frame */
+class ScrollingWorkload : public Workload
+{
+public:
+    static const int TOOLBAR_HEIGHT = 80;
+    static const int PAGE_HEIGHT    = 6000;
+    static const int SCROLL_STEP    = 48;
+
+    ScrollingWorkload() : Workload("scrolling"), m_page(SCREEN_WIDTH, PAGE_HEIGHT, QImage::Format_RGB32)
+    {
+        m_page.fill(qRgb(255, 255, 255));
+
+        int y = 24;
+        quint32 seed = 1;
+
+        while(y < PAGE_HEIGHT - 400)
+        {
+            switch(mix(seed) % 4)
+            {
+                case 0: // heading
+                    fillRect(m_page, 160, y + 8, 200 + static_cast<int>(mix(seed + 1) % 400), 22, TEXT_DARK);
+                    y += 48;
+                    break;
+                case 1: // photo
+                    drawPhoto(m_page, 160, y, 640, 300, seed);
+                    y += 324;
+                    break;
+                default: // paragraph
+                {
+                    const int lines = 4 + static_cast<int>(mix(seed + 2) % 8);
+                    for(int i=0;i<lines;++i)
+                        drawTextLine(m_page, 160, y + i * 20, i + 1 < lines ? 110 : 50, seed * 97 + static_cast<quint32>(i),
+                                     i % 5 == 3 ? LINK : TEXT_DARK, qRgb(255, 255, 255));
+                    y += lines * 20 + 16;
+                    break;
+                }
+            }
+
+            ++seed;
+        }
+    }
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        if(index == 0)
+        {
+            fillRect(screen, 0, 0, SCREEN_WIDTH, TOOLBAR_HEIGHT, qRgb(222, 225, 230));
+            fillRect(screen, 120, 24, 900, 32, qRgb(255, 255, 255));
+            drawTextLine(screen, 132, 32, 40, 77, TEXT_DARK, qRgb(255, 255, 255));
+        }
+
+        const int viewHeight = SCREEN_HEIGHT - TOOLBAR_HEIGHT;
+        const int offset = (index * SCROLL_STEP) % (PAGE_HEIGHT - viewHeight);
+
+        blit(screen, 0, TOOLBAR_HEIGHT, m_page, offset, viewHeight);
+        return true;
+    }
+
+private:
+    QImage m_page;
+};
+
+/* A window dragged across the desktop, back and forth */
+class DraggingWorkload : public Workload
+{
+public:
+    static const int WINDOW_WIDTH   = 520;
+    static const int WINDOW_HEIGHT  = 360;
+
+    DraggingWorkload() : Workload("dragging"),
+        m_background(SCREEN_WIDTH, SCREEN_HEIGHT, QImage::Format_RGB32),
+        m_window(WINDOW_WIDTH, WINDOW_HEIGHT, QImage::Format_RGB32),
+        m_x(0),
+        m_y(0)
+    {
+        drawDesktop(m_background);
+        drawWindow(m_background, 700, 300, 500, 400, 31, WINDOW_FACE, TEXT_DARK);
+        drawWindow(m_window, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, 32, WINDOW_FACE, TEXT_DARK);
+        drawPhoto(m_window, 280, 60, 220, 160, 33);
+    }
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        if(index == 0)
+            blit(screen, 0, 0, m_background, 0, SCREEN_HEIGHT);
+        else blit(screen, 0, m_y, m_background, m_y, WINDOW_HEIGHT); // what the window covered
+
+        m_x = triangle(index * 14, SCREEN_WIDTH - WINDOW_WIDTH);
+        m_y = triangle(index * 9, SCREEN_HEIGHT - 40 - WINDOW_HEIGHT);
+
+        blit(screen, m_x, m_y, m_window, 0, WINDOW_HEIGHT);
+        return true;
+    }
+
+private:
+    static int triangle(int value, int range)
+    {
+        value %= 2 * range;
+        return value < range ? value : 2 * range - value;
+    }
+
+    QImage m_background;
+    QImage m_window;
+    int    m_x;
+    int    m_y;
+};
+
+/* A video playing in a window, all of its picture changes every frame */
+class VideoWorkload : public Workload
+{
+public:
+    VideoWorkload() : Workload("video") {}
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        static const int LEFT   = 213;
+        static const int TOP    = 100;
+        static const int WIDTH  = 854;
+        static const int HEIGHT = 480;
+
+        if(index == 0)
+        {
+            drawDesktop(screen);
+            drawWindow(screen, LEFT - 4, TOP - TITLE_HEIGHT - 4, WIDTH + 8, HEIGHT + TITLE_HEIGHT + 48, 41, qRgb(0, 0, 0), TEXT_LIGHT);
+        }
+
+        // a slow pan over a scene with a shape crossing it
+        drawPhoto(screen, LEFT, TOP, WIDTH, HEIGHT, 42, index * 6);
+        fillRect(screen, LEFT + (index * 23) % (WIDTH - 120), TOP + 180 + (index * 7) % 120, 120, 90, qRgb(230, 200, 40));
+        fillRect(screen, LEFT, TOP + HEIGHT + 16, (index * 4) % WIDTH, 4, qRgb(220, 40, 40)); // progress bar
+        return true;
+    }
+};
+
+/* Snow, every pixel random every frame: the worst case for the encoders, the
+ * largest tiles there are */
+class NoiseWorkload : public Workload
+{
+public:
+    NoiseWorkload() : Workload("noise") {}
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        quint32 seed = mix(static_cast<quint32>(index) + 1);
+
+        for(int row=0;row<screen.height();++row)
+        {
+            QRgb *line = reinterpret_cast<QRgb*>(screen.scanLine(row));
+
+            for(int column=0;column<screen.width();++column)
+            {
+                seed = mix(seed);
+                line[column] = 0xff000000u | (seed & 0xffffffu);
+            }
+        }
+
+        return true;
+    }
+};
+
+/* Screenshots from a directory, in file name order */
+class RecordedWorkload : public Workload
+{
+public:
+    RecordedWorkload(const QString &dir, const QStringList &files) : Workload("recorded"), m_dir(dir), m_files(files) {}
+
+protected:
+    bool drawFrame(QImage &screen, int index)
+    {
+        if(index >= m_files.size())
+            return false;
+
+        screen = QImage(m_dir.filePath(m_files.at(index))).convertToFormat(QImage::Format_RGB32);
+        return !screen.isNull();
+    }
+
+private:
+    QDir        m_dir;
+    QStringList m_files;
+};
+
+Workload::Workload(const QString &name) :
+    m_name(name),
+    m_screen(SCREEN_WIDTH, SCREEN_HEIGHT, QImage::Format_RGB32),
+    m_index(0),
+    m_exhausted(false),
+    m_sourceNsecs(0),
+    m_sourceAllocations(0)
+{
+    m_screen.fill(qRgb(0, 0, 0));
+}
+
+QImage Workload::nextFrame()
+{
+    QElapsedTimer timer;
+    timer.start();
+    const quint64 allocations = heapAllocationCount();
+
+    if(!m_exhausted && !drawFrame(m_screen, m_index++))
+        m_exhausted = true;
+
+    m_sourceAllocations += heapAllocationCount() - allocations;
+    m_sourceNsecs += timer.nsecsElapsed();
+
+    return m_exhausted ? QImage() : m_screen;
+}
+
+QStringList Workload::syntheticNames()
+{
+    return QStringList() << "idle" << "typing" << "scrolling" << "dragging" << "video" << "noise";
+}
+
+Workload *Workload::createSynthetic(const QString &name)
+{
+    if(name == "idle")
+        return new IdleWorkload;
+    if(name == "typing")
+        return new TypingWorkload;
+    if(name == "scrolling")
+        return new ScrollingWorkload;
+    if(name == "dragging")
+        return new DraggingWorkload;
+    if(name == "video")
+        return new VideoWorkload;
+    if(name == "noise")
+        return new NoiseWorkload;
+
+    return Q_NULLPTR;
+}
+
+Workload *Workload::createRecorded(const QString &dir)
+{
+    QDir directory(dir);
+    const QStringList files = directory.entryList(QStringList() << "*.png" << "*.jpg" << "*.bmp" << "*.ppm",
+                                                  QDir::Files, QDir::Name);
+
+    if(files.isEmpty())
+        return Q_NULLPTR;
+
+    return new RecordedWorkload(dir, files);
+}
@@ -0,0 +1,143 @@
+#include "host_launcher.h"
+
+#include <QProcessEnvironment>
+
+HostLauncher::HostLauncher() :
+    m_xvfb(false)
+{
+
+}
+
+HostLauncher::~HostLauncher()
+{
+    stop();
+}
+
+bool HostLauncher::parseArgument(const QString &arg)
+{
+    if(arg.startsWith("--host="))
+        m_host = arg.mid(7);
+    else if(arg.startsWith("--xvfb="))
+    {
+        m_xvfb = true;
+        m_display = arg.mid(7);
+    }
+    else if(arg == "--xvfb")
+        m_xvfb = true; // on the first free display
+    else if(arg.startsWith("--app="))
+        m_app = arg.mid(6);
+    else return false;
+
+    return true;
+}
+
+bool HostLauncher::isValid() const
+{
+    return !m_host.isEmpty() || (!m_xvfb && m_app.isEmpty());
+}
+
+const char *HostLauncher::usage()
+{
+    return "[--host=path/to/QuickViewerApp [--xvfb[=:N]] [--app=\"command\"]]";
+}
+
+bool HostLauncher::start(const QString &proxyUrl, const QString &password, int maxViewers)
+{
+    if(m_host.isEmpty())
+        return true;
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("QV_PROXY_URL", proxyUrl);
+    env.insert("QV_PASSWORD", password);
+    env.insert("QV_MAX_VIEWERS", QString::number(maxViewers));
+
+    if(m_xvfb && !startXvfb(env))
+        return false;
+
+    if(!m_app.isEmpty())
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        QStringList args = QProcess::splitCommand(m_app); // quoted arguments stay whole
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        QStringList args = m_app.split(' ', Qt::SkipEmptyParts);
+#else
+        QStringList args = m_app.split(' ', QString::SkipEmptyParts);
+#endif
+
+        if(args.isEmpty())
+        {
+            m_errorString = "--app has no command";
+            return false;
+        }
+
+        const QString program = args.takeFirst();
+
+        m_appProcess.setProcessEnvironment(env);
+
+        if(!startProcess(m_appProcess, program, args))
+            return false;
+    }
+
+    m_hostProcess.setProcessEnvironment(env);
+    m_hostProcess.setProcessChannelMode(QProcess::ForwardedChannels);
+
+    return startProcess(m_hostProcess, m_host, QStringList() << "--headless"); // no window, no tray
+}
+
+void HostLauncher::stop()
+{
+    stopProcess(m_hostProcess);
+    stopProcess(m_appProcess);
+    stopProcess(m_xvfbProcess);
+}
+
+/* -displayfd has Xvfb write the display's number once it takes connections,
+ * of the one asked for or of the first free one. */
+bool HostLauncher::startXvfb(QProcessEnvironment &env)
+{
+    QStringList args;
+
+    if(!m_display.isEmpty())
+        args << m_display;
+
+    args << "-displayfd" << "1" << "-screen" << "0" << "1920x1080x24" << "-nolisten" << "tcp";
+
+    if(!startProcess(m_xvfbProcess, "Xvfb", args))
+        return false;
+
+    QByteArray number;
+
+    while(!number.contains('\n') && m_xvfbProcess.waitForReadyRead(5000))
+        number += m_xvfbProcess.readAllStandardOutput();
+
+    if(!number.contains('\n'))
+    {
+        m_errorString = QString("Xvfb did not come up: %1").arg(m_xvfbProcess.errorString());
+        return false;
+    }
+
+    env.insert("DISPLAY", ":" + QString::fromLatin1(number.trimmed()));
+    return true;
+}
+
+bool HostLauncher::startProcess(QProcess &process, const QString &program, const QStringList &args)
+{
+    process.start(program, args);
+
+    if(process.waitForStarted(5000))
+        return true;
+
+    m_errorString = QString("can't start %1: %2").arg(program, process.errorString());
+    return false;
+}
+
+void HostLauncher::stopProcess(QProcess &process)
+{
+    if(process.state() == QProcess::NotRunning)
+        return;
+
+    process.terminate();
+
+    if(!process.waitForFinished(3000))
+        process.kill();
+}
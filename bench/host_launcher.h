@@ -0,0 +1,47 @@
+#ifndef HOST_LAUNCHER_H
+#define HOST_LAUNCHER_H
+
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QString>
+
+/* Starts the host app against a stand-in proxy, QV_PROXY_URL, QV_PASSWORD and
+ * QV_MAX_VIEWERS set, for unattended runs of the bench tools:
+ *   --host=path/to/QuickViewerApp  the app, headless, none to wait for one started by hand
+ *   --xvfb[=:N]                    on a virtual display of its own, the first free one
+ *                                  without a number
+ *   --app="command"                started on that display first, to give the
+ *                                  screen something to change */
+class HostLauncher
+{
+public:
+    HostLauncher();
+    ~HostLauncher(); // stops what it started
+
+    bool parseArgument(const QString &arg); // false if it is none of the above
+    bool isValid() const; // --xvfb and --app need --host
+    bool startsHost() const {return !m_host.isEmpty();}
+
+    bool start(const QString &proxyUrl, const QString &password, int maxViewers);
+    void stop();
+    QString errorString() const {return m_errorString;}
+
+    static const char *usage();
+
+private:
+    bool startXvfb(QProcessEnvironment &env);
+    bool startProcess(QProcess &process, const QString &program, const QStringList &args);
+    static void stopProcess(QProcess &process);
+
+    QString  m_host;
+    bool     m_xvfb;
+    QString  m_display; // empty for the first free one
+    QString  m_app;
+    QString  m_errorString;
+
+    QProcess m_xvfbProcess;
+    QProcess m_appProcess;
+    QProcess m_hostProcess;
+};
+
+#endif // HOST_LAUNCHER_H
@@ -0,0 +1,144 @@
+#include "host_packet_reader.h"
+#include "protocol.h"
+
+HostPacketReader::HostPacketReader() :
+    m_next(0),
+    m_fragmentTotal(0),
+    m_registrations(0),
+    m_errorCount(0)
+{
+}
+
+bool HostPacketReader::append(const char *data, int size)
+{
+    m_packets.clear();
+    m_next = 0;
+
+    // the registration with the proxy, text after the command and no size: "1111REGO|id|version|"
+    if(size > PREAMBLE_SIZE + 4 && fourCCFromData(data) == KEY_PKT_HEADR &&
+       fourCCFromData(data + PREAMBLE_SIZE) == KEY_REGISTER && data[PREAMBLE_SIZE + 4] == '|')
+    {
+        ++m_registrations;
+        return true;
+    }
+
+    int pos = 0;
+
+    while(pos < size)
+    {
+        int used = 0;
+
+        if(size - pos < PREAMBLE_SIZE || fourCCFromData(data + pos) != KEY_PKT_HEADR ||
+           !readPacket(data + pos + PREAMBLE_SIZE, size - pos - PREAMBLE_SIZE, used, false))
+        {
+            ++m_errorCount;
+            return false;
+        }
+
+        pos += PREAMBLE_SIZE + used;
+    }
+
+    return true;
+}
+
+bool HostPacketReader::next(Packet &packet)
+{
+    if(m_next >= m_packets.size())
+        return false;
+
+    packet = m_packets.at(m_next++);
+    return true;
+}
+
+void HostPacketReader::clear()
+{
+    m_packets.clear();
+    m_next = 0;
+    m_fragment.clear();
+    m_fragmentTotal = 0;
+}
+
+// command + size + payload, used is what it took
+bool HostPacketReader::readPacket(const char *data, int size, int &used, bool nested)
+{
+    if(size < 8)
+        return false;
+
+    const quint32 payloadSize = uint32FromData(data + 4);
+
+    if(payloadSize > static_cast<quint32>(size - 8))
+        return false;
+
+    used = 8 + static_cast<int>(payloadSize);
+    return addPacket(fourCCFromData(data), data + 8, static_cast<int>(payloadSize), nested);
+}
+
+bool HostPacketReader::addPacket(quint32 command, const char *payload, int size, bool nested)
+{
+    Packet packet;
+    packet.command = command;
+    packet.payload = payload;
+    packet.size = size;
+    packet.nested = nested;
+    m_packets.append(packet);
+
+    if(command == KEY_IMAGE_BATCH)
+    {
+        PayloadReader reader(payload, size);
+        quint32 frameSeq = 0;
+        quint16 count = 0;
+        quint16 flags = 0;
+
+        if(!reader.readUint32(frameSeq) || !reader.readUint16(count) || !reader.readUint16(flags))
+            return false;
+
+        const char *tiles = payload + BATCH_HEADER_SIZE;
+        int remaining = size - BATCH_HEADER_SIZE;
+
+        for(int i=0;i<count;++i)
+        {
+            int used = 0;
+
+            if(!readPacket(tiles, remaining, used, true))
+                return false;
+
+            tiles += used;
+            remaining -= used;
+        }
+    }
+    else if(command == KEY_FRAGMENT)
+    {
+        PayloadReader reader(payload, size);
+        quint32 total = 0;
+        quint32 offset = 0;
+
+        if(!reader.readUint32(total) || !reader.readUint32(offset))
+            return false;
+
+        if(offset == 0)
+        {
+            m_fragment.clear();
+            m_fragmentTotal = total;
+        }
+
+        // pieces arrive in order, anything else is a broken stream
+        if(total != m_fragmentTotal || offset != static_cast<quint32>(m_fragment.size()))
+        {
+            m_fragment.clear();
+            return false;
+        }
+
+        m_fragment.append(payload + FRAGMENT_HEADER_SIZE, size - FRAGMENT_HEADER_SIZE);
+
+        if(static_cast<quint32>(m_fragment.size()) >= total)
+        {
+            m_joined = m_fragment;
+            m_fragment.clear();
+
+            int used = 0;
+            return readPacket(m_joined.constData(), m_joined.size(), used, true) && used == m_joined.size();
+        }
+    }
+
+    return true;
+}
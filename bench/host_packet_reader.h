@@ -0,0 +1,49 @@
+#ifndef HOST_PACKET_READER_H
+#define HOST_PACKET_READER_H
+
+#include <QByteArray>
+#include <QVector>
+
+/* Splits host messages the way the viewer does: KEY_PKT_HEADR + command +
+ * size + payload. The tile packets in a KEY_IMAGE_BATCH follow their batch
+ * and the packet KEY_FRAGMENT pieces join up to follows its last piece, both
+ * marked nested. The host's registration with the proxy is text and gives
+ * no packets. Packets point into the message or the reader, they stay valid
+ * until the next append(). */
+class HostPacketReader
+{
+public:
+    struct Packet
+    {
+        quint32     command;
+        const char *payload;
+        int         size;
+        bool        nested;
+    };
+
+    HostPacketReader();
+
+    bool append(const char *data, int size); // one message, false for a malformed one
+    bool append(const QByteArray &message) {return append(message.constData(), message.size());}
+    bool next(Packet &packet);
+    void clear();
+
+    quint32 registrationCount() const {return m_registrations;}
+    quint32 errorCount() const {return m_errorCount;}
+
+private:
+    bool readPacket(const char *data, int size, int &used, bool nested);
+    bool addPacket(quint32 command, const char *payload, int size, bool nested);
+
+    QVector<Packet> m_packets;
+    int             m_next;
+
+    QByteArray      m_fragment; // joined so far
+    quint32         m_fragmentTotal;
+    QByteArray      m_joined;   // the last packet the pieces made
+
+    quint32         m_registrations;
+    quint32         m_errorCount;
+};
+
+#endif // HOST_PACKET_READER_H
@@ -0,0 +1,210 @@
+#include "link_shaper.h"
+
+#include <QFile>
+#include <QStringList>
+
+#include <cmath>
+
+static const char *const BUILT_IN_PROFILES[][2] =
+{
+    {"lan",
+        "steady   30 100000 100000    1   0  0\n"},
+    {"3g",
+        "good     15   1600    400  120  30  0.5\n"
+        "fade     10    300    100  300 120  3\n"
+        "handover  2     50     20  800 300 10\n"
+        "recover  13   1600    400  120  30  0.5\n"},
+    {"wifi",
+        "clear    10  30000  15000    3   2  0\n"
+        "busy     10   4000   2000   25  40  2\n"
+        "burst     5    800    400   80 120  6\n"
+        "busy     10   4000   2000   25  40  2\n"
+        "clear     5  30000  15000    3   2  0\n"},
+};
+
+bool LinkProfile::load(const QString &nameOrPath)
+{
+    for(const auto &profile : BUILT_IN_PROFILES)
+    {
+        if(nameOrPath == profile[0])
+            return parse(profile[1]);
+    }
+
+    QFile file(nameOrPath);
+
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        m_errorString = QString("%1: no such profile and %2").arg(nameOrPath, file.errorString());
+        return false;
+    }
+
+    return parse(QString::fromUtf8(file.readAll()));
+}
+
+bool LinkProfile::parse(const QString &script)
+{
+    const QStringList lines = script.split('\n');
+    m_phases.clear();
+
+    for(int i=0;i<lines.size();++i)
+    {
+        const QString line = lines.at(i).section('#', 0, 0).simplified();
+
+        if(line.isEmpty())
+            continue;
+
+        const QStringList fields = line.split(' ');
+        bool ok[6] = {false, false, false, false, false, false};
+        LinkPhase phase;
+
+        if(fields.size() == 7)
+        {
+            phase.name = fields.at(0);
+            phase.durationMs = static_cast<int>(fields.at(1).toDouble(&ok[0]) * 1000);
+            phase.down.bandwidthKbit = fields.at(2).toInt(&ok[1]);
+            phase.up.bandwidthKbit = fields.at(3).toInt(&ok[2]);
+            phase.down.latencyMs = phase.up.latencyMs = fields.at(4).toInt(&ok[3]);
+            phase.down.jitterMs = phase.up.jitterMs = fields.at(5).toInt(&ok[4]);
+            phase.down.lossPercent = phase.up.lossPercent = fields.at(6).toDouble(&ok[5]);
+        }
+
+        if(!(ok[0] && ok[1] && ok[2] && ok[3] && ok[4] && ok[5]) || phase.durationMs <= 0 || phase.down.bandwidthKbit < 0 ||
+           phase.up.bandwidthKbit < 0 || phase.down.latencyMs < 0 || phase.down.jitterMs < 0 ||
+           phase.down.lossPercent < 0 || phase.down.lossPercent >= 100)
+        {
+            m_errorString = QString("line %1: expected name seconds down_kbit up_kbit latency_ms jitter_ms loss_percent").arg(i + 1);
+            return false;
+        }
+
+        m_phases.append(phase);
+    }
+
+    if(m_phases.isEmpty())
+    {
+        m_errorString = "no phases";
+        return false;
+    }
+
+    return true;
+}
+
+int LinkProfile::durationMs() const
+{
+    int duration = 0;
+
+    for(const LinkPhase &phase : m_phases)
+        duration += phase.durationMs;
+
+    return duration;
+}
+
+QStringList LinkProfile::builtInNames()
+{
+    QStringList names;
+
+    for(const auto &profile : BUILT_IN_PROFILES)
+        names << profile[0];
+
+    return names;
+}
+
+void LinkStats::clear()
+{
+    bytes = 0;
+    messages = 0;
+    lostMessages = 0;
+    queueMs.clear();
+    transitMs.clear();
+}
+
+LinkShaper::LinkShaper(quint64 seed, QObject *parent) : QObject(parent),
+    m_random(seed ? seed : 1),
+    m_linkFreeUs(0),
+    m_lastDeliverUs(0)
+{
+    m_clock.start();
+
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &LinkShaper::deliver);
+}
+
+double LinkShaper::random()
+{
+    m_random ^= m_random >> 12;
+    m_random ^= m_random << 25;
+    m_random ^= m_random >> 27;
+
+    return static_cast<double>((m_random * 2685821657736338717ull) >> 11) / 9007199254740992.0; // 53 bits
+}
+
+void LinkShaper::send(const QByteArray &message)
+{
+    const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+    const int segments = qMax(1, (message.size() + SEGMENT_SIZE - 1) / SEGMENT_SIZE);
+    const qint64 rttUs = 2 * m_conditions.latencyMs * 1000;
+
+    qint64 bytes = message.size();
+    qint64 retransmitUs = 0;
+
+    for(int i=0;i<segments && m_conditions.lossPercent > 0;++i)
+    {
+        if(random() * 100 >= m_conditions.lossPercent)
+            continue;
+
+        bytes += SEGMENT_SIZE;
+        retransmitUs += i == segments - 1 ? qMax<qint64>(MIN_RTO_MS * 1000, 2 * rttUs) : rttUs;
+    }
+
+    // out over the bottleneck one after the other, then across
+    const qint64 startUs = qMax(nowUs, m_linkFreeUs);
+    const qint64 serializeUs = m_conditions.bandwidthKbit > 0 ? bytes * 8 * 1000 / m_conditions.bandwidthKbit : 0;
+    m_linkFreeUs = startUs + serializeUs;
+
+    qint64 delayUs = m_conditions.latencyMs * 1000;
+
+    if(m_conditions.jitterMs > 0)
+        delayUs += static_cast<qint64>((random() * 2 - 1) * m_conditions.jitterMs * 1000);
+
+    Pending pending;
+    pending.sentUs = nowUs;
+    pending.deliverUs = qMax(m_lastDeliverUs, m_linkFreeUs + qMax<qint64>(delayUs, 0) + retransmitUs);
+    pending.message = message;
+    m_lastDeliverUs = pending.deliverUs;
+
+    m_stats.bytes += static_cast<quint64>(message.size());
+    ++m_stats.messages;
+    m_stats.queueMs.add(static_cast<quint64>((startUs - nowUs) / 1000));
+
+    if(retransmitUs > 0)
+        ++m_stats.lostMessages;
+
+    m_queue.enqueue(pending);
+
+    if(m_queue.size() == 1)
+        scheduleDelivery();
+}
+
+void LinkShaper::deliver()
+{
+    const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+
+    while(!m_queue.isEmpty() && m_queue.head().deliverUs <= nowUs)
+    {
+        const Pending pending = m_queue.dequeue();
+
+        m_stats.transitMs.add(static_cast<quint64>((nowUs - pending.sentUs) / 1000));
+        emit delivered(pending.message);
+    }
+
+    scheduleDelivery();
+}
+
+void LinkShaper::scheduleDelivery()
+{
+    if(m_queue.isEmpty())
+        return;
+
+    const qint64 waitUs = m_queue.head().deliverUs - m_clock.nsecsElapsed() / 1000;
+    m_timer.start(static_cast<int>(qMax<qint64>(0, (waitUs + 999) / 1000)));
+}
@@ -0,0 +1,120 @@
+#ifndef LINK_SHAPER_H
+#define LINK_SHAPER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+#include <QVector>
+
+#include "histogram.h"
+
+struct LinkConditions
+{
+    int    bandwidthKbit;   // 0 for unlimited
+    int    latencyMs;       // one way
+    int    jitterMs;        // the latency varies by up to that much either way
+    double lossPercent;     // of TCP segments
+
+    LinkConditions() : bandwidthKbit(0), latencyMs(0), jitterMs(0), lossPercent(0) {}
+};
+
+struct LinkPhase
+{
+    QString        name;
+    int            durationMs;
+    LinkConditions down;    // host to viewer
+    LinkConditions up;
+};
+
+/* A scripted link, one phase after the other. A script has a phase a line:
+ *   name seconds down_kbit up_kbit latency_ms jitter_ms loss_percent
+ * '#' starts a comment. load() takes a file or one of the built-in
+ * profiles: "lan", "3g" (fading and a handover) and "wifi" (a congested
+ * access point with bursts of interference). */
+class LinkProfile
+{
+public:
+    bool load(const QString &nameOrPath);
+    bool parse(const QString &script);
+    QString errorString() const {return m_errorString;}
+
+    const QVector<LinkPhase> &phases() const {return m_phases;}
+    int durationMs() const;
+
+    static QStringList builtInNames();
+
+private:
+    QVector<LinkPhase> m_phases;
+    QString            m_errorString;
+};
+
+struct LinkStats
+{
+    quint64   bytes;
+    quint64   messages;
+    quint64   lostMessages;     // a segment of them had to be sent again
+    Histogram queueMs;          // waiting for the bandwidth
+    Histogram transitMs;        // in until out, all of it
+
+    LinkStats() {clear();}
+    void clear();
+};
+
+/* One direction of an emulated TCP link between a host socket and a viewer.
+ * Messages go out as bandwidth allows, one after the other, then take the
+ * latency give or take the jitter. A lost segment is sent again: one round
+ * trip later, or the retransmission timeout later if it was the last segment
+ * of the message, with nothing after it to show it missing. Delivery keeps
+ * the order, a late message holds up those behind it as TCP does.
+ *
+ * Jitter and loss come from a generator seeded by the caller: the same
+ * messages through the same conditions get the same delays and losses. */
+class LinkShaper : public QObject
+{
+    Q_OBJECT
+public:
+    static const int SEGMENT_SIZE = 1448;   // TCP payload of an Ethernet frame
+    static const int MIN_RTO_MS   = 200;    // Linux' minimum retransmission timeout
+
+    explicit LinkShaper(quint64 seed, QObject *parent = Q_NULLPTR);
+
+    void setConditions(const LinkConditions &conditions) {m_conditions = conditions;}
+    const LinkConditions &conditions() const {return m_conditions;}
+
+    const LinkStats &stats() const {return m_stats;}
+    void clearStats() {m_stats.clear();}
+    int queuedMessages() const {return m_queue.size();}
+
+signals:
+    void delivered(const QByteArray &message);
+
+public slots:
+    void send(const QByteArray &message);
+
+private slots:
+    void deliver();
+
+private:
+    struct Pending
+    {
+        qint64     sentUs;
+        qint64     deliverUs;
+        QByteArray message;
+    };
+
+    double random(); // [0, 1)
+    void scheduleDelivery();
+
+    LinkConditions  m_conditions;
+    LinkStats       m_stats;
+    quint64         m_random;       // xorshift64* state
+
+    QElapsedTimer   m_clock;
+    QTimer          m_timer;
+    QQueue<Pending> m_queue;
+    qint64          m_linkFreeUs;   // when the last message is out
+    qint64          m_lastDeliverUs;
+};
+
+#endif // LINK_SHAPER_H
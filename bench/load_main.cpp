@@ -0,0 +1,326 @@
+#include "host_launcher.h"
+#include "load_proxy.h"
+#include "load_viewer.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QTimer>
+
+/* Puts a host under the load of many viewers, without the Go proxy or a browser.
+ *
+ *   QuickViewerLoad [--viewers=N] [--duration=s] [--ramp=ms] [--input=rate] [--legacy]
+ *                   [--port=p] [--password=pw] [--timeout=s] [--csv]
+ *                   [--host=path/to/QuickViewerApp [--xvfb[=:N]] [--app="command"]]
+ *
+ * Stands in for the proxy on localhost (StandInProxy) and takes the host's
+ * registered connections for LoadViewers, one a connection as the host opens
+ * them, --ramp ms apart. A host started by hand needs QV_PROXY_URL and
+ * QV_PASSWORD as printed; with --host it is started here with them, with
+ * --xvfb on a virtual display of its own (HostLauncher). Once every viewer streams the
+ * counts start over, after --duration seconds they are printed per viewer and
+ * in total: throughput, frames and tiles, handshake and first image time, and
+ * with --input the time from an input event until its frame was in.
+ *
+ * --legacy viewers send no KEY_CAPABILITIES and ack every tile. Exits with 1
+ * if a viewer failed, not all streamed within --timeout seconds, or with
+ * --input one that the host echoes input for got frames but no probe back. */
+
+struct LoadOptions
+{
+    int     viewers;
+    int     durationS;
+    int     rampMs;
+    int     inputRate;
+    bool    legacy;
+    quint16 port;
+    QString password;
+    int     timeoutS;
+    bool    csv;
+
+    LoadOptions() : viewers(1), durationS(10), rampMs(200), inputRate(0), legacy(false), port(0),
+        password("loadtest"), timeoutS(30), csv(false) {}
+};
+
+class LoadRun : public QObject
+{
+public:
+    LoadRun(const LoadOptions &options, HostLauncher &launcher, QTextStream &out) : m_options(options), m_launcher(launcher),
+        m_out(out), m_lastAttachMs(-1), m_measuring(false), m_failures(0)
+    {
+        connect(&m_proxy, &StandInProxy::hostRegistered, this, &LoadRun::attachViewers);
+        connect(&m_proxy, &StandInProxy::hostLost,       this, &LoadRun::hostLost);
+
+        m_checkTimer.setInterval(100);
+        connect(&m_checkTimer, &QTimer::timeout, this, &LoadRun::check);
+    }
+
+    bool start()
+    {
+        if(!m_proxy.listen(m_options.port))
+        {
+            m_out << "can't listen: " << m_proxy.errorString() << "\n";
+            return false;
+        }
+
+        const QString url = QString("ws://127.0.0.1:%1").arg(m_proxy.port());
+
+        if(!m_launcher.start(url, m_options.password, m_options.viewers))
+        {
+            m_out << m_launcher.errorString() << "\n";
+            return false;
+        }
+
+        if(!m_launcher.startsHost())
+            m_out << "waiting for a host started with QV_PROXY_URL=" << url << " QV_PASSWORD=" << m_options.password << "\n";
+
+        m_out.flush();
+        m_clock.start();
+        m_checkTimer.start();
+        return true;
+    }
+
+private:
+    // the host opens its next connection once a viewer is in, so one viewer a registration
+    void attachViewers()
+    {
+        if(m_viewers.size() >= m_options.viewers || m_proxy.idleHostCount() == 0)
+            return;
+
+        const qint64 dueMs = m_lastAttachMs < 0 ? 0 : m_lastAttachMs + m_options.rampMs;
+
+        if(m_clock.elapsed() < dueMs)
+        {
+            QTimer::singleShot(static_cast<int>(dueMs - m_clock.elapsed()), this, &LoadRun::attachViewers);
+            return;
+        }
+
+        QWebSocket *host = m_proxy.takeHost();
+
+        LoadViewerOptions options;
+        options.login = m_proxy.desktopId();
+        options.password = m_options.password;
+        options.capabilities = m_options.legacy ? 0 : options.capabilities;
+        options.inputRate = m_options.inputRate;
+
+        LoadViewer *viewer = new LoadViewer(m_viewers.size(), options, this);
+        m_viewers.append(viewer);
+        m_hosts.append(host);
+        m_lastAttachMs = m_clock.elapsed();
+
+        connect(viewer, &LoadViewer::sendMessage, host, [host](const QByteArray &message) {host->sendBinaryMessage(message);});
+        connect(host, &QWebSocket::binaryMessageReceived, viewer, &LoadViewer::messageReceived);
+        connect(viewer, &LoadViewer::failed, this, &LoadRun::viewerFailed);
+
+        viewer->start();
+        attachViewers(); // for connections registered meanwhile
+    }
+
+    void hostLost(QWebSocket *socket)
+    {
+        const int index = m_hosts.indexOf(socket);
+
+        if(index < 0)
+            return;
+
+        m_hosts[index] = Q_NULLPTR;
+        m_viewers.at(index)->stop();
+        viewerFailed(m_viewers.at(index), "the host closed the connection");
+    }
+
+    void viewerFailed(LoadViewer *viewer, const QString &reason)
+    {
+        m_out << "viewer " << viewer->index() << ": " << reason << "\n";
+        ++m_failures;
+        finish();
+    }
+
+    void check()
+    {
+        int streaming = 0;
+
+        for(const LoadViewer *viewer : m_viewers)
+            streaming += viewer->isStreaming() ? 1 : 0;
+
+        if(m_measuring)
+        {
+            if(m_measureClock.elapsed() >= m_options.durationS * 1000)
+                finish();
+            return;
+        }
+
+        if(streaming == m_options.viewers)
+        {
+            for(LoadViewer *viewer : m_viewers)
+                viewer->clearStats();
+
+            m_out << m_options.viewers << " viewers streaming after " << m_clock.elapsed() << " ms, measuring "
+                  << m_options.durationS << " s\n";
+            m_out.flush();
+
+            m_measuring = true;
+            m_measureClock.start();
+        }
+        else if(m_clock.elapsed() > m_options.timeoutS * 1000)
+        {
+            m_out << "only " << m_viewers.size() << " viewers connected and " << streaming << " streaming after "
+                  << m_options.timeoutS << " s\n";
+            ++m_failures;
+            finish();
+        }
+    }
+
+    void finish()
+    {
+        if(!m_checkTimer.isActive())
+            return;
+
+        m_checkTimer.stop();
+
+        for(LoadViewer *viewer : m_viewers)
+            viewer->stop();
+
+        if(m_measuring)
+            report(m_measureClock.elapsed());
+
+        m_out.flush();
+        QCoreApplication::exit(m_failures > 0 ? 1 : 0);
+    }
+
+    void report(qint64 elapsedMs)
+    {
+        const double seconds = qMax<qint64>(1, elapsedMs) / 1000.0;
+        LoadStats total;
+
+        if(m_options.csv)
+            m_out << "viewer,handshake_ms,first_image_ms,mb_per_s,frames_per_s,tiles_per_s,screens,acks,input_per_s,input_probes,"
+                     "input_latency_mean_ms,input_latency_p99_ms,frame_gap_p99_ms\n";
+
+        for(const LoadViewer *viewer : m_viewers)
+        {
+            printStats(QString::number(viewer->index()), viewer->stats(), seconds);
+            total.add(viewer->stats());
+        }
+
+        printStats("total", total, seconds);
+
+        // the wheel notches are probes, any frame after one is echoed, a still screen sends none
+        for(const LoadViewer *viewer : m_viewers)
+        {
+            const LoadStats &stats = viewer->stats();
+
+            if(m_options.inputRate > 0 && viewer->echoesInput() && stats.frames > 0 && stats.inputEchoes == 0)
+            {
+                m_out << "viewer " << viewer->index() << ": no input probe came back\n";
+                ++m_failures;
+            }
+        }
+    }
+
+    void printStats(const QString &name, const LoadStats &stats, double seconds)
+    {
+        const bool viewer = name != "total";
+
+        if(m_options.csv)
+        {
+            m_out << name << "," << (viewer ? stats.handshakeMs : -1) << "," << (viewer ? stats.firstImageMs : -1) << ","
+                  << QString::number(stats.bytes / 1048576.0 / seconds, 'f', 3) << ","
+                  << QString::number(stats.frames / seconds, 'f', 1) << "," << QString::number(stats.tiles / seconds, 'f', 1) << ","
+                  << stats.screens << "," << stats.acks << "," << QString::number(stats.inputEvents / seconds, 'f', 1) << ","
+                  << stats.inputEchoes << "," << QString::number(stats.inputLatencyMs.mean(), 'f', 1) << "," << stats.inputLatencyMs.percentile(99) << ","
+                  << stats.frameGapMs.percentile(99) << "\n";
+            return;
+        }
+
+        m_out << name.rightJustified(5) << ": "
+              << QString::number(stats.bytes / 1048576.0 / seconds, 'f', 2) << " MB/s, "
+              << QString::number(stats.frames / seconds, 'f', 1) << " frames/s, "
+              << QString::number(stats.tiles / seconds, 'f', 1) << " tiles/s, "
+              << stats.screens << " screens";
+
+        if(viewer)
+            m_out << ", handshake " << stats.handshakeMs << " ms, first image " << stats.firstImageMs << " ms";
+
+        m_out << "\n";
+
+        if(stats.frameGapMs.count() > 0)
+            m_out << "       frame gap ms: " << stats.frameGapMs.summary() << "\n";
+
+        if(stats.inputEvents > 0)
+            m_out << "       input: " << QString::number(stats.inputEvents / seconds, 'f', 1) << " events/s, "
+                  << stats.inputEchoes << " probes\n";
+
+        if(stats.inputLatencyMs.count() > 0)
+            m_out << "       input latency ms: " << stats.inputLatencyMs.summary() << "\n";
+    }
+
+    LoadOptions   m_options;
+    HostLauncher &m_launcher;
+    QTextStream  &m_out;
+    StandInProxy  m_proxy;
+
+    QList<LoadViewer*> m_viewers;
+    QList<QWebSocket*> m_hosts;     // of each viewer, Q_NULLPTR once lost
+
+    QTimer        m_checkTimer;
+    QElapsedTimer m_clock;
+    QElapsedTimer m_measureClock;
+    qint64        m_lastAttachMs;
+    bool          m_measuring;
+    int           m_failures;
+};
+
+static bool parseOptions(const QStringList &args, LoadOptions &options, HostLauncher &launcher)
+{
+    for(int i=0;i<args.size();++i)
+    {
+        const QString &arg = args.at(i);
+
+        if(arg.startsWith("--viewers="))
+            options.viewers = qBound(1, arg.mid(10).toInt(), 16); // as many as QV_MAX_VIEWERS lets in
+        else if(arg.startsWith("--duration="))
+            options.durationS = qMax(1, arg.mid(11).toInt());
+        else if(arg.startsWith("--ramp="))
+            options.rampMs = qMax(0, arg.mid(7).toInt());
+        else if(arg.startsWith("--input="))
+            options.inputRate = qMax(0, arg.mid(8).toInt());
+        else if(arg == "--legacy")
+            options.legacy = true;
+        else if(arg.startsWith("--port="))
+            options.port = static_cast<quint16>(arg.mid(7).toUInt());
+        else if(arg.startsWith("--password="))
+            options.password = arg.mid(11);
+        else if(arg.startsWith("--timeout="))
+            options.timeoutS = qMax(1, arg.mid(10).toInt());
+        else if(arg == "--csv")
+            options.csv = true;
+        else if(!launcher.parseArgument(arg))
+            return false;
+    }
+
+    return !options.password.isEmpty() && launcher.isValid();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    LoadOptions options;
+    HostLauncher launcher;
+
+    if(!parseOptions(app.arguments().mid(1), options, launcher))
+    {
+        out << "usage: QuickViewerLoad [--viewers=N] [--duration=s] [--ramp=ms] [--input=rate] [--legacy]\n"
+            << "                       [--port=p] [--password=pw] [--timeout=s] [--csv]\n"
+            << "                       " << HostLauncher::usage() << "\n";
+        return 2;
+    }
+
+    LoadRun run(options, launcher, out);
+
+    if(!run.start())
+        return 1;
+
+    return app.exec();
+}
@@ -0,0 +1,150 @@
+#include "load_proxy.h"
+#include "protocol.h"
+
+#include <QDebug>
+
+StandInProxy::StandInProxy(QObject *parent) : QObject(parent),
+    m_server("QuickViewer stand-in proxy", QWebSocketServer::NonSecureMode)
+{
+    connect(&m_server, &QWebSocketServer::newConnection, this, &StandInProxy::newConnection);
+}
+
+StandInProxy::~StandInProxy()
+{
+    m_server.close();
+}
+
+bool StandInProxy::listen(quint16 port)
+{
+    return m_server.listen(QHostAddress::LocalHost, port);
+}
+
+quint16 StandInProxy::port() const
+{
+    return m_server.serverPort();
+}
+
+QString StandInProxy::errorString() const
+{
+    return m_server.errorString();
+}
+
+QWebSocket *StandInProxy::takeHost()
+{
+    if(m_idleHosts.isEmpty())
+        return Q_NULLPTR;
+
+    QWebSocket *socket = m_idleHosts.takeFirst();
+    m_busyHosts.append(socket);
+    return socket;
+}
+
+void StandInProxy::newConnection()
+{
+    while(m_server.hasPendingConnections())
+    {
+        QWebSocket *socket = m_server.nextPendingConnection();
+        socket->setParent(this);
+
+        // hosts register with a binary message, browsers ask with a text message
+        connect(socket, &QWebSocket::binaryMessageReceived, this, &StandInProxy::registrationMessage);
+        connect(socket, &QWebSocket::textMessageReceived,   this, &StandInProxy::registrationText);
+        connect(socket, &QWebSocket::disconnected,          this, &StandInProxy::socketDisconnected);
+    }
+}
+
+void StandInProxy::registrationMessage(const QByteArray &message)
+{
+    QWebSocket *socket = static_cast<QWebSocket*>(sender());
+
+    if(message.startsWith("1111REGO|"))
+        registerHost(socket, message);
+    else if(message.startsWith("1111CONN|"))
+        connectViewer(socket, message);
+    else socket->close(QWebSocketProtocol::CloseCodeProtocolError);
+}
+
+void StandInProxy::registrationText(const QString &message)
+{
+    registrationMessage(message.toUtf8());
+}
+
+void StandInProxy::registerHost(QWebSocket *socket, const QByteArray &message)
+{
+    const QList<QByteArray> fields = message.split('|');
+
+    if(fields.size() != 4)
+    {
+        socket->close(QWebSocketProtocol::CloseCodeProtocolError);
+        return;
+    }
+
+    disconnect(socket, &QWebSocket::binaryMessageReceived, this, &StandInProxy::registrationMessage);
+    disconnect(socket, &QWebSocket::textMessageReceived,   this, &StandInProxy::registrationText);
+
+    if(fields.at(2).toInt() != CLIENT_VERSION)
+    {
+        socket->sendTextMessage("TXTMSG:Please update the QuickView app from the website.");
+        return;
+    }
+
+    // the id back, without KEY_PKT_HEADR as everything to the host
+    QByteArray response;
+    appendFourCC(response, KEY_REGISTER);
+    appendFourCC(response, static_cast<quint32>(fields.at(1).size()));
+    response.append(fields.at(1));
+    socket->sendBinaryMessage(response);
+
+    m_desktopId = QString::fromUtf8(fields.at(1));
+    m_idleHosts.append(socket);
+
+    // qDebug() << "StandInProxy - desktop" << m_desktopId << "registered a connection";
+    emit hostRegistered();
+}
+
+void StandInProxy::connectViewer(QWebSocket *socket, const QByteArray &message)
+{
+    const QList<QByteArray> fields = message.split('|');
+    QWebSocket *host = Q_NULLPTR;
+
+    disconnect(socket, &QWebSocket::binaryMessageReceived, this, &StandInProxy::registrationMessage);
+    disconnect(socket, &QWebSocket::textMessageReceived,   this, &StandInProxy::registrationText);
+
+    if(fields.size() == 4 && QString::fromUtf8(fields.at(1)) == m_desktopId)
+        host = takeHost();
+
+    QByteArray response("1111");
+    appendFourCC(response, KEY_PROXY_CONNECT);
+
+    if(!host)
+    {
+        appendFourCC(response, 0);
+        response.append("FAILTRAIN"); // as the proxy says it
+        socket->sendBinaryMessage(response);
+        socket->close();
+        return;
+    }
+
+    appendFourCC(response, static_cast<quint32>(fields.at(1).size()));
+    response.append(fields.at(1));
+    socket->sendBinaryMessage(response);
+
+    // from now on everything goes across as it is, either end closing closes both
+    m_busyHosts.append(socket);
+    connect(socket, &QWebSocket::binaryMessageReceived, host,   [host](const QByteArray &data) {host->sendBinaryMessage(data);});
+    connect(host,   &QWebSocket::binaryMessageReceived, socket, [socket](const QByteArray &data) {socket->sendBinaryMessage(data);});
+    connect(socket, &QWebSocket::disconnected,          host,   [host]() {host->close();});
+    connect(host,   &QWebSocket::disconnected,          socket, [socket]() {socket->close();});
+}
+
+void StandInProxy::socketDisconnected()
+{
+    QWebSocket *socket = static_cast<QWebSocket*>(sender());
+    const bool taken = m_busyHosts.removeOne(socket);
+
+    m_idleHosts.removeOne(socket);
+    socket->deleteLater();
+
+    if(taken)
+        emit hostLost(socket);
+}
@@ -0,0 +1,50 @@
+#ifndef LOAD_PROXY_H
+#define LOAD_PROXY_H
+
+#include <QList>
+#include <QObject>
+#include <QtWebSockets/qwebsocket.h>
+#include <QtWebSockets/qwebsocketserver.h>
+
+/* The proxy's part, quickviewer_proxy/client.go, on a local port: a host
+ * registers a connection with "1111REGO|id|version|" and waits on it for a
+ * viewer. A viewer connection asking with "1111CONN|id|...|" is bridged to
+ * the next idle host connection, browsers work as with the real proxy. The
+ * load generator takes idle host connections for its own viewers instead,
+ * without a socket on their end. */
+class StandInProxy : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StandInProxy(QObject *parent = Q_NULLPTR);
+    ~StandInProxy();
+
+    bool listen(quint16 port); // on localhost, 0 for any free port
+    quint16 port() const;
+    QString errorString() const;
+
+    QString desktopId() const {return m_desktopId;} // of the last host that registered
+    int idleHostCount() const {return m_idleHosts.size();}
+    QWebSocket *takeHost(); // a registered connection no viewer has, Q_NULLPTR if none
+
+signals:
+    void hostRegistered();
+    void hostLost(QWebSocket *socket); // a taken or bridged one, deleted later
+
+private slots:
+    void newConnection();
+    void registrationMessage(const QByteArray &message);
+    void registrationText(const QString &message);
+    void socketDisconnected();
+
+private:
+    void registerHost(QWebSocket *socket, const QByteArray &message);
+    void connectViewer(QWebSocket *socket, const QByteArray &message);
+
+    QWebSocketServer   m_server;
+    QList<QWebSocket*> m_idleHosts;
+    QList<QWebSocket*> m_busyHosts;
+    QString            m_desktopId;
+};
+
+#endif // LOAD_PROXY_H
@@ -0,0 +1,359 @@
+#include "load_viewer.h"
+
+#include <QUuid>
+
+#include <cmath>
+
+static void appendUint16(QByteArray &buf, quint16 number)
+{
+    buf.append(static_cast<char>(number));
+    buf.append(static_cast<char>(number >> 8));
+}
+
+void LoadStats::clear()
+{
+    bytes = 0;
+    frames = 0;
+    tiles = 0;
+    screens = 0;
+    inputEvents = 0;
+    inputEchoes = 0;
+    acks = 0;
+    inputLatencyMs.clear();
+    frameGapMs.clear();
+}
+
+void LoadStats::add(const LoadStats &other)
+{
+    bytes += other.bytes;
+    frames += other.frames;
+    tiles += other.tiles;
+    screens += other.screens;
+    inputEvents += other.inputEvents;
+    inputEchoes += other.inputEchoes;
+    acks += other.acks;
+    inputLatencyMs.add(other.inputLatencyMs);
+    frameGapMs.add(other.frameGapMs);
+}
+
+LoadViewer::LoadViewer(int index, const LoadViewerOptions &options, QObject *parent) : QObject(parent),
+    m_index(index),
+    m_options(options),
+    m_getImageMs(0),
+    m_capabilities(0),
+    m_width(0),
+    m_height(0),
+    m_inputStartMs(0),
+    m_inputCount(0),
+    m_wheelCount(0),
+    m_frameSeq(0),
+    m_frameMs(-1),
+    m_pendingFrame(false),
+    m_pendingFrameSeq(0)
+{
+    m_inputTimer.setInterval(INPUT_BATCH_INTERVAL_MS);
+    connect(&m_inputTimer, &QTimer::timeout, this, &LoadViewer::inputTick);
+}
+
+void LoadViewer::start()
+{
+    m_clock.start();
+
+    // the session id the proxy's page hands the viewer, 36 characters
+    sendPacket(KEY_CONNECT_UUID, QUuid::createUuid().toString().mid(1, 36).toUtf8());
+}
+
+void LoadViewer::stop()
+{
+    m_inputTimer.stop();
+}
+
+void LoadViewer::messageReceived(const QByteArray &message)
+{
+    m_stats.bytes += static_cast<quint64>(message.size());
+
+    if(!m_reader.append(message))
+    {
+        emit failed(this, "malformed message from the host");
+        return;
+    }
+
+    HostPacketReader::Packet packet;
+
+    while(m_reader.next(packet))
+        handlePacket(packet);
+
+    // a batch comes in one message, its tiles are all in now
+    if(m_pendingFrame)
+    {
+        m_pendingFrame = false;
+        frameReceived(m_pendingFrameSeq);
+    }
+}
+
+void LoadViewer::handlePacket(const HostPacketReader::Packet &packet)
+{
+    PayloadReader reader(packet.payload, packet.size);
+
+    switch(packet.command)
+    {
+        case KEY_SET_NONCE:
+        {
+            const QByteArray nonce = QByteArray::fromRawData(packet.payload, packet.size);
+            sendPacket(KEY_SET_AUTH_REQUEST, QByteArray::fromBase64(authHashSum(nonce, m_options.login, m_options.password)));
+            break;
+        }
+        case KEY_SET_AUTH_RESPONSE:
+        {
+            quint32 state = 0;
+
+            if(!reader.readUint32(state) || state != 1)
+            {
+                emit failed(this, "the host did not take the password");
+                break;
+            }
+
+            m_stats.handshakeMs = m_clock.elapsed();
+
+            if(m_options.capabilities != 0)
+            {
+                QByteArray caps;
+                appendFourCC(caps, m_options.capabilities);
+                appendUint16(caps, PROTOCOL_VERSION);
+                appendUint16(caps, HOST_CODECS);
+                sendPacket(KEY_CAPABILITIES, caps);
+            }
+
+            QByteArray getImage;
+            appendFourCC(getImage, KEY_GET_IMAGE);
+            emit sendMessage(getImage); // bare, as the viewer sends it
+            m_getImageMs = m_clock.elapsed();
+
+            if(m_options.inputRate > 0)
+                m_inputTimer.start();
+
+            emit authenticated(this);
+            break;
+        }
+        case KEY_CAPABILITIES:
+        {
+            quint32 flags = 0;
+
+            if(reader.readUint32(flags))
+                m_capabilities = flags;
+            break;
+        }
+        case KEY_IMAGE_PARAM:
+        {
+            quint32 width = 0;
+            quint32 height = 0;
+
+            if(reader.readUint32(width) && reader.readUint32(height))
+            {
+                m_width = static_cast<int>(width);
+                m_height = static_cast<int>(height);
+            }
+            break;
+        }
+        case KEY_IMAGE_TILE:
+        {
+            quint32 posX = 0;
+            quint32 posY = 0;
+            quint32 tileNum = 0;
+
+            imageReceived(false);
+
+            // a frame ack covers the tiles of a batch
+            if(!(packet.nested && (m_capabilities & CAP_FRAME_ACK)) && reader.readUint32(posX) && reader.readUint32(posY) && reader.readUint32(tileNum))
+                sendTileAck(static_cast<quint16>(tileNum));
+            break;
+        }
+        case KEY_IMAGE_SCREEN:
+        {
+            imageReceived(true);
+
+            if(!(packet.nested && (m_capabilities & CAP_FRAME_ACK)))
+                sendTileAck(9999); // drew the full screen, see displayField.js
+            break;
+        }
+        case KEY_IMAGE_BATCH:
+        {
+            quint32 frameSeq = 0;
+            quint16 count = 0;
+            quint16 flags = 0;
+
+            if(reader.readUint32(frameSeq) && reader.readUint16(count) && reader.readUint16(flags) && (flags & BATCH_FLAG_FINAL))
+            {
+                m_pendingFrame = true; // its tiles come next, nested
+                m_pendingFrameSeq = frameSeq;
+            }
+            break;
+        }
+        case KEY_INPUT_ECHO:
+        {
+            InputEcho echo;
+
+            if(reader.readUint32(echo.eventMs) && reader.readUint32(echo.frameSeq))
+            {
+                ++m_stats.inputEchoes;
+                m_echoes.append(echo);
+                resolveEchoes(); // its frame may be in already
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void LoadViewer::imageReceived(bool screen)
+{
+    if(m_stats.firstImageMs < 0)
+        m_stats.firstImageMs = m_clock.elapsed() - m_getImageMs;
+
+    if(screen)
+        ++m_stats.screens;
+    else
+        ++m_stats.tiles;
+}
+
+void LoadViewer::frameReceived(quint32 frameSeq)
+{
+    const qint64 now = m_clock.elapsed();
+
+    if(m_frameMs >= 0)
+        m_stats.frameGapMs.add(static_cast<quint64>(now - m_frameMs));
+
+    m_frameSeq = frameSeq;
+    m_frameMs = now;
+    ++m_stats.frames;
+
+    if(m_capabilities & CAP_FRAME_ACK)
+    {
+        QByteArray ack;
+        appendFourCC(ack, frameSeq);
+        sendPacket(KEY_FRAME_RECEIVED, ack);
+        ++m_stats.acks;
+    }
+
+    emit frameCompleted(frameSeq);
+    resolveEchoes();
+}
+
+// KEY_INPUT_LATENCY for every echoed event whose frame is in
+void LoadViewer::resolveEchoes()
+{
+    while(m_frameMs >= 0 && !m_echoes.isEmpty() && static_cast<qint32>(m_frameSeq - m_echoes.first().frameSeq) >= 0)
+    {
+        const InputEcho echo = m_echoes.takeFirst();
+        const quint32 latencyMs = nowMs() - echo.eventMs;
+
+        QByteArray latency;
+        appendFourCC(latency, echo.eventMs);
+        appendFourCC(latency, latencyMs);
+        sendPacket(KEY_INPUT_LATENCY, latency);
+
+        m_stats.inputLatencyMs.add(latencyMs);
+    }
+}
+
+/* The moves due since the last tick, along a circle around the middle of the
+ * screen, and the wheel notches due, the host's latency probes. One
+ * KEY_INPUT_BATCH per tick like the viewer's, else one KEY_SET_CURSOR_POS a
+ * move and one KEY_SET_MOUSE_WHEEL a notch. */
+void LoadViewer::inputTick()
+{
+    if(m_width <= 0 || m_height <= 0)
+        return;
+
+    const qint64 now = m_clock.elapsed();
+
+    if(m_inputCount == 0 && m_wheelCount == 0 && m_inputStartMs == 0)
+        m_inputStartMs = now;
+
+    const quint64 due = static_cast<quint64>((now - m_inputStartMs) * m_options.inputRate / 1000);
+    const quint64 wheelsDue = static_cast<quint64>((now - m_inputStartMs) / WHEEL_INTERVAL_MS) + 1;
+    const int wheels = static_cast<int>(qMin<quint64>(wheelsDue - m_wheelCount, 1)); // a late tick doesn't make up for missed ones
+    const int count = static_cast<int>(qMin<quint64>(due - m_inputCount, INPUT_BATCH_MAX_EVENTS - wheels));
+
+    if(count <= 0 && wheels == 0)
+        return;
+
+    const bool batched = (m_capabilities & CAP_INPUT_BATCH) != 0;
+    QByteArray batch;
+
+    if(batched)
+    {
+        appendFourCC(batch, static_cast<quint32>(now));
+        appendUint16(batch, static_cast<quint16>(count + wheels));
+        appendUint16(batch, 0);
+    }
+
+    const int radius = qMin(m_width, m_height) / 4;
+
+    for(int i=0;i<count;++i, ++m_inputCount)
+    {
+        const double angle = static_cast<double>(m_inputCount) * 0.05;
+        const quint16 x = static_cast<quint16>(m_width / 2 + radius * std::cos(angle));
+        const quint16 y = static_cast<quint16>(m_height / 2 + radius * std::sin(angle));
+
+        QByteArray event;
+        appendUint16(event, x);
+        appendUint16(event, y);
+
+        if(batched)
+        {
+            appendUint16(batch, 0); // all at the time of the batch
+            appendUint16(batch, INPUT_MOVE);
+            batch.append(event);
+        }
+        else sendPacket(KEY_SET_CURSOR_POS, event);
+    }
+
+    if(wheels > 0)
+    {
+        m_wheelCount = wheelsDue;
+        const bool down = (m_wheelCount & 1) != 0; // down and up in turn, the page stays put
+
+        if(batched)
+        {
+            appendUint16(batch, 0);
+            appendUint16(batch, INPUT_WHEEL);
+            appendUint16(batch, 0);
+            appendUint16(batch, static_cast<quint16>(down ? WHEEL_NOTCH : -WHEEL_NOTCH));
+        }
+        else
+        {
+            QByteArray event;
+            appendUint16(event, 0);
+            appendUint16(event, down ? 1 : 0);
+            sendPacket(KEY_SET_MOUSE_WHEEL, event);
+        }
+    }
+
+    if(batched)
+        sendPacket(KEY_INPUT_BATCH, batch);
+
+    m_stats.inputEvents += static_cast<quint64>(count + wheels);
+}
+
+void LoadViewer::sendPacket(quint32 command, const QByteArray &payload)
+{
+    QByteArray packet;
+    packet.reserve(8 + payload.size());
+    appendFourCC(packet, command);
+    appendFourCC(packet, static_cast<quint32>(payload.size()));
+    packet.append(payload);
+
+    emit sendMessage(packet);
+}
+
+void LoadViewer::sendTileAck(quint16 tileNum)
+{
+    QByteArray ack;
+    appendUint16(ack, tileNum);
+    appendUint16(ack, 0);
+    sendPacket(KEY_TILE_RECEIVED, ack);
+
+    ++m_stats.acks;
+}
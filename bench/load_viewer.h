@@ -0,0 +1,118 @@
+#ifndef LOAD_VIEWER_H
+#define LOAD_VIEWER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include "histogram.h"
+#include "host_packet_reader.h"
+#include "protocol.h"
+
+struct LoadViewerOptions
+{
+    QString login;          // the desktop's id and password
+    QString password;
+    quint32 capabilities;   // CAP_* to ask for, 0 for a viewer that never sends KEY_CAPABILITIES
+    int     inputRate;      // mouse moves per second, 0 for none, with wheel notches every WHEEL_INTERVAL_MS
+
+    LoadViewerOptions() :
+        capabilities(CAP_IMAGE_BATCH | CAP_FRAGMENT | CAP_FRAME_ACK | CAP_INPUT_BATCH | CAP_INPUT_ECHO),
+        inputRate(0) {}
+};
+
+struct LoadStats
+{
+    qint64    handshakeMs;    // KEY_CONNECT_UUID until KEY_SET_AUTH_RESPONSE, -1 until then
+    qint64    firstImageMs;   // KEY_GET_IMAGE until the first image, -1 until then
+    quint64   bytes;          // from the host
+    quint64   frames;         // final parts of image batches
+    quint64   tiles;
+    quint64   screens;        // full screen images
+    quint64   inputEvents;    // sent
+    quint64   inputEchoes;    // KEY_INPUT_ECHO, the probes the host timed
+    quint64   acks;           // TLRD and FACK sent
+    Histogram inputLatencyMs; // input event until its frame was in, KEY_INPUT_ECHO
+    Histogram frameGapMs;     // between frames
+
+    LoadStats() : handshakeMs(-1), firstImageMs(-1) {clear();}
+
+    void clear(); // the counts, not the setup times
+    void add(const LoadStats &other);
+};
+
+/* A viewer without a display, as dataManager.js talks to the host: the
+ * handshake from KEY_CONNECT_UUID on, KEY_GET_IMAGE, an ack for every image
+ * or frame as soon as it is in, and mouse moves at a steady rate. The host
+ * times only presses and wheel turns, so a wheel notch, down and up in turn,
+ * goes with the moves every WHEEL_INTERVAL_MS. Messages
+ * go out with sendMessage() and come in through messageReceived(), whatever
+ * carries them, a stand-in proxy's host connection or a shaped link. */
+class LoadViewer : public QObject
+{
+    Q_OBJECT
+public:
+    static const int WHEEL_INTERVAL_MS = 250;
+
+    LoadViewer(int index, const LoadViewerOptions &options, QObject *parent = Q_NULLPTR);
+
+    int index() const {return m_index;}
+    bool isStreaming() const {return m_stats.firstImageMs >= 0;}
+    bool echoesInput() const {return (m_capabilities & (CAP_INPUT_BATCH | CAP_INPUT_ECHO)) == (CAP_INPUT_BATCH | CAP_INPUT_ECHO);}
+    const LoadStats &stats() const {return m_stats;}
+    void clearStats() {m_stats.clear();}
+
+signals:
+    void sendMessage(const QByteArray &message);
+    void authenticated(LoadViewer *viewer);
+    void frameCompleted(quint32 frameSeq); // every tile of it is in
+    void failed(LoadViewer *viewer, const QString &reason);
+
+public slots:
+    void start();   // sends KEY_CONNECT_UUID
+    void stop();
+    void messageReceived(const QByteArray &message);
+
+private slots:
+    void inputTick();
+
+private:
+    struct InputEcho
+    {
+        quint32 eventMs;
+        quint32 frameSeq;
+    };
+
+    void handlePacket(const HostPacketReader::Packet &packet);
+    void imageReceived(bool screen);
+    void frameReceived(quint32 frameSeq);
+    void resolveEchoes();
+    void sendPacket(quint32 command, const QByteArray &payload);
+    void sendTileAck(quint16 tileNum);
+    quint32 nowMs() const {return static_cast<quint32>(m_clock.elapsed());}
+
+    int               m_index;
+    LoadViewerOptions m_options;
+    LoadStats         m_stats;
+    HostPacketReader  m_reader;
+
+    QElapsedTimer m_clock;          // the viewer's, of its input event times
+    qint64        m_getImageMs;
+    quint32       m_capabilities;   // as the host answered
+    int           m_width;          // of the host's screen, KEY_IMAGE_PARAM
+    int           m_height;
+
+    QTimer        m_inputTimer;
+    qint64        m_inputStartMs;
+    quint64       m_inputCount;     // moves made since m_inputStartMs
+    quint64       m_wheelCount;     // wheel notches
+
+    quint32       m_frameSeq;       // of the last complete frame
+    qint64        m_frameMs;
+    bool          m_pendingFrame;   // the final part of a batch came, with its tiles to follow
+    quint32       m_pendingFrameSeq;
+    QVector<InputEcho> m_echoes;
+};
+
+#endif // LOAD_VIEWER_H
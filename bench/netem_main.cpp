@@ -0,0 +1,431 @@
+#include "host_launcher.h"
+#include "host_packet_reader.h"
+#include "link_shaper.h"
+#include "load_proxy.h"
+#include "load_viewer.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QTimer>
+
+/* Runs a host's send path through scripted network conditions.
+ *
+ *   QuickViewerNetem [--profile=lan|3g|wifi|script] [--viewers=N] [--input=rate] [--seed=n]
+ *                    [--port=p] [--password=pw] [--timeout=s] [--csv]
+ *                    [--host=path/to/QuickViewerApp [--xvfb[=:N]] [--app="command"]]
+ *
+ * As QuickViewerLoad, but each viewer's messages both ways go through a
+ * LinkShaper. The viewers connect over the profile's first phase, once all
+ * stream the profile runs phase by phase. Printed per phase, over all
+ * viewers:
+ *  - the bytes each way and the frames in per second
+ *  - frame latency: the last message of a frame leaving the host until its
+ *    last tile was in at the viewer
+ *  - staleness, sampled: 0 while a viewer has the newest frame the host sent,
+ *    else how long ago the host sent the first frame it doesn't have yet
+ *  - how long messages queued for the bandwidth, and how many lost a segment
+ *  - with --input the probes the host echoed, wheel notches, and the time
+ *    from one until its frame was in
+ *
+ * The shapers are seeded from --seed, a run with the same seed treats the
+ * same messages the same. What the host sends still depends on its timing
+ * and the screen, --app gives it content that changes the same every run. */
+
+static const int STALENESS_SAMPLE_MS = 50;
+
+struct NetemOptions
+{
+    LinkProfile profile;
+    int         viewers;
+    int         inputRate;
+    quint64     seed;
+    quint16     port;
+    QString     password;
+    int         timeoutS;
+    bool        csv;
+
+    NetemOptions() : viewers(1), inputRate(0), seed(1), port(0), password("netem"), timeoutS(60), csv(false) {}
+};
+
+// a viewer on its shaped link to a host connection
+struct NetemLink
+{
+    struct SentFrame
+    {
+        quint32 frameSeq;
+        qint64  sentMs;
+    };
+
+    LoadViewer       *viewer;
+    QWebSocket       *host;
+    LinkShaper       *down;
+    LinkShaper       *up;
+    HostPacketReader  reader;   // sees the frames leave the host
+    QQueue<SentFrame> frames;   // sent, not complete at the viewer yet
+};
+
+struct PhaseStats
+{
+    quint64   frames;
+    Histogram frameLatencyMs;
+    Histogram stalenessMs;
+
+    PhaseStats() {clear();}
+
+    void clear()
+    {
+        frames = 0;
+        frameLatencyMs.clear();
+        stalenessMs.clear();
+    }
+};
+
+class NetemRun : public QObject
+{
+public:
+    NetemRun(const NetemOptions &options, HostLauncher &launcher, QTextStream &out) : m_options(options), m_launcher(launcher),
+        m_out(out), m_phase(-1), m_phaseStartMs(0), m_failures(0)
+    {
+        connect(&m_proxy, &StandInProxy::hostRegistered, this, &NetemRun::attachViewers);
+        connect(&m_proxy, &StandInProxy::hostLost,       this, &NetemRun::hostLost);
+
+        m_sampleTimer.setInterval(STALENESS_SAMPLE_MS);
+        connect(&m_sampleTimer, &QTimer::timeout, this, &NetemRun::sample);
+    }
+
+    ~NetemRun()
+    {
+        qDeleteAll(m_links);
+    }
+
+    bool start()
+    {
+        if(!m_proxy.listen(m_options.port))
+        {
+            m_out << "can't listen: " << m_proxy.errorString() << "\n";
+            return false;
+        }
+
+        const QString url = QString("ws://127.0.0.1:%1").arg(m_proxy.port());
+
+        if(!m_launcher.start(url, m_options.password, m_options.viewers))
+        {
+            m_out << m_launcher.errorString() << "\n";
+            return false;
+        }
+
+        if(!m_launcher.startsHost())
+            m_out << "waiting for a host started with QV_PROXY_URL=" << url << " QV_PASSWORD=" << m_options.password << "\n";
+
+        m_out << "profile: ";
+
+        for(const LinkPhase &phase : m_options.profile.phases())
+            m_out << phase.name << " " << phase.durationMs / 1000.0 << " s, ";
+
+        m_out << m_options.profile.durationMs() / 1000.0 << " s in all\n";
+        m_out.flush();
+
+        m_clock.start();
+        m_sampleTimer.start();
+        return true;
+    }
+
+private:
+    void attachViewers()
+    {
+        while(m_links.size() < m_options.viewers && m_proxy.idleHostCount() > 0)
+        {
+            const LinkPhase &first = m_options.profile.phases().first();
+
+            LoadViewerOptions options;
+            options.login = m_proxy.desktopId();
+            options.password = m_options.password;
+            options.inputRate = m_options.inputRate;
+
+            NetemLink *link = new NetemLink;
+            link->host = m_proxy.takeHost();
+            link->viewer = new LoadViewer(m_links.size(), options, this);
+            link->down = new LinkShaper(m_options.seed * 2 + static_cast<quint64>(m_links.size()) * 7919, this);
+            link->up = new LinkShaper(m_options.seed * 2 + 1 + static_cast<quint64>(m_links.size()) * 7919, this);
+            link->down->setConditions(first.down);
+            link->up->setConditions(first.up);
+            m_links.append(link);
+
+            connect(link->host,   &QWebSocket::binaryMessageReceived, this, [this, link](const QByteArray &message) {hostMessage(link, message);});
+            connect(link->down,   &LinkShaper::delivered, link->viewer, &LoadViewer::messageReceived);
+            connect(link->viewer, &LoadViewer::sendMessage, link->up, &LinkShaper::send);
+            connect(link->up,     &LinkShaper::delivered, link->host, [link](const QByteArray &message) {link->host->sendBinaryMessage(message);});
+            connect(link->viewer, &LoadViewer::frameCompleted, this, [this, link](quint32 frameSeq) {frameCompleted(link, frameSeq);});
+            connect(link->viewer, &LoadViewer::failed, this, &NetemRun::viewerFailed);
+
+            link->viewer->start();
+        }
+    }
+
+    void hostMessage(NetemLink *link, const QByteArray &message)
+    {
+        HostPacketReader::Packet packet;
+        link->reader.append(message);
+
+        while(link->reader.next(packet))
+        {
+            PayloadReader payload(packet.payload, packet.size);
+            quint32 frameSeq = 0;
+            quint16 count = 0;
+            quint16 flags = 0;
+
+            if(packet.command == KEY_IMAGE_BATCH && payload.readUint32(frameSeq) && payload.readUint16(count) &&
+               payload.readUint16(flags) && (flags & BATCH_FLAG_FINAL))
+            {
+                NetemLink::SentFrame frame;
+                frame.frameSeq = frameSeq;
+                frame.sentMs = m_clock.elapsed();
+                link->frames.enqueue(frame);
+            }
+        }
+
+        link->down->send(message);
+    }
+
+    void frameCompleted(NetemLink *link, quint32 frameSeq)
+    {
+        // frames before it that never completed were superseded
+        while(!link->frames.isEmpty() && static_cast<qint32>(frameSeq - link->frames.head().frameSeq) >= 0)
+        {
+            const NetemLink::SentFrame frame = link->frames.dequeue();
+
+            if(frame.frameSeq == frameSeq && m_phase >= 0)
+            {
+                m_stats.frameLatencyMs.add(static_cast<quint64>(m_clock.elapsed() - frame.sentMs));
+                ++m_stats.frames;
+            }
+        }
+    }
+
+    void hostLost(QWebSocket *socket)
+    {
+        for(NetemLink *link : m_links)
+        {
+            if(link->host != socket)
+                continue;
+
+            link->viewer->stop();
+            viewerFailed(link->viewer, "the host closed the connection");
+            return;
+        }
+    }
+
+    void viewerFailed(LoadViewer *viewer, const QString &reason)
+    {
+        m_out << "viewer " << viewer->index() << ": " << reason << "\n";
+        ++m_failures;
+        finish();
+    }
+
+    void sample()
+    {
+        const qint64 now = m_clock.elapsed();
+
+        if(m_phase < 0)
+        {
+            int streaming = 0;
+
+            for(const NetemLink *link : m_links)
+                streaming += link->viewer->isStreaming() ? 1 : 0;
+
+            if(streaming == m_options.viewers)
+            {
+                for(const NetemLink *link : m_links)
+                    m_out << "viewer " << link->viewer->index() << ": handshake " << link->viewer->stats().handshakeMs
+                          << " ms, first image " << link->viewer->stats().firstImageMs << " ms\n";
+
+                if(m_options.csv)
+                    m_out << "phase,seconds,down_kbit,latency_ms,loss_percent,down_kb_per_s,up_kb_per_s,frames_per_s,"
+                             "frame_latency_p50_ms,frame_latency_p99_ms,staleness_mean_ms,staleness_p99_ms,staleness_max_ms,"
+                             "queue_p99_ms,lost_messages,input_probes,input_latency_p50_ms,input_latency_p99_ms\n";
+
+                startPhase(0);
+            }
+            else if(now > m_options.timeoutS * 1000)
+            {
+                m_out << "only " << streaming << " of " << m_options.viewers << " viewers streaming after " << m_options.timeoutS << " s\n";
+                ++m_failures;
+                finish();
+            }
+            return;
+        }
+
+        for(const NetemLink *link : m_links)
+            m_stats.stalenessMs.add(link->frames.isEmpty() ? 0 : static_cast<quint64>(now - link->frames.head().sentMs));
+
+        if(now - m_phaseStartMs < m_options.profile.phases().at(m_phase).durationMs)
+            return;
+
+        report(now - m_phaseStartMs);
+
+        if(m_phase + 1 < m_options.profile.phases().size())
+            startPhase(m_phase + 1);
+        else finish();
+    }
+
+    void startPhase(int index)
+    {
+        const LinkPhase &phase = m_options.profile.phases().at(index);
+
+        for(NetemLink *link : m_links)
+        {
+            link->down->setConditions(phase.down);
+            link->up->setConditions(phase.up);
+            link->down->clearStats();
+            link->up->clearStats();
+            link->viewer->clearStats();
+        }
+
+        m_stats.clear();
+        m_phase = index;
+        m_phaseStartMs = m_clock.elapsed();
+    }
+
+    void report(qint64 elapsedMs)
+    {
+        const LinkPhase &phase = m_options.profile.phases().at(m_phase);
+        const double seconds = qMax<qint64>(1, elapsedMs) / 1000.0;
+
+        LinkStats down;
+        LinkStats up;
+        LoadStats viewers;
+
+        for(const NetemLink *link : m_links)
+        {
+            down.bytes += link->down->stats().bytes;
+            down.lostMessages += link->down->stats().lostMessages;
+            down.queueMs.add(link->down->stats().queueMs);
+            up.bytes += link->up->stats().bytes;
+            up.lostMessages += link->up->stats().lostMessages;
+            viewers.add(link->viewer->stats());
+        }
+
+        if(m_options.csv)
+        {
+            m_out << phase.name << "," << seconds << "," << phase.down.bandwidthKbit << "," << phase.down.latencyMs << ","
+                  << phase.down.lossPercent << "," << QString::number(down.bytes / 1024.0 / seconds, 'f', 1) << ","
+                  << QString::number(up.bytes / 1024.0 / seconds, 'f', 1) << "," << QString::number(m_stats.frames / seconds, 'f', 1) << ","
+                  << m_stats.frameLatencyMs.percentile(50) << "," << m_stats.frameLatencyMs.percentile(99) << ","
+                  << QString::number(m_stats.stalenessMs.mean(), 'f', 1) << "," << m_stats.stalenessMs.percentile(99) << ","
+                  << m_stats.stalenessMs.max() << "," << down.queueMs.percentile(99) << "," << down.lostMessages + up.lostMessages << ","
+                  << viewers.inputEchoes << "," << viewers.inputLatencyMs.percentile(50) << "," << viewers.inputLatencyMs.percentile(99) << "\n";
+            m_out.flush();
+            return;
+        }
+
+        m_out << phase.name << " (" << phase.down.bandwidthKbit << "/" << phase.up.bandwidthKbit << " kbit, "
+              << phase.down.latencyMs << " +-" << phase.down.jitterMs << " ms, " << phase.down.lossPercent << "% loss), "
+              << seconds << " s:\n"
+              << "  down " << QString::number(down.bytes / 1024.0 / seconds, 'f', 1) << " KB/s, up "
+              << QString::number(up.bytes / 1024.0 / seconds, 'f', 1) << " KB/s, "
+              << QString::number(m_stats.frames / seconds, 'f', 1) << " frames/s, "
+              << down.lostMessages << " down and " << up.lostMessages << " up messages lost a segment\n"
+              << "  frame latency ms: " << m_stats.frameLatencyMs.summary() << "\n"
+              << "  staleness ms:     " << m_stats.stalenessMs.summary() << "\n"
+              << "  queued ms:        " << down.queueMs.summary() << "\n";
+
+        if(viewers.inputEvents > 0)
+            m_out << "  input:            " << QString::number(viewers.inputEvents / seconds, 'f', 1) << " events/s, "
+                  << viewers.inputEchoes << " probes\n";
+
+        if(viewers.inputLatencyMs.count() > 0)
+            m_out << "  input latency ms: " << viewers.inputLatencyMs.summary() << "\n";
+
+        m_out.flush();
+    }
+
+    void finish()
+    {
+        if(!m_sampleTimer.isActive())
+            return;
+
+        m_sampleTimer.stop();
+
+        for(NetemLink *link : m_links)
+            link->viewer->stop();
+
+        m_out.flush();
+        QCoreApplication::exit(m_failures > 0 ? 1 : 0);
+    }
+
+    NetemOptions   m_options;
+    HostLauncher  &m_launcher;
+    QTextStream   &m_out;
+    StandInProxy   m_proxy;
+
+    QList<NetemLink*> m_links;
+
+    QTimer        m_sampleTimer;
+    QElapsedTimer m_clock;
+    int           m_phase;          // -1 until all viewers stream
+    qint64        m_phaseStartMs;
+    PhaseStats    m_stats;          // of the current phase
+    int           m_failures;
+};
+
+static bool parseOptions(const QStringList &args, NetemOptions &options, HostLauncher &launcher, QTextStream &out)
+{
+    QString profile = "3g";
+
+    for(int i=0;i<args.size();++i)
+    {
+        const QString &arg = args.at(i);
+
+        if(arg.startsWith("--profile="))
+            profile = arg.mid(10);
+        else if(arg.startsWith("--viewers="))
+            options.viewers = qBound(1, arg.mid(10).toInt(), 16); // as many as QV_MAX_VIEWERS lets in
+        else if(arg.startsWith("--input="))
+            options.inputRate = qMax(0, arg.mid(8).toInt());
+        else if(arg.startsWith("--seed="))
+            options.seed = arg.mid(7).toULongLong();
+        else if(arg.startsWith("--port="))
+            options.port = static_cast<quint16>(arg.mid(7).toUInt());
+        else if(arg.startsWith("--password="))
+            options.password = arg.mid(11);
+        else if(arg.startsWith("--timeout="))
+            options.timeoutS = qMax(1, arg.mid(10).toInt());
+        else if(arg == "--csv")
+            options.csv = true;
+        else if(!launcher.parseArgument(arg))
+            return false;
+    }
+
+    if(!options.profile.load(profile))
+    {
+        out << options.profile.errorString() << "\n";
+        return false;
+    }
+
+    return !options.password.isEmpty() && launcher.isValid();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    NetemOptions options;
+    HostLauncher launcher;
+
+    if(!parseOptions(app.arguments().mid(1), options, launcher, out))
+    {
+        out << "usage: QuickViewerNetem [--profile=" << LinkProfile::builtInNames().join('|') << "|script] [--viewers=N]\n"
+            << "                        [--input=rate] [--seed=n] [--port=p] [--password=pw] [--timeout=s] [--csv]\n"
+            << "                        " << HostLauncher::usage() << "\n";
+        return 2;
+    }
+
+    NetemRun run(options, launcher, out);
+
+    if(!run.start())
+        return 1;
+
+    return app.exec();
+}
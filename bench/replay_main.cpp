@@ -0,0 +1,808 @@
+#include "histogram.h"
+#include "host_packet_reader.h"
+#include "packet_parser.h"
+#include "protocol.h"
+#include "session_recorder.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMap>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+#include <QtWebSockets/qwebsocket.h>
+
+/* Plays back a session a host recorded with QV_RECORD_DIR.
+ *
+ *   QuickViewerReplay file.qvsr [--from=s] [--to=s] [--timeline=ms] [--decode] [--passes=N]
+ *
+ * Offline, at full speed: the viewer's messages go through the host's
+ * PacketParser, the host's are split as the viewer splits them. Prints the
+ * bytes per command, how long the viewer took to ack tiles and frames, with
+ * --timeline the bandwidth over time, with --decode what decoding the images
+ * costs and with --passes the parsers' throughput over N runs.
+ *
+ *   QuickViewerReplay file.qvsr --connect=ws://host:port --login=id --password=pw [--speed=real|max|x]
+ *
+ * Live, as a viewer on a host's LAN listener (QV_LAN_PORT): the recorded
+ * viewer messages from its KEY_CONNECT_UUID on go out at the recorded pace,
+ * x times as fast, or all at once. KEY_SET_AUTH_REQUEST is made anew for the
+ * host's nonce, and the recorded acks are left out for acks of the frames and
+ * tiles this host sends, as they come in. Prints what came back per command
+ * next to the recording and how late the messages went out. */
+
+struct ReplayOptions
+{
+    QString file;
+    qint64  fromUs;
+    qint64  toUs;       // -1 for the end
+    int     timelineMs; // 0 for none
+    bool    decode;
+    int     passes;
+
+    QUrl    url;        // live
+    QString login;
+    QString password;
+    double  speed;      // 0 for as fast as it goes
+
+    ReplayOptions() : fromUs(0), toUs(-1), timelineMs(0), decode(false), passes(0), speed(1.0) {}
+};
+
+struct CommandStat
+{
+    quint64 count;
+    quint64 bytes;
+
+    CommandStat() : count(0), bytes(0) {}
+};
+
+typedef QMap<quint32, CommandStat> CommandStats; // 0 for text messages
+
+static QString commandName(quint32 command)
+{
+    if(command == 0)
+        return "text";
+
+    QString name;
+
+    for(int i=0;i<4;++i)
+    {
+        const char c = static_cast<char>(command >> (8 * i));
+        name.append(c >= 0x20 && c < 0x7f ? QChar(c) : QChar('?'));
+    }
+
+    return name;
+}
+
+static void addStat(CommandStats &stats, quint32 command, quint64 bytes)
+{
+    CommandStat &stat = stats[command];
+    ++stat.count;
+    stat.bytes += bytes;
+}
+
+static void printStats(QTextStream &out, const QString &title, const CommandStats &stats, const CommandStats *compare = Q_NULLPTR)
+{
+    out << title << "\n";
+
+    for(CommandStats::const_iterator it = stats.constBegin(); it != stats.constEnd(); ++it)
+    {
+        out << "  " << commandName(it.key()) << QString::number(it.value().count).rightJustified(10)
+            << QString::number(it.value().bytes / 1024).rightJustified(10) << " KB";
+
+        if(compare)
+        {
+            const CommandStat recorded = compare->value(it.key());
+            out << "   recorded" << QString::number(recorded.count).rightJustified(10)
+                << QString::number(recorded.bytes / 1024).rightJustified(10) << " KB";
+        }
+
+        out << "\n";
+    }
+}
+
+static bool inRange(const SessionRecording::Record &record, const ReplayOptions &options)
+{
+    return options.toUs < 0 || record.timeUs <= options.toUs;
+}
+
+static void printInfo(QTextStream &out, const SessionRecording &recording)
+{
+    out << "session of " << QDateTime::fromMSecsSinceEpoch(recording.startMsecsSinceEpoch()).toString(Qt::ISODate)
+        << ", " << QString::number(static_cast<double>(recording.durationUs()) / 1e6, 'f', 1) << " s, "
+        << recording.recordCount() << " messages" << (recording.isComplete() ? "" : ", not closed by the host") << "\n";
+}
+
+/* The session as it went: bytes per command, ack delays, with --timeline
+ * the bandwidth each way, with --decode the cost of the images */
+class SessionAnalysis
+{
+public:
+    SessionAnalysis(const ReplayOptions &options, QTextStream &out) :
+        m_options(options),
+        m_out(out),
+        m_bucketStartUs(options.fromUs),
+        m_bucketIn(0),
+        m_bucketOut(0),
+        m_bucketImages(0),
+        m_images(0),
+        m_decoded(0),
+        m_decodeFailed(0),
+        m_decodeNsecs(0)
+    {
+        if(m_options.timelineMs > 0)
+            m_out << "      s   in KB/s  out KB/s  images\n";
+    }
+
+    void add(const SessionRecording::Record &record)
+    {
+        while(m_options.timelineMs > 0 && record.timeUs >= m_bucketStartUs + m_options.timelineMs * 1000)
+            printBucket();
+
+        if(record.kind == SessionFile::Text)
+        {
+            addStat(record.outbound ? m_outbound : m_inbound, 0, static_cast<quint64>(record.size));
+            (record.outbound ? m_bucketOut : m_bucketIn) += static_cast<quint64>(record.size);
+        }
+        else if(record.outbound)
+            addOutbound(record);
+        else
+            addInbound(record);
+    }
+
+    int finish()
+    {
+        if(m_bucketIn + m_bucketOut > 0)
+            printBucket();
+
+        printStats(m_out, "viewer to host        count     bytes", m_inbound);
+        printStats(m_out, "host to viewer        count     bytes", m_outbound);
+
+        if(!m_nested.isEmpty())
+            printStats(m_out, "in batches and fragments", m_nested);
+
+        if(m_frameAckMs.count() > 0)
+            m_out << "frame ack ms: " << m_frameAckMs.summary() << "\n";
+
+        if(m_tileAckMs.count() > 0)
+            m_out << "tile ack ms: " << m_tileAckMs.summary() << "\n";
+
+        if(m_options.decode)
+            m_out << "decoded " << m_decoded << " of " << m_images << " images, "
+                  << QString::number(m_decoded > 0 ? m_decodeNsecs / 1000.0 / m_decoded : 0.0, 'f', 0) << " us per image\n";
+
+        const quint32 errors = m_parser.errorCount() + m_reader.errorCount();
+
+        if(errors > 0)
+            m_out << errors << " malformed packets\n";
+
+        return errors > 0 || m_decodeFailed > 0 ? 1 : 0;
+    }
+
+private:
+    void addInbound(const SessionRecording::Record &record)
+    {
+        const qint64 nowMs = record.timeUs / 1000;
+
+        m_bucketIn += static_cast<quint64>(record.size);
+        m_parser.append(QByteArray::fromRawData(record.data, record.size));
+
+        PacketParser::Packet packet;
+
+        while(m_parser.next(packet))
+        {
+            const quint32 command = fourCCFromData(packet.command);
+            addStat(m_inbound, command, static_cast<quint64>(packet.size) + 8);
+
+            if(command == KEY_FRAME_RECEIVED)
+            {
+                FrameReceivedPayload ack;
+
+                // cumulative, every frame up to it
+                if(ack.decode(packet.payload, packet.size))
+                    while(!m_framesSent.isEmpty() && m_framesSent.firstKey() <= ack.frameSeq)
+                        m_frameAckMs.add(static_cast<quint64>(nowMs - m_framesSent.take(m_framesSent.firstKey())));
+            }
+            else if(command == KEY_TILE_RECEIVED)
+            {
+                TileReceivedPayload ack;
+
+                if(ack.decode(packet.payload, packet.size) && m_tilesSent.contains(ack.tileNum))
+                    m_tileAckMs.add(static_cast<quint64>(nowMs - m_tilesSent.take(ack.tileNum)));
+            }
+        }
+    }
+
+    void addOutbound(const SessionRecording::Record &record)
+    {
+        const qint64 nowMs = record.timeUs / 1000;
+
+        m_bucketOut += static_cast<quint64>(record.size);
+        m_reader.append(record.data, record.size);
+
+        HostPacketReader::Packet packet;
+
+        while(m_reader.next(packet))
+        {
+            addStat(packet.nested ? m_nested : m_outbound, packet.command,
+                    static_cast<quint64>(packet.size) + (packet.nested ? 8 : PREAMBLE_SIZE + 8));
+
+            if(packet.command == KEY_IMAGE_BATCH)
+            {
+                PayloadReader batch(packet.payload, packet.size);
+                quint32 frameSeq = 0;
+                quint16 count = 0;
+                quint16 flags = 0;
+
+                if(batch.readUint32(frameSeq) && batch.readUint16(count) && batch.readUint16(flags) && (flags & BATCH_FLAG_FINAL))
+                    m_framesSent.insert(frameSeq, nowMs);
+            }
+            else if(packet.command == KEY_IMAGE_TILE || packet.command == KEY_IMAGE_SCREEN)
+            {
+                const int header = packet.command == KEY_IMAGE_TILE ? 12 : 0; // position and tile number
+
+                ++m_images;
+                ++m_bucketImages;
+
+                // a tile outside a batch is acked on its own
+                if(packet.command == KEY_IMAGE_TILE && !packet.nested && packet.size >= header)
+                    m_tilesSent.insert(static_cast<quint16>(uint32FromData(packet.payload + 8)), nowMs);
+
+                if(m_options.decode && packet.size > header)
+                    decode(packet.payload + header, packet.size - header);
+            }
+        }
+    }
+
+    void decode(const char *data, int size)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        QImage image;
+
+        if(image.loadFromData(reinterpret_cast<const uchar*>(data), size))
+            ++m_decoded;
+        else
+            ++m_decodeFailed;
+
+        m_decodeNsecs += timer.nsecsElapsed();
+    }
+
+    void printBucket()
+    {
+        const double seconds = m_options.timelineMs / 1000.0;
+
+        m_out << QString::number(static_cast<double>(m_bucketStartUs) / 1e6, 'f', 1).rightJustified(7)
+              << QString::number(m_bucketIn / 1024.0 / seconds, 'f', 1).rightJustified(10)
+              << QString::number(m_bucketOut / 1024.0 / seconds, 'f', 1).rightJustified(10)
+              << QString::number(m_bucketImages).rightJustified(8) << "\n";
+
+        m_bucketStartUs += m_options.timelineMs * 1000;
+        m_bucketIn = m_bucketOut = m_bucketImages = 0;
+    }
+
+    const ReplayOptions &m_options;
+    QTextStream &m_out;
+
+    PacketParser     m_parser;
+    HostPacketReader m_reader;
+
+    CommandStats m_inbound;
+    CommandStats m_outbound;
+    CommandStats m_nested; // in batches and joined fragments
+
+    QMap<quint32, qint64> m_framesSent; // frame sequence, when its final part went out
+    QMap<quint16, qint64> m_tilesSent;
+    Histogram m_frameAckMs;
+    Histogram m_tileAckMs;
+
+    qint64  m_bucketStartUs;
+    quint64 m_bucketIn;
+    quint64 m_bucketOut;
+    quint64 m_bucketImages;
+
+    quint64 m_images;
+    quint64 m_decoded;
+    quint64 m_decodeFailed;
+    qint64  m_decodeNsecs;
+};
+
+static int analyse(SessionRecording &recording, const ReplayOptions &options, QTextStream &out)
+{
+    SessionAnalysis analysis(options, out);
+
+    recording.seek(options.fromUs);
+    SessionRecording::Record record;
+
+    while(recording.next(record) && inRange(record, options))
+        analysis.add(record);
+
+    return analysis.finish();
+}
+
+// the parsers alone over the session, passes times
+static void measureParsers(SessionRecording &recording, const ReplayOptions &options, QTextStream &out)
+{
+    quint64 bytes = 0;
+    quint64 packets = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int pass=0;pass<options.passes;++pass)
+    {
+        PacketParser parser;
+        HostPacketReader reader;
+
+        recording.seek(options.fromUs);
+        SessionRecording::Record record;
+
+        while(recording.next(record) && inRange(record, options))
+        {
+            if(record.kind != SessionFile::Binary)
+                continue;
+
+            bytes += static_cast<quint64>(record.size);
+
+            if(record.outbound)
+            {
+                reader.append(record.data, record.size);
+
+                HostPacketReader::Packet packet;
+
+                while(reader.next(packet))
+                    ++packets;
+            }
+            else
+            {
+                parser.append(QByteArray::fromRawData(record.data, record.size));
+
+                PacketParser::Packet packet;
+
+                while(parser.next(packet))
+                    ++packets;
+            }
+        }
+    }
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+
+    out << "parsers: " << QString::number(seconds > 0 ? bytes / 1048576.0 / seconds : 0.0, 'f', 0) << " MB/s, "
+        << QString::number(seconds > 0 ? packets / seconds / 1e6 : 0.0, 'f', 2) << " M packets/s over "
+        << options.passes << " passes\n";
+}
+
+/* The recorded viewer on a live host. A plain object, the socket's signals go
+ * to lambdas. */
+class LiveReplay
+{
+public:
+    LiveReplay(SessionRecording &recording, const ReplayOptions &options, QTextStream &out) :
+        m_recording(recording),
+        m_options(options),
+        m_out(out),
+        m_started(false),
+        m_finishing(false),
+        m_finished(false),
+        m_hasPending(false),
+        m_baseUs(0),
+        m_capabilities(0),
+        m_sentBytes(0),
+        m_frameAcks(0),
+        m_tileAcks(0),
+        m_failed(false)
+    {
+        m_timer.setSingleShot(true);
+
+        QObject::connect(&m_timer, &QTimer::timeout, [this]() {pump();});
+        QObject::connect(&m_socket, &QWebSocket::connected, [this]() {
+            // asks for the desktop as it would ask the proxy
+            m_socket.sendTextMessage(QString("1111CONN|%1|1|").arg(m_options.login));
+        });
+        QObject::connect(&m_socket, &QWebSocket::binaryMessageReceived, [this](const QByteArray &message) {received(message);});
+        QObject::connect(&m_socket, &QWebSocket::disconnected, [this]() {
+            if(!m_finishing)
+            {
+                m_out << "the host closed the connection: " << m_socket.closeReason() << "\n";
+                m_failed = true;
+            }
+
+            finish();
+        });
+        QObject::connect(&m_socket, static_cast<void(QWebSocket::*)(QAbstractSocket::SocketError)>(&QWebSocket::error), [this](QAbstractSocket::SocketError) {
+            if(m_finishing)
+                return;
+
+            m_out << "connection failed: " << m_socket.errorString() << "\n";
+            m_failed = true;
+            finish();
+        });
+    }
+
+    void start()
+    {
+        m_socket.open(m_options.url);
+    }
+
+private:
+    void received(const QByteArray &message)
+    {
+        m_reader.append(message);
+
+        HostPacketReader::Packet packet;
+        bool frameFinal = false;
+        quint32 frameSeq = 0;
+
+        while(m_reader.next(packet))
+        {
+            if(!packet.nested)
+                addStat(m_received, packet.command, static_cast<quint64>(packet.size) + PREAMBLE_SIZE + 8);
+
+            if(m_started)
+                ackImage(packet, frameFinal, frameSeq);
+
+            if(packet.command == KEY_PROXY_CONNECT && !m_started)
+            {
+                if(QString::fromUtf8(packet.payload, packet.size) != m_options.login)
+                {
+                    fail("the host is not desktop " + m_options.login);
+                    return;
+                }
+
+                startReplay();
+            }
+            else if(packet.command == KEY_SET_NONCE)
+            {
+                m_nonce = QByteArray(packet.payload, packet.size);
+                pump(); // may wait for it
+            }
+            else if(packet.command == KEY_SET_AUTH_RESPONSE)
+            {
+                PayloadReader reader(packet.payload, packet.size);
+                quint32 state = 0;
+
+                if(!reader.readUint32(state) || state == 0)
+                {
+                    fail("the host did not take the password");
+                    return;
+                }
+            }
+            else if(packet.command == KEY_CAPABILITIES)
+            {
+                PayloadReader reader(packet.payload, packet.size);
+                reader.readUint32(m_capabilities);
+            }
+        }
+
+        // a batch comes in one message, its tiles are all in now
+        if(frameFinal)
+        {
+            QByteArray ack;
+            appendFourCC(ack, frameSeq);
+            sendAck(KEY_FRAME_RECEIVED, ack);
+            ++m_frameAcks;
+        }
+    }
+
+    // as the viewer acks: a frame ack covers the tiles of a batch, else each image on its own
+    void ackImage(const HostPacketReader::Packet &packet, bool &frameFinal, quint32 &frameSeq)
+    {
+        const bool frameAck = packet.nested && (m_capabilities & CAP_FRAME_ACK);
+
+        if(packet.command == KEY_IMAGE_BATCH)
+        {
+            PayloadReader batch(packet.payload, packet.size);
+            quint16 count = 0;
+            quint16 flags = 0;
+
+            if((m_capabilities & CAP_FRAME_ACK) && batch.readUint32(frameSeq) && batch.readUint16(count) && batch.readUint16(flags) && (flags & BATCH_FLAG_FINAL))
+                frameFinal = true;
+        }
+        else if(packet.command == KEY_IMAGE_TILE && !frameAck && packet.size >= 12)
+        {
+            QByteArray ack;
+            appendFourCC(ack, uint32FromData(packet.payload + 8)); // tile number and a zero, UINT16 LE each
+            sendAck(KEY_TILE_RECEIVED, ack);
+            ++m_tileAcks;
+        }
+        else if(packet.command == KEY_IMAGE_SCREEN && !frameAck)
+        {
+            QByteArray ack;
+            appendFourCC(ack, 9999); // drew the full screen, see displayField.js
+            sendAck(KEY_TILE_RECEIVED, ack);
+            ++m_tileAcks;
+        }
+    }
+
+    void sendAck(quint32 command, const QByteArray &payload)
+    {
+        QByteArray message;
+        appendFourCC(message, command);
+        appendFourCC(message, static_cast<quint32>(payload.size()));
+        message.append(payload);
+
+        m_socket.sendBinaryMessage(message);
+        m_sentBytes += message.size();
+    }
+
+    // from the viewer's KEY_CONNECT_UUID on, what came before was for the proxy
+    void startReplay()
+    {
+        m_started = true;
+        m_recording.seek(m_options.fromUs);
+
+        SessionRecording::Record record;
+
+        while(m_recording.next(record) && inRange(record, m_options))
+        {
+            if(record.outbound)
+            {
+                addOutbound(record);
+                continue;
+            }
+
+            if(record.kind == SessionFile::Binary && record.size >= 4 && fourCCFromData(record.data) == KEY_CONNECT_UUID)
+            {
+                m_pending = record;
+                m_hasPending = true;
+                m_baseUs = record.timeUs;
+                break;
+            }
+        }
+
+        if(!m_hasPending)
+        {
+            fail("no KEY_CONNECT_UUID from the viewer in the recording");
+            return;
+        }
+
+        m_clock.start();
+        pump();
+    }
+
+    void pump()
+    {
+        if(!m_started || m_finishing)
+            return;
+
+        while(m_hasPending)
+        {
+            const qint64 dueUs = m_options.speed > 0 ? static_cast<qint64>((m_pending.timeUs - m_baseUs) / m_options.speed) : 0;
+            const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+
+            if(nowUs < dueUs)
+            {
+                m_timer.start(static_cast<int>((dueUs - nowUs + 999) / 1000));
+                return;
+            }
+
+            if(!send(m_pending))
+                return; // waits for the nonce
+
+            m_lateMs.add(static_cast<quint64>((nowUs - dueUs) / 1000));
+            advance();
+        }
+
+        if(!m_finishing)
+        {
+            m_finishing = true;
+            QTimer::singleShot(LINGER_MS, [this]() {m_socket.close();}); // for the host's answers to the last messages
+        }
+    }
+
+    void advance()
+    {
+        m_hasPending = false;
+
+        SessionRecording::Record record;
+
+        while(m_recording.next(record) && inRange(record, m_options))
+        {
+            if(record.outbound)
+            {
+                addOutbound(record);
+                continue;
+            }
+
+            // the listener took our own
+            if(record.kind == SessionFile::Text && QByteArray::fromRawData(record.data, record.size).startsWith("1111CONN|"))
+                continue;
+
+            // acked what came in from this host instead, see received()
+            if(record.kind == SessionFile::Binary && record.size >= 4 &&
+               (fourCCFromData(record.data) == KEY_FRAME_RECEIVED || fourCCFromData(record.data) == KEY_TILE_RECEIVED))
+                continue;
+
+            m_pending = record;
+            m_hasPending = true;
+            return;
+        }
+    }
+
+    bool send(const SessionRecording::Record &record)
+    {
+        if(record.kind == SessionFile::Text)
+        {
+            m_socket.sendTextMessage(QString::fromUtf8(record.data, record.size));
+            m_sentBytes += record.size;
+            return true;
+        }
+
+        QByteArray message = QByteArray::fromRawData(record.data, record.size);
+
+        // the recorded one answered another nonce
+        if(record.size >= 4 && fourCCFromData(record.data) == KEY_SET_AUTH_REQUEST)
+        {
+            if(m_nonce.isEmpty())
+                return false;
+
+            const QByteArray hash = QByteArray::fromBase64(authHashSum(m_nonce, m_options.login, m_options.password));
+
+            message.clear();
+            appendFourCC(message, KEY_SET_AUTH_REQUEST);
+            appendFourCC(message, static_cast<quint32>(hash.size())); // UINT32 LE as well
+            message.append(hash);
+        }
+
+        m_socket.sendBinaryMessage(message);
+        m_sentBytes += message.size();
+        return true;
+    }
+
+    void addOutbound(const SessionRecording::Record &record)
+    {
+        if(record.kind == SessionFile::Text)
+            return;
+
+        m_recordedReader.append(record.data, record.size);
+
+        HostPacketReader::Packet packet;
+
+        while(m_recordedReader.next(packet))
+            if(!packet.nested)
+                addStat(m_recorded, packet.command, static_cast<quint64>(packet.size) + PREAMBLE_SIZE + 8);
+    }
+
+    void fail(const QString &reason)
+    {
+        m_out << reason << "\n";
+        m_failed = true;
+        m_finishing = true;
+        m_socket.close();
+    }
+
+    void finish()
+    {
+        if(m_finished)
+            return;
+
+        m_finished = true;
+        m_timer.stop();
+
+        m_out << "sent " << m_sentBytes / 1024 << " KB in " << QString::number(m_clock.isValid() ? m_clock.elapsed() / 1000.0 : 0.0, 'f', 1) << " s\n";
+
+        if(m_lateMs.count() > 0)
+            m_out << "late ms: " << m_lateMs.summary() << "\n";
+
+        m_out << "acked " << m_frameAcks << " frames and " << m_tileAcks << " tiles\n";
+
+        printStats(m_out, "host to viewer        count     bytes", m_received, &m_recorded);
+        m_out.flush();
+
+        QCoreApplication::exit(m_failed ? 1 : 0);
+    }
+
+    static const int LINGER_MS = 2000;
+
+    SessionRecording &m_recording;
+    const ReplayOptions &m_options;
+    QTextStream &m_out;
+
+    QWebSocket       m_socket;
+    QTimer           m_timer;
+    QElapsedTimer    m_clock;
+    HostPacketReader m_reader;
+    HostPacketReader m_recordedReader;
+
+    bool    m_started;
+    bool    m_finishing;
+    bool    m_finished;
+    bool    m_hasPending;
+    SessionRecording::Record m_pending;
+    qint64  m_baseUs;   // recorded time of the first message sent
+    QByteArray m_nonce;
+    quint32 m_capabilities; // as the host answered the recorded KEY_CAPABILITIES
+
+    qint64       m_sentBytes;
+    quint64      m_frameAcks;
+    quint64      m_tileAcks;
+    Histogram    m_lateMs;
+    CommandStats m_received;
+    CommandStats m_recorded; // what the host sent in the recording, as far as it was replayed
+    bool         m_failed;
+};
+
+static bool parseOptions(const QStringList &args, ReplayOptions &options)
+{
+    for(int i=0;i<args.size();++i)
+    {
+        const QString &arg = args.at(i);
+
+        if(arg.startsWith("--from="))
+            options.fromUs = static_cast<qint64>(arg.mid(7).toDouble() * 1e6);
+        else if(arg.startsWith("--to="))
+            options.toUs = static_cast<qint64>(arg.mid(5).toDouble() * 1e6);
+        else if(arg.startsWith("--timeline="))
+            options.timelineMs = qMax(1, arg.mid(11).toInt());
+        else if(arg == "--timeline")
+            options.timelineMs = 1000;
+        else if(arg == "--decode")
+            options.decode = true;
+        else if(arg.startsWith("--passes="))
+            options.passes = qMax(1, arg.mid(9).toInt());
+        else if(arg.startsWith("--connect="))
+            options.url = QUrl(arg.mid(10));
+        else if(arg.startsWith("--login="))
+            options.login = arg.mid(8);
+        else if(arg.startsWith("--password="))
+            options.password = arg.mid(11);
+        else if(arg.startsWith("--speed="))
+        {
+            const QString speed = arg.mid(8);
+            options.speed = speed == "max" ? 0.0 : speed == "real" ? 1.0 : speed.toDouble();
+
+            if(speed != "max" && options.speed <= 0)
+                return false;
+        }
+        else if(arg.startsWith("--") || !options.file.isEmpty())
+            return false;
+        else options.file = arg;
+    }
+
+    return !options.file.isEmpty() && (options.url.isEmpty() || (options.url.isValid() && !options.login.isEmpty()));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    ReplayOptions options;
+
+    if(!parseOptions(app.arguments().mid(1), options))
+    {
+        out << "usage: QuickViewerReplay file.qvsr [--from=s] [--to=s] [--timeline[=ms]] [--decode] [--passes=N]\n"
+            << "       QuickViewerReplay file.qvsr --connect=ws://host:port --login=id --password=pw [--speed=real|max|x]\n";
+        return 2;
+    }
+
+    SessionRecording recording;
+
+    if(!recording.open(options.file))
+    {
+        out << options.file << ": " << recording.errorString() << "\n";
+        return 1;
+    }
+
+    printInfo(out, recording);
+
+    if(options.url.isEmpty())
+    {
+        const int result = analyse(recording, options, out);
+
+        if(options.passes > 0)
+            measureParsers(recording, options, out);
+
+        return result;
+    }
+
+    out.flush();
+
+    LiveReplay replay(recording, options, out);
+    replay.start();
+
+    return app.exec();
+}
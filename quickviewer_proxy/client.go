@@ -264,19 +264,18 @@ func (c *Client) readPump() {
 						// is this desktop already connected to somebody else?
 						if client.partner != nil {
 							//client.partner.conn.Close()
-							break // don't break what's already happening.
-						} else {
-
-							c.partner = client
-							client.partner = c
+							continue // don't break what's already happening, the desktop may have registered another connection for more viewers.
+						}
 
-							log.Printf("Creating connection passthru for client id: %s", client.id)
-							match = true
+						c.partner = client
+						client.partner = c
 
-							// Send message to desktop host to kick off nonce
-							//c.partner.binmsg <- append([]byte("1111REGO"), []byte(client_info[1])...) // send back client id
-						}
+						log.Printf("Creating connection passthru for client id: %s", client.id)
+						match = true
 
+						// Send message to desktop host to kick off nonce
+						//c.partner.binmsg <- append([]byte("1111REGO"), []byte(client_info[1])...) // send back client id
+						break
 					}
 				}
 
@@ -13,10 +13,22 @@ var KEY_TILE_RECEIVED = new Uint8Array([84,76,82,68]); 		//"TLRD";
 var KEY_SET_AUTH_REQUEST = new Uint8Array([83,65,82,81]); 	//"SARQ";
 var KEY_CONNECT_UUID = new Uint8Array([67,84,85,85]); 		//"CTUU";
 var KEY_DEBUG = new Uint8Array([68,66,85,71]); 				//"DBUG";
+var KEY_CAPABILITIES = new Uint8Array([67,65,80,83]); 		//"CAPS";
+var KEY_FRAME_RECEIVED = new Uint8Array([70,65,67,75]); 	//"FACK";
+var KEY_RESUME = new Uint8Array([82,83,85,77]); 			//"RSUM";
+var KEY_TILE_HASHES = new Uint8Array([84,76,72,83]); 		//"TLHS";
+var KEY_STREAM_PARAMS = new Uint8Array([83,84,82,80]); 		//"STRP";
+var KEY_INPUT_BATCH = new Uint8Array([73,78,80,66]); 		//"INPB";
+var KEY_INPUT_LATENCY = new Uint8Array([73,78,80,76]); 		//"INPL";
 
 var KEY_IMAGE_PARAM = "73,77,71,80";	//new Uint8Array([73,77,71,80]); //ascii: "IMGP";
 var KEY_IMAGE_TILE = "73,77,71,84";		//IMGT
 var KEY_IMAGE_SCREEN = "73,77,71,83";	//IMGS
+var KEY_IMAGE_BATCH = "73,77,71,66";	//IMGB
+var KEY_FRAGMENT = "70,82,65,71";		//FRAG
+var KEY_RESUME_TOKEN = "82,84,79,75";	//RTOK
+var KEY_INPUT_ECHO = "73,78,80,69";		//INPE
+var KEY_HOST_STATS = "83,84,65,84";		//STAT
 var KEY_SET_NONCE = "83,84,78,67";		//STNC
 var KEY_SET_AUTH_RESPONSE 		= "83,65,82,80"; //SARP;
 var KEY_CHECK_AUTH_RESPONSE 	= "67,65,82,80"; //CARP;
@@ -28,6 +40,54 @@ var REQUEST_MIN_SIZE = HEADER_SIZE + COMMAND_SIZE; // header ('1111') + command
 
 var MAX_PAYLOAD_SIZE = 256000;
 
+// Capabilities, sent after authentication. The host answers with those it will use.
+var CAP_IMAGE_BATCH = 0x00000001; // all tiles of a frame in one IMGB message
+var CAP_FRAGMENT    = 0x00000002; // large images arrive as FRAG pieces
+var CAP_FRAME_ACK   = 0x00000004; // one cumulative FACK per drawn frame instead of a TLRD per tile
+var CAP_RESUME      = 0x00000008; // a dropped link is resumed with a token instead of a new session
+var CAP_TILE_HASH   = 0x00000010; // report tile hashes now and then, the host resends tiles that differ
+var CAP_STREAM_PARAMS = 0x00000020; // frame interval, tile size, codecs and quality can be asked for with STRP
+var CAP_INPUT_BATCH   = 0x00000040; // input goes out as INPB batches with event times
+var CAP_INPUT_ECHO    = 0x00000080; // INPE names the frame an input event showed up in, INPL says when it was drawn
+var CAP_HOST_STATS    = 0x00000100; // the host's metrics arrive as STAT every 2 s
+var DEBUG_HOST_STATS  = false; // ask for STAT and log it to the console
+var VIEWER_CAPABILITIES = CAP_IMAGE_BATCH | CAP_FRAGMENT | CAP_FRAME_ACK | CAP_RESUME | CAP_TILE_HASH | CAP_STREAM_PARAMS | CAP_INPUT_BATCH |
+                          CAP_INPUT_ECHO | (DEBUG_HOST_STATS ? CAP_HOST_STATS : 0);
+
+// STAT: field count + flags, then the values in this order. Totals wrap, queue and rtt are current.
+var STAT_FRAMES = 0, STAT_FULL_FRAMES = 1, STAT_TILES = 2, STAT_DIRTY_TILES = 3, STAT_CAPTURE_US = 4, STAT_DIFF_US = 5,
+    STAT_ENCODE_US = 6, STAT_ENCODED_IMAGES = 7, STAT_SENT_BYTES = 8, STAT_QUEUED_BYTES = 9, STAT_RTT_MS = 10, STAT_RECONNECTS = 11;
+
+// CAPS carries the protocol version and the codecs the viewer decodes after the flags
+var PROTOCOL_VERSION = 1;
+var CODEC_WEBP = 0x0001;
+var CODEC_JPEG = 0x0002;
+var VIEWER_CODECS = CODEC_WEBP | CODEC_JPEG;
+
+// INPB: time of the first event (ms) + count + flags, then per event ms after the first + type + two values
+var INPUT_KEY       = 1;
+var INPUT_MOUSE_KEY = 2;
+var INPUT_WHEEL     = 3; // delta x, delta y, WHEEL_NOTCH per notch
+var INPUT_MOVE      = 4;
+var INPUT_MOVE_BY   = 5;
+var INPUT_BATCH_HEADER_SIZE = 8;
+var INPUT_EVENT_SIZE        = 8;
+var INPUT_BATCH_MAX_EVENTS  = 256;
+var INPUT_BATCH_INTERVAL    = 16; // ms, a batch goes out this long after its first event
+var WHEEL_NOTCH             = 120;
+
+var FRAME_ACK_DELAY = 50; // ms, acks of frames drawn meanwhile go out as one
+
+var BATCH_HEADER_SIZE = 8; // frame sequence + tile count + flags
+var BATCH_FLAG_FINAL  = 0x0001;
+
+var FRAGMENT_HEADER_SIZE = 8; // total size + offset
+
+var TILE_HASH_INTERVAL = 3000; // ms between tile hash reports
+
+var RESUME_RETRY_DELAY   = 2000; // ms between reconnect attempts
+var RESUME_MAX_ATTEMPTS  = 25;   // stays inside the host's 60 s grace period
+
 /*
  *  https://stackoverflow.com/questions/50257210/convert-qbytearray-from-big-endian-to-little-endian/50257560
  *  The concept of endianness only applies to multi-byte data types. So the "right" order depends on what the data type is.
@@ -54,6 +114,28 @@ class DataManager
 		
 		this.dataTmp 			= new Uint8Array();
 		
+		this.capabilities 		= 0; // accepted by the host
+		this.protocolVersion 	= 0;
+		this.streamParams 		= null; // in effect, as the host last reported them
+		this.frameSeq 			= 0; // last complete batched frame
+		this.pendingTiles 		= 0; // batched tiles not drawn yet
+		this.refreshRequested 	= false; // for a tile that failed to decode, until the screen comes
+		this.ackedFrameSeq 		= null;
+		this.frameAckTimer 		= null;
+		this.fragmentBuf 		= null; // packet being reassembled from FRAG pieces
+		
+		this.tileHashes 		= null; // hash of the image each tile was last drawn from
+		this.tileHashTimer 		= null;
+		
+		this.inputEvents 		= []; // of the batch being collected, {time, type, value1, value2}
+		this.inputBatchTimer 	= null;
+		this.inputEchoes 		= []; // {time, frameSeq} of input events whose frame isn't drawn yet
+		this.hostStats 			= null; // last STAT, {time, values}
+		
+		this.resumeToken 		= null; // handed out by the host, valid for a while after the link drops
+		this.isResuming 		= false;
+		this.resumeAttempts 	= 0;
+		
 
         // console.log("performed construction.");
     }
@@ -79,8 +161,12 @@ class DataManager
         // ServerHTTP_Class
 		
 		var location_str = String(window.location.href);
+		var lanHost = urlParams.get('lan'); // e.g. ?lan=192.168.1.20:8090, straight to the host's LAN listener
 		
-		if (location_str.includes("app"))
+		if (lanHost)
+		{
+			this.webSocket = new WebSocket('ws://' + lanHost + '/');
+		} else if (location_str.includes("app"))
 		{
 			this.webSocket = new WebSocket('wss://' + window.location.hostname + ':8443/');
 		} else {
@@ -96,7 +182,7 @@ class DataManager
         this.webSocket.binaryType = 'arraybuffer';
         this.webSocket.onopen = this.socketConnected.bind(this);
         this.webSocket.onmessage = this.setData.bind(this);
-        this.webSocket.onclose = this.showDisconnectMessage.bind(this);
+        this.webSocket.onclose = this.socketClosed.bind(this);
     }
     
     startSession()
@@ -112,7 +198,7 @@ class DataManager
 				console.log("isConnected = true");						
                 this.removeDisconnectMessage();
 				
-				if ( !this.isSessionStarted &&  this.partner_id != null &&  this.partner_pw != null) 
+				if ( (!this.isSessionStarted || this.isResuming) &&  this.partner_id != null &&  this.partner_pw != null) 
 				{
 					// kick off the workflow, witha conn request, server will respond if it's valid & setup direct proxy fwd
 					this.sendToSocket("1111CONN|" + this.partner_id + "|1|");
@@ -134,6 +220,29 @@ class DataManager
         setTimeout(this.startSession.bind(this),1500);
     }
     
+    socketClosed()
+    {
+		console.log("socketClosed()");
+		
+		if(this.tileHashTimer)
+		{
+			clearInterval(this.tileHashTimer);
+			this.tileHashTimer = null;
+		}
+		
+		// reconnect and pick the session up where it stopped, the host keeps it for a while
+		if(this.isSessionStarted && this.resumeToken && this.resumeAttempts < RESUME_MAX_ATTEMPTS)
+		{
+			++this.resumeAttempts;
+			this.isConnected = false;
+			this.isResuming = true;
+			setTimeout(this.startSocket.bind(this), RESUME_RETRY_DELAY);
+			return;
+		}
+		
+		this.showDisconnectMessage();
+    }
+    
     setData(event)
     {
 		//console.log("setData(event)");
@@ -238,7 +347,7 @@ class DataManager
 				this.sendToSocket(response);
 				//this.sendToSocket("CTUU" +  this.arrayFromUint32(this.session_uuid.length) + this.session_uuid);	
 				
-			} else {
+			} else if(!this.isResuming) { // while resuming the host may simply not be back yet
 				if(this.loginClass)
 				{
                     this.loginClass.showWrongRequest();
@@ -275,7 +384,18 @@ class DataManager
         {
             var response = this.uint32FromArray(payload);
             
-            if(response === 1)
+            if(response === 1 && this.isResuming)
+            {
+                this.capabilities = 0;
+                this.pendingTiles = 0;
+                this.refreshRequested = false;
+                this.ackedFrameSeq = null;
+                this.inputEchoes = [];
+                this.fragmentBuf = null;
+                this.sendCapabilities();
+                this.sendDataMessage2(KEY_RESUME, this.resumeToken);
+            }
+            else if(response === 1)
             {
                 if(this.loginClass)
                     this.loginClass.removeLoginHtml();
@@ -287,6 +407,12 @@ class DataManager
                     this.extraKeys.createExtraKeysHtml();
                 
                 this.isSessionStarted = true;
+                this.capabilities = 0;
+                this.pendingTiles = 0;
+                this.refreshRequested = false;
+                this.ackedFrameSeq = null;
+                this.inputEchoes = [];
+                this.sendCapabilities();
                 this.webSocket.send(KEY_GET_IMAGE);
             }
             else
@@ -295,6 +421,8 @@ class DataManager
                     this.loginClass.showWrongRequest();
                 
                 this.isSessionStarted = false;
+                this.isResuming = false;
+                this.resumeToken = null;
             }
             
         }
@@ -303,6 +431,10 @@ class DataManager
             var imageWidth = this.uint32FromArray(payload.slice(0,4));
             var imageHeight = this.uint32FromArray(payload.slice(4,8));
             var rectWidth = this.uint32FromArray(payload.slice(8,12));
+            var tileCount = Math.ceil(imageWidth / rectWidth) * Math.ceil(imageHeight / rectWidth);
+            
+            if(!this.tileHashes || this.tileHashes.length !== tileCount)
+                this.tileHashes = new Uint32Array(tileCount);
             
             if(this.displayField)
                 this.displayField.setImageParameters(imageWidth,imageHeight,rectWidth);
@@ -312,20 +444,83 @@ class DataManager
             var posX = this.uint32FromArray(payload.slice(0,4));
             var posY = this.uint32FromArray(payload.slice(4,8));
             var tileNum = this.uint32FromArray(payload.slice(8,12));
-            var b64encoded = 'data:image/webp;base64,' + btoa(String.fromCharCode.apply(null, payload.slice(12)));
+            var b64encoded = this.imageDataUrl(payload.subarray(12));
 			
 			console.log("Recieved tile: " + tileNum);
             
             if(this.displayField)
-                this.displayField.setImageData(posX, posY, b64encoded, tileNum);
+                this.displayField.setImageData(posX, posY, b64encoded, tileNum, this.tileHash(payload.subarray(12)));
+        }
+        else if(command === KEY_IMAGE_BATCH)
+        {
+            this.setImageBatch(payload);
+        }
+        else if(command === KEY_FRAGMENT)
+        {
+            this.setFragment(payload);
+        }
+        else if(command === KEY_INPUT_ECHO)
+        {
+            if(payload.length >= 8)
+                this.inputEchoes.push({time: this.uint32FromArray(payload.slice(0,4)), frameSeq: this.uint32FromArray(payload.slice(4,8))});
+            
+            this.sendInputLatency(); // the frame may be drawn already, the echo can overtake it
+        }
+        else if(command === KEY_HOST_STATS)
+        {
+            this.setHostStats(payload);
+        }
+        else if(command === KEY_RESUME_TOKEN)
+        {
+            this.resumeToken = payload.slice();
+        }
+        else if(command === KEY_RESUME.toString())
+        {
+            this.isResuming = false;
+            this.resumeAttempts = 0;
+            
+            if(this.uint32FromArray(payload) !== 1) // session expired on the host, start over with a full image
+            {
+                this.resumeToken = null;
+                this.webSocket.send(KEY_GET_IMAGE);
+            }
+        }
+        else if(command === KEY_CAPABILITIES.toString())
+        {
+            this.capabilities = this.uint32FromArray(payload.slice(0,4));
+            this.protocolVersion = payload.length >= 8 ? this.uint16FromArray(payload.slice(4,6)) : 0;
+            console.log("Host capabilities: " + this.capabilities + " protocol version: " + this.protocolVersion);
+            
+            if(this.tileHashTimer)
+                clearInterval(this.tileHashTimer);
+            
+            this.tileHashTimer = (this.capabilities & CAP_TILE_HASH) ? setInterval(this.sendTileHashes.bind(this), TILE_HASH_INTERVAL) : null;
+            
+            // e.g. ?interval=100&tile=128&quality=50
+            var interval = parseInt(urlParams.get('interval')) || 0;
+            var tile = parseInt(urlParams.get('tile')) || 0;
+            var quality = parseInt(urlParams.get('quality')) || 0;
+            
+            if(interval || tile || quality)
+                this.requestStreamParams(interval, tile, 0, quality);
+        }
+        else if(command === KEY_STREAM_PARAMS.toString())
+        {
+            var view = new DataView(payload.buffer, payload.byteOffset, payload.byteLength);
+            
+            if(payload.length >= 8)
+                this.streamParams = {interval: view.getUint16(0, true), tile: view.getUint16(2, true),
+                                     codecs: view.getUint16(4, true), quality: view.getUint16(6, true)};
+            
+            console.log("Stream parameters: " + JSON.stringify(this.streamParams));
         }
         else if(command === KEY_IMAGE_SCREEN)
         {
              //console.log("got a full screen image.");
-             var b64encoded = 'data:image/webp;base64,' + btoa(String.fromCharCode.apply(null, payload));
+             var b64encoded = this.imageDataUrl(payload);
 
             if(this.displayField)
-                this.displayField.setImageScreenData(b64encoded);
+                this.displayField.setImageScreenData(b64encoded, this.tileHash(payload));
         }
         else if(command === KEY_CHECK_AUTH_RESPONSE)
         {
@@ -350,6 +545,257 @@ class DataManager
         }
     }
 	
+	// WEBP through the proxy, JPEG from a LAN listener
+	imageDataUrl(bytes)
+	{
+		var type = (bytes.length > 1 && bytes[0] === 0xFF && bytes[1] === 0xD8) ? 'image/jpeg' : 'image/webp';
+		return 'data:' + type + ';base64,' + btoa(String.fromCharCode.apply(null, bytes));
+	}
+	
+	// logs what the host did since the last STAT, with DEBUG_HOST_STATS
+	setHostStats(payload)
+	{
+		if(payload.length < 4)
+			return;
+		
+		var count = Math.min(payload[0] | (payload[1] << 8), (payload.length - 4) >> 2);
+		var values = new Uint32Array(count);
+		
+		for(var i=0;i<count;++i)
+			values[i] = this.uint32FromArray(payload.slice(4 + i * 4, 8 + i * 4));
+		
+		var now = performance.now();
+		var last = this.hostStats;
+		this.hostStats = {time: now, values: values};
+		
+		if(!DEBUG_HOST_STATS || !last || count <= STAT_RECONNECTS || last.values.length <= STAT_RECONNECTS)
+			return;
+		
+		var delta = function(index) { return (values[index] - last.values[index]) >>> 0; };
+		var seconds = (now - last.time) / 1000;
+		var frames = delta(STAT_FRAMES);
+		var images = delta(STAT_ENCODED_IMAGES);
+		var tiles = delta(STAT_TILES);
+		
+		console.log("Host: " + (frames / seconds).toFixed(1) + " fps (" + delta(STAT_FULL_FRAMES) + " full)" +
+		            ", capture " + (frames ? delta(STAT_CAPTURE_US) / frames / 1000 : 0).toFixed(2) + " ms" +
+		            ", diff " + (frames ? delta(STAT_DIFF_US) / frames / 1000 : 0).toFixed(2) + " ms" +
+		            ", encode " + (images ? delta(STAT_ENCODE_US) / images / 1000 : 0).toFixed(2) + " ms/image" +
+		            ", dirty " + (tiles ? delta(STAT_DIRTY_TILES) * 100 / tiles : 0).toFixed(1) + " %" +
+		            ", " + (delta(STAT_SENT_BYTES) / 1024 / seconds).toFixed(1) + " KB/s" +
+		            ", queue " + values[STAT_QUEUED_BYTES] + " B, rtt " + values[STAT_RTT_MS] + " ms" +
+		            ", reconnects " + values[STAT_RECONNECTS]);
+	}
+	
+	// IMGB: frame sequence, tile count and flags, then the tile packets (command + size + payload)
+	setImageBatch(payload)
+	{
+		if(payload.length < BATCH_HEADER_SIZE)
+			return;
+		
+		var frameSeq = this.uint32FromArray(payload.slice(0,4));
+		var count = payload[4] | payload[5] << 8;
+		var flags = payload[6] | payload[7] << 8;
+		var pos = BATCH_HEADER_SIZE;
+		
+		for(var i = 0; i < count; i++)
+		{
+			if(pos + COMMAND_SIZE*2 > payload.length)
+				break;
+			
+			var command = payload.slice(pos, pos+COMMAND_SIZE);
+			var size = this.uint32FromArray(payload.slice(pos+COMMAND_SIZE, pos+COMMAND_SIZE*2));
+			
+			if(pos + COMMAND_SIZE*2 + size > payload.length)
+				break;
+			
+			this.pendingTiles++; // before newData(), drawing may finish right away
+			this.newData(command, payload.subarray(pos+COMMAND_SIZE*2, pos+COMMAND_SIZE*2+size));
+			pos += COMMAND_SIZE*2 + size;
+		}
+		
+		if(flags & BATCH_FLAG_FINAL)
+		{
+			this.frameSeq = frameSeq;
+			this.scheduleFrameAck();
+			this.sendInputLatency();
+		}
+	}
+	
+	// called by the display field once a tile is drawn or failed to decode
+	tileDrawn(tileNum, drawn, hash)
+	{
+		if(drawn && this.tileHashes && tileNum < this.tileHashes.length)
+			this.tileHashes[tileNum] = hash;
+		
+		if(!(this.capabilities & CAP_FRAME_ACK))
+		{
+			if(drawn) // otherwise the host resends it
+				this.sendInput(KEY_TILE_RECEIVED, tileNum, 0);
+			return;
+		}
+		
+		if(this.pendingTiles > 0)
+			this.pendingTiles--;
+		
+		// the cumulative frame ack covers this tile as well, ask for the screen again instead
+		if(!drawn && !this.refreshRequested)
+		{
+			this.refreshRequested = true;
+			this.sendToSocket(KEY_REFRESH_DISPLAY);
+		}
+		
+		this.scheduleFrameAck();
+		this.sendInputLatency();
+	}
+	
+	// ack the last complete frame once all its tiles are drawn, cumulative and coalesced
+	scheduleFrameAck()
+	{
+		if(this.frameAckTimer || this.pendingTiles > 0)
+			return;
+		
+		if(this.ackedFrameSeq !== null && ((this.frameSeq - this.ackedFrameSeq) | 0) <= 0)
+			return;
+		
+		this.frameAckTimer = setTimeout(this.sendFrameAck.bind(this), FRAME_ACK_DELAY);
+	}
+	
+	// INPL for every echoed input event whose frame is drawn completely, ms from the event until now
+	sendInputLatency()
+	{
+		if(this.pendingTiles > 0)
+			return;
+		
+		var now = Math.floor(performance.now()) >>> 0; // the clock of the INPB event times
+		
+		while(this.inputEchoes.length > 0 && ((this.frameSeq - this.inputEchoes[0].frameSeq) | 0) >= 0)
+		{
+			var echo = this.inputEchoes.shift();
+			var buf = new Uint8Array(8);
+			var view = new DataView(buf.buffer);
+			view.setUint32(0, echo.time, true);
+			view.setUint32(4, (now - echo.time) >>> 0, true);
+			this.sendDataMessage2(KEY_INPUT_LATENCY, buf);
+		}
+	}
+	
+	// called by the display field once a full screen image is drawn
+	screenDrawn(hash)
+	{
+		if(this.tileHashes)
+			this.tileHashes.fill(hash);
+		
+		this.refreshRequested = false;
+		this.sendInput(KEY_TILE_RECEIVED,9999,0); // HACK, awlays trigger refresh
+	}
+	
+	// FNV-1a over the encoded image a tile is drawn from, the host hashes the same bytes
+	tileHash(bytes)
+	{
+		var hash = 0x811c9dc5;
+		
+		for(var i = 0; i < bytes.length; i++)
+		{
+			hash ^= bytes[i];
+			hash = Math.imul(hash, 16777619);
+		}
+		
+		return hash >>> 0;
+	}
+	
+	// TLHS: first tile + count, then what each tile holds
+	sendTileHashes()
+	{
+		if(!this.tileHashes || !this.webSocket || this.webSocket.readyState !== WebSocket.OPEN)
+			return;
+		
+		var count = Math.min(this.tileHashes.length, 0xFFFF);
+		var buf = new Uint8Array(4 + count * 4);
+		var view = new DataView(buf.buffer);
+		
+		view.setUint16(0, 0, true);
+		view.setUint16(2, count, true);
+		
+		for(var i = 0; i < count; i++)
+			view.setUint32(4 + i * 4, this.tileHashes[i], true);
+		
+		this.sendDataMessage2(KEY_TILE_HASHES, buf);
+	}
+	
+	// CAPS: flags, protocol version, codecs
+	sendCapabilities()
+	{
+		var buf = new Uint8Array(8);
+		var view = new DataView(buf.buffer);
+		
+		view.setUint32(0, VIEWER_CAPABILITIES, true);
+		view.setUint16(4, PROTOCOL_VERSION, true);
+		view.setUint16(6, VIEWER_CODECS, true);
+		
+		this.sendDataMessage2(KEY_CAPABILITIES, buf);
+	}
+	
+	// STRP: frame interval (ms), tile size (px), codecs, quality (1-100), 0 leaves one as it is.
+	// Works mid-session, the host answers with what it applied.
+	requestStreamParams(interval, tile, codecs, quality)
+	{
+		if(!(this.capabilities & CAP_STREAM_PARAMS))
+			return false;
+		
+		var buf = new Uint8Array(8);
+		var view = new DataView(buf.buffer);
+		
+		view.setUint16(0, interval, true);
+		view.setUint16(2, tile, true);
+		view.setUint16(4, codecs, true);
+		view.setUint16(6, quality, true);
+		
+		this.sendDataMessage2(KEY_STREAM_PARAMS, buf);
+		return true;
+	}
+	
+	sendFrameAck()
+	{
+		this.frameAckTimer = null;
+		
+		if(this.pendingTiles > 0)
+			return; // the next drawn tile reschedules
+		
+		this.ackedFrameSeq = this.frameSeq;
+		this.sendDataMessage2(KEY_FRAME_RECEIVED, this.arrayFromUint32(this.frameSeq));
+	}
+	
+	// FRAG: total size and offset, then a piece of a packet (command + size + payload)
+	setFragment(payload)
+	{
+		if(payload.length < FRAGMENT_HEADER_SIZE)
+			return;
+		
+		var total = this.uint32FromArray(payload.slice(0,4));
+		var offset = this.uint32FromArray(payload.slice(4,8));
+		var piece = payload.subarray(FRAGMENT_HEADER_SIZE);
+		
+		if(offset === 0)
+			this.fragmentBuf = new Uint8Array(total);
+		
+		if(!this.fragmentBuf || this.fragmentBuf.length !== total || offset + piece.length > total)
+		{
+			this.fragmentBuf = null; // lost the start, wait for the next packet
+			return;
+		}
+		
+		this.fragmentBuf.set(piece, offset);
+		
+		if(offset + piece.length < total || total < COMMAND_SIZE*2)
+			return;
+		
+		var packet = this.fragmentBuf;
+		this.fragmentBuf = null;
+		
+		this.newData(packet.slice(0, COMMAND_SIZE), packet.subarray(COMMAND_SIZE*2));
+	}
+	
 	requestRefresh() // clean the local packet cache as well
 	{
 		this.dataTmp = new Uint8Array(); // empty it out 	
@@ -410,6 +856,20 @@ class DataManager
     
     sendInput(key, param1, param2)
     {
+        if(this.capabilities & CAP_INPUT_BATCH)
+        {
+            var type = key === KEY_SET_KEY_STATE ? INPUT_KEY :
+                       key === KEY_SET_MOUSE_KEY ? INPUT_MOUSE_KEY :
+                       key === KEY_SET_CURSOR_POS ? INPUT_MOVE :
+                       key === KEY_SET_CURSOR_DELTA ? INPUT_MOVE_BY : 0;
+            
+            if(type)
+            {
+                this.queueInput(type, param1, param2);
+                return;
+            }
+        }
+        
         var posSize = this.arrayFromUint16(4);
         var posXBuf = this.arrayFromUint16(param1);
         var posYBuf = this.arrayFromUint16(param2);
@@ -431,6 +891,70 @@ class DataManager
         this.sendToSocket(buf);
     }
 	
+    // wheel deltas of a WheelEvent, in WHEEL_NOTCH per notch
+    sendWheel(deltaX, deltaY, deltaMode)
+    {
+        var scale = deltaMode === 1 ? WHEEL_NOTCH / 3 :    // lines, three a notch
+                    deltaMode === 2 ? WHEEL_NOTCH * 3 :    // pages
+                    WHEEL_NOTCH / 100;                     // pixels, about a hundred a notch
+        
+        var x = Math.max(-32768, Math.min(32767, Math.round(deltaX * scale)));
+        var y = Math.max(-32768, Math.min(32767, Math.round(deltaY * scale)));
+        
+        if(this.capabilities & CAP_INPUT_BATCH)
+        {
+            if(x || y)
+                this.queueInput(INPUT_WHEEL, x, y); // as INT16
+        }
+        else if(y) // a notch down or up
+            this.sendInput(KEY_SET_MOUSE_WHEEL, 0, y > 0 ? 1 : 0);
+    }
+    
+    // the batch goes out INPUT_BATCH_INTERVAL after its first event, or when it is full
+    queueInput(type, value1, value2)
+    {
+        this.inputEvents.push({time: Math.floor(performance.now()), type: type, value1: value1, value2: value2});
+        
+        if(this.inputEvents.length >= INPUT_BATCH_MAX_EVENTS)
+            this.sendInputBatch();
+        else if(!this.inputBatchTimer)
+            this.inputBatchTimer = setTimeout(this.sendInputBatch.bind(this), INPUT_BATCH_INTERVAL);
+    }
+    
+    sendInputBatch()
+    {
+        if(this.inputBatchTimer)
+        {
+            clearTimeout(this.inputBatchTimer);
+            this.inputBatchTimer = null;
+        }
+        
+        var events = this.inputEvents;
+        this.inputEvents = [];
+        
+        if(events.length === 0)
+            return;
+        
+        var buf = new Uint8Array(INPUT_BATCH_HEADER_SIZE + events.length * INPUT_EVENT_SIZE);
+        var view = new DataView(buf.buffer);
+        var base = events[0].time;
+        
+        view.setUint32(0, base >>> 0, true);
+        view.setUint16(4, events.length, true);
+        view.setUint16(6, 0, true);
+        
+        for(var i = 0; i < events.length; i++)
+        {
+            var offset = INPUT_BATCH_HEADER_SIZE + i * INPUT_EVENT_SIZE;
+            view.setUint16(offset, events[i].time - base, true);
+            view.setUint16(offset + 2, events[i].type, true);
+            view.setUint16(offset + 4, events[i].value1, true);
+            view.setUint16(offset + 6, events[i].value2, true);
+        }
+        
+        this.sendDataMessage2(KEY_INPUT_BATCH, buf);
+    }
+	
     sendDataMessage2(key, parameter)
     {
         var paramSize =  parameter.length
@@ -568,6 +1092,9 @@ class DataManager
 		// Reset vars
         this.isConnected = false;
         this.isSessionStarted = false;
+        this.isResuming = false;
+        this.resumeToken = null;
+        this.resumeAttempts = 0;
 		this.session_nonce 	= null;
 		this.session_uuid 	= null;
 		this.partner_id 	= null;
@@ -308,9 +308,7 @@ class DisplayField
     {
         event.preventDefault();
 
-        if(event.deltaY > 0)
-            this.dataManager.sendInput(KEY_SET_MOUSE_WHEEL,0,1);
-        else this.dataManager.sendInput(KEY_SET_MOUSE_WHEEL,0,0);
+        this.dataManager.sendWheel(event.deltaX, event.deltaY, event.deltaMode);
     }
 
     cursorPosChanged(event)
@@ -459,7 +457,7 @@ class DisplayField
         }
     }
     
-    setImageData(posX, posY, b64data, tileNum)
+    setImageData(posX, posY, b64data, tileNum, tileHash)
     {
         if(!this.ctx)
             return;
@@ -472,18 +470,24 @@ class DisplayField
         image.width = this.rectWidth;
         image.height = this.rectWidth;
         image.tileNum = tileNum;
+        image.tileHash = tileHash;
         image.foo = 2;
 
         image.onload = function()
         {
             this.ctx.drawImage(this, this.posX, this.posY, this.width, this.height);
-            this.dataManager.sendInput(KEY_TILE_RECEIVED,this.tileNum,0);
+            this.dataManager.tileDrawn(this.tileNum, true, this.tileHash);
+        }
+
+        image.onerror = function()
+        {
+            this.dataManager.tileDrawn(this.tileNum, false);
         }
 
         image.src = b64data;
     }
 
-    setImageScreenData(b64data)
+    setImageScreenData(b64data, screenHash)
     {
         if(!this.ctx)
             return;
@@ -495,11 +499,12 @@ class DisplayField
         image.dataManager = this.dataManager;
         image.width = this.canvas.width;
         image.height = this.canvas.height;
+        image.screenHash = screenHash;
 
         image.onload = function()
         {
-            this.ctx.drawImage(this, 0,0);
-            this.dataManager.sendInput(KEY_TILE_RECEIVED,9999,0); // HACK, awlays trigger refresh
+            this.ctx.drawImage(this, 0, 0, this.width, this.height); // a reduced rung sends it scaled down
+            this.dataManager.screenDrawn(this.screenHash);
         }
 
         image.src = b64data;
@@ -0,0 +1,130 @@
+#include "bandwidth_estimator.h"
+
+static const qint64 MIN_RTT_WINDOW_MS = 10000; // the minimum is forgotten after two of these
+
+BandwidthEstimator::BandwidthEstimator()
+{
+    reset();
+}
+
+void BandwidthEstimator::reset()
+{
+    m_frames.clear();
+    m_delivered = 0;
+    m_deliveredMs = -1;
+    m_drainBytes = 0;
+    m_drainStartMs = -1;
+    m_estimate = 0;
+    m_saturated = false;
+    m_minRttMs = -1;
+    m_smoothedRttMs = -1;
+    m_rttWindowMin = -1;
+    m_rttWindowStartMs = 0;
+}
+
+void BandwidthEstimator::bytesDrained(qint64 bytes, bool backlogged, qint64 nowMs)
+{
+    if(!backlogged)
+    {
+        m_drainStartMs = -1; // the socket waited for data, this says nothing about the link
+        return;
+    }
+
+    if(m_drainStartMs < 0)
+    {
+        m_drainStartMs = nowMs; // these bytes left before the sample started
+        m_drainBytes = 0;
+        return;
+    }
+
+    m_drainBytes += bytes;
+
+    qint64 elapsedMs = nowMs - m_drainStartMs;
+
+    if(elapsedMs >= SAMPLE_MS)
+    {
+        addSample(m_drainBytes * 1000 / elapsedMs, true);
+        m_drainStartMs = nowMs;
+        m_drainBytes = 0;
+    }
+}
+
+void BandwidthEstimator::frameSent(quint32 frameSeq, qint64 bytes, bool backlogged, qint64 nowMs)
+{
+    if(m_frames.size() >= MAX_FRAMES)
+        m_frames.dequeue(); // its ack got lost, a later one covers the bytes anyway
+
+    if(m_deliveredMs < 0)
+        m_deliveredMs = nowMs;
+
+    SentFrame frame;
+    frame.frameSeq = frameSeq;
+    frame.bytes = bytes;
+    frame.sentMs = nowMs;
+    frame.deliveredAtSend = m_delivered;
+    frame.deliveredMsAtSend = m_deliveredMs;
+    frame.backlogged = backlogged;
+    m_frames.enqueue(frame);
+}
+
+/* Delivery rate as in BBR: what was acknowledged since the newest acknowledged
+ * frame went out, over the time since the delivery count it saw was taken */
+qint64 BandwidthEstimator::frameAcked(quint32 frameSeq, qint64 nowMs)
+{
+    bool acked = false;
+    SentFrame newest;
+
+    while(!m_frames.isEmpty() && static_cast<qint32>(frameSeq - m_frames.head().frameSeq) >= 0)
+    {
+        newest = m_frames.dequeue();
+        m_delivered += newest.bytes;
+        acked = true;
+    }
+
+    if(!acked)
+        return -1;
+
+    m_deliveredMs = nowMs;
+
+    // ack delay of the newest frame
+    qint64 rttMs = nowMs - newest.sentMs;
+
+    m_smoothedRttMs = m_smoothedRttMs < 0 ? rttMs : m_smoothedRttMs + (rttMs - m_smoothedRttMs) / 8;
+
+    if(nowMs - m_rttWindowStartMs > MIN_RTT_WINDOW_MS)
+    {
+        m_minRttMs = m_rttWindowMin; // the last window's minimum carries over for one window
+        m_rttWindowMin = -1;
+        m_rttWindowStartMs = nowMs;
+    }
+
+    if(m_rttWindowMin < 0 || rttMs < m_rttWindowMin)
+        m_rttWindowMin = rttMs;
+
+    if(m_minRttMs < 0 || rttMs < m_minRttMs)
+        m_minRttMs = rttMs;
+
+    qint64 intervalMs = nowMs - newest.deliveredMsAtSend;
+
+    if(intervalMs >= MIN_DELIVERY_MS)
+        addSample((m_delivered - newest.deliveredAtSend) * 1000 / intervalMs, newest.backlogged);
+
+    return rttMs;
+}
+
+bool BandwidthEstimator::isRttInflated() const
+{
+    return m_minRttMs >= 0 && m_smoothedRttMs > 2 * m_minRttMs + 50;
+}
+
+void BandwidthEstimator::addSample(qint64 bytesPerSecond, bool backlogged)
+{
+    if(backlogged)
+    {
+        // the link was the limit, follow it both ways
+        m_estimate = m_saturated ? m_estimate + (bytesPerSecond - m_estimate) / 4 : bytesPerSecond;
+        m_saturated = true;
+    }
+    else if(bytesPerSecond > m_estimate)
+        m_estimate = bytesPerSecond; // carried at least this much
+}
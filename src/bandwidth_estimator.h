@@ -0,0 +1,69 @@
+#ifndef BANDWIDTH_ESTIMATOR_H
+#define BANDWIDTH_ESTIMATOR_H
+
+#include <QtGlobal>
+#include <QQueue>
+
+/* What a viewer's link carries, in bytes per second, from two kinds of
+ * samples:
+ *  - drain rate: bytes the socket took over SAMPLE_MS while more was waiting
+ *  - delivery rate: bytes the viewer acknowledged between a frame's send and
+ *    its ack, over that interval (cumulative frame acks)
+ *
+ * A sample taken while the send queue was backlogged measures the link and
+ * moves the estimate. Otherwise the stream was idle part of the time, such a
+ * sample only proves the link carries at least that much and can raise the
+ * estimate, never lower it. isSaturated() tells whether any sample measured
+ * the link at all.
+ *
+ * All times are monotonic milliseconds passed in by the caller. */
+class BandwidthEstimator
+{
+public:
+    static const qint64 SAMPLE_MS       = 200;  // shortest interval a drain sample covers
+    static const qint64 MIN_DELIVERY_MS = 50;   // shorter ack intervals are too noisy
+    static const int    MAX_FRAMES      = 64;   // frames awaiting an ack that are kept
+
+    BandwidthEstimator();
+
+    void reset();
+
+    void bytesDrained(qint64 bytes, bool backlogged, qint64 nowMs); // the socket took bytes
+    void frameSent(quint32 frameSeq, qint64 bytes, bool backlogged, qint64 nowMs);
+    qint64 frameAcked(quint32 frameSeq, qint64 nowMs); // cumulative, returns the newest frame's rtt or -1
+
+    qint64 estimate() const {return m_estimate;} // bytes/s, 0 before the first sample
+    bool isSaturated() const {return m_saturated;}
+    qint64 minRttMs() const {return m_minRttMs;} // -1 before the first ack
+    qint64 smoothedRttMs() const {return m_smoothedRttMs;}
+    bool isRttInflated() const; // acks take much longer than they did, something queues
+
+private:
+    struct SentFrame
+    {
+        quint32 frameSeq;
+        qint64  bytes;
+        qint64  sentMs;
+        qint64  deliveredAtSend;    // m_delivered when it was sent
+        qint64  deliveredMsAtSend;  // and when that was last updated
+        bool    backlogged;
+    };
+
+    void addSample(qint64 bytesPerSecond, bool backlogged);
+
+    QQueue<SentFrame> m_frames;
+    qint64 m_delivered;     // acknowledged bytes since reset()
+    qint64 m_deliveredMs;
+
+    qint64 m_drainBytes;    // of the running drain sample
+    qint64 m_drainStartMs;  // -1 if none runs
+
+    qint64 m_estimate;
+    bool   m_saturated;
+    qint64 m_minRttMs;          // over the current and the last window
+    qint64 m_smoothedRttMs;
+    qint64 m_rttWindowMin;
+    qint64 m_rttWindowStartMs;
+};
+
+#endif // BANDWIDTH_ESTIMATOR_H
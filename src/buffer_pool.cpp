@@ -0,0 +1,58 @@
+#include "buffer_pool.h"
+
+BufferPool::BufferPool(int reserveSize) :
+    m_reserveSize(reserveSize),
+    m_nextIndex(0),
+    m_allocationCount(0)
+{
+
+}
+
+// The returned reference stays valid until the next acquire()
+QByteArray &BufferPool::acquire()
+{
+    int count = m_buffers.size();
+
+    for(int i=0;i<count;++i)
+    {
+        int index = (m_nextIndex + i) % count;
+        QByteArray &buffer = m_buffers[index];
+
+        // still referenced by a queued signal or a socket write?
+        if(!buffer.isDetached())
+            continue;
+
+        buffer.resize(0); // keeps capacity, it was reserved
+        m_nextIndex = (index + 1) % count;
+        return buffer;
+    }
+
+    // nothing free, grow the pool
+    QByteArray buffer;
+    buffer.reserve(qMax(m_reserveSize, 1)); // reserved capacity survives resize(0)
+    m_buffers.append(buffer);
+    m_capacities.append(buffer.capacity());
+    ++m_allocationCount;
+
+    m_nextIndex = 0;
+    return m_buffers.last();
+}
+
+quint32 BufferPool::takeAllocationCount()
+{
+    // buffers that had to grow while being written count as an allocation too
+    for(int i=0;i<m_buffers.size();++i)
+    {
+        int capacity = m_buffers.at(i).capacity();
+
+        if(capacity != m_capacities.at(i))
+        {
+            m_capacities[i] = capacity;
+            ++m_allocationCount;
+        }
+    }
+
+    quint32 result = m_allocationCount;
+    m_allocationCount = 0;
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <QByteArray>
+#include <QVector>
+
+/* A small pool of reusable byte arrays for encoder output and packet assembly.
+ * A buffer is handed out again once every implicitly shared copy of it (e.g. the
+ * copy queued in a cross-thread signal) has been released, so in steady state
+ * no new memory is allocated. */
+class BufferPool
+{
+public:
+    explicit BufferPool(int reserveSize = 0);
+
+    QByteArray &acquire(); // empty buffer nobody else references
+
+    void setReserveSize(int size){m_reserveSize = size;}
+    int reserveSize() const {return m_reserveSize;}
+    int count() const {return m_buffers.size();}
+
+    quint32 takeAllocationCount(); // allocations since the last call
+
+private:
+    QVector<QByteArray> m_buffers;
+    QVector<int>        m_capacities; // capacity last seen for each buffer
+    int                 m_reserveSize;
+    int                 m_nextIndex;
+    quint32             m_allocationCount;
+};
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,199 @@
+#include "encode_cache.h"
+
+#include <cstring>
+
+EncodeCache::EncodeCache(qint64 capacityBytes) :
+    m_head(-1),
+    m_tail(-1),
+    m_capacity(capacityBytes),
+    m_bytes(0),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0),
+    m_allocationCount(0)
+{
+
+}
+
+void EncodeCache::setCapacity(qint64 bytes)
+{
+    m_capacity = qMax<qint64>(0, bytes);
+
+    while(m_tail >= 0 && m_bytes > m_capacity)
+        evict(m_tail);
+}
+
+static inline quint64 mixKey(quint64 hash, quint64 value)
+{
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 29);
+}
+
+/* Eight bytes per multiply, a tile is hashed in a fraction of its encode time */
+quint64 EncodeCache::imageKey(const uchar *bits, int lineSize, int height, int bytesPerLine, int width,
+                              const char *format, int quality, int scale)
+{
+    quint64 codec = 0;
+    memcpy(&codec, format, qMin<size_t>(strlen(format), 8)); // "WEBP", "JPEG"
+
+    quint64 hash = mixKey(0xcbf29ce484222325ull, static_cast<quint64>(width) << 32 | static_cast<quint32>(height));
+    hash = mixKey(hash, static_cast<quint64>(quality) << 32 | static_cast<quint32>(lineSize));
+    hash = mixKey(hash, codec);
+    hash = mixKey(hash, static_cast<quint64>(scale));
+
+    for(int y=0;y<height;++y)
+    {
+        const uchar *line = bits + static_cast<qint64>(y) * bytesPerLine;
+        int x = 0;
+
+        for(;x+8<=lineSize;x+=8)
+        {
+            quint64 value;
+            memcpy(&value, line + x, 8);
+            hash = mixKey(hash, value);
+        }
+
+        if(x < lineSize)
+        {
+            quint64 value = 0;
+            memcpy(&value, line + x, static_cast<size_t>(lineSize - x));
+            hash = mixKey(hash, value);
+        }
+    }
+
+    return hash;
+}
+
+bool EncodeCache::find(quint64 key, QByteArray &encoded)
+{
+    if(!isEnabled())
+        return false;
+
+    QHash<quint64,int>::const_iterator it = m_index.constFind(key);
+
+    if(it == m_index.constEnd())
+    {
+        ++m_misses;
+        return false;
+    }
+
+    int index = it.value();
+
+    if(index != m_head)
+    {
+        unlink(index);
+        pushFront(index);
+    }
+
+    encoded = m_entries.at(index).encoded;
+    ++m_hits;
+    return true;
+}
+
+void EncodeCache::insert(quint64 key, const char *encoded, int size)
+{
+    if(!isEnabled() || size > m_capacity / 4 || m_index.contains(key))
+        return;
+
+    while(m_tail >= 0 && m_bytes + size > m_capacity)
+        evict(m_tail);
+
+    int index;
+
+    if(!m_freeEntries.isEmpty())
+    {
+        index = m_freeEntries.last();
+        m_freeEntries.removeLast();
+    }
+    else
+    {
+        index = m_entries.size();
+        m_entries.append(Entry());
+    }
+
+    Entry &entry = m_entries[index];
+    entry.key = key;
+    entry.encoded = QByteArray(encoded, size);
+    ++m_allocationCount;
+
+    pushFront(index);
+    m_index.insert(key, index);
+    m_bytes += size;
+}
+
+void EncodeCache::clear()
+{
+    m_entries.clear();
+    m_freeEntries.clear();
+    m_index.clear();
+    m_head = -1;
+    m_tail = -1;
+    m_bytes = 0;
+}
+
+void EncodeCache::clearStats()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+quint32 EncodeCache::takeAllocationCount()
+{
+    const quint32 count = m_allocationCount;
+    m_allocationCount = 0;
+    return count;
+}
+
+QString EncodeCache::summary() const
+{
+    quint64 lookups = m_hits + m_misses;
+
+    return QString("entries %1 bytes %2 hits %3 misses %4 hit% %5 evictions %6")
+            .arg(count())
+            .arg(m_bytes)
+            .arg(m_hits)
+            .arg(m_misses)
+            .arg(lookups > 0 ? 100.0 * m_hits / lookups : 0.0, 0, 'f', 1)
+            .arg(m_evictions);
+}
+
+void EncodeCache::unlink(int index)
+{
+    Entry &entry = m_entries[index];
+
+    if(entry.prev >= 0)
+        m_entries[entry.prev].next = entry.next;
+    else m_head = entry.next;
+
+    if(entry.next >= 0)
+        m_entries[entry.next].prev = entry.prev;
+    else m_tail = entry.prev;
+}
+
+void EncodeCache::pushFront(int index)
+{
+    Entry &entry = m_entries[index];
+    entry.prev = -1;
+    entry.next = m_head;
+
+    if(m_head >= 0)
+        m_entries[m_head].prev = index;
+
+    m_head = index;
+
+    if(m_tail < 0)
+        m_tail = index;
+}
+
+void EncodeCache::evict(int index)
+{
+    unlink(index);
+
+    Entry &entry = m_entries[index];
+    m_index.remove(entry.key);
+    m_bytes -= entry.encoded.size();
+    entry.encoded = QByteArray(); // the memory goes now, not when the slot is reused
+    m_freeEntries.append(index);
+    ++m_evictions;
+}
@@ -0,0 +1,76 @@
+#ifndef ENCODE_CACHE_H
+#define ENCODE_CACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+const int ENCODE_CACHE_DEFAULT_MB = 32; // a capture's, unless the host's settings say otherwise
+
+/* Encoder output of recently seen images, keyed by a hash of their pixels and
+ * the encoder settings. Content that comes back (switching between two windows,
+ * a refresh, a blinking cursor) is copied from here instead of running WEBP
+ * again. The least recently used entries are dropped to stay under the memory
+ * cap, a cap of 0 turns the cache off.
+ *
+ * Entries live in flat arrays linked by index, most recent first. Keys are 64
+ * bit hashes without the pixels kept for comparison, a collision would show
+ * the wrong image until the tile changes again. */
+class EncodeCache
+{
+public:
+    explicit EncodeCache(qint64 capacityBytes = 0);
+
+    void setCapacity(qint64 bytes); // drops entries over the new cap
+    qint64 capacity() const {return m_capacity;}
+    bool isEnabled() const {return m_capacity > 0;}
+
+    // pixels of an image and how it is encoded, rows of lineSize bytes every bytesPerLine,
+    // scaled down by scale before encoding
+    static quint64 imageKey(const uchar *bits, int lineSize, int height, int bytesPerLine, int width,
+                            const char *format, int quality, int scale);
+
+    bool find(quint64 key, QByteArray &encoded); // a hit becomes the most recent entry
+    void insert(quint64 key, const char *encoded, int size); // copied, too large for a quarter of the cap is not kept
+    void clear();
+
+    int count() const {return m_index.size();}
+    qint64 bytes() const {return m_bytes;}
+    quint64 hits() const {return m_hits;}
+    quint64 misses() const {return m_misses;}
+    quint64 evictions() const {return m_evictions;}
+    void clearStats();
+
+    quint32 takeAllocationCount(); // entries copied in since the last call
+
+    QString summary() const; // "entries bytes hits misses hit% evictions"
+
+private:
+    struct Entry
+    {
+        quint64    key;
+        QByteArray encoded;
+        int        prev;    // more recent, -1 at the head
+        int        next;    // less recent, -1 at the tail
+    };
+
+    void unlink(int index);
+    void pushFront(int index);
+    void evict(int index);
+
+    QVector<Entry>     m_entries;
+    QVector<int>       m_freeEntries;
+    QHash<quint64,int> m_index; // key to entry
+    int                m_head;
+    int                m_tail;
+
+    qint64  m_capacity;
+    qint64  m_bytes;
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_evictions;
+    quint32 m_allocationCount;
+};
+
+#endif // ENCODE_CACHE_H
@@ -0,0 +1,105 @@
+#include "histogram.h"
+
+#include <cstring>
+
+Histogram::Histogram()
+{
+    clear();
+}
+
+void Histogram::add(quint64 value)
+{
+    ++m_buckets[bucketIndex(value)];
+    ++m_count;
+    m_sum += value;
+
+    if(value > m_max)
+        m_max = value;
+}
+
+void Histogram::add(const Histogram &other)
+{
+    for(int i=0;i<BUCKET_COUNT;++i)
+        m_buckets[i] += other.m_buckets[i];
+
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = qMax(m_max, other.m_max);
+}
+
+void Histogram::clear()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+double Histogram::mean() const
+{
+    if(m_count == 0)
+        return 0;
+
+    return static_cast<double>(m_sum) / m_count;
+}
+
+quint64 Histogram::percentile(double percent) const
+{
+    if(m_count == 0)
+        return 0;
+
+    quint64 rank = static_cast<quint64>(percent / 100.0 * m_count + 0.5);
+    rank = qBound<quint64>(1, rank, m_count);
+
+    quint64 seen = 0;
+
+    for(int i=0;i<BUCKET_COUNT;++i)
+    {
+        seen += m_buckets[i];
+
+        if(seen >= rank)
+            return qMin(bucketUpperBound(i), m_max);
+    }
+
+    return m_max;
+}
+
+QString Histogram::summary() const
+{
+    return QString("count %1 mean %2 p50 %3 p90 %4 p99 %5 max %6")
+            .arg(m_count)
+            .arg(mean(), 0, 'f', 0)
+            .arg(percentile(50))
+            .arg(percentile(90))
+            .arg(percentile(99))
+            .arg(m_max);
+}
+
+/* Values below SUB_BUCKETS get a bucket each, above that every power of two
+ * [2^n, 2^(n+1)) is split into SUB_BUCKETS equal buckets. */
+int Histogram::bucketIndex(quint64 value)
+{
+    if(value < SUB_BUCKETS)
+        return static_cast<int>(value);
+
+    int msb = 0;
+    for(quint64 v = value >> 1; v; v >>= 1)
+        ++msb;
+
+    int sub = static_cast<int>(value >> (msb - 2)) & (SUB_BUCKETS - 1);
+    int index = (msb - 1) * SUB_BUCKETS + sub;
+
+    return qMin(index, BUCKET_COUNT - 1);
+}
+
+quint64 Histogram::bucketUpperBound(int index)
+{
+    if(index < SUB_BUCKETS)
+        return static_cast<quint64>(index);
+
+    int msb = index / SUB_BUCKETS + 1;
+    int sub = index % SUB_BUCKETS;
+    quint64 width = Q_UINT64_C(1) << (msb - 2);
+
+    return (static_cast<quint64>(SUB_BUCKETS + sub) << (msb - 2)) + width - 1;
+}
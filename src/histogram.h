@@ -0,0 +1,39 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtGlobal>
+#include <QString>
+
+/* Log-linear histogram of non-negative values (e.g. latencies in microseconds).
+ * Each power of two is split into four buckets, so a percentile is accurate to
+ * within 25% of its value with a fixed, small footprint and no allocation. */
+class Histogram
+{
+public:
+    static const int SUB_BUCKETS = 4;
+    static const int BUCKET_COUNT = 160;    // values up to 2^40
+
+    Histogram();
+
+    void add(quint64 value);
+    void add(const Histogram &other); // merges its values
+    void clear();
+
+    quint64 count() const {return m_count;}
+    quint64 max() const {return m_max;}
+    double mean() const;
+    quint64 percentile(double percent) const; // upper bound of the bucket, at most max()
+
+    QString summary() const; // "count mean p50 p90 p99 max"
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketUpperBound(int index);
+
+private:
+    quint64 m_buckets[BUCKET_COUNT];
+    quint64 m_count;
+    quint64 m_sum;
+    quint64 m_max;
+};
+
+#endif // HISTOGRAM_H
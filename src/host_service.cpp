@@ -0,0 +1,272 @@
+#include "host_service.h"
+#include "trace.h"
+
+#include <QDebug>
+
+HostService::HostService(const HostSettings &settings, QObject *parent) : QObject(parent),
+    m_settings(settings),
+    m_proxyClientCount(0),
+    m_lanServer(Q_NULLPTR),
+    m_stopped(false),
+    m_metricsServer(Q_NULLPTR),
+    m_graberClass(new ScreenCapture(this)),
+    m_inputSimulator(new InputSimulator),
+    m_inputThread(new QThread(this))
+{
+    // spans of every stage for chrome://tracing, QV_TRACE=events kept per thread
+    if(qEnvironmentVariableIsSet("QV_TRACE"))
+        Trace::start(qEnvironmentVariableIntValue("QV_TRACE") > 0 ? qEnvironmentVariableIntValue("QV_TRACE") : int(Trace::DEFAULT_EVENTS));
+
+    QThread::currentThread()->setObjectName("main"); // the capture, trace thread names
+
+    // input is injected in its own thread, a frame being encoded doesn't hold the pointer up
+    m_inputThread->setObjectName("input");
+    connect(m_inputThread, &QThread::finished, m_inputSimulator, &InputSimulator::deleteLater);
+    m_inputSimulator->moveToThread(m_inputThread);
+    m_inputThread->start();
+
+    m_graberClass->setMetrics(&m_metrics);
+
+    if(m_settings.captureInterval > 0)
+        m_graberClass->setInterval(m_settings.captureInterval);
+
+    if(m_settings.rectSize > 0)
+        m_graberClass->setRectSize(m_settings.rectSize);
+
+    m_graberClass->setEncodeCacheSize(m_settings.encodeCacheMb);
+}
+
+HostService::~HostService()
+{
+    stop(); // the handlers first, they hand input to the input thread and read the members below
+
+    m_inputThread->quit();
+    m_inputThread->wait();
+
+    if(Trace::isEnabled() && qEnvironmentVariableIsSet("QV_TRACE_FILE"))
+    {
+        const QString path = QString::fromLocal8Bit(qgetenv("QV_TRACE_FILE"));
+
+        if(!Trace::writeFile(path))
+            qDebug() << "Trace could not be written to" << path;
+    }
+}
+
+void HostService::start()
+{
+    startOutboundProxyConnection(); // try connect to a proxy
+
+    startLanServer(m_settings.lanPort);
+    startMetricsServer(m_settings.metricsPort);
+
+    m_graberClass->start();
+}
+
+void HostService::stop()
+{
+    if(m_stopped)
+        return;
+
+    m_stopped = true;
+    emit closeAppSignal(); // queued, each handler closes its socket and quits its thread
+
+    for(const QPointer<QThread> &thread : m_handlerThreads)
+    {
+        if(thread)
+            thread->wait();
+    }
+
+    m_handlerThreads.clear();
+}
+
+// outgoing proxy connection
+void HostService::startOutboundProxyConnection()
+{
+    if(m_stopped)
+        return;
+
+    // qDebug() << "HostService::startOutboundProxyConnection to host: "<< m_settings.proxyUrl;
+
+    WebSocketHandler *handler = new WebSocketHandler;
+    handler->setUrl(m_settings.proxyUrl);
+    handler->setName(m_settings.machineName);
+    handler->setLoginPass(m_settings.login, m_settings.password);
+    m_proxySocketHandlers.append(handler);
+
+    connect(handler,                &WebSocketHandler::connectedStatus,         this,           &HostService::connectedToProxy);
+
+    startHandlerThread(handler);
+
+} //startOutboundProxyConnection
+
+/* Listener for viewers on the same network. They ask for this desktop's id and
+ * log in with the same nonce and password as through the proxy, then get the
+ * LAN stream profile. Plain ws://, like the proxy's port 8080. */
+void HostService::startLanServer(quint16 port)
+{
+    if(m_lanServer || port == 0)
+        return;
+
+    m_lanServer = new QWebSocketServer(m_settings.machineName, QWebSocketServer::NonSecureMode, this);
+
+    if(!m_lanServer->listen(QHostAddress::Any, port))
+    {
+        qDebug() << "LAN listener failed on port" << port << m_lanServer->errorString();
+        m_lanServer->deleteLater();
+        m_lanServer = Q_NULLPTR;
+        return;
+    }
+
+    connect(m_lanServer, &QWebSocketServer::newConnection, this, &HostService::lanClientConnected);
+
+    // qDebug() << "LAN listener on port" << port;
+}
+
+void HostService::startMetricsServer(quint16 port)
+{
+    if(m_metricsServer || port == 0)
+        return;
+
+    m_metricsServer = new MetricsServer(&m_metrics, this);
+
+    if(!m_metricsServer->listen(port))
+    {
+        qDebug() << "Metrics listener failed on port" << port << m_metricsServer->errorString();
+        m_metricsServer->deleteLater();
+        m_metricsServer = Q_NULLPTR;
+    }
+}
+
+void HostService::lanClientConnected()
+{
+    while(m_lanServer->hasPendingConnections())
+    {
+        QWebSocket *socket = m_lanServer->nextPendingConnection();
+
+        if(m_stopped || m_lanSocketHandlers.size() >= m_settings.maxViewers)
+        {
+            socket->close(QWebSocketProtocol::CloseCodeTryAgainLater);
+            socket->deleteLater();
+            continue;
+        }
+
+        socket->setParent(Q_NULLPTR); // the handler takes it to its thread
+
+        WebSocketHandler *handler = new WebSocketHandler;
+        handler->setName(m_settings.machineName);
+        handler->setLoginPass(m_settings.login, m_settings.password);
+        handler->setSocket(socket);
+        m_lanSocketHandlers.append(handler);
+
+        startHandlerThread(handler);
+    }
+}
+
+// every handler runs in a thread of its own and shares the capture's tile store
+void HostService::startHandlerThread(WebSocketHandler *handler)
+{
+    QThread *thread = new QThread;
+    thread->setObjectName("handler");
+    m_handlerThreads.append(thread);
+    handler->setTileStore(m_graberClass->tileStore());
+    handler->setSessionRegistry(&m_viewerSessions);
+    handler->setMetrics(&m_metrics);
+
+    connect(thread,                 &QThread::started,                  handler,                &WebSocketHandler::createSocket); // this kicks things off on thread start
+    connect(this,                   &HostService::closeAppSignal,       handler,                &WebSocketHandler::removeSocket);
+
+    connect(handler,                &WebSocketHandler::finished,        this,                   &HostService::finishedWebSockeHandler);
+    connect(handler,                &WebSocketHandler::finished,        thread,                 &QThread::quit, Qt::DirectConnection); // stop() waits for it in this thread
+
+    connect(thread,                 &QThread::finished,                 handler,                &WebSocketHandler::deleteLater);
+    connect(thread,                 &QThread::finished,                 thread,                 &QThread::deleteLater);
+
+    // Wait for incoming requests
+    connect(handler,                &WebSocketHandler::connectedProxyClient,    this,           &HostService::remoteClientConnected); //?
+    connect(handler,                &WebSocketHandler::disconnectedProxyClient, this,           &HostService::remoteClientDisconnected);
+
+    // message
+    connect(handler,                &WebSocketHandler::sendTextMessage,     this,               &HostService::textMessage);
+
+
+    // Get the socket up and running now hand over to the handler
+    createConnectionToHandler(handler);
+
+    handler->moveToThread(thread);
+    thread->start();
+}
+
+
+void HostService::createConnectionToHandler(WebSocketHandler *webSocketHandler)
+{
+    if(!webSocketHandler)
+        return;
+
+    connect(m_graberClass, &ScreenCapture::imageParameters,   webSocketHandler, &WebSocketHandler::sendImageParameters);
+    connect(m_graberClass, &ScreenCapture::imageTile,         webSocketHandler, &WebSocketHandler::sendImageTile);
+    connect(m_graberClass, &ScreenCapture::imageScreen,       webSocketHandler, &WebSocketHandler::sendImageScreen);
+    connect(m_graberClass, &ScreenCapture::frameFinished,     webSocketHandler, &WebSocketHandler::flushImageBatch);
+    connect(m_graberClass, &ScreenCapture::intervalChanged,   webSocketHandler, &WebSocketHandler::setCaptureInterval);
+    connect(m_graberClass, &ScreenCapture::screenPositionChanged,     m_inputSimulator, &InputSimulator::setScreenPosition);
+
+    connect(webSocketHandler, &WebSocketHandler::getDesktop,        m_graberClass, &ScreenCapture::startSending); // only on get desktop
+    connect(webSocketHandler, &WebSocketHandler::resumeDesktop,     m_graberClass, &ScreenCapture::resumeSending);
+
+    connect(webSocketHandler, &WebSocketHandler::changeDisplayNum,  m_graberClass, &ScreenCapture::changeScreenNum);
+    connect(webSocketHandler, &WebSocketHandler::refreshDisplay,    m_graberClass, &ScreenCapture::updateScreen);
+    connect(webSocketHandler, &WebSocketHandler::frameIntervalRequested, m_graberClass, &ScreenCapture::setViewerInterval);
+    connect(webSocketHandler, &WebSocketHandler::rectSizeRequested, m_graberClass, &ScreenCapture::setRectSize);
+    webSocketHandler->setCaptureInterval(m_graberClass->interval()); // still in this thread
+
+    webSocketHandler->setInputQueue(m_inputSimulator->createQueue()); // lock free from the handler's thread to the input thread
+
+}
+
+void HostService::finishedWebSockeHandler()
+{
+    m_proxySocketHandlers.removeOne(static_cast<WebSocketHandler*>(sender()));
+    m_lanSocketHandlers.removeOne(static_cast<WebSocketHandler*>(sender()));
+}
+
+void HostService::remoteClientConnected(const QByteArray &uuid)
+{
+    // qDebug() << "Remote Client Connected.";
+
+    if(!m_remoteClientsList.contains(uuid))
+    {
+        m_remoteClientsList.append(uuid);
+
+        if(m_proxySocketHandlers.contains(static_cast<WebSocketHandler*>(sender())))
+            ++m_proxyClientCount;
+    }
+
+    // keep a connection registered with the proxy for the next viewer, e.g. a supervisor
+    if(m_proxyClientCount >= m_proxySocketHandlers.size() && m_proxySocketHandlers.size() < m_settings.maxViewers)
+        startOutboundProxyConnection();
+
+    emit viewerConnected();
+
+    // qDebug()<<"HostService::m_remoteClientsList"<<m_remoteClientsList.size();
+
+}
+
+void HostService::remoteClientDisconnected(const QByteArray &uuid)
+{
+    // qDebug() << "Remote Client Disconnected.";
+
+    if(m_remoteClientsList.contains(uuid))
+    {
+        m_remoteClientsList.removeOne(uuid);
+
+        if(m_proxySocketHandlers.contains(static_cast<WebSocketHandler*>(sender())))
+            --m_proxyClientCount;
+
+        if(m_remoteClientsList.size() == 0)
+            m_graberClass->stopSending();
+    }
+
+    emit viewerDisconnected();
+
+    // qDebug()<<"HostService::remoteClientDisconnected"<<m_remoteClientsList.size();
+
+}
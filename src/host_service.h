@@ -0,0 +1,73 @@
+#ifndef HOST_SERVICE_H
+#define HOST_SERVICE_H
+
+#include <QObject>
+#include <QPointer>
+#include <QThread>
+#include <QtWebSockets/qwebsocketserver.h>
+
+#include "host_settings.h"
+#include "input_simulator.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "screen_capture.h"
+#include "ws_handler.h"
+
+/* The host without a face: the screen capture, input injection in its own
+ * thread, a handler thread per viewer through the proxy or the LAN listener,
+ * and the metrics listener. QV_MainWindow shows its state, headless it runs
+ * on its own (qv_main.cpp --headless). */
+class HostService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HostService(const HostSettings &settings, QObject *parent = Q_NULLPTR);
+    ~HostService();
+
+    const HostSettings &settings() const {return m_settings;}
+    int viewerCount() const {return m_remoteClientsList.size();}
+
+signals:
+    void connectedToProxy(bool state);
+    void viewerConnected();
+    void viewerDisconnected();
+    void textMessage(const QString &message); // from the proxy, for the user
+    void closeAppSignal();
+
+public slots:
+    void start();
+    void stop(); // closes every viewer's socket and waits for the handler threads
+
+private:
+    HostSettings m_settings;
+
+    QList<WebSocketHandler*> m_proxySocketHandlers; // one per viewer plus a free one, up to maxViewers
+    int m_proxyClientCount; // viewers on m_proxySocketHandlers
+    QWebSocketServer *m_lanServer; // direct LAN viewers
+    QList<WebSocketHandler*> m_lanSocketHandlers; // one per LAN viewer
+    QList<QPointer<QThread> > m_handlerThreads; // joined by stop(), they use the capture's tile store, the metrics and the sessions
+    bool m_stopped;
+    ViewerSessionRegistry m_viewerSessions; // dropped viewers, resumable on any handler
+    Metrics m_metrics; // of the capture and all handlers
+    MetricsServer *m_metricsServer; // localhost
+    ScreenCapture *m_graberClass;
+    InputSimulator *m_inputSimulator; // lives in m_inputThread
+    QThread *m_inputThread;
+
+    QList<QByteArray> m_remoteClientsList;
+
+private slots:
+    void startOutboundProxyConnection();
+    void startLanServer(quint16 port);
+    void startMetricsServer(quint16 port);
+    void lanClientConnected();
+    void startHandlerThread(WebSocketHandler *handler);
+    void createConnectionToHandler(WebSocketHandler *webSocketHandler);
+
+    void finishedWebSockeHandler();
+
+    void remoteClientConnected(const QByteArray &uuid);
+    void remoteClientDisconnected(const QByteArray &uuid);
+};
+
+#endif // HOST_SERVICE_H
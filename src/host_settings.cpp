@@ -0,0 +1,213 @@
+#include "host_settings.h"
+#include "encode_cache.h"
+#include "protocol.h"
+
+#include <QFileInfo>
+#include <QHostInfo>
+#include <QSettings>
+#include <QSysInfo>
+#include <QUuid>
+
+#include <cstring>
+
+HostSettings::HostSettings() :
+    proxyUrl("ws://quickviewer.app:8080"),
+    machineName(QHostInfo::localHostName()),
+    login(machineId()),
+    password(QUuid::createUuid().toString().mid(1,7)),
+    maxViewers(4),
+    lanPort(0),
+    metricsPort(0),
+    captureInterval(0),
+    rectSize(0),
+    encodeCacheMb(ENCODE_CACHE_DEFAULT_MB),
+    headless(false)
+{
+
+}
+
+bool HostSettings::load(const QStringList &args)
+{
+    QString config = QString::fromLocal8Bit(qgetenv("QV_CONFIG"));
+
+    // the file first, whatever else the command line says
+    for(const QString &arg : args)
+    {
+        if(arg.startsWith("--config="))
+            config = arg.mid(9);
+    }
+
+    if(!config.isEmpty() && !loadFile(config))
+        return false;
+
+    loadEnvironment();
+
+    return parseArguments(args) && validate();
+}
+
+bool HostSettings::isHeadless(int argc, char *argv[])
+{
+    for(int i=1;i<argc;++i)
+    {
+        if(std::strcmp(argv[i], "--headless") == 0)
+            return true;
+    }
+
+    return false;
+}
+
+const char *HostSettings::usage()
+{
+    return "usage: QuickViewerApp [--help] [--headless] [--config=file.ini] [--proxy=ws://host:port] [--name=name]\n"
+           "                      [--id=desktop-id] [--password=pw] [--max-viewers=1-16] [--lan-port=p]\n"
+           "                      [--metrics-port=p] [--interval=ms] [--tile-size=px] [--encode-cache-mb=n]\n"
+           "config file keys: proxy/url, host/name, login/id, login/password, viewers/max, lan/port,\n"
+           "                  metrics/port, capture/interval, capture/tileSize, capture/encodeCacheMb\n";
+}
+
+// as it always was, viewers keep finding the same desktop id
+QString HostSettings::machineId()
+{
+    QByteArray access_id = QSysInfo::machineUniqueId();
+
+    if (access_id.size() == 0) {
+        access_id = QUuid::createUuid().toByteArray();
+    }
+
+    // qDebug() << "Random UUID is: "  << QUuid::createUuid();
+    // qDebug() << "OS UUID is: "      << access_id;
+
+    quint32 machine_id = 0;
+    for (int i = 0; i < access_id.size(); i++) {
+        machine_id += access_id[i];
+
+        if (i % 4 == 0) {
+            machine_id *= 6.499;
+        }
+    }
+
+    // qDebug() << "Obfuscated ID is: " << machine_id;
+    return QString::number(machine_id);
+}
+
+bool HostSettings::loadFile(const QString &path)
+{
+    if(!QFileInfo(path).isReadable())
+    {
+        m_errorString = QString("%1: can't read the config file").arg(path);
+        return false;
+    }
+
+    QSettings file(path, QSettings::IniFormat);
+
+    if(file.status() != QSettings::NoError)
+    {
+        m_errorString = QString("%1: not an INI file").arg(path);
+        return false;
+    }
+
+    proxyUrl        = file.value("proxy/url", proxyUrl).toString();
+    machineName     = file.value("host/name", machineName).toString();
+    login           = file.value("login/id", login).toString();
+    password        = file.value("login/password", password).toString();
+    maxViewers      = file.value("viewers/max", maxViewers).toInt();
+    lanPort         = static_cast<quint16>(file.value("lan/port", lanPort).toUInt());
+    metricsPort     = static_cast<quint16>(file.value("metrics/port", metricsPort).toUInt());
+    captureInterval = file.value("capture/interval", captureInterval).toInt();
+    rectSize        = file.value("capture/tileSize", rectSize).toInt();
+    encodeCacheMb   = file.value("capture/encodeCacheMb", encodeCacheMb).toInt();
+    return true;
+}
+
+void HostSettings::loadEnvironment()
+{
+    // a proxy of your own, or the stand-in of bench/QuickViewerLoad
+    if(qEnvironmentVariableIsSet("QV_PROXY_URL"))
+        proxyUrl = QString::fromLocal8Bit(qgetenv("QV_PROXY_URL"));
+
+    // a fixed one for scripted viewers, e.g. load tests
+    if(qEnvironmentVariableIsSet("QV_PASSWORD"))
+        password = QString::fromLocal8Bit(qgetenv("QV_PASSWORD"));
+
+    if(qEnvironmentVariableIsSet("QV_MAX_VIEWERS"))
+        maxViewers = qEnvironmentVariableIntValue("QV_MAX_VIEWERS");
+
+    // viewers on the same network may also connect straight to this host
+    if(qEnvironmentVariableIsSet("QV_LAN_PORT"))
+        lanPort = static_cast<quint16>(qEnvironmentVariableIntValue("QV_LAN_PORT"));
+
+    // Prometheus scrapes, e.g. curl localhost:9464/metrics
+    if(qEnvironmentVariableIsSet("QV_METRICS_PORT"))
+        metricsPort = static_cast<quint16>(qEnvironmentVariableIntValue("QV_METRICS_PORT"));
+
+    // 0 turns it off, to measure without it
+    if(qEnvironmentVariableIsSet("QV_ENCODE_CACHE_MB"))
+        encodeCacheMb = qEnvironmentVariableIntValue("QV_ENCODE_CACHE_MB");
+}
+
+bool HostSettings::parseArguments(const QStringList &args)
+{
+    for(const QString &arg : args)
+    {
+        if(!arg.startsWith("--"))
+            continue; // Qt's, e.g. -platform
+
+        const QString value = arg.section('=', 1);
+
+        if(arg == "--help")
+        {
+            m_errorString.clear(); // nothing wrong, just the usage
+            return false;
+        }
+        else if(arg == "--headless")
+            headless = true;
+        else if(arg.startsWith("--config="))
+            continue; // read already
+        else if(arg.startsWith("--proxy="))
+            proxyUrl = value;
+        else if(arg.startsWith("--name="))
+            machineName = value;
+        else if(arg.startsWith("--id="))
+            login = value;
+        else if(arg.startsWith("--password="))
+            password = value;
+        else if(arg.startsWith("--max-viewers="))
+            maxViewers = value.toInt();
+        else if(arg.startsWith("--lan-port="))
+            lanPort = static_cast<quint16>(value.toUInt());
+        else if(arg.startsWith("--metrics-port="))
+            metricsPort = static_cast<quint16>(value.toUInt());
+        else if(arg.startsWith("--interval="))
+            captureInterval = value.toInt();
+        else if(arg.startsWith("--tile-size="))
+            rectSize = value.toInt();
+        else if(arg.startsWith("--encode-cache-mb="))
+            encodeCacheMb = value.toInt();
+        else
+        {
+            m_errorString = QString("unknown option %1").arg(arg);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool HostSettings::validate()
+{
+    maxViewers = qBound(1, maxViewers, 16);
+
+    if(!proxyUrl.startsWith("ws://") && !proxyUrl.startsWith("wss://"))
+        m_errorString = QString("the proxy url %1 is not ws:// or wss://").arg(proxyUrl);
+    else if(login.isEmpty() || password.isEmpty())
+        m_errorString = "the desktop id and the password may not be empty";
+    else if(captureInterval != 0 && (captureInterval < STREAM_INTERVAL_MIN || captureInterval > STREAM_INTERVAL_MAX))
+        m_errorString = QString("the capture interval is %1 to %2 ms").arg(STREAM_INTERVAL_MIN).arg(STREAM_INTERVAL_MAX);
+    else if(rectSize != 0 && (rectSize < STREAM_RECT_SIZE_MIN || rectSize > STREAM_RECT_SIZE_MAX))
+        m_errorString = QString("the tile size is %1 to %2 px").arg(STREAM_RECT_SIZE_MIN).arg(STREAM_RECT_SIZE_MAX);
+    else if(encodeCacheMb < 0)
+        m_errorString = "the encode cache size may not be negative";
+    else return true;
+
+    return false;
+}
@@ -0,0 +1,46 @@
+#ifndef HOST_SETTINGS_H
+#define HOST_SETTINGS_H
+
+#include <QString>
+#include <QStringList>
+
+/* What the host runs with. Each source overrides the one before:
+ *  - defaults: the public proxy, an id made from the machine id, a random password
+ *  - an INI file, --config=path or QV_CONFIG (keys as in usage())
+ *  - the QV_* environment: QV_PROXY_URL, QV_PASSWORD, QV_MAX_VIEWERS, QV_LAN_PORT, QV_METRICS_PORT
+ *  - the command line
+ * Arguments not starting with "--" are left to Qt. */
+class HostSettings
+{
+public:
+    HostSettings();
+
+    bool load(const QStringList &args); // all of the above, false with an empty error for --help
+    QString errorString() const {return m_errorString;}
+
+    static bool isHeadless(int argc, char *argv[]); // --headless, before there is an application
+    static const char *usage();
+    static QString machineId(); // the desktop id from QSysInfo::machineUniqueId()
+
+    QString proxyUrl;
+    QString machineName;
+    QString login;          // desktop id
+    QString password;
+    int     maxViewers;     // 1-16
+    quint16 lanPort;        // 0 for no LAN listener
+    quint16 metricsPort;    // 0 for no metrics listener
+    int     captureInterval;// ms, 0 for the capture's own
+    int     rectSize;       // tile size in px, 0 for the capture's own
+    int     encodeCacheMb;  // 0 turns the cache off
+    bool    headless;
+
+private:
+    bool loadFile(const QString &path);
+    void loadEnvironment();
+    bool parseArguments(const QStringList &args);
+    bool validate();
+
+    QString m_errorString;
+};
+
+#endif // HOST_SETTINGS_H
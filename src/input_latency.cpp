@@ -0,0 +1,99 @@
+#include "input_latency.h"
+
+InputLatency::InputLatency()
+{
+    reset();
+}
+
+void InputLatency::reset()
+{
+    m_state = PROBE_NONE;
+    m_viewerMs = 0;
+    m_arrivalMs = 0;
+    m_injectedMs = 0;
+    m_captureMs = 0;
+    m_sentMs = 0;
+    m_lost = 0;
+
+    m_total.clear();
+    m_host.clear();
+    m_hold.clear();
+    m_capture.clear();
+    m_send.clear();
+}
+
+bool InputLatency::startProbe(quint32 viewerMs, qint64 arrivalMs)
+{
+    if(m_state != PROBE_NONE)
+    {
+        if(arrivalMs - m_arrivalMs <= PROBE_TIMEOUT_MS)
+            return false;
+
+        dropProbe(); // the answer got lost, or the viewer doesn't give one
+    }
+
+    m_state = PROBE_INJECTING;
+    m_viewerMs = viewerMs;
+    m_arrivalMs = arrivalMs;
+    return true;
+}
+
+void InputLatency::injected(qint64 injectedMs)
+{
+    if(m_state != PROBE_INJECTING || injectedMs < m_arrivalMs)
+        return; // an earlier probe's, it timed out
+
+    m_state = PROBE_CAPTURING;
+    m_injectedMs = injectedMs;
+}
+
+bool InputLatency::frameSent(qint64 captureMs, qint64 sentMs, bool batched, quint32 &viewerMs)
+{
+    if(m_state != PROBE_CAPTURING || captureMs < m_injectedMs)
+        return false; // grabbed before the event had an effect
+
+    // a full image has no sequence to wait for, and whatever changed this late wasn't the event
+    if(!batched || captureMs - m_injectedMs > FRAME_WINDOW_MS)
+    {
+        dropProbe();
+        return false;
+    }
+
+    m_state = PROBE_REPORTING;
+    m_captureMs = captureMs;
+    m_sentMs = sentMs;
+    viewerMs = m_viewerMs;
+    return true;
+}
+
+bool InputLatency::reportReceived(quint32 viewerMs, quint32 latencyMs)
+{
+    if(m_state != PROBE_REPORTING || viewerMs != m_viewerMs)
+        return false;
+
+    m_total.add(latencyMs);
+    m_host.add(static_cast<quint64>(m_sentMs - m_arrivalMs));
+    m_hold.add(static_cast<quint64>(qMax<qint64>(m_injectedMs - m_arrivalMs, 0)));
+    m_capture.add(static_cast<quint64>(m_captureMs - m_injectedMs));
+    m_send.add(static_cast<quint64>(m_sentMs - m_captureMs));
+
+    m_state = PROBE_NONE;
+    return true;
+}
+
+void InputLatency::dropProbe()
+{
+    m_state = PROBE_NONE;
+    ++m_lost;
+}
+
+QString InputLatency::summary() const
+{
+    return QString("total %1, host %2 (hold %3, capture %4, send %5), lost %6")
+            .arg(m_total.summary())
+            .arg(m_host.summary())
+            .arg(m_hold.summary())
+            .arg(m_capture.summary())
+            .arg(m_send.summary())
+            .arg(m_lost);
+}
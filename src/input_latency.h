@@ -0,0 +1,78 @@
+#ifndef INPUT_LATENCY_H
+#define INPUT_LATENCY_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "histogram.h"
+
+/* Input to photon latency of one viewer session, one probe at a time.
+ *
+ * A key or button press or a wheel event from an INPB batch becomes the probe
+ * while none is out. The host notes when it arrived and when it was injected,
+ * then waits for the first frame captured after the injection that carries
+ * tiles to the viewer: that frame holds the change, if the input made one.
+ * The viewer gets the event's time and the frame's sequence with
+ * KEY_INPUT_ECHO and answers with KEY_INPUT_LATENCY how long after the event
+ * it had drawn that frame, on its own clock, so no clocks need to agree.
+ *
+ * A probe no frame follows within FRAME_WINDOW_MS of its injection changed
+ * nothing on the screen and is dropped, as is one without an answer after
+ * PROBE_TIMEOUT_MS. So is one whose frame went out as a full image, the
+ * viewer can't tell when it drew a frame without a batch's sequence.
+ * All host times are inputClockMs(). */
+class InputLatency
+{
+public:
+    static const qint64 FRAME_WINDOW_MS     = 1000;
+    static const qint64 PROBE_TIMEOUT_MS    = 5000;
+
+    InputLatency();
+
+    void reset(); // a new session, the histograms start over
+
+    // true if the event, viewerMs on the viewer's clock, is the new probe
+    bool startProbe(quint32 viewerMs, qint64 arrivalMs);
+    bool awaitsInjection() const {return m_state == PROBE_INJECTING;}
+    void injected(qint64 injectedMs);
+    // a frame captured at captureMs went out with tiles for the viewer, true to echo viewerMs with it
+    bool frameSent(qint64 captureMs, qint64 sentMs, bool batched, quint32 &viewerMs);
+    bool reportReceived(quint32 viewerMs, quint32 latencyMs); // false if it isn't the probe's
+
+    // ms, per answered probe
+    const Histogram &total() const {return m_total;}        // event to drawn frame, on the viewer
+    const Histogram &host() const {return m_host;}          // arrival to frame sent
+    const Histogram &hold() const {return m_hold;}          // arrival to injection, the replay's playout
+    const Histogram &capture() const {return m_capture;}    // injection to capture
+    const Histogram &send() const {return m_send;}          // capture to frame sent, encoding and pacing
+    quint32 lostCount() const {return m_lost;}
+
+    QString summary() const;
+
+private:
+    enum ProbeState
+    {
+        PROBE_NONE,
+        PROBE_INJECTING,
+        PROBE_CAPTURING,
+        PROBE_REPORTING
+    };
+
+    void dropProbe();
+
+    int     m_state;        // ProbeState
+    quint32 m_viewerMs;
+    qint64  m_arrivalMs;
+    qint64  m_injectedMs;
+    qint64  m_captureMs;
+    qint64  m_sentMs;
+    quint32 m_lost;
+
+    Histogram m_total;
+    Histogram m_host;
+    Histogram m_hold;
+    Histogram m_capture;
+    Histogram m_send;
+};
+
+#endif // INPUT_LATENCY_H
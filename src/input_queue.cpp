@@ -0,0 +1,103 @@
+#include "input_queue.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+
+InputQueue::InputQueue(QObject *consumer) :
+    m_consumer(consumer),
+    m_owners(2), // the producer and the consumer
+    m_head(0),
+    m_tail(0),
+    m_wakeup(WAKEUP_ARMED),
+    m_dropped(0),
+    m_probeInjectedMs(0)
+{
+}
+
+bool InputQueue::push(const InputEvent &event)
+{
+    const quint32 tail = m_tail.load();
+
+    if(tail - m_head.loadAcquire() >= CAPACITY)
+    {
+        m_dropped.ref();
+        return false;
+    }
+
+    m_events[tail & (CAPACITY - 1)] = event;
+    m_tail.storeRelease(tail + 1);
+
+    wakeConsumer(WAKEUP_PENDING);
+    return true;
+}
+
+void InputQueue::close()
+{
+    wakeConsumer(WAKEUP_CLOSED);
+    release();
+}
+
+qint64 InputQueue::takeProbeInjected()
+{
+    return m_probeInjectedMs.fetchAndStoreRelaxed(0);
+}
+
+void InputQueue::wakeConsumer(int state)
+{
+    // ordered against the consumer's armWakeup(), either it sees what was pushed or it is invoked again
+    if(m_wakeup.fetchAndStoreOrdered(state) != WAKEUP_ARMED)
+        return;
+
+    QMutexLocker locker(&m_consumerMutex); // a consumer on its way out waits in detach()
+    if(m_consumer)
+        QMetaObject::invokeMethod(m_consumer, "drainQueues", Qt::QueuedConnection);
+}
+
+bool InputQueue::armWakeup()
+{
+    return m_wakeup.fetchAndStoreOrdered(WAKEUP_ARMED) == WAKEUP_CLOSED;
+}
+
+bool InputQueue::peek(InputEvent &event) const
+{
+    const quint32 head = m_head.load();
+
+    if(head == m_tail.loadAcquire())
+        return false;
+
+    event = m_events[head & (CAPACITY - 1)];
+    return true;
+}
+
+bool InputQueue::pop(InputEvent &event)
+{
+    const quint32 head = m_head.load();
+
+    if(head == m_tail.loadAcquire())
+        return false;
+
+    event = m_events[head & (CAPACITY - 1)];
+    m_head.storeRelease(head + 1);
+    return true;
+}
+
+void InputQueue::probeInjected(qint64 injectedMs)
+{
+    m_probeInjectedMs.store(injectedMs);
+}
+
+void InputQueue::detach()
+{
+    {
+        QMutexLocker locker(&m_consumerMutex);
+        m_consumer = Q_NULLPTR;
+    }
+
+    release();
+}
+
+void InputQueue::release()
+{
+    if(!m_owners.deref())
+        delete this;
+}
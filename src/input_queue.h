@@ -0,0 +1,95 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+
+// monotonic ms, the same clock in every thread
+inline qint64 inputClockMs()
+{
+    QElapsedTimer clock;
+    clock.start();
+    return clock.msecsSinceReference();
+}
+
+// one input event of a viewer, as InputSimulator injects it
+struct InputEvent
+{
+    enum Type
+    {
+        KEY,        // code: key code, state: pressed
+        MOUSE_KEY,  // code: button, state: pressed
+        WHEEL,      // x, y: delta, WHEEL_NOTCH per notch
+        MOVE,       // x, y: position on the screen
+        MOVE_BY     // x, y: delta
+    };
+
+    quint8  type;
+    bool    state;
+    quint16 code;
+    qint32  x;
+    qint32  y;
+    bool    probe;  // an input latency probe, its injection time goes back to the producer
+    qint64  dueMs;  // on inputClockMs(), 0 for at once
+};
+
+/* One viewer's input on its way from the handler's thread to the input
+ * thread, a single producer single consumer ring without locks.
+ *
+ * The first event pushed after the consumer armed the wakeup invokes its
+ * drainQueues() slot, a burst of events costs one posted call. A full ring
+ * drops the event, the consumer would have to be stuck for that.
+ * Both sides own the queue: the producer closes it when it goes, the consumer
+ * detaches once armWakeup() tells it so and it drained the rest, or when it
+ * goes itself, and whichever is last deletes it. A detached consumer is not
+ * invoked any more. The injection time of a probe event goes the other way,
+ * in a slot of its own. */
+class InputQueue
+{
+public:
+    static const quint32 CAPACITY = 1024; // a power of two
+
+    explicit InputQueue(QObject *consumer);
+
+    // the producer's side
+    bool push(const InputEvent &event); // false if it was dropped
+    void close(); // the queue may be gone after it
+    qint64 takeProbeInjected(); // inputClockMs() the last probe was injected at, 0 if none since
+
+    // the consumer's
+    bool armWakeup(); // before draining, events pushed from then on wake it again, true if closed
+    bool peek(InputEvent &event) const; // the next one stays queued
+    bool pop(InputEvent &event);
+    quint32 droppedCount() const {return m_dropped.load();}
+    void probeInjected(qint64 injectedMs);
+    void detach(); // the queue may be gone after it
+
+private:
+    enum WakeupState
+    {
+        WAKEUP_ARMED,
+        WAKEUP_PENDING,
+        WAKEUP_CLOSED
+    };
+
+    void wakeConsumer(int state);
+    void release();
+
+    QMutex     m_consumerMutex; // only taken to invoke the consumer or to detach it
+    QObject   *m_consumer;      // Q_NULLPTR once detached
+    QAtomicInt m_owners;
+    InputEvent m_events[CAPACITY];
+
+    // each written by one side only, kept off each other's cache line
+    QAtomicInteger<quint32> m_head;     // next to pop
+    char                    m_headPadding[64];
+    QAtomicInteger<quint32> m_tail;     // next to push
+    char                    m_tailPadding[64];
+    QAtomicInt              m_wakeup;   // WakeupState
+    QAtomicInteger<quint32> m_dropped;
+    QAtomicInteger<qint64>  m_probeInjectedMs;
+};
+
+#endif // INPUT_QUEUE_H
@@ -0,0 +1,72 @@
+#include "input_replay.h"
+
+InputReplay::InputReplay()
+{
+    reset();
+}
+
+void InputReplay::reset()
+{
+    m_viewerMs = 0;
+    m_lastBaseMs = 0;
+    m_started = false;
+    startWindow(m_window, 0, 0);
+    startWindow(m_lastWindow, 0, 0);
+    m_windowStartMs = 0;
+}
+
+void InputReplay::batchArrived(quint32 baseMs, int spanMs, qint64 arrivalMs)
+{
+    // the viewer's 32 bit clock wraps after 49 days
+    m_viewerMs = m_started ? m_viewerMs + static_cast<qint32>(baseMs - m_lastBaseMs) : baseMs;
+    m_lastBaseMs = baseMs;
+
+    const qint64 offset = arrivalMs - (m_viewerMs + spanMs);
+
+    if(!m_started)
+    {
+        startWindow(m_window, offset, spanMs);
+        m_lastWindow = m_window;
+        m_windowStartMs = arrivalMs;
+        m_started = true;
+        return;
+    }
+
+    if(arrivalMs - m_windowStartMs > OFFSET_WINDOW_MS)
+    {
+        m_lastWindow = m_window;
+        startWindow(m_window, offset, spanMs);
+        m_windowStartMs = arrivalMs;
+        return;
+    }
+
+    addToWindow(m_window, offset, spanMs);
+}
+
+qint64 InputReplay::dueMs(int offsetMs) const
+{
+    return m_viewerMs + offsetMs + qMin(m_window.minOffsetMs, m_lastWindow.minOffsetMs) + playoutMs();
+}
+
+qint64 InputReplay::playoutMs() const
+{
+    const qint64 minOffset = qMin(m_window.minOffsetMs, m_lastWindow.minOffsetMs);
+    const qint64 jitter = qMax(m_window.maxOffsetMs, m_lastWindow.maxOffsetMs) - minOffset;
+    const qint64 span = qMax(m_window.maxSpanMs, m_lastWindow.maxSpanMs);
+
+    return qMin(span + jitter, qint64(MAX_PLAYOUT_MS));
+}
+
+void InputReplay::startWindow(Window &window, qint64 offsetMs, qint64 spanMs)
+{
+    window.minOffsetMs = offsetMs;
+    window.maxOffsetMs = offsetMs;
+    window.maxSpanMs = spanMs;
+}
+
+void InputReplay::addToWindow(Window &window, qint64 offsetMs, qint64 spanMs)
+{
+    window.minOffsetMs = qMin(window.minOffsetMs, offsetMs);
+    window.maxOffsetMs = qMax(window.maxOffsetMs, offsetMs);
+    window.maxSpanMs = qMax(window.maxSpanMs, spanMs);
+}
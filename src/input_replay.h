@@ -0,0 +1,56 @@
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include <QtGlobal>
+
+/* Maps the times of a viewer's batched input events onto the host clock, so
+ * they are injected with the spacing they were made with.
+ *
+ * A batch goes out right after its last event, arrival minus that event's
+ * viewer time is the clock offset plus the batch's network delay. Over the
+ * current and the last OFFSET_WINDOW_MS the smallest of these is the offset
+ * plus the least delay, the spread up to the largest the jitter. An event is
+ * due at its viewer time plus the smallest, plus a playout delay of the
+ * longest batch span and the jitter, up to MAX_PLAYOUT_MS. A batch delayed
+ * more than that is partly past due, those events go out at once. The
+ * windows let the offset follow clock drift and the playout shrink again.
+ *
+ * All host times are monotonic milliseconds passed in by the caller. */
+class InputReplay
+{
+public:
+    static const qint64 OFFSET_WINDOW_MS    = 10000;
+    static const qint64 MAX_PLAYOUT_MS      = 100;  // longest an event is held for its timing
+
+    InputReplay();
+
+    void reset();
+
+    // a batch of events from baseMs to baseMs + spanMs on the viewer's clock arrived
+    void batchArrived(quint32 baseMs, int spanMs, qint64 arrivalMs);
+    // host time an event of the last batch is due, offsetMs after its base
+    qint64 dueMs(int offsetMs) const;
+
+    qint64 playoutMs() const;
+
+private:
+    struct Window
+    {
+        qint64 minOffsetMs;     // host minus viewer time
+        qint64 maxOffsetMs;
+        qint64 maxSpanMs;
+    };
+
+    void startWindow(Window &window, qint64 offsetMs, qint64 spanMs);
+    void addToWindow(Window &window, qint64 offsetMs, qint64 spanMs);
+
+    qint64  m_viewerMs;         // base of the last batch, unwrapped
+    quint32 m_lastBaseMs;
+    bool    m_started;
+
+    Window  m_window;           // the current and the last one
+    Window  m_lastWindow;
+    qint64  m_windowStartMs;
+};
+
+#endif // INPUT_REPLAY_H
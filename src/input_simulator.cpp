@@ -1,6 +1,10 @@
 #include "input_simulator.h"
+#include "protocol.h"
 #include <QDebug>
 #include <QCursor>
+#include <QMutexLocker>
+
+#include <cstring>
 
 #ifdef Q_OS_WIN
 #include "windows.h"
@@ -11,36 +15,185 @@
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
 #include <X11/extensions/XTest.h>
+
+#include "key_map.h"
 #endif
 
 InputSimulator::InputSimulator(QObject *parent) : QObject(parent),
-    m_screenPosition(QPoint(0,0))
-{
+    m_screenPosition(QPoint(0,0)),
 #ifdef Q_OS_UNIX
+    m_display(Q_NULLPTR),
+    m_displayFailed(false),
+#endif
+    m_flushPending(false),
+    m_draining(false),
+#ifdef Q_OS_UNIX
+    m_wheelRemainderX(0),
+    m_wheelRemainderY(0),
+#endif
+    m_replayTimer(new QTimer(this)), // moves to the input thread with the simulator
+    m_queuesAdded(0)
+{
     createKeysMap();
+
+    m_replayTimer->setSingleShot(true);
+    m_replayTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_replayTimer, &QTimer::timeout, this, &InputSimulator::drainQueues);
+}
+
+InputSimulator::~InputSimulator()
+{
+    // the handlers of queues still open close them later, the last of the two deletes them
+    for(int i=0;i<m_queues.size();++i)
+        m_queues.at(i).queue->detach();
+
+    QMutexLocker locker(&m_newQueuesMutex);
+    for(int i=0;i<m_newQueues.size();++i)
+        m_newQueues.at(i)->detach();
+    m_newQueues.clear();
+
+#ifdef Q_OS_UNIX
+    if(m_display)
+        XCloseDisplay(m_display); // flushes what is still buffered
 #endif
 }
 
+InputQueue *InputSimulator::createQueue()
+{
+    InputQueue *queue = new InputQueue(this);
+
+    QMutexLocker locker(&m_newQueuesMutex);
+    m_newQueues.append(queue);
+    m_queuesAdded.storeRelease(1); // before its first event wakes the drain
+
+    return queue;
+}
+
+void InputSimulator::drainQueues()
+{
+    if(m_queuesAdded.fetchAndStoreAcquire(0))
+    {
+        QMutexLocker locker(&m_newQueuesMutex);
+        for(int i=0;i<m_newQueues.size();++i)
+        {
+            QueueState state;
+            state.queue = m_newQueues.at(i);
+            state.closed = false;
+            m_queues.append(state);
+        }
+
+        m_newQueues.clear();
+    }
+
+    m_draining = true;
+
+    const qint64 nowMs = inputClockMs();
+    qint64 nextDueMs = -1;
+
+    for(int i=0;i<m_queues.size();)
+    {
+        QueueState &state = m_queues[i];
+
+        if(state.queue->armWakeup())
+            state.closed = true;
+
+        // of consecutive absolute moves only the last one matters
+        InputEvent event;
+        InputEvent move;
+        bool movePending = false;
+
+        while(state.queue->peek(event))
+        {
+            if(event.dueMs > nowMs)
+            {
+                nextDueMs = nextDueMs < 0 ? event.dueMs : qMin(nextDueMs, event.dueMs);
+                break;
+            }
+
+            state.queue->pop(event);
+
+            if(event.type == InputEvent::MOVE)
+            {
+                move = event;
+                movePending = true;
+                continue;
+            }
+
+            if(movePending)
+            {
+                injectEvent(move);
+                movePending = false;
+            }
+
+            injectEvent(event);
+
+            if(event.probe)
+                state.queue->probeInjected(inputClockMs());
+        }
+
+        if(movePending)
+            injectEvent(move);
+
+        if(state.closed && !state.queue->peek(event))
+        {
+            state.queue->detach();
+            m_queues.removeAt(i);
+            continue;
+        }
+
+        ++i;
+    }
+
+    m_draining = false;
+    flushEvents();
+
+    if(nextDueMs >= 0)
+        m_replayTimer->start(static_cast<int>(nextDueMs - nowMs));
+}
+
+void InputSimulator::injectEvent(const InputEvent &event)
+{
+    switch(event.type)
+    {
+        case InputEvent::KEY:
+            simulateKeyboard(event.code, event.state);
+            break;
+        case InputEvent::MOUSE_KEY:
+            simulateMouseKeys(event.code, event.state);
+            break;
+        case InputEvent::WHEEL:
+            simulateWheel(static_cast<qint16>(event.x), static_cast<qint16>(event.y));
+            break;
+        case InputEvent::MOVE:
+            simulateMouseMove(static_cast<quint16>(event.x), static_cast<quint16>(event.y));
+            break;
+        case InputEvent::MOVE_BY:
+            setMouseDelta(static_cast<qint16>(event.x), static_cast<qint16>(event.y));
+            break;
+        default:
+            break;
+    }
+}
+
 void InputSimulator::simulateKeyboard(quint16 keyCode, bool state)
 {
 #ifdef Q_OS_UNIX
-    if(!m_keysMap.contains(keyCode))
+    if(keyCode >= KEY_CODE_COUNT || m_keySyms[keyCode] == 0)
     {
         qDebug()<<"InputSimulator::simulateKeyboard"<<keyCode<<state;
         return;
     }
 
-    Display *display;
-    display = XOpenDisplay(Q_NULLPTR);
+    if(!openDisplay())
+        return;
 
-    unsigned int keycode = XKeysymToKeycode(display, m_keysMap.value(keyCode));
+    unsigned int keycode = XKeysymToKeycode(m_display, m_keySyms[keyCode]);
 
     if(state)
-        XTestFakeKeyEvent(display, keycode, True, 0);
-    else XTestFakeKeyEvent(display, keycode, False, 0);
+        XTestFakeKeyEvent(m_display, keycode, True, 0);
+    else XTestFakeKeyEvent(m_display, keycode, False, 0);
 
-    XFlush(display);
-    XCloseDisplay(display);
+    scheduleFlush();
 #endif
 
 
@@ -63,18 +216,17 @@ void InputSimulator::simulateKeyboard(quint16 keyCode, bool state)
 void InputSimulator::simulateMouseKeys(quint16 keyCode, bool state)
 {
 #ifdef Q_OS_UNIX
-    Display *display;
-    display = XOpenDisplay(Q_NULLPTR);
+    if(!openDisplay())
+        return;
 
     if(keyCode == 0)//left
-        XTestFakeButtonEvent(display,Button1,state,0);
+        XTestFakeButtonEvent(m_display,Button1,state,0);
     else if(keyCode == 1)//middle
-        XTestFakeButtonEvent(display,Button2,state,0);
+        XTestFakeButtonEvent(m_display,Button2,state,0);
     else if(keyCode == 2)//right
-        XTestFakeButtonEvent(display,Button3,state,0);
+        XTestFakeButtonEvent(m_display,Button3,state,0);
 
-    XFlush(display);
-    XCloseDisplay(display);
+    scheduleFlush();
 #endif
 
 #ifdef Q_OS_WIN
@@ -113,162 +265,145 @@ void InputSimulator::simulateMouseMove(quint16 posX, quint16 posY)
     //qDebug() << "posX: " << QString(posX);
     //qDebug() << "posY: " << QString(posY);
 
+#ifdef Q_OS_UNIX
+    if(!openDisplay())
+        return;
+
+    XTestFakeMotionEvent(m_display, -1, m_screenPosition.x()+posX, m_screenPosition.y()+posY, 0);
+    scheduleFlush();
+#else
     QCursor::setPos(m_screenPosition.x()+posX,m_screenPosition.y()+posY);
+#endif
 }
 
-void InputSimulator::simulateWheelEvent(bool deltaPos)
+void InputSimulator::simulateWheel(qint16 deltaX, qint16 deltaY)
 {
 #ifdef Q_OS_UNIX
-    Display *display;
-    display = XOpenDisplay(Q_NULLPTR);
+    if(!openDisplay())
+        return;
+
+    // a click of buttons 4 to 7 per notch, what is left of one waits for the next event
+    m_wheelRemainderX += deltaX;
+    m_wheelRemainderY += deltaY;
+
+    const int clicksX = m_wheelRemainderX / WHEEL_NOTCH;
+    const int clicksY = m_wheelRemainderY / WHEEL_NOTCH;
 
-    quint32 btnNum = Button4;
-    if(deltaPos)btnNum = Button5;
+    m_wheelRemainderX -= clicksX * WHEEL_NOTCH;
+    m_wheelRemainderY -= clicksY * WHEEL_NOTCH;
 
-    XTestFakeButtonEvent(display,btnNum,true,0);
-    XTestFakeButtonEvent(display,btnNum,false,0);
+    const unsigned int buttonX = clicksX > 0 ? 7 : 6;
+    const unsigned int buttonY = clicksY > 0 ? Button5 : Button4;
 
-    XFlush(display);
-    XCloseDisplay(display);
+    for(int i=0;i<qAbs(clicksY);++i)
+    {
+        XTestFakeButtonEvent(m_display,buttonY,true,0);
+        XTestFakeButtonEvent(m_display,buttonY,false,0);
+    }
+
+    for(int i=0;i<qAbs(clicksX);++i)
+    {
+        XTestFakeButtonEvent(m_display,buttonX,true,0);
+        XTestFakeButtonEvent(m_display,buttonX,false,0);
+    }
+
+    scheduleFlush();
 #endif
 
 #ifdef Q_OS_WIN
-    INPUT ip;
+    INPUT ip[2];
+    UINT count = 0;
 
-    ZeroMemory(&ip,sizeof(ip));
+    ZeroMemory(ip,sizeof(ip));
 
-    ip.type = INPUT_MOUSE;
-    ip.ki.wScan = 0;
-    ip.ki.time = 0;
-    ip.ki.dwExtraInfo = 0;
-    ip.mi.dwFlags = MOUSEEVENTF_WHEEL;
+    if(deltaY != 0)
+    {
+        ip[count].type = INPUT_MOUSE;
+        ip[count].mi.dwFlags = MOUSEEVENTF_WHEEL;
+        ip[count].mi.mouseData = static_cast<DWORD>(-deltaY); // up is positive
+        ++count;
+    }
 
-    if(deltaPos)ip.mi.mouseData = static_cast<DWORD>(-120);
-    else ip.mi.mouseData = 120;
+    if(deltaX != 0)
+    {
+        ip[count].type = INPUT_MOUSE;
+        ip[count].mi.dwFlags = MOUSEEVENTF_HWHEEL;
+        ip[count].mi.mouseData = static_cast<DWORD>(deltaX);
+        ++count;
+    }
 
-    SendInput(1, &ip, sizeof(INPUT));
+    if(count > 0)
+        SendInput(count, ip, sizeof(INPUT));
 #endif
 }
 
 void InputSimulator::setMouseDelta(qint16 deltaX, qint16 deltaY)
 {
+#ifdef Q_OS_UNIX
+    if(!openDisplay())
+        return;
+
+    XTestFakeRelativeMotionEvent(m_display, -deltaX, -deltaY, 0);
+    scheduleFlush();
+#else
     QPoint cursorPos = QCursor::pos();
     quint16 posX = static_cast<quint16>(cursorPos.x() - deltaX);
     quint16 posY = static_cast<quint16>(cursorPos.y() - deltaY);
     QCursor::setPos(posX,posY);
+#endif
 }
 
 void InputSimulator::createKeysMap()
 {
 #ifdef Q_OS_UNIX
-    m_keysMap.insert(8,XK_BackSpace);
-    m_keysMap.insert(9,XK_Tab);
-    m_keysMap.insert(13,XK_Return);
-    m_keysMap.insert(16,XK_Shift_L);
-    m_keysMap.insert(17,XK_Control_L);
-    m_keysMap.insert(18,XK_Alt_L);
-    m_keysMap.insert(44,XK_Pause);
-    m_keysMap.insert(20,XK_Caps_Lock);
-    m_keysMap.insert(27,XK_Escape);
-
-    m_keysMap.insert(32,XK_space);
-    m_keysMap.insert(35,XK_End);
-    m_keysMap.insert(36,XK_Home);
-    m_keysMap.insert(37,XK_Left);
-    m_keysMap.insert(38,XK_Up);
-    m_keysMap.insert(39,XK_Right);
-    m_keysMap.insert(40,XK_Down);
-
-    m_keysMap.insert(44,XK_Print);
-    m_keysMap.insert(45,XK_Insert);
-    m_keysMap.insert(46,XK_Delete);
-
-    m_keysMap.insert(48,XK_0);
-    m_keysMap.insert(49,XK_1);
-    m_keysMap.insert(50,XK_2);
-    m_keysMap.insert(51,XK_3);
-    m_keysMap.insert(52,XK_4);
-    m_keysMap.insert(53,XK_5);
-    m_keysMap.insert(54,XK_6);
-    m_keysMap.insert(55,XK_7);
-    m_keysMap.insert(56,XK_8);
-    m_keysMap.insert(57,XK_9);
-
-    m_keysMap.insert(65,XK_A);
-    m_keysMap.insert(66,XK_B);
-    m_keysMap.insert(67,XK_C);
-    m_keysMap.insert(68,XK_D);
-    m_keysMap.insert(69,XK_E);
-    m_keysMap.insert(70,XK_F);
-    m_keysMap.insert(71,XK_G);
-    m_keysMap.insert(72,XK_H);
-    m_keysMap.insert(73,XK_I);
-    m_keysMap.insert(74,XK_J);
-    m_keysMap.insert(75,XK_K);
-    m_keysMap.insert(76,XK_L);
-    m_keysMap.insert(77,XK_M);
-    m_keysMap.insert(78,XK_N);
-    m_keysMap.insert(79,XK_O);
-    m_keysMap.insert(80,XK_P);
-    m_keysMap.insert(81,XK_Q);
-    m_keysMap.insert(82,XK_R);
-    m_keysMap.insert(83,XK_S);
-    m_keysMap.insert(84,XK_T);
-    m_keysMap.insert(85,XK_U);
-    m_keysMap.insert(86,XK_V);
-    m_keysMap.insert(87,XK_W);
-    m_keysMap.insert(88,XK_X);
-    m_keysMap.insert(89,XK_Y);
-    m_keysMap.insert(90,XK_Z);
-
-    m_keysMap.insert(91,XK_Super_L);
-    m_keysMap.insert(93,XK_Menu);
-
-    m_keysMap.insert(96,XK_KP_0);
-    m_keysMap.insert(97,XK_KP_1);
-    m_keysMap.insert(98,XK_KP_2);
-    m_keysMap.insert(99,XK_KP_3);
-    m_keysMap.insert(100,XK_KP_4);
-    m_keysMap.insert(101,XK_KP_5);
-    m_keysMap.insert(102,XK_KP_6);
-    m_keysMap.insert(103,XK_KP_7);
-    m_keysMap.insert(104,XK_KP_8);
-    m_keysMap.insert(105,XK_KP_9);
-
-    m_keysMap.insert(112,XK_F1);
-    m_keysMap.insert(113,XK_F2);
-    m_keysMap.insert(114,XK_F3);
-    m_keysMap.insert(115,XK_F4);
-    m_keysMap.insert(116,XK_F5);
-    m_keysMap.insert(117,XK_F6);
-    m_keysMap.insert(118,XK_F7);
-    m_keysMap.insert(119,XK_F8);
-    m_keysMap.insert(120,XK_F9);
-    m_keysMap.insert(121,XK_F10);
-    m_keysMap.insert(122,XK_F11);
-    m_keysMap.insert(123,XK_F12);
-
-    m_keysMap.insert(144,XK_Num_Lock);
-    m_keysMap.insert(145,XK_Scroll_Lock);
-
-    m_keysMap.insert(179,179);//Play/pause
-    m_keysMap.insert(173,173);//Mute
-    m_keysMap.insert(174,174);//Volume-
-    m_keysMap.insert(175,175);//Volume+
-
-    m_keysMap.insert(186,XK_semicolon);
-    m_keysMap.insert(187,XK_equal);
-    m_keysMap.insert(188,XK_comma);
-    m_keysMap.insert(189,XK_minus);
-
-    m_keysMap.insert(190,XK_greater);
-    m_keysMap.insert(191,XK_question);
-    m_keysMap.insert(192,XK_asciitilde);
-
-    m_keysMap.insert(219,XK_bracketleft);
-    m_keysMap.insert(220,XK_backslash);
-    m_keysMap.insert(221,XK_bracketright);
-    m_keysMap.insert(222,XK_apostrophe);
-    m_keysMap.insert(226,XK_bar);
+    memset(m_keySyms, 0, sizeof(m_keySyms));
+
+    for(int i=0;i<KEY_MAP_SIZE;++i)
+        m_keySyms[KEY_MAP[i].keyCode] = KEY_MAP[i].keySym;
+#endif
+}
+
+bool InputSimulator::openDisplay()
+{
+#ifdef Q_OS_UNIX
+    if(m_display)
+        return true;
+
+    if(m_displayFailed)
+        return false;
+
+    m_display = XOpenDisplay(Q_NULLPTR);
+
+    if(!m_display)
+    {
+        m_displayFailed = true; // said once, the events are dropped
+        qWarning() << "InputSimulator: can't open the X display, input is ignored";
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void InputSimulator::scheduleFlush()
+{
+    if(m_flushPending || m_draining)
+        return;
+
+    m_flushPending = true;
+
+    // behind the input events already queued to this thread, a burst of them gets one flush
+    QMetaObject::invokeMethod(this, "flushEvents", Qt::QueuedConnection);
+}
+
+void InputSimulator::flushEvents()
+{
+    m_flushPending = false;
+
+#ifdef Q_OS_UNIX
+    if(m_display)
+        XFlush(m_display);
 #endif
 }
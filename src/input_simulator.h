@@ -2,32 +2,77 @@
 #define INPUT_SIMULATOR_H
 
 #include <QObject>
-#include <QMap>
 #include <QPoint>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+
+#include "input_queue.h"
+
+#ifdef Q_OS_UNIX
+#include "key_map.h"
+
+typedef struct _XDisplay Display;
+#endif
 
 class InputSimulator : public QObject
 {
     Q_OBJECT
 public:
     explicit InputSimulator(QObject *parent = nullptr);
+    ~InputSimulator();
+
+    InputQueue *createQueue(); // for a viewer's handler, from any thread, the handler closes it and never touches it again
 
 private:
 
-    QMap<quint16,quint16> m_keysMap;
     QPoint m_screenPosition;
 
+#ifdef Q_OS_UNIX
+    quint32  m_keySyms[KEY_CODE_COUNT]; // X keysym by viewer key code, 0 if it has none
+
+    // one connection for the life of the simulator, opened by the thread that injects
+    Display *m_display;
+    bool     m_displayFailed;
+#endif
+    bool     m_flushPending;    // events went out since the last flush
+    bool     m_draining;        // the drain flushes once at its end
+
+#ifdef Q_OS_UNIX
+    int      m_wheelRemainderX; // of a notch, X scrolls in whole ones
+    int      m_wheelRemainderY;
+#endif
+
+    // the viewers' input, drained in this thread
+    struct QueueState
+    {
+        InputQueue *queue;
+        bool        closed; // detached once empty
+    };
+
+    QList<QueueState>       m_queues;
+    QTimer                 *m_replayTimer; // for the next event held for its time
+    QMutex                  m_newQueuesMutex; // only taken to pick up new queues
+    QList<InputQueue*>      m_newQueues;
+    QAtomicInt              m_queuesAdded;
+
 signals:
 
 public slots:
     void simulateKeyboard(quint16 keyCode, bool state);
     void simulateMouseKeys(quint16 keyCode, bool state);
     void simulateMouseMove(quint16 posX, quint16 posY);
-    void simulateWheelEvent(bool deltaPos);
+    void simulateWheel(qint16 deltaX, qint16 deltaY); // WHEEL_NOTCH per notch, positive is right and down
     void setMouseDelta(qint16 deltaX, qint16 deltaY);
     void setScreenPosition(const QPoint &pos){m_screenPosition = pos;}
 
 private slots:
+    void drainQueues();
+    void injectEvent(const InputEvent &event);
     void createKeysMap();
+    bool openDisplay();
+    void scheduleFlush(); // the events queued behind this one go out with it
+    void flushEvents();
 };
 
 #endif // INPUT_SIMULATOR_H
@@ -0,0 +1,131 @@
+#ifndef KEY_MAP_H
+#define KEY_MAP_H
+
+#include <QtGlobal>
+#include <X11/keysym.h>
+
+// Browser key codes (KeyboardEvent.keyCode) as the viewer sends them, and the X keysyms they're injected as
+struct KeyMapping
+{
+    quint16 keyCode;
+    quint32 keySym;
+};
+
+static const int KEY_CODE_COUNT = 256; // key codes are below
+
+static const KeyMapping KEY_MAP[] =
+{
+    {8, XK_BackSpace},
+    {9, XK_Tab},
+    {13, XK_Return},
+    {16, XK_Shift_L},
+    {17, XK_Control_L},
+    {18, XK_Alt_L},
+    {19, XK_Pause},
+    {20, XK_Caps_Lock},
+    {27, XK_Escape},
+
+    {32, XK_space},
+    {35, XK_End},
+    {36, XK_Home},
+    {37, XK_Left},
+    {38, XK_Up},
+    {39, XK_Right},
+    {40, XK_Down},
+
+    {44, XK_Print},
+    {45, XK_Insert},
+    {46, XK_Delete},
+
+    {48, XK_0},
+    {49, XK_1},
+    {50, XK_2},
+    {51, XK_3},
+    {52, XK_4},
+    {53, XK_5},
+    {54, XK_6},
+    {55, XK_7},
+    {56, XK_8},
+    {57, XK_9},
+
+    {65, XK_A},
+    {66, XK_B},
+    {67, XK_C},
+    {68, XK_D},
+    {69, XK_E},
+    {70, XK_F},
+    {71, XK_G},
+    {72, XK_H},
+    {73, XK_I},
+    {74, XK_J},
+    {75, XK_K},
+    {76, XK_L},
+    {77, XK_M},
+    {78, XK_N},
+    {79, XK_O},
+    {80, XK_P},
+    {81, XK_Q},
+    {82, XK_R},
+    {83, XK_S},
+    {84, XK_T},
+    {85, XK_U},
+    {86, XK_V},
+    {87, XK_W},
+    {88, XK_X},
+    {89, XK_Y},
+    {90, XK_Z},
+
+    {91, XK_Super_L},
+    {93, XK_Menu},
+
+    {96, XK_KP_0},
+    {97, XK_KP_1},
+    {98, XK_KP_2},
+    {99, XK_KP_3},
+    {100, XK_KP_4},
+    {101, XK_KP_5},
+    {102, XK_KP_6},
+    {103, XK_KP_7},
+    {104, XK_KP_8},
+    {105, XK_KP_9},
+
+    {112, XK_F1},
+    {113, XK_F2},
+    {114, XK_F3},
+    {115, XK_F4},
+    {116, XK_F5},
+    {117, XK_F6},
+    {118, XK_F7},
+    {119, XK_F8},
+    {120, XK_F9},
+    {121, XK_F10},
+    {122, XK_F11},
+    {123, XK_F12},
+
+    {144, XK_Num_Lock},
+    {145, XK_Scroll_Lock},
+
+    {179, 179},         // Play/pause
+    {173, 173},         // Mute
+    {174, 174},         // Volume-
+    {175, 175},         // Volume+
+
+    {186, XK_semicolon},
+    {187, XK_equal},
+    {188, XK_comma},
+    {189, XK_minus},
+
+    {190, XK_greater},
+    {191, XK_question},
+    {192, XK_asciitilde},
+
+    {219, XK_bracketleft},
+    {220, XK_backslash},
+    {221, XK_bracketright},
+    {222, XK_apostrophe},
+    {226, XK_bar}
+};
+
+static const int KEY_MAP_SIZE = sizeof(KEY_MAP) / sizeof(KEY_MAP[0]);
+
+#endif // KEY_MAP_H
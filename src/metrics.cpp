@@ -0,0 +1,164 @@
+#include "metrics.h"
+#include "protocol.h"
+
+// the commands packets are counted by, packetType() is the index
+static const quint32 PACKET_TYPES[] =
+{
+    0, // anything else
+    KEY_REGISTER, KEY_PROXY_CONNECT, KEY_SET_NAME, KEY_GET_IMAGE, KEY_IMAGE_PARAM,
+    KEY_IMAGE_TILE, KEY_IMAGE_SCREEN, KEY_IMAGE_BATCH, KEY_SET_KEY_STATE, KEY_SET_CURSOR_POS,
+    KEY_SET_CURSOR_DELTA, KEY_SET_MOUSE_KEY, KEY_SET_MOUSE_WHEEL, KEY_CHANGE_DISPLAY, KEY_REFRESH_DISPLAY,
+    KEY_TILE_RECEIVED, KEY_FRAME_RECEIVED, KEY_CAPABILITIES, KEY_FRAGMENT, KEY_RESUME_TOKEN,
+    KEY_RESUME, KEY_TILE_HASHES, KEY_STREAM_PARAMS, KEY_INPUT_BATCH, KEY_INPUT_ECHO,
+    KEY_INPUT_LATENCY, KEY_HOST_STATS, KEY_CONNECT_UUID, KEY_SET_NONCE, KEY_SET_AUTH_REQUEST,
+    KEY_SET_AUTH_RESPONSE, KEY_CONNECTED_PROXY_CLIENT, KEY_DISCONNECTED_PROXY_CLIENT
+};
+
+static const int PACKET_TYPES_USED = sizeof(PACKET_TYPES) / sizeof(PACKET_TYPES[0]);
+
+Q_STATIC_ASSERT(PACKET_TYPES_USED <= Metrics::PACKET_TYPE_COUNT);
+
+MetricHistogram::MetricHistogram() :
+    m_count(0),
+    m_sum(0)
+{
+    for(int i=0;i<Histogram::BUCKET_COUNT;++i)
+        m_buckets[i].store(0);
+}
+
+void MetricHistogram::add(quint64 value)
+{
+    m_buckets[Histogram::bucketIndex(value)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(value);
+}
+
+Metrics::Metrics()
+{
+}
+
+Metrics *Metrics::unshared()
+{
+    static Metrics metrics;
+    return &metrics;
+}
+
+int Metrics::packetType(quint32 command)
+{
+    for(int i=1;i<PACKET_TYPES_USED;++i)
+    {
+        if(PACKET_TYPES[i] == command)
+            return i;
+    }
+
+    return 0;
+}
+
+static void appendHeader(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out.append("# HELP ").append(name).append(' ').append(help).append('\n');
+    out.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+static void appendValue(QByteArray &out, const char *name, qint64 value)
+{
+    out.append(name).append(' ').append(QByteArray::number(value)).append('\n');
+}
+
+static void appendCounter(QByteArray &out, const char *name, const char *help, const MetricCounter &counter)
+{
+    appendHeader(out, name, "counter", help);
+    appendValue(out, name, static_cast<qint64>(counter.value()));
+}
+
+static void appendGauge(QByteArray &out, const char *name, const char *help, const MetricGauge &gauge)
+{
+    appendHeader(out, name, "gauge", help);
+    appendValue(out, name, gauge.value());
+}
+
+/* Cumulative buckets at the powers of two up to the largest value seen, in
+ * the base unit: scale converts what was added, e.g. 1e-6 from us to seconds. */
+static void appendHistogram(QByteArray &out, const char *name, const char *help, const MetricHistogram &histogram, double scale)
+{
+    appendHeader(out, name, "histogram", help);
+
+    int last = -1;
+    for(int i=0;i<Histogram::BUCKET_COUNT;++i)
+        if(histogram.bucket(i) > 0)
+            last = i | (Histogram::SUB_BUCKETS - 1); // up to the end of its power of two
+
+    quint64 cumulative = 0;
+
+    for(int i=0;i<=last;++i)
+    {
+        cumulative += histogram.bucket(i);
+
+        if(i % Histogram::SUB_BUCKETS != Histogram::SUB_BUCKETS - 1)
+            continue;
+
+        out.append(name).append("_bucket{le=\"")
+           .append(QByteArray::number(static_cast<double>(Histogram::bucketUpperBound(i)) * scale, 'g', 6))
+           .append("\"} ").append(QByteArray::number(cumulative)).append('\n');
+    }
+
+    // read after the buckets, +Inf holds at least what they do
+    const quint64 count = qMax(histogram.count(), cumulative);
+
+    out.append(name).append("_bucket{le=\"+Inf\"} ").append(QByteArray::number(count)).append('\n');
+    out.append(name).append("_sum ").append(QByteArray::number(static_cast<double>(histogram.sum()) * scale, 'g', 12)).append('\n');
+    out.append(name).append("_count ").append(QByteArray::number(count)).append('\n');
+}
+
+static void appendPacketBytes(QByteArray &out, const char *direction, const MetricCounter *counters)
+{
+    for(int i=0;i<PACKET_TYPES_USED;++i)
+    {
+        const quint64 bytes = counters[i].value();
+
+        if(bytes == 0)
+            continue;
+
+        QByteArray command;
+
+        if(i > 0)
+            appendFourCC(command, PACKET_TYPES[i]);
+        else command = "other";
+
+        out.append("qv_packet_bytes_total{direction=\"").append(direction)
+           .append("\",command=\"").append(command).append("\"} ")
+           .append(QByteArray::number(bytes)).append('\n');
+    }
+}
+
+// text exposition format 0.0.4
+QByteArray Metrics::prometheusText() const
+{
+    QByteArray out;
+    out.reserve(16 * 1024);
+
+    appendHistogram(out, "qv_capture_seconds", "Screen grab and conversion per frame.", captureUs, 1e-6);
+    appendHistogram(out, "qv_diff_seconds", "Comparison with the last frame per frame.", diffUs, 1e-6);
+    appendHistogram(out, "qv_diff_tile_seconds", "Comparison with the last frame per tile.", diffTileNs, 1e-9);
+    appendHistogram(out, "qv_encode_seconds", "Encoding of all images of a frame.", encodeUs, 1e-6);
+    appendHistogram(out, "qv_encode_image_seconds", "Encoding per tile or full screen image.", encodeTileUs, 1e-6);
+    appendHistogram(out, "qv_frame_seconds", "Capture cycle, grab to the last image handed to the viewers.", frameUs, 1e-6);
+    appendCounter(out, "qv_frames_total", "Frames captured.", frames);
+    appendCounter(out, "qv_full_frames_total", "Frames sent as one full screen image.", fullFrames);
+    appendCounter(out, "qv_tiles_total", "Tiles compared with the last frame.", tiles);
+    appendCounter(out, "qv_dirty_tiles_total", "Tiles that changed.", dirtyTiles);
+    appendGauge(out, "qv_dirty_tile_ratio_permille", "Dirty tiles of the last frame, per 1000.", dirtyPermille);
+    appendGauge(out, "qv_viewers", "Viewers being streamed to.", viewers);
+
+    appendHeader(out, "qv_packet_bytes_total", "counter", "Bytes by packet command, queued for or received from the viewers.");
+    appendPacketBytes(out, "sent", sentBytes);
+    appendPacketBytes(out, "received", receivedBytes);
+
+    appendHistogram(out, "qv_send_queue_bytes", "Bytes waiting for a viewer's link at the end of a frame.", sendQueueBytes, 1);
+    appendHistogram(out, "qv_ack_rtt_seconds", "Frame or tile sent until the viewer acknowledged it.", ackRttMs, 1e-3);
+    appendHistogram(out, "qv_input_latency_seconds", "Viewer input event until the frame it changed was drawn.", inputLatencyMs, 1e-3);
+    appendCounter(out, "qv_reconnects_total", "Attempts to reconnect to the proxy.", reconnects);
+    appendCounter(out, "qv_session_resumes_total", "Viewer sessions resumed after a dropped link.", resumes);
+
+    return out;
+}
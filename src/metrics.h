@@ -0,0 +1,96 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+
+#include "histogram.h"
+
+/* Counters, gauges and histograms any thread updates without a lock, an
+ * update is one relaxed atomic add, three for a histogram. A reader sees each
+ * value as it is, not a snapshot of all of them at one point in time. */
+
+class MetricCounter
+{
+public:
+    MetricCounter() : m_value(0) {}
+
+    void add(quint64 n = 1) {m_value.fetchAndAddRelaxed(n);}
+    quint64 value() const {return m_value.load();}
+
+private:
+    QAtomicInteger<quint64> m_value;
+};
+
+class MetricGauge
+{
+public:
+    MetricGauge() : m_value(0) {}
+
+    void set(qint64 value) {m_value.store(value);}
+    qint64 value() const {return m_value.load();}
+
+private:
+    QAtomicInteger<qint64> m_value;
+};
+
+// Histogram's buckets, for several writers
+class MetricHistogram
+{
+public:
+    MetricHistogram();
+
+    void add(quint64 value);
+
+    quint64 count() const {return m_count.load();}
+    quint64 sum() const {return m_sum.load();}
+    quint64 bucket(int index) const {return m_buckets[index].load();}
+
+private:
+    QAtomicInteger<quint64> m_buckets[Histogram::BUCKET_COUNT];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+};
+
+/* Everything the host measures, one instance shared by the capture and the
+ * viewer handlers. Read out as Prometheus text (QV_METRICS_PORT) and, in
+ * part, in the KEY_HOST_STATS packets viewers get. */
+class Metrics
+{
+public:
+    static const int PACKET_TYPE_COUNT = 40; // the protocol's commands, index 0 for unknown ones
+
+    Metrics();
+
+    // ScreenCapture, per frame unless it says tile
+    MetricHistogram captureUs;      // grab and conversion into the frame ring, the screen is grabbed whole
+    MetricHistogram diffUs;         // comparison with the last frame
+    MetricHistogram diffTileNs;
+    MetricHistogram encodeUs;       // all images of the frame, cache hits included
+    MetricHistogram encodeTileUs;   // per tile or full screen image
+    MetricHistogram frameUs;        // the whole capture cycle
+    MetricCounter   frames;
+    MetricCounter   fullFrames;     // too many dirty tiles, sent as one image
+    MetricCounter   tiles;          // compared
+    MetricCounter   dirtyTiles;
+    MetricGauge     dirtyPermille;  // of the last frame
+    MetricGauge     viewers;
+
+    // WebSocketHandler, over all viewers
+    MetricCounter   sentBytes[PACKET_TYPE_COUNT];       // queued for the socket, by packetType()
+    MetricCounter   receivedBytes[PACKET_TYPE_COUNT];
+    MetricHistogram sendQueueBytes; // waiting for a viewer's link, per frame
+    MetricHistogram ackRttMs;       // a frame or tile sent until its ack
+    MetricHistogram inputLatencyMs; // input to photon, CAP_INPUT_ECHO
+    MetricCounter   reconnects;     // attempts to get back to the proxy
+    MetricCounter   resumes;        // sessions resumed after a dropped link
+
+    static int packetType(quint32 command);
+
+    // for a capture or handler the host gave no metrics of its own, counted and never read
+    static Metrics *unshared();
+
+    QByteArray prometheusText() const;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,67 @@
+#include "metrics_server.h"
+#include "trace.h"
+
+MetricsServer::MetricsServer(const Metrics *metrics, QObject *parent) : QObject(parent),
+    m_metrics(metrics),
+    m_server(new QTcpServer(this))
+{
+    connect(m_server, &QTcpServer::newConnection, this, &MetricsServer::clientConnected);
+}
+
+bool MetricsServer::listen(quint16 port)
+{
+    return m_server->listen(QHostAddress::LocalHost, port);
+}
+
+void MetricsServer::clientConnected()
+{
+    while(m_server->hasPendingConnections())
+    {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead,     this,   &MetricsServer::requestReceived);
+        connect(socket, &QTcpSocket::disconnected,  socket, &QTcpSocket::deleteLater);
+    }
+}
+
+// the request line is all that matters, the response goes out once the headers are in
+void MetricsServer::requestReceived()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+
+    if(socket->bytesAvailable() > MAX_REQUEST_SIZE)
+    {
+        socket->abort();
+        return;
+    }
+
+    QByteArray request = socket->peek(MAX_REQUEST_SIZE);
+
+    if(!request.contains("\r\n\r\n"))
+        return;
+
+    socket->readAll();
+    disconnect(socket, &QTcpSocket::readyRead, this, &MetricsServer::requestReceived);
+
+    if(!request.startsWith("GET "))
+        sendResponse(socket, "405 Method Not Allowed", QByteArray());
+    else if(!request.startsWith("GET /trace "))
+        sendResponse(socket, "200 OK", m_metrics->prometheusText());
+    else if(Trace::isEnabled())
+        sendResponse(socket, "200 OK", Trace::chromeJson(), "application/json");
+    else sendResponse(socket, "404 Not Found", "QV_TRACE is not set\n");
+}
+
+void MetricsServer::sendResponse(QTcpSocket *socket, const QByteArray &status, const QByteArray &body, const QByteArray &contentType)
+{
+    QByteArray response("HTTP/1.1 ");
+    response.append(status);
+    response.append("\r\nContent-Type: ");
+    response.append(contentType);
+    response.append("\r\nContent-Length: ");
+    response.append(QByteArray::number(body.size()));
+    response.append("\r\nConnection: close\r\n\r\n");
+    response.append(body);
+
+    socket->write(response);
+    socket->disconnectFromHost(); // after what was written is out
+}
@@ -0,0 +1,36 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "metrics.h"
+
+/* Serves Metrics as Prometheus text over plain HTTP, on localhost only: a
+ * scraper on the host itself or a tunnel to it. A GET of /trace gets the
+ * Chrome trace while QV_TRACE records one, any other GET the metrics, one
+ * response per connection. */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    static const int MAX_REQUEST_SIZE = 8 * 1024;
+
+    explicit MetricsServer(const Metrics *metrics, QObject *parent = Q_NULLPTR);
+
+    bool listen(quint16 port);
+    QString errorString() const {return m_server->errorString();}
+
+private:
+    const Metrics *m_metrics;
+    QTcpServer    *m_server;
+
+private slots:
+    void clientConnected();
+    void requestReceived();
+    void sendResponse(QTcpSocket *socket, const QByteArray &status, const QByteArray &body,
+                      const QByteArray &contentType = "text/plain; version=0.0.4; charset=utf-8");
+};
+
+#endif // METRICS_SERVER_H
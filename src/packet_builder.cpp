@@ -0,0 +1,60 @@
+#include "packet_builder.h"
+#include "protocol.h"
+
+PacketBuilder::PacketBuilder(QByteArray &buffer) :
+    m_buffer(buffer),
+    m_start(buffer.size())
+{
+
+}
+
+void PacketBuilder::begin(quint32 command)
+{
+    m_start = m_buffer.size();
+
+    appendFourCC(m_buffer, KEY_PKT_HEADR);
+    appendFourCC(m_buffer, command);
+    appendUint32(0); // payload size, patched by finish()
+}
+
+void PacketBuilder::appendUint16(quint16 number)
+{
+    m_buffer.append(static_cast<char>(number));
+    m_buffer.append(static_cast<char>(number >> 8));
+}
+
+void PacketBuilder::appendUint32(quint32 number)
+{
+    m_buffer.append(static_cast<char>(number));
+    m_buffer.append(static_cast<char>(number >> 8));
+    m_buffer.append(static_cast<char>(number >> 16));
+    m_buffer.append(static_cast<char>(number >> 24));
+}
+
+void PacketBuilder::append(const QByteArray &data)
+{
+    m_buffer.append(data);
+}
+
+void PacketBuilder::append(const char *data, int size)
+{
+    m_buffer.append(data, size);
+}
+
+int PacketBuilder::payloadSize() const
+{
+    return m_buffer.size() - m_start - HEADER_SIZE;
+}
+
+const QByteArray &PacketBuilder::finish()
+{
+    quint32 size = static_cast<quint32>(payloadSize());
+
+    char *header = m_buffer.data() + m_start + HEADER_SIZE - 4;
+    header[0] = static_cast<char>(size);
+    header[1] = static_cast<char>(size >> 8);
+    header[2] = static_cast<char>(size >> 16);
+    header[3] = static_cast<char>(size >> 24);
+
+    return m_buffer;
+}
@@ -0,0 +1,30 @@
+#ifndef PACKET_BUILDER_H
+#define PACKET_BUILDER_H
+
+#include <QByteArray>
+
+/* Assembles a viewer packet in place: KEY_PKT_HEADR + command + payload size + payload.
+ * begin() reserves the header, so an encoder can write the payload straight
+ * behind it into the same buffer; finish() patches the payload size. The
+ * finished buffer is handed to the socket as is. */
+class PacketBuilder
+{
+public:
+    static const int HEADER_SIZE = 12;
+
+    explicit PacketBuilder(QByteArray &buffer);
+
+    void begin(quint32 command);
+    void appendUint16(quint16 number);
+    void appendUint32(quint32 number);
+    void append(const QByteArray &data);
+    void append(const char *data, int size);
+    int payloadSize() const;
+    const QByteArray &finish();
+
+private:
+    QByteArray &m_buffer;
+    int         m_start;    // header offset
+};
+
+#endif // PACKET_BUILDER_H
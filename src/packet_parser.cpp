@@ -0,0 +1,250 @@
+#include "packet_parser.h"
+#include "protocol.h"
+
+#include <cstring>
+
+PacketParser::PacketParser(int capacity) :
+    m_mask(0),
+    m_head(0),
+    m_size(0),
+    m_inputPos(0),
+    m_errorCount(0),
+    m_failed(false)
+{
+    int ringCapacity = 64;
+    while(ringCapacity < capacity)
+        ringCapacity <<= 1;
+
+    m_ring.resize(ringCapacity);
+    m_mask = ringCapacity - 1;
+}
+
+void PacketParser::append(const QByteArray &data)
+{
+    if(m_failed)
+        return;
+
+    if(m_size == 0 && m_inputPos >= m_input.size())
+    {
+        // nothing pending, parse the message in place
+        m_input = data;
+        m_inputPos = 0;
+        return;
+    }
+
+    // continues a fragment, keep the stream in order in the ring
+    if(m_inputPos < m_input.size())
+        write(m_input.constData() + m_inputPos, m_input.size() - m_inputPos);
+
+    m_input = QByteArray();
+    m_inputPos = 0;
+
+    write(data.constData(), data.size());
+}
+
+bool PacketParser::next(Packet &packet)
+{
+    int headerSize = 0;
+    quint32 payloadSize = 0;
+
+    // buffered fragments first, while there are any the ring holds the rest of the stream
+    while(m_size > 0)
+    {
+        char header[HEADER_SIZE];
+        peek(header, qMin(m_size, static_cast<int>(HEADER_SIZE)));
+
+        HeaderResult result = parseHeader(header, m_size, headerSize, payloadSize);
+
+        if(result == HeaderIncomplete)
+            return false;
+
+        if(result == HeaderInvalid)
+        {
+            fail();
+            return false;
+        }
+
+        int packetSize = headerSize + static_cast<int>(payloadSize);
+
+        if(m_size < packetSize)
+            return false;
+
+        const char *data = linear(packetSize);
+        packet.command = data;
+        packet.payload = data + headerSize;
+        packet.size    = static_cast<int>(payloadSize);
+
+        skip(packetSize);
+        return true;
+    }
+
+    // then straight out of the last message
+    while(m_inputPos < m_input.size())
+    {
+        const char *data = m_input.constData() + m_inputPos;
+        int available = m_input.size() - m_inputPos;
+
+        HeaderResult result = parseHeader(data, available, headerSize, payloadSize);
+
+        if(result == HeaderInvalid)
+        {
+            fail();
+            return false;
+        }
+
+        if(result == HeaderIncomplete || available < headerSize + static_cast<int>(payloadSize))
+        {
+            // keep the fragment until the rest of the packet arrives
+            write(data, available);
+            m_input = QByteArray();
+            m_inputPos = 0;
+            return false;
+        }
+
+        packet.command = data;
+        packet.payload = data + headerSize;
+        packet.size    = static_cast<int>(payloadSize);
+
+        m_inputPos += headerSize + static_cast<int>(payloadSize);
+        return true;
+    }
+
+    m_input = QByteArray();
+    m_inputPos = 0;
+    return false;
+}
+
+void PacketParser::clear()
+{
+    m_head = 0;
+    m_size = 0;
+    m_input = QByteArray();
+    m_inputPos = 0;
+    m_failed = false;
+}
+
+// no marker to find the next packet by, whatever follows is dropped
+void PacketParser::fail()
+{
+    ++m_errorCount;
+    m_failed = true;
+
+    m_head = 0;
+    m_size = 0;
+    m_input = QByteArray();
+    m_inputPos = 0;
+}
+
+bool PacketParser::isCommand(const char *command)
+{
+    for(int i=0;i<COMMAND_SIZE;++i)
+    {
+        char c = command[i];
+
+        if(!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+            return false;
+    }
+
+    return true;
+}
+
+bool PacketParser::isBareCommand(const char *command)
+{
+    switch(fourCCFromData(command))
+    {
+        case KEY_GET_IMAGE:
+        case KEY_REFRESH_DISPLAY:
+        case KEY_CHANGE_DISPLAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+PacketParser::HeaderResult PacketParser::parseHeader(const char *header, int available, int &headerSize, quint32 &payloadSize) const
+{
+    if(available < COMMAND_SIZE)
+        return HeaderIncomplete;
+
+    if(!isCommand(header))
+        return HeaderInvalid;
+
+    if(isBareCommand(header))
+    {
+        if(available < HEADER_SIZE || uint32FromData(header + COMMAND_SIZE) != 0)
+        {
+            headerSize = COMMAND_SIZE;
+            payloadSize = 0;
+            return HeaderComplete;
+        }
+    }
+
+    if(available < HEADER_SIZE)
+        return HeaderIncomplete;
+
+    payloadSize = uint32FromData(header + COMMAND_SIZE);
+
+    if(payloadSize > MAX_PAYLOAD_SIZE)
+        return HeaderInvalid;
+
+    headerSize = HEADER_SIZE;
+    return HeaderComplete;
+}
+
+void PacketParser::write(const char *data, int size)
+{
+    if(size <= 0)
+        return;
+
+    if(m_size + size > m_mask + 1)
+    {
+        int capacity = m_mask + 1;
+        while(capacity < m_size + size)
+            capacity <<= 1;
+
+        QByteArray ring(capacity, Qt::Uninitialized);
+        peek(ring.data(), m_size);
+
+        m_ring = ring;
+        m_mask = capacity - 1;
+        m_head = 0;
+    }
+
+    int tail = (m_head + m_size) & m_mask;
+    int first = qMin(size, m_mask + 1 - tail);
+
+    memcpy(m_ring.data() + tail, data, static_cast<size_t>(first));
+    memcpy(m_ring.data(), data + first, static_cast<size_t>(size - first));
+
+    m_size += size;
+}
+
+void PacketParser::peek(char *out, int size) const
+{
+    int first = qMin(size, m_mask + 1 - m_head);
+
+    memcpy(out, m_ring.constData() + m_head, static_cast<size_t>(first));
+    memcpy(out + first, m_ring.constData(), static_cast<size_t>(size - first));
+}
+
+// contiguous view of the next size bytes, only a packet wrapping the ring end is copied
+const char *PacketParser::linear(int size)
+{
+    if(m_head + size <= m_mask + 1)
+        return m_ring.constData() + m_head;
+
+    if(m_scratch.size() < size)
+        m_scratch.resize(size);
+
+    peek(m_scratch.data(), size);
+    return m_scratch.constData();
+}
+
+void PacketParser::skip(int size)
+{
+    m_head = (m_head + size) & m_mask;
+    m_size -= size;
+
+    if(m_size == 0)
+        m_head = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef PACKET_PARSER_H
+#define PACKET_PARSER_H
+
+#include <QByteArray>
+
+/* Streaming parser for viewer packets: command + payload size (UINT32 LE) + payload.
+ *
+ * Whole packets are handed out as spans straight into the received message.
+ * Only a trailing fragment is copied, into a ring buffer, where it waits for
+ * the rest of its packet. Spans stay valid until the next append() or next().
+ *
+ * GIMG, REFH and CHDP may arrive bare, without a size field. Since bare commands
+ * are always sent as a message of their own, a bare-capable command at the end
+ * of the buffered data, or one not followed by a zero size, is taken as bare.
+ *
+ * Viewer packets carry no marker to resync on, after an invalid header the
+ * stream is out of step for good: the parser drops what it holds and fails
+ * until clear(), the connection is to be closed. */
+class PacketParser
+{
+public:
+    static const int COMMAND_SIZE = 4;
+    static const int HEADER_SIZE = 8;
+    static const quint32 MAX_PAYLOAD_SIZE = 256000;
+
+    struct Packet
+    {
+        const char *command;    // COMMAND_SIZE bytes
+        const char *payload;
+        int         size;
+    };
+
+    explicit PacketParser(int capacity = 4096);
+
+    void append(const QByteArray &data);
+    bool next(Packet &packet);
+    void clear();
+
+    bool hasFailed() const {return m_failed;}
+    int bufferedSize() const {return m_size + (m_input.size() - m_inputPos);}
+    quint32 errorCount() const {return m_errorCount;}
+
+    static bool isCommand(const char *command);
+    static bool isBareCommand(const char *command);
+
+private:
+    enum HeaderResult
+    {
+        HeaderIncomplete,
+        HeaderComplete,
+        HeaderInvalid
+    };
+
+    HeaderResult parseHeader(const char *header, int available, int &headerSize, quint32 &payloadSize) const;
+
+    void write(const char *data, int size);
+    void peek(char *out, int size) const;
+    const char *linear(int size);
+    void skip(int size);
+    void fail();
+
+    QByteArray m_ring;
+    int        m_mask;      // ring capacity - 1, capacity is a power of two
+    int        m_head;      // first buffered byte
+    int        m_size;      // buffered bytes
+
+    QByteArray m_input;     // last received message, parsed in place
+    int        m_inputPos;
+
+    QByteArray m_scratch;   // a packet that wraps around the ring end
+    quint32    m_errorCount;
+    bool       m_failed;
+};
+
+#endif // PACKET_PARSER_H
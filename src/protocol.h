@@ -0,0 +1,447 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QString>
+
+// Packets sent to the viewer: KEY_PKT_HEADR + command + payload size (UINT32 LE) + payload
+// Packets from the viewer:    command + payload size (UINT32 LE) + payload
+//
+// Commands are four ASCII bytes. They are handled as the UINT32 those bytes
+// make in little endian order, so a command compares and switches as an integer.
+
+Q_DECL_CONSTEXPR inline quint32 fourCC(const char (&code)[5])
+{
+    return static_cast<quint32>(static_cast<quint8>(code[0])) |
+           static_cast<quint32>(static_cast<quint8>(code[1])) << 8 |
+           static_cast<quint32>(static_cast<quint8>(code[2])) << 16 |
+           static_cast<quint32>(static_cast<quint8>(code[3])) << 24;
+}
+
+inline quint32 uint32FromData(const char *data) // UINT32 LE
+{
+    return static_cast<quint32>(static_cast<quint8>(data[0])) |
+           static_cast<quint32>(static_cast<quint8>(data[1])) << 8 |
+           static_cast<quint32>(static_cast<quint8>(data[2])) << 16 |
+           static_cast<quint32>(static_cast<quint8>(data[3])) << 24;
+}
+
+inline quint32 fourCCFromData(const char *data)
+{
+    return uint32FromData(data);
+}
+
+inline void appendFourCC(QByteArray &buf, quint32 code)
+{
+    buf.append(static_cast<char>(code));
+    buf.append(static_cast<char>(code >> 8));
+    buf.append(static_cast<char>(code >> 16));
+    buf.append(static_cast<char>(code >> 24));
+}
+
+// Packet & Proxy Control
+Q_CONSTEXPR quint32 KEY_PKT_HEADR           = fourCC("1111"); // 8bit ASCI CODE 219 - https://theasciicode.com.ar/extended-ascii-code/block-graphic-character-ascii-code-219.html
+const int PREAMBLE_SIZE = 4; // KEY_PKT_HEADR in front of host packets
+Q_CONSTEXPR quint32 KEY_REGISTER            = fourCC("REGO");
+Q_CONSTEXPR quint32 KEY_PROXY_CONNECT       = fourCC("CONN"); // viewer asks for a desktop id, answered with the id if it is there
+
+// Actual Desktop Sharing
+Q_CONSTEXPR quint32 KEY_SET_NAME            = fourCC("STNM"); // i.e. 'DESKTOP-XYZ'
+Q_CONSTEXPR quint32 KEY_GET_IMAGE           = fourCC("GIMG");
+Q_CONSTEXPR quint32 KEY_IMAGE_PARAM         = fourCC("IMGP");
+Q_CONSTEXPR quint32 KEY_IMAGE_TILE          = fourCC("IMGT");
+Q_CONSTEXPR quint32 KEY_IMAGE_SCREEN        = fourCC("IMGS");
+Q_CONSTEXPR quint32 KEY_IMAGE_BATCH         = fourCC("IMGB"); // all tiles of a frame, see below
+Q_CONSTEXPR quint32 KEY_SET_KEY_STATE       = fourCC("SKST");
+Q_CONSTEXPR quint32 KEY_SET_CURSOR_POS      = fourCC("SCUP");
+Q_CONSTEXPR quint32 KEY_SET_CURSOR_DELTA    = fourCC("SCUD");
+Q_CONSTEXPR quint32 KEY_SET_MOUSE_KEY       = fourCC("SMKS");
+Q_CONSTEXPR quint32 KEY_SET_MOUSE_WHEEL     = fourCC("SMWH");
+Q_CONSTEXPR quint32 KEY_CHANGE_DISPLAY      = fourCC("CHDP");
+Q_CONSTEXPR quint32 KEY_REFRESH_DISPLAY     = fourCC("REFH");
+Q_CONSTEXPR quint32 KEY_TILE_RECEIVED       = fourCC("TLRD");
+Q_CONSTEXPR quint32 KEY_FRAME_RECEIVED      = fourCC("FACK"); // cumulative, every tile up to that frame
+Q_CONSTEXPR quint32 KEY_CAPABILITIES        = fourCC("CAPS");
+Q_CONSTEXPR quint32 KEY_FRAGMENT            = fourCC("FRAG"); // part of a large image packet, see below
+Q_CONSTEXPR quint32 KEY_RESUME_TOKEN        = fourCC("RTOK"); // token to resume this session with
+Q_CONSTEXPR quint32 KEY_RESUME              = fourCC("RSUM"); // viewer: token, host: UINT32 1 resumed, 0 start over with GIMG
+Q_CONSTEXPR quint32 KEY_TILE_HASHES         = fourCC("TLHS"); // what the viewer's tiles hold, see below
+Q_CONSTEXPR quint32 KEY_STREAM_PARAMS       = fourCC("STRP"); // stream parameters the viewer asks for, see below
+Q_CONSTEXPR quint32 KEY_INPUT_BATCH         = fourCC("INPB"); // timestamped input events, see below
+Q_CONSTEXPR quint32 KEY_INPUT_ECHO          = fourCC("INPE"); // the frame an input event showed up in, see below
+Q_CONSTEXPR quint32 KEY_INPUT_LATENCY       = fourCC("INPL"); // viewer: how long until it drew that frame
+Q_CONSTEXPR quint32 KEY_HOST_STATS          = fourCC("STAT"); // the host's metrics now and then, see below
+
+// Authentication etc.
+Q_CONSTEXPR quint32 KEY_CONNECT_UUID                = fourCC("CTUU");
+Q_CONSTEXPR quint32 KEY_SET_NONCE                   = fourCC("STNC");
+Q_CONSTEXPR quint32 KEY_SET_AUTH_REQUEST            = fourCC("SARQ");
+Q_CONSTEXPR quint32 KEY_SET_AUTH_RESPONSE           = fourCC("SARP");
+
+Q_CONSTEXPR quint32 KEY_CONNECTED_PROXY_CLIENT      = fourCC("CNPC");
+Q_CONSTEXPR quint32 KEY_DISCONNECTED_PROXY_CLIENT   = fourCC("DNPC");
+
+/* What a viewer proves the password with, in base64. KEY_SET_AUTH_REQUEST carries
+ * it decoded, over the KEY_SET_NONCE payload and the desktop's id and password. */
+inline QByteArray authHashSum(const QByteArray &nonce, const QString &login, const QString &pass)
+{
+    QString sum = login + pass;
+    QByteArray concatFirst = QCryptographicHash::hash(sum.toUtf8(),QCryptographicHash::Md5).toBase64();
+    concatFirst.append(nonce.toBase64());
+    return QCryptographicHash::hash(concatFirst,QCryptographicHash::Md5).toBase64();
+}
+
+const int CLIENT_VERSION    = 2;
+
+/* Capabilities: after authentication the viewer sends KEY_CAPABILITIES with the
+ * flags it understands, the host answers with the subset it will use. A viewer
+ * that never asks gets the original packets.
+ *
+ * Payload: flags (UINT32), then from protocol version 1 on the version (UINT16)
+ * and the CODEC_* the viewer decodes (UINT16). The host answers a versioned
+ * request with the version both speak and the codecs it may send, a request
+ * of flags only with flags only. */
+const quint16 PROTOCOL_VERSION  = 1;
+
+const quint32 CAP_IMAGE_BATCH   = 0x00000001;
+const quint32 CAP_FRAGMENT      = 0x00000002;
+const quint32 CAP_FRAME_ACK     = 0x00000004; // viewer acks batched frames with KEY_FRAME_RECEIVED instead of a TLRD per tile
+const quint32 CAP_RESUME        = 0x00000008; // host hands out a KEY_RESUME_TOKEN with every new session
+const quint32 CAP_TILE_HASH     = 0x00000010; // viewer reports KEY_TILE_HASHES now and then
+const quint32 CAP_STREAM_PARAMS = 0x00000020; // viewer may send KEY_STREAM_PARAMS at any time, version 1
+const quint32 CAP_INPUT_BATCH   = 0x00000040; // viewer sends its input as KEY_INPUT_BATCH
+const quint32 CAP_INPUT_ECHO    = 0x00000080; // viewer answers KEY_INPUT_ECHO, needs CAP_INPUT_BATCH and CAP_IMAGE_BATCH
+const quint32 CAP_HOST_STATS    = 0x00000100; // viewer gets KEY_HOST_STATS every STATS_INTERVAL_MS
+const quint32 HOST_CAPABILITIES = CAP_IMAGE_BATCH | CAP_FRAGMENT | CAP_FRAME_ACK | CAP_RESUME | CAP_TILE_HASH | CAP_STREAM_PARAMS |
+                                  CAP_INPUT_BATCH | CAP_INPUT_ECHO | CAP_HOST_STATS;
+
+const quint16 CODEC_WEBP        = 0x0001;
+const quint16 CODEC_JPEG        = 0x0002;
+const quint16 HOST_CODECS       = CODEC_WEBP | CODEC_JPEG; // what an unversioned viewer is assumed to take
+
+/* KEY_STREAM_PARAMS payload: frame interval in ms (UINT16) + tile size in px (UINT16)
+ * + CODEC_* (UINT16) + quality 1-100 (UINT16), a 0 leaves the field as it is. The
+ * host answers with the values in effect for the viewer, again whenever they change,
+ * a tile size of 0 before the first IMGP.
+ *
+ * Frame interval and tile size belong to the capture and are shared: it runs at
+ * the shortest of its own interval and those viewers asked for, a viewer asking
+ * for a longer one gets its frames at that pace. The tile size asked for last applies, every viewer
+ * then gets a full image on the new grid. Codecs and quality only limit the stream
+ * profiles the viewer's quality ladder may use, quality caps the image quality. */
+const int     STREAM_INTERVAL_MIN   = 33;
+const int     STREAM_INTERVAL_MAX   = 5000;
+const int     STREAM_RECT_SIZE_MIN  = 32;
+const int     STREAM_RECT_SIZE_MAX  = 512;
+
+/* KEY_INPUT_BATCH payload: time of the first event on the viewer's clock in ms (UINT32)
+ * + event count (UINT16) + flags (UINT16, 0), then count events of INPUT_EVENT_SIZE:
+ * ms after the first event (UINT16) + INPUT_* type (UINT16) + two values (UINT16/INT16)
+ *  - INPUT_KEY, INPUT_MOUSE_KEY: key code or button, pressed
+ *  - INPUT_WHEEL: delta x, delta y, WHEEL_NOTCH per notch, positive is right and down
+ *  - INPUT_MOVE: position, INPUT_MOVE_BY: delta, as KEY_SET_CURSOR_POS and _DELTA
+ * The host replays the events with the spacing they were made with, a viewer
+ * sends a batch every INPUT_BATCH_INTERVAL_MS while there is input.
+ *
+ * With CAP_INPUT_ECHO the host now and then answers an event with KEY_INPUT_ECHO:
+ * the event's time as the batch gave it (UINT32) + the sequence of the first
+ * frame captured after it was injected (UINT32). Once the viewer has drawn all
+ * tiles of that frame it sends KEY_INPUT_LATENCY, the event's time (UINT32) +
+ * ms from the event until then (UINT32). */
+const quint16 INPUT_KEY             = 1;
+const quint16 INPUT_MOUSE_KEY       = 2;
+const quint16 INPUT_WHEEL           = 3;
+const quint16 INPUT_MOVE            = 4;
+const quint16 INPUT_MOVE_BY         = 5;
+const int     INPUT_BATCH_HEADER_SIZE   = 8;
+const int     INPUT_EVENT_SIZE          = 8;
+const int     INPUT_BATCH_MAX_EVENTS    = 256;
+const int     INPUT_BATCH_INTERVAL_MS   = 16;
+const int     WHEEL_NOTCH               = 120;
+
+/* KEY_HOST_STATS payload: field count (UINT16) + flags (UINT16, 0), then count
+ * values (UINT32) in the order of the STAT_* indices, a viewer reads those it
+ * knows. Most are totals since the host started, wrapping, the viewer takes
+ * the difference to the last packet; queue and rtt are as they are now. */
+const int     STATS_HEADER_SIZE     = 4;
+const int     STATS_INTERVAL_MS     = 2000;
+
+enum HostStat
+{
+    STAT_FRAMES,            // captured
+    STAT_FULL_FRAMES,       // of them sent as one full screen image
+    STAT_TILES,             // compared with the last frame
+    STAT_DIRTY_TILES,       // of them changed
+    STAT_CAPTURE_US,        // grabbing and converting the frames
+    STAT_DIFF_US,           // comparing them
+    STAT_ENCODE_US,         // encoding their images
+    STAT_ENCODED_IMAGES,
+    STAT_SENT_BYTES,        // to this viewer
+    STAT_QUEUED_BYTES,      // waiting for this viewer's link
+    STAT_RTT_MS,            // this viewer's smoothed ack delay
+    STAT_RECONNECTS,        // of the host to the proxy
+    STAT_COUNT
+};
+
+/* Resumable sessions: when the link drops the host keeps the viewer's frame and
+ * ack state. Within the grace period the viewer may authenticate again and send
+ * KEY_RESUME with its token instead of KEY_GET_IMAGE, it then only receives the
+ * tiles that changed or were not acknowledged. */
+const int     RESUME_TOKEN_SIZE     = 16;
+const qint64  RESUME_GRACE_MS       = 60 * 1000;
+
+/* KEY_IMAGE_BATCH payload: frame sequence (UINT32) + tile count (UINT16) + flags (UINT16),
+ * then count tile packets as the viewer would get them, command + size + payload
+ * without KEY_PKT_HEADR. A frame larger than the batch size goes out in several
+ * parts with the same sequence, the last one flagged BATCH_FLAG_FINAL. */
+const quint16 BATCH_FLAG_FINAL      = 0x0001;
+const int     BATCH_HEADER_SIZE     = 8;
+const int     BATCH_SIZE_DEFAULT    = 64 * 1024;
+const int     BATCH_SIZE_MIN        = 4 * 1024;
+const int     BATCH_SIZE_MAX        = 120 * 1000; // the proxy drops host messages over 128000 bytes
+const int     TILE_SIZE_MAX         = BATCH_SIZE_MAX; // a tile packet as counted in a batch, the host encodes larger ones again at a lower quality
+
+/* KEY_FRAGMENT payload: total size (UINT32) + offset (UINT32) + data. Image packets
+ * larger than the fragment size are cut into consecutive fragments, so packets of
+ * a higher priority can go out in between. The fragments of one packet arrive in
+ * order and joined give command + size + payload, without KEY_PKT_HEADR. */
+const int     FRAGMENT_HEADER_SIZE  = 8;
+const int     FRAGMENT_SIZE_DEFAULT = 16 * 1024;
+
+/* KEY_TILE_HASHES payload: first tile (UINT16) + count (UINT16) + count hashes (UINT32).
+ * A tile's hash is tileHash() over the encoded image it was last drawn from, every
+ * tile of a full screen image gets the hash of the screen image. The host resends
+ * tiles whose hash differs from what it sent in two reports in a row, so a tile
+ * still in flight during one report is not resent. */
+const int     TILE_HASH_INTERVAL_MS = 3000; // how often the viewer reports
+
+inline quint32 tileHash(const char *data, int size) // FNV-1a
+{
+    quint32 hash = 2166136261u;
+
+    for(int i=0;i<size;++i)
+    {
+        hash ^= static_cast<quint8>(data[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+/* Bounds checked little endian reads over a payload span. A read past the
+ * end fails and leaves the value untouched. */
+class PayloadReader
+{
+public:
+    PayloadReader(const char *data, int size) : m_data(data), m_size(size), m_pos(0){}
+
+    int remaining() const {return m_size - m_pos;}
+
+    bool readUint16(quint16 &value)
+    {
+        if(remaining() < 2)
+            return false;
+
+        value = static_cast<quint16>(static_cast<quint8>(m_data[m_pos]) |
+                                     static_cast<quint8>(m_data[m_pos+1]) << 8);
+        m_pos += 2;
+        return true;
+    }
+
+    bool readInt16(qint16 &value)
+    {
+        quint16 number = 0;
+
+        if(!readUint16(number))
+            return false;
+
+        value = static_cast<qint16>(number);
+        return true;
+    }
+
+    bool readUint32(quint32 &value)
+    {
+        if(remaining() < 4)
+            return false;
+
+        value = uint32FromData(m_data + m_pos);
+        m_pos += 4;
+        return true;
+    }
+
+    bool readSpan(int size, const char *&span) // points into the payload, nothing is copied
+    {
+        if(size < 0 || remaining() < size)
+            return false;
+
+        span = m_data + m_pos;
+        m_pos += size;
+        return true;
+    }
+
+private:
+    const char *m_data;
+    int         m_size;
+    int         m_pos;
+};
+
+// Typed viewer payloads
+
+struct CursorPosPayload         // KEY_SET_CURSOR_POS
+{
+    quint16 posX;
+    quint16 posY;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint16(posX) && reader.readUint16(posY);
+    }
+};
+
+struct CursorDeltaPayload       // KEY_SET_CURSOR_DELTA
+{
+    qint16 deltaX;
+    qint16 deltaY;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readInt16(deltaX) && reader.readInt16(deltaY);
+    }
+};
+
+struct KeyStatePayload          // KEY_SET_KEY_STATE, KEY_SET_MOUSE_KEY, KEY_SET_MOUSE_WHEEL
+{
+    quint16 keyCode;
+    quint16 keyState;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint16(keyCode) && reader.readUint16(keyState);
+    }
+};
+
+struct CapabilitiesPayload      // KEY_CAPABILITIES
+{
+    quint32 flags;
+    quint16 version;    // 0 for a viewer that sends flags only
+    quint16 codecs;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+
+        if(!reader.readUint32(flags))
+            return false;
+
+        if(!reader.readUint16(version) || !reader.readUint16(codecs))
+        {
+            version = 0;
+            codecs = HOST_CODECS;
+        }
+
+        return true;
+    }
+};
+
+struct StreamParamsPayload      // KEY_STREAM_PARAMS
+{
+    quint16 intervalMs;
+    quint16 rectSize;
+    quint16 codecs;
+    quint16 quality;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint16(intervalMs) && reader.readUint16(rectSize) &&
+               reader.readUint16(codecs) && reader.readUint16(quality);
+    }
+};
+
+struct InputBatchPayload        // KEY_INPUT_BATCH
+{
+    quint32     baseMs;
+    quint16     count;
+    quint16     flags;
+    const char *events; // count events of INPUT_EVENT_SIZE, read with InputBatchEvent
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint32(baseMs) && reader.readUint16(count) && reader.readUint16(flags) &&
+               count <= INPUT_BATCH_MAX_EVENTS && reader.readSpan(count * INPUT_EVENT_SIZE, events);
+    }
+};
+
+struct InputBatchEvent          // one event of a KEY_INPUT_BATCH
+{
+    quint16 offsetMs;
+    quint16 type;
+    quint16 value1;
+    quint16 value2; // signed for INPUT_WHEEL and INPUT_MOVE_BY
+
+    // event index of a decoded batch, always in bounds
+    void decode(const InputBatchPayload &batch, int index)
+    {
+        PayloadReader reader(batch.events + index * INPUT_EVENT_SIZE, INPUT_EVENT_SIZE);
+        reader.readUint16(offsetMs);
+        reader.readUint16(type);
+        reader.readUint16(value1);
+        reader.readUint16(value2);
+    }
+};
+
+struct InputLatencyPayload      // KEY_INPUT_LATENCY
+{
+    quint32 eventMs;
+    quint32 latencyMs;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint32(eventMs) && reader.readUint32(latencyMs);
+    }
+};
+
+struct FrameReceivedPayload     // KEY_FRAME_RECEIVED
+{
+    quint32 frameSeq;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint32(frameSeq);
+    }
+};
+
+struct TileReceivedPayload      // KEY_TILE_RECEIVED
+{
+    quint16 tileNum;
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint16(tileNum);
+    }
+};
+
+struct TileHashesPayload        // KEY_TILE_HASHES
+{
+    quint16     firstTile;
+    quint16     count;
+    const char *hashes; // count UINT32 LE
+
+    bool decode(const char *data, int size)
+    {
+        PayloadReader reader(data, size);
+        return reader.readUint16(firstTile) && reader.readUint16(count) &&
+               reader.readSpan(count * 4, hashes);
+    }
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,127 @@
+#include "quality_ladder.h"
+
+QualityLadder::QualityLadder(int topRung, int startRung) :
+    m_topRung(topRung),
+    m_bottomRung(STREAM_PROFILE_COUNT - 1),
+    m_rung(qBound(topRung, startRung, m_bottomRung)),
+    m_demand(0),
+    m_windowBytes(0),
+    m_windowStartMs(-1),
+    m_downSinceMs(-1),
+    m_upSinceMs(-1),
+    m_upHoldMs(UP_HOLD_MS),
+    m_lastUpMs(-1),
+    m_switchCount(0)
+{
+
+}
+
+void QualityLadder::setRung(int rung)
+{
+    m_rung = qBound(m_topRung, rung, m_bottomRung);
+    m_downSinceMs = -1;
+    m_upSinceMs = -1;
+}
+
+void QualityLadder::setRange(int topRung, int bottomRung)
+{
+    m_topRung = topRung;
+    m_bottomRung = qMax(topRung, bottomRung);
+    setRung(m_rung);
+}
+
+qint64 QualityLadder::projectedDemand(int rung) const
+{
+    return m_demand * STREAM_PROFILES[rung].relativeCost / STREAM_PROFILES[m_rung].relativeCost;
+}
+
+bool QualityLadder::update(const BandwidthEstimator &estimator, qint64 frameBytes, bool congested, qint64 nowMs)
+{
+    // demand, averaged over windows so a lone large frame doesn't count as a rate
+    if(m_windowStartMs < 0)
+        m_windowStartMs = nowMs;
+
+    m_windowBytes += frameBytes;
+
+    qint64 windowMs = nowMs - m_windowStartMs;
+
+    if(windowMs >= DEMAND_WINDOW_MS)
+    {
+        m_demand += (m_windowBytes * 1000 / windowMs - m_demand) / 4;
+        m_windowBytes = 0;
+        m_windowStartMs = nowMs;
+    }
+
+    const qint64 capacity = estimator.isSaturated() ? estimator.estimate() : 0;
+
+    if(m_lastUpMs >= 0 && nowMs - m_lastUpMs >= FAILED_UP_MS)
+    {
+        m_upHoldMs = UP_HOLD_MS; // the last step up held
+        m_lastUpMs = -1;
+    }
+
+    // down
+    bool overloaded = congested || (capacity > 0 && m_demand * 100 > capacity * DOWN_UTILISATION);
+
+    if(!overloaded)
+        m_downSinceMs = -1;
+    else if(m_downSinceMs < 0)
+        m_downSinceMs = nowMs;
+
+    if(m_downSinceMs >= 0 && nowMs - m_downSinceMs >= DOWN_HOLD_MS && m_rung < m_bottomRung)
+    {
+        int rung = m_rung + 1;
+
+        while(capacity > 0 && rung < m_bottomRung && projectedDemand(rung) * 100 > capacity * DOWN_TARGET)
+            ++rung;
+
+        if(m_lastUpMs >= 0)
+            m_upHoldMs = qMin(m_upHoldMs * 2, qint64(UP_HOLD_MAX_MS)); // it went up too early
+
+        m_lastUpMs = -1;
+        return switchTo(rung, nowMs);
+    }
+
+    // up
+    bool fits = false;
+    bool room = false;
+
+    if(!congested && m_rung > m_topRung && m_demand >= ACTIVE_BYTES_PER_S)
+    {
+        fits = capacity > 0 && projectedDemand(m_rung - 1) * 100 <= capacity * UP_UTILISATION;
+        room = fits || !estimator.isRttInflated();
+    }
+
+    if(!room)
+        m_upSinceMs = -1;
+    else if(m_upSinceMs < 0)
+        m_upSinceMs = nowMs;
+
+    // probing past a measured limit takes twice as long
+    qint64 holdMs = fits || capacity == 0 ? m_upHoldMs : 2 * m_upHoldMs;
+
+    if(m_upSinceMs >= 0 && nowMs - m_upSinceMs >= holdMs)
+    {
+        m_lastUpMs = nowMs;
+        return switchTo(m_rung - 1, nowMs);
+    }
+
+    return false;
+}
+
+bool QualityLadder::switchTo(int rung, qint64 nowMs)
+{
+    if(rung == m_rung)
+        return false;
+
+    // qDebug()<<"QualityLadder::switchTo"<<STREAM_PROFILES[m_rung].name<<"->"<<STREAM_PROFILES[rung].name<<"demand"<<m_demand;
+
+    m_demand = projectedDemand(rung); // until the new rung's frames are measured
+    m_rung = rung;
+    m_windowBytes = 0;
+    m_windowStartMs = nowMs;
+    m_downSinceMs = -1;
+    m_upSinceMs = -1;
+    ++m_switchCount;
+    return true;
+}
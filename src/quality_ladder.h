@@ -0,0 +1,72 @@
+#ifndef QUALITY_LADDER_H
+#define QUALITY_LADDER_H
+
+#include <QtGlobal>
+
+#include "bandwidth_estimator.h"
+#include "stream_profile.h"
+
+/* Picks the stream profile of one viewer from what its stream needs and what
+ * the BandwidthEstimator says the link carries. The rungs are the profiles
+ * from topRung down to bottomRung, the last one unless the viewer's codecs
+ * rule out some.
+ *
+ * Down: the link is congested, or the stream needs over DOWN_UTILISATION
+ * percent of a measured link, for DOWN_HOLD_MS. It goes straight to the best
+ * rung whose projected need fits DOWN_TARGET percent, one rung at least.
+ *
+ * Up: one rung at a time after the next rung up fitted UP_UTILISATION percent
+ * of the link for the up hold. A link measured on a lower rung may have grown
+ * since, so while acks come back as fast as they used to it is probed after
+ * twice the hold. A step up that fails within FAILED_UP_MS doubles the up
+ * hold, up to UP_HOLD_MAX_MS, so a link that can't take the better rung isn't
+ * probed every few seconds. An idle stream says nothing about the link and
+ * never steps up. */
+class QualityLadder
+{
+public:
+    static const qint64 DOWN_HOLD_MS        = 1000;
+    static const qint64 UP_HOLD_MS          = 8000;
+    static const qint64 UP_HOLD_MAX_MS      = 64000;
+    static const qint64 FAILED_UP_MS        = 10000;
+    static const int    DOWN_UTILISATION    = 90;   // percent of the estimate
+    static const int    DOWN_TARGET         = 75;
+    static const int    UP_UTILISATION      = 60;
+    static const qint64 ACTIVE_BYTES_PER_S  = 16 * 1024;
+    static const qint64 DEMAND_WINDOW_MS    = 250;
+
+    explicit QualityLadder(int topRung = STREAM_PROFILE_HIGH, int startRung = STREAM_PROFILE_NORMAL);
+
+    int rung() const {return m_rung;}
+    void setRung(int rung);
+    int topRung() const {return m_topRung;}
+    int bottomRung() const {return m_bottomRung;}
+    void setRange(int topRung, int bottomRung); // the rung moves into it
+
+    // a frame of frameBytes was queued, true if the rung changed
+    bool update(const BandwidthEstimator &estimator, qint64 frameBytes, bool congested, qint64 nowMs);
+
+    qint64 demand() const {return m_demand;} // bytes/s the stream needs on the current rung
+    qint64 projectedDemand(int rung) const;
+    qint64 upHoldMs() const {return m_upHoldMs;}
+    int switchCount() const {return m_switchCount;}
+
+private:
+    bool switchTo(int rung, qint64 nowMs);
+
+    int    m_topRung;
+    int    m_bottomRung;
+    int    m_rung;
+
+    qint64 m_demand;
+    qint64 m_windowBytes;
+    qint64 m_windowStartMs; // -1 before the first frame
+
+    qint64 m_downSinceMs;   // -1 unless the link is overloaded
+    qint64 m_upSinceMs;     // -1 unless the next rung up fits
+    qint64 m_upHoldMs;
+    qint64 m_lastUpMs;      // -1 once the last step up survived FAILED_UP_MS
+    int    m_switchCount;
+};
+
+#endif // QUALITY_LADDER_H
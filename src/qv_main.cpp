@@ -1,14 +1,112 @@
 #include "qv_mainwindow.h"
+#include "host_service.h"
+#include "host_settings.h"
 
 #include <QApplication>
+#include <QGuiApplication>
+#include <QTextStream>
+
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int signalFds[2] = {-1, -1};
+
+static void quitSignalHandler(int)
+{
+    char signal = 1;
+    ssize_t written = ::write(signalFds[0], &signal, sizeof(signal)); // all that's safe in a handler
+    Q_UNUSED(written)
+}
+
+// SIGINT and SIGTERM quit the event loop, the service closes its viewers' sockets on the way out
+static void quitOnSignals(QCoreApplication *app)
+{
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFds) != 0)
+        return;
+
+    QSocketNotifier *notifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, app);
+    QObject::connect(notifier, &QSocketNotifier::activated, app, &QCoreApplication::quit);
+
+    std::signal(SIGINT, quitSignalHandler);
+    std::signal(SIGTERM, quitSignalHandler);
+}
+#endif
+
+/* Without the window and the tray, for servers and virtual desktops: only a
+ * display to capture is needed, an X server or Xvfb. What would be in the
+ * window goes to stdout. */
+static int runHeadless(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    HostSettings settings;
+
+    if(!settings.load(app.arguments().mid(1)))
+    {
+        if(!settings.errorString().isEmpty())
+            out << settings.errorString() << "\n";
+
+        out << HostSettings::usage();
+        return settings.errorString().isEmpty() ? 0 : 2;
+    }
+
+    HostService service(settings);
+
+    QObject::connect(&service, &HostService::connectedToProxy, [&out, &settings](bool state) {
+        out << (state ? "connected to " : "not connected to ") << settings.proxyUrl << "\n";
+        out.flush();
+    });
+    QObject::connect(&service, &HostService::viewerConnected, [&out, &service]() {
+        out << "viewers: " << service.viewerCount() << "\n";
+        out.flush();
+    });
+    QObject::connect(&service, &HostService::viewerDisconnected, [&out, &service]() {
+        out << "viewers: " << service.viewerCount() << "\n";
+        out.flush();
+    });
+    QObject::connect(&service, &HostService::textMessage, [&out](const QString &message) {
+        out << message << "\n";
+        out.flush();
+    });
+    QObject::connect(&app, &QCoreApplication::aboutToQuit, &service, &HostService::stop);
+
+#ifdef Q_OS_UNIX
+    quitOnSignals(&app);
+#endif
+
+    out << "desktop id " << settings.login << ", password " << settings.password << "\n";
+    out.flush();
+
+    service.start();
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    if(HostSettings::isHeadless(argc, argv))
+        return runHeadless(argc, argv);
+
     QApplication a(argc, argv);
    // QApplication::setStyle("fusion");
-    QV_MainWindow core;
+
+    HostSettings settings;
+
+    if(!settings.load(a.arguments().mid(1)))
+    {
+        QTextStream err(stderr);
+
+        if(!settings.errorString().isEmpty())
+            err << settings.errorString() << "\n";
+
+        err << HostSettings::usage();
+        return settings.errorString().isEmpty() ? 0 : 2;
+    }
+
+    QV_MainWindow core(settings);
     core.show();
     return a.exec();
 }
-
-
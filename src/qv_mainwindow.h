@@ -8,9 +8,7 @@
 #include <QAction>
 #include <QMainWindow>
 
-#include "ws_handler.h"
-#include "screen_capture.h"
-#include "input_simulator.h"
+#include "host_service.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class QV_MainWindow; }
@@ -22,14 +20,13 @@ class QV_MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-  explicit QV_MainWindow(QWidget *parent = Q_NULLPTR);
+  explicit QV_MainWindow(const HostSettings &settings, QWidget *parent = Q_NULLPTR);
+  ~QV_MainWindow();
 
 private:
     Ui::QV_MainWindow *m_ui;
 
-    WebSocketHandler *m_proxySocketHandler;
-    ScreenCapture *m_graberClass;
-    InputSimulator *m_inputSimulator;
+    HostService *m_service; // everything but the window and the tray
     QMenu *m_trayMenu;
     QSystemTrayIcon *m_trayIcon;
 
@@ -37,8 +34,6 @@ private:
     QString m_device_access_id;
     QString m_device_access_pw;
 
-    QList<QByteArray> m_remoteClientsList;
-
 signals:
     void closeAppSignal();
 
@@ -47,16 +42,8 @@ public slots:
 private slots:
     void actionTriggered(QAction* action);
     void showInfoMessage();
-    void loadSettings();
-
-    void startOutboundProxyConnection(const QString &host, const QString &name, const QString &login, const QString &pass);
-    void createConnectionToHandler(WebSocketHandler *webSocketHandler);
-
-    void finishedWebSockeTransfer();
-    void finishedWebSockeHandler();
 
-    void remoteClientConnected(const QByteArray &uuid);
-    void remoteClientDisconnected(const QByteArray &uuid);
+    void remoteClientDisconnected();
 
     void showTextMessageDialog(QString message);
 
@@ -1,22 +1,44 @@
 #include "screen_capture.h"
+#include "input_queue.h"
+#include "packet_builder.h"
+#include "protocol.h"
+#include "trace.h"
 
 #include <QPixmap>
 #include <QScreen>
-#include <QApplication>
+#include <QGuiApplication>
 #include <QWindow>
-#include <QDesktopWidget>
 #include <QDebug>
 #include <QBuffer>
-#include <QTime>
+
+#include <cstring>
 
 ScreenCapture::ScreenCapture(QObject *parent) : QObject(parent),
     m_grabTimer(Q_NULLPTR),
     m_grabInterval(300),
+    m_captureInterval(300),
     m_rectSize(300),
-    m_screenNumber(0)
+    m_screenNumber(0),
+    m_frameSource(Q_NULLPTR),
+    m_frameIndex(0),
+    m_lastFrameValid(false),
+    m_columnCount(0),
+    m_rowCount(0),
+    m_gridRectSize(0),
+    m_tilePool(16 * 1024),
+    m_screenPool(256 * 1024),
+    m_encodeCache(qint64(ENCODE_CACHE_DEFAULT_MB) * 1024 * 1024),
+    m_debugStats(qEnvironmentVariableIsSet("QV_DEBUG_STATS")),
+    m_frameAllocations(0),
+    m_metrics(Metrics::unshared()),
+    m_frameEncodeNs(0),
+    m_frameSeq(0)
 {
-    m_AckLatencyMs.resize(10);
-    m_AckLatencyMs.fill(5000);
+    for(int i=0;i<STREAM_PROFILE_COUNT;++i)
+    {
+        m_imageWriters[i].setDevice(&m_encodeBuffer);
+        m_imageWriters[i].setFormat(STREAM_PROFILES[i].format);
+    }
 }
 
 void ScreenCapture::start()
@@ -36,7 +58,7 @@ void ScreenCapture::stop()
 
 void ScreenCapture::changeScreenNum()
 {
-    QList<QScreen *> screens = QApplication::screens();
+    QList<QScreen *> screens = QGuiApplication::screens();
 
     if(screens.size() > m_screenNumber+1)
         ++m_screenNumber;
@@ -45,6 +67,7 @@ void ScreenCapture::changeScreenNum()
     QScreen* screen = screens.at(m_screenNumber);
     emit screenPositionChanged(QPoint(screen->geometry().x(),screen->geometry().y()));
 
+    m_lastFrameValid = false;
     startSending();
 }
 
@@ -53,10 +76,30 @@ void ScreenCapture::startSending()
     // // qDebug()<<"GraberClass::startSending";
 
     if(m_grabTimer)
-        if(!m_grabTimer->isActive())
-            m_grabTimer->start(m_grabInterval);
+    {
+        // already capturing for another viewer, its handler catches up from the tile store
+        if(m_grabTimer->isActive())
+            return;
+
+        m_grabTimer->start(m_captureInterval);
+    }
+
+    m_lastFrameValid = false;
+    updateImage();
+}
+
+/* A resumed session: the last frame still matches the tile store, only tiles
+ * changed since go out. A lost frame ring or tile grid still means a full image. */
+void ScreenCapture::resumeSending()
+{
+    if(m_grabTimer)
+    {
+        if(m_grabTimer->isActive())
+            return;
+
+        m_grabTimer->start(m_captureInterval);
+    }
 
-    m_lastImage = QImage();
     updateImage();
 }
 
@@ -71,163 +114,448 @@ void ScreenCapture::stopSending()
     qDebug() << "Stopped sending.";
 }
 
-void ScreenCapture::updateScreen()
+void ScreenCapture::setInterval(int msec)
 {
-    QScreen *screen = QApplication::screens().at(m_screenNumber);
-    QImage currentImage = screen->grabWindow(0).toImage().convertToFormat(QImage::Format_RGB888);
-    sendImage(currentImage);
+    m_grabInterval = msec;
+    updateInterval();
 }
 
-void ScreenCapture::updateImage()
+void ScreenCapture::setViewerInterval(QObject *viewer, int msec)
 {
+    if(msec > 0)
+        m_viewerIntervals.insert(viewer, msec);
+    else m_viewerIntervals.remove(viewer);
 
-    QScreen *screen = QApplication::screens().at(m_screenNumber);
-    //QImage currentImage = screen->grabWindow(0).toImage().convertToFormat(QImage::Format_RGB444);
-    QImage currentImage = screen->grabWindow(0).toImage().convertToFormat(QImage::Format_RGB888);
+    updateInterval();
+}
 
-    int columnCount = currentImage.width() / m_rectSize;
-    int rowCount = currentImage.height() / m_rectSize;
+/* One capture for every viewer, at the pace of the fastest. Slower viewers
+ * skip frames in their handlers. */
+void ScreenCapture::updateInterval()
+{
+    int interval = m_grabInterval;
 
-    // Deal with fractionals
-    if(currentImage.width() % m_rectSize > 0)
-        ++columnCount;
+    for(QMap<QObject*, int>::const_iterator it=m_viewerIntervals.constBegin();it!=m_viewerIntervals.constEnd();++it)
+        interval = qMin(interval, it.value());
 
-    if(currentImage.height() % m_rectSize > 0)
-        ++rowCount;
+    if(interval == m_captureInterval)
+        return;
 
-    if(m_lastImage.isNull())
-    {
-        m_lastImage = QImage(currentImage.size(),currentImage.format());
-        m_lastImage.fill(QColor(Qt::blue));
+    m_captureInterval = interval;
 
-        emit imageParameters(currentImage.size(), m_rectSize);
+    if(m_grabTimer && m_grabTimer->isActive())
+        m_grabTimer->start(m_captureInterval);
+
+    emit intervalChanged(m_captureInterval);
+}
+
+void ScreenCapture::updateScreen()
+{
+    TraceSpan frameSpan("frame", "frame", m_frameSeq);
+
+    const qint64 captureMs = inputClockMs();
+
+    if(!grabFrame())
+        return;
+
+    if(!m_lastFrameValid)
+        emit imageParameters(m_screenSize, m_rectSize);
+
+    for(int profile=0;profile<STREAM_PROFILE_COUNT;++profile)
+    {
+        if(m_tileStore.isInUse(profile))
+            sendImage(profile, screenImage(m_frames[m_frameIndex ^ 1]));
+        else m_tileStore.invalidate(profile);
     }
 
+    // a frame of its own like any other, its acks and input echoes count for it
+    emit frameFinished(m_frameSeq++, captureMs);
 
-    quint16 tileNum = 0;
+    m_metrics->frames.add();
+    m_metrics->fullFrames.add();
 
-    /* Pre-check to see if > 50% of the tiles have changed, if so, just send a complete new image instead. */
-    quint16 numTiles        = columnCount*rowCount;
-    quint16 numDirtyTiles   = 0;
+    // the viewer now holds this frame
+    m_frameIndex ^= 1;
+    m_lastFrameValid = true;
+}
 
-    m_time        = QTime::currentTime();
-    quint64 dtime = m_time.msecsSinceStartOfDay();
+void ScreenCapture::updateImage()
+{
+    TraceSpan frameSpan("frame", "frame", m_frameSeq);
 
+    m_frameEncodeNs = 0;
+    m_frameTimer.start();
 
-    for(int i=0;i<columnCount;++i) {
-        for(int j=0;j<rowCount;++j) {
+    const qint64 captureMs = inputClockMs(); // on the clock the injected input is timed with
 
-            tileNum = (i*rowCount)+j;
-            QImage image        = currentImage.copy(i*m_rectSize, j*m_rectSize, m_rectSize, m_rectSize);
-            QImage lastImage     = m_lastImage.copy(i*m_rectSize, j*m_rectSize, m_rectSize, m_rectSize);
+    if(!grabFrame())
+        return;
 
-            // when was the last ackowlegement of a tile, more than a second ago?
-            bool missingAck = false;
+    const qint64 grabbedNs = m_frameTimer.nsecsElapsed();
+    const QImage &currentImage = m_frames[m_frameIndex ^ 1];
 
-            if ( m_tilePendingAck.contains(tileNum) ) {
-                missingAck = ( (dtime - m_tilePendingAck.value(tileNum) ) > 1000) ? true:false;
-            }
+    if(!m_lastFrameValid)
+        emit imageParameters(m_screenSize, m_rectSize);
 
-            if (missingAck) {
-                //qDebug() << "Tile was last acknowleged more than a second ago.";
-            }
+    quint16 tileNum = 0;
 
+    /* Pre-check to see if > 33% of the tiles have changed, if so, just send a complete new image instead. */
+    quint16 numTiles        = m_columnCount*m_rowCount;
 
-            if(lastImage != image) {
-                numDirtyTiles++;
-                sendImage(i,j,tileNum,image);
-                m_tilePendingAck.insert(tileNum, dtime );
-#ifdef Q_DEBUG
-                qDebug() << "Send tile " << tileNum << " at ms" << dtime;
-#endif
+    m_dirtyTiles.clear();
 
-            }
-            else if ( missingAck)
+    qint64 tileStartNs = m_frameTimer.nsecsElapsed();
+
+    for(int i=0;i<m_columnCount;++i) {
+        for(int j=0;j<m_rowCount;++j) {
+
+            tileNum = (i*m_rowCount)+j;
+
+            if(!m_lastFrameValid)
             {
-                sendImage(i,j,tileNum,image);
-                m_tilePendingAck.remove(tileNum); // need to do this here or we'll cause a race condition
+                m_dirtyTiles.append(tileNum);
+                continue;
             }
 
-            if (numDirtyTiles > numTiles/3)
             {
-                sendImage(currentImage);
-                break;
+                TraceSpan span("diff", "tile", tileNum);
+
+                if(isTileChanged(i,j))
+                    m_dirtyTiles.append(tileNum);
             }
+
+            const qint64 tileEndNs = m_frameTimer.nsecsElapsed();
+            m_metrics->diffTileNs.add(static_cast<quint64>(tileEndNs - tileStartNs));
+            tileStartNs = tileEndNs;
         }
     }
 
-    m_lastImage = currentImage;
+    const qint64 diffedNs = m_frameTimer.nsecsElapsed();
 
+    bool fullImage = !m_lastFrameValid || m_dirtyTiles.size() > numTiles/3;
 
-    /*
-    if ( m_lastImage != currentImage) {
-            m_lastImage = currentImage;
-            sendImage(currentImage);
-            return;
+    // once per profile in use, all viewers on a profile get the same packets
+    for(int profile=0;profile<STREAM_PROFILE_COUNT;++profile)
+    {
+        if(!m_tileStore.isInUse(profile))
+        {
+            if(!m_dirtyTiles.isEmpty())
+                m_tileStore.invalidate(profile); // not encoded, would go stale
+            continue;
+        }
+
+        bool refresh = m_tileStore.takeRefresh(profile); // a viewer just switched to it
+
+        if(fullImage || refresh)
+        {
+            sendImage(profile, screenImage(currentImage));
+            continue;
+        }
+
+        for(int k=0;k<m_dirtyTiles.size();++k)
+        {
+            tileNum = m_dirtyTiles.at(k);
+            int i = tileNum / m_rowCount;
+            int j = tileNum % m_rowCount;
+
+            sendImage(profile,i,j,tileNum,tileImage(currentImage,i,j));
+#ifdef Q_DEBUG
+            qDebug() << "Send tile " << tileNum << " profile " << profile;
+#endif
+        }
+    }
+
+    // every cycle, the viewer handlers resend what their viewer is missing
+    emit frameFinished(m_frameSeq++, captureMs);
+
+    m_metrics->captureUs.add(static_cast<quint64>(grabbedNs / 1000));
+    m_metrics->frameUs.add(static_cast<quint64>(m_frameTimer.nsecsElapsed() / 1000));
+    m_metrics->frames.add();
+    m_metrics->viewers.set(m_tileStore.viewerCount());
+
+    if(m_lastFrameValid)
+    {
+        m_metrics->diffUs.add(static_cast<quint64>((diffedNs - grabbedNs) / 1000));
+        m_metrics->tiles.add(numTiles);
+        m_metrics->dirtyTiles.add(static_cast<quint64>(m_dirtyTiles.size()));
+        m_metrics->dirtyPermille.set(numTiles > 0 ? m_dirtyTiles.size() * 1000 / numTiles : 0);
     }
-    */
 
+    if(fullImage)
+        m_metrics->fullFrames.add();
+
+    if(m_frameEncodeNs > 0)
+        m_metrics->encodeUs.add(static_cast<quint64>(m_frameEncodeNs / 1000));
+
+    // swap, the captured frame becomes the last frame and its buffer is reused next cycle
+    m_frameIndex ^= 1;
+    m_lastFrameValid = true;
+
+    if(m_debugStats && !m_dirtyTiles.isEmpty())
+    {
+        qDebug()<<"ScreenCapture::updateImage - dirty tiles:"<<m_dirtyTiles.size()<<"of"<<numTiles
+                <<"full image:"<<fullImage
+                <<"viewers:"<<m_tileStore.viewerCount()
+                <<"buffer allocations:"<<takeAllocationCount()
+                <<"pooled buffers:"<<m_tilePool.count()<<m_screenPool.count()
+                <<"encode cache:"<<m_encodeCache.summary();
+    }
 }
 
-void ScreenCapture::setReceivedTileNum(quint16 tileNum)
+quint32 ScreenCapture::takeAllocationCount()
 {
-#ifdef QT_DEBUG
-    qDebug() << "Client recieved tile " << tileNum;
-#endif
+    const quint32 count = m_frameAllocations + m_tilePool.takeAllocationCount() + m_screenPool.takeAllocationCount() +
+                          m_encodeCache.takeAllocationCount();
+    m_frameAllocations = 0;
+    return count;
+}
 
-    if (tileNum == 9999) // within displayField.js line ~500
+/* Grab the screen, or take the frame source's next frame, into the back buffer
+ * of the frame ring. The ring is only (re)allocated when the screen or tile
+ * size changes. */
+bool ScreenCapture::grabFrame()
+{
+    QImage grabbed;
+
+    if(m_frameSource)
     {
-        m_tilePendingAck.clear();
+        TraceSpan span("grab");
+        grabbed = m_frameSource->nextFrame();
     }
+    else
+    {
+        QList<QScreen *> screens = QGuiApplication::screens();
 
-    m_time        =     QTime::currentTime();
-    quint64 dtime = m_time.msecsSinceStartOfDay();
+        if(m_screenNumber >= screens.size())
+            return false;
+
+        TraceSpan span("grab");
+        grabbed = screens.at(m_screenNumber)->grabWindow(0).toImage();
+    }
 
-    if (m_tilePendingAck.contains(tileNum)) {
-         quint64 sentMs     = m_tilePendingAck.value(tileNum);
-         quint64 latencyMs  = dtime - sentMs;
+    if(grabbed.isNull())
+        return false;
 
-         m_AckLatencyMs.pop_back();
-         m_AckLatencyMs.push_front(latencyMs);
+    int columnCount = grabbed.width() / m_rectSize;
+    int rowCount = grabbed.height() / m_rectSize;
 
-//         qDebug() << "Adding latency of:" << latencyMs;
+    // Deal with fractionals
+    if(grabbed.width() % m_rectSize > 0)
+        ++columnCount;
 
-         // Update mean latency, NOT USED ANYMORE
-         m_meanAckLatencyMs = std::accumulate(m_AckLatencyMs.begin(), m_AckLatencyMs.end(), .0) / m_AckLatencyMs.size();
+    if(grabbed.height() % m_rectSize > 0)
+        ++rowCount;
 
-#ifdef QT_DEBUG
-         qDebug()<<"GraberClass::setReceivedTileNum - Current client tile acknowledge latency (ms) is: " << m_meanAckLatencyMs;
-#endif
-         // Remove from pending list
-         m_tilePendingAck.remove(tileNum);
+    // a new rect size may keep the counts, 280 and 300 both cut 1920 in 7
+    if(grabbed.size() != m_screenSize || columnCount != m_columnCount || rowCount != m_rowCount || m_rectSize != m_gridRectSize)
+    {
+        m_screenSize   = grabbed.size();
+        m_columnCount  = columnCount;
+        m_rowCount     = rowCount;
+        m_gridRectSize = m_rectSize;
+
+        // padding stays black in both frames, like QImage::copy() outside the screen
+        for(int i=0;i<2;++i)
+        {
+            m_frames[i] = QImage(m_columnCount*m_rectSize, m_rowCount*m_rectSize, QImage::Format_RGB888);
+            m_frames[i].fill(Qt::black);
+            ++m_frameAllocations;
+        }
+
+        m_dirtyTiles.reserve(m_columnCount*m_rowCount);
+        m_tileStore.setGeometry(m_screenSize, m_rectSize, m_columnCount*m_rowCount);
+        m_lastFrameValid = false;
+    }
+
+    copyToFrame(grabbed, m_frames[m_frameIndex ^ 1]);
+    return true;
+}
+
+void ScreenCapture::copyToFrame(const QImage &source, QImage &frame)
+{
+    TraceSpan span("convert");
+
+    QImage image = source;
+
+    if(image.format() != QImage::Format_RGB32 &&
+       image.format() != QImage::Format_ARGB32 &&
+       image.format() != QImage::Format_ARGB32_Premultiplied)
+    {
+        image = source.convertToFormat(QImage::Format_RGB32);
+        ++m_frameAllocations;
+    }
+
+    const int width = m_screenSize.width();
+    const int height = m_screenSize.height();
 
+    for(int y=0;y<height;++y)
+    {
+        const QRgb *src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        uchar *dst = frame.scanLine(y);
+
+        for(int x=0;x<width;++x)
+        {
+            QRgb pixel = src[x];
+            *dst++ = static_cast<uchar>(qRed(pixel));
+            *dst++ = static_cast<uchar>(qGreen(pixel));
+            *dst++ = static_cast<uchar>(qBlue(pixel));
+        }
     }
+}
+
+bool ScreenCapture::isTileChanged(int column, int row) const
+{
+    const QImage &currentImage = m_frames[m_frameIndex ^ 1];
+    const QImage &lastImage = m_frames[m_frameIndex];
 
+    const int offset = column*m_rectSize*3; // RGB888
+    const int lineSize = m_rectSize*3;
+    const int firstLine = row*m_rectSize;
+
+    for(int y=firstLine;y<firstLine+m_rectSize;++y)
+    {
+        if(memcmp(currentImage.constScanLine(y) + offset, lastImage.constScanLine(y) + offset, lineSize) != 0)
+            return true;
+    }
+
+    return false;
+}
+
+/* Read-only views into a ring frame, no pixels are copied. m_rectSize is a
+ * multiple of 4, so every view starts 32 bit aligned as QImage requires. */
+QImage ScreenCapture::tileImage(const QImage &frame, int column, int row) const
+{
+    const uchar *data = frame.constScanLine(row*m_rectSize) + column*m_rectSize*3;
+    return QImage(data, m_rectSize, m_rectSize, frame.bytesPerLine(), frame.format());
 }
 
-/* Send a tile image */
-void ScreenCapture::sendImage(int posX, int posY, quint16 tileNum, const QImage &image)
+QImage ScreenCapture::screenImage(const QImage &frame) const
+{
+    return QImage(frame.constBits(), m_screenSize.width(), m_screenSize.height(), frame.bytesPerLine(), frame.format());
+}
+
+/* Send a tile image, encoded straight into its packet */
+void ScreenCapture::sendImage(int profile, int posX, int posY, quint16 tileNum, const QImage &image)
 {    
-    QByteArray bArray;
-    QBuffer buffer(&bArray);
-    buffer.open(QIODevice::WriteOnly);
-    //image.save(&buffer, "PNG");
-    image.save(&buffer, "WEBP", 25);
-    //bArray.remove(0,PNG_HEADER_SIZE);
+    QByteArray &buffer = m_tilePool.acquire();
+
+    PacketBuilder packet(buffer);
+    packet.begin(KEY_IMAGE_TILE);
+    packet.appendUint32(static_cast<quint32>(posX));
+    packet.appendUint32(static_cast<quint32>(posY));
+    packet.appendUint32(static_cast<quint32>(tileNum));
 
-    emit imageTile(static_cast<quint16>(posX),static_cast<quint16>(posY),bArray,static_cast<quint16>(tileNum));
+    const int imageOffset = buffer.size();
+    int quality = STREAM_PROFILES[profile].tileQuality;
+
+    {
+        TraceSpan span("encode tile", "tile", tileNum);
+        encodeImage(image, buffer, profile, quality);
+
+        // a batch takes it whole, noise at a large rect size can be too much for the quality
+        while(buffer.size() - PREAMBLE_SIZE > TILE_SIZE_MAX && quality > 1)
+        {
+            quality = qMax(1, quality / 2);
+            buffer.resize(imageOffset);
+            encodeImage(image, buffer, profile, quality);
+        }
+    }
+
+    if(m_debugStats && quality != STREAM_PROFILES[profile].tileQuality)
+        qDebug()<<"ScreenCapture::sendImage - tile"<<tileNum<<"encoded again at quality"<<quality<<"bytes:"<<buffer.size();
+
+    const QByteArray &finished = packet.finish();
+    quint32 hash = tileHash(finished.constData() + imageOffset, finished.size() - imageOffset);
+
+    // stored first, a handler catching up from the store never misses a newer tile
+    m_tileStore.setTile(profile, tileNum, finished, hash, m_frameSeq);
+
+    emit imageTile(tileNum, finished, hash, m_frameSeq, profile);
 }
 
 /* Send a full screen image */
-void ScreenCapture::sendImage(const QImage &image)
+void ScreenCapture::sendImage(int profile, const QImage &image)
+{
+    QByteArray &buffer = m_screenPool.acquire();
+
+    PacketBuilder packet(buffer);
+    packet.begin(KEY_IMAGE_SCREEN);
+
+    const int imageOffset = buffer.size();
+
+    {
+        TraceSpan span("encode screen", "profile", profile);
+        encodeImage(image, buffer, profile, STREAM_PROFILES[profile].screenQuality);
+    }
+
+    const QByteArray &finished = packet.finish();
+    quint32 hash = tileHash(finished.constData() + imageOffset, finished.size() - imageOffset);
+
+    m_tileStore.setScreen(profile, finished, hash, m_frameSeq);
+
+    emit imageScreen(finished, hash, profile); // full screen one
+}
+
+void ScreenCapture::encodeImage(const QImage &image, QByteArray &output, int profile, int quality)
 {
-    QByteArray bArray;
-    QBuffer buffer(&bArray);
-    buffer.open(QIODevice::WriteOnly);
-    image.save(&buffer, "WEBP", 35);
+    QElapsedTimer timer;
+    timer.start();
+
+    encodeImageData(image, output, profile, quality);
+
+    const qint64 encodeNs = timer.nsecsElapsed();
+    m_frameEncodeNs += encodeNs;
+    m_metrics->encodeTileUs.add(static_cast<quint64>(encodeNs / 1000));
+}
+
+/* Encode into a pooled buffer behind whatever it already holds (the packet header)
+ * with the profile's writer, at the profile's scale. Pixels encoded recently
+ * with the same settings are copied from the encode cache. */
+void ScreenCapture::encodeImageData(const QImage &image, QByteArray &output, int profile, int quality)
+{
+    QImageWriter &writer = m_imageWriters[profile];
+    quint64 key = 0;
+
+    if(m_encodeCache.isEnabled())
+    {
+        key = EncodeCache::imageKey(image.constBits(), image.width() * image.depth() / 8, image.height(),
+                                    image.bytesPerLine(), image.width(), STREAM_PROFILES[profile].format, quality,
+                                    STREAM_PROFILES[profile].scale);
+
+        QByteArray encoded;
+
+        if(m_encodeCache.find(key, encoded))
+        {
+            output.append(encoded);
+            return;
+        }
+    }
+
+    const int imageOffset = output.size();
+
+    m_encodeBuffer.setBuffer(&output);
+    m_encodeBuffer.open(QIODevice::WriteOnly);
+    m_encodeBuffer.seek(output.size());
+
+    writer.setQuality(quality);
+
+    const int scale = STREAM_PROFILES[profile].scale;
+    bool written;
+
+    // the viewer stretches it back over the tile's rectangle
+    if(scale > 1)
+        written = writer.write(image.scaled(qMax(1, image.width() / scale), qMax(1, image.height() / scale),
+                                            Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    else written = writer.write(image);
+
+    if(!written)
+        qDebug()<<"ScreenCapture::encodeImage"<<writer.errorString();
 
-    m_tilePendingAck.clear();
+    m_encodeBuffer.close();
+    m_encodeBuffer.setBuffer(Q_NULLPTR);
 
-    emit imageScreen(bArray); // full screen one
+    // a copy, the pooled packet buffer gets reused, counted with the buffer allocations
+    if(m_encodeCache.isEnabled() && output.size() > imageOffset)
+        m_encodeCache.insert(key, output.constData() + imageOffset, output.size() - imageOffset);
 }
 
@@ -4,8 +4,24 @@
 #include <QObject>
 #include <QTimer>
 #include <QImage>
+#include <QBuffer>
+#include <QImageWriter>
 #include <QMap>
-#include <QTime>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "buffer_pool.h"
+#include "encode_cache.h"
+#include "metrics.h"
+#include "tile_store.h"
+
+// Frames from somewhere other than the screen, recorded or made up ones in the benchmarks
+class FrameSource
+{
+public:
+    virtual ~FrameSource(){}
+    virtual QImage nextFrame() = 0; // a null image if there is none
+};
 
 class ScreenCapture : public QObject
 {
@@ -13,6 +29,11 @@ class ScreenCapture : public QObject
 public:
     explicit ScreenCapture(QObject *parent = Q_NULLPTR);
 
+    TileStore *tileStore(){return &m_tileStore;} // shared with the viewer handlers
+    int interval() const {return m_captureInterval;}
+    void setFrameSource(FrameSource *source){m_frameSource = source;} // Q_NULLPTR for the screen again
+    quint32 takeAllocationCount(); // frame ring, packet buffers and encode cache entries allocated since the last call
+
 private:
 
     struct TileStruct
@@ -28,40 +49,84 @@ private:
     };
 
     QTimer *m_grabTimer;
-    int m_grabInterval;
+    int m_grabInterval;                     // the host's
+    int m_captureInterval;                  // the shortest of it and the viewers' requests
+    QMap<QObject*, int> m_viewerIntervals;
     int m_rectSize;
     int m_screenNumber;
-    QImage m_lastImage;
-    QTime m_time;
+    FrameSource *m_frameSource;
 
-    // tile response ack time
-    QMap <quint16, quint64>  m_tilePendingAck;  // tile, and time sent
-    QVector<quint64>         m_AckLatencyMs;
-    quint64                  m_meanAckLatencyMs;
+    // frame ring, the last sent frame and the one being captured swap every cycle
+    QImage  m_frames[2];        // padded to whole tiles
+    int     m_frameIndex;       // m_frames[m_frameIndex] is the last frame
+    bool    m_lastFrameValid;
+    QSize   m_screenSize;
+    int     m_columnCount;
+    int     m_rowCount;
+    int     m_gridRectSize;     // the m_rectSize the frames were cut for
+
+    QVector<quint16> m_dirtyTiles;
+
+    // encoder output
+    BufferPool   m_tilePool;
+    BufferPool   m_screenPool;
+    QBuffer      m_encodeBuffer;
+    QImageWriter m_imageWriters[STREAM_PROFILE_COUNT]; // keep their handlers between calls
+    EncodeCache  m_encodeCache; // of tile and screen images, sized by HostSettings::encodeCacheMb
+
+    // debug stats mode (QV_DEBUG_STATS)
+    bool    m_debugStats;
+    quint32 m_frameAllocations; // of the frame ring, since takeAllocationCount()
+
+    Metrics      *m_metrics;
+    QElapsedTimer m_frameTimer;     // of the capture cycle
+    qint64        m_frameEncodeNs;
+
+    // every image is encoded once per stream profile in use and kept for all viewers,
+    // acks and resends are up to each viewer's handler
+    TileStore      m_tileStore;
+    quint32        m_frameSeq;  // frame being sent
 
 signals: // 'emit'
     void finished();
     void imageParameters(const QSize &imageSize, int rectWidth);
-    void imageTile(quint16 posX, quint16 posY, const QByteArray &imageData, quint16 tileNum);
-    void imageScreen(const QByteArray &imageData); // full screen image
+    void imageTile(quint16 tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq, int profile); // complete IMGT packet
+    void imageScreen(const QByteArray &packet, quint32 hash, int profile); // full screen image, complete IMGS packet
+    void frameFinished(quint32 frameSeq, qint64 captureMs); // all tiles of the frame are out, every capture cycle, grabbed at inputClockMs()
+    void intervalChanged(int msec);
     void screenPositionChanged(const QPoint &pos);
 
 public slots:
     void start();
     void stop();
-    void setInterval(int msec){m_grabInterval = msec;}
-    void setRectSize(int size){m_rectSize = size;}
+    void setInterval(int msec);
+    void setViewerInterval(QObject *viewer, int msec); // 0 withdraws the viewer's request
+    // from the next frame on, with a full image; a multiple of 4, QImage wants the
+    // tile views into the RGB888 frame 32 bit aligned
+    void setRectSize(int size){m_rectSize = size & ~3;}
+    void setDebugStats(bool state){m_debugStats = state;}
+    void setEncodeCacheSize(int megabytes){m_encodeCache.setCapacity(qint64(megabytes) * 1024 * 1024);} // 0 turns it off
+    void setMetrics(Metrics *metrics){m_metrics = metrics ? metrics : Metrics::unshared();}
     void changeScreenNum();
 
-    void startSending();
+    void startSending(); // the first viewer starts the capture with a full image
+    void resumeSending(); // the viewer still holds what the tile store has
     void stopSending();
     void updateImage();
     void updateScreen();
-    void setReceivedTileNum(quint16 num);
 
 private slots:
-    void sendImage(int posX, int posY, quint16 tileNum, const QImage& image);
-    void sendImage(const QImage& image); // full screen image
+    void updateInterval();
+    bool grabFrame(); // into m_frames[m_frameIndex ^ 1]
+    void copyToFrame(const QImage &source, QImage &frame);
+    bool isTileChanged(int column, int row) const;
+    QImage tileImage(const QImage &frame, int column, int row) const;
+    QImage screenImage(const QImage &frame) const;
+
+    void sendImage(int profile, int posX, int posY, quint16 tileNum, const QImage& image);
+    void sendImage(int profile, const QImage& image); // full screen image
+    void encodeImage(const QImage &image, QByteArray &output, int profile, int quality); // timed
+    void encodeImageData(const QImage &image, QByteArray &output, int profile, int quality);
 };
 
 #endif // SCREEN_CAPTURE_H
@@ -0,0 +1,98 @@
+#include "send_scheduler.h"
+#include "packet_builder.h"
+#include "protocol.h"
+
+SendScheduler::SendScheduler() :
+    m_queuedBytes(0),
+    m_fragmentSize(0),
+    m_prioritized(true),
+    m_fragmentPool(PacketBuilder::HEADER_SIZE + FRAGMENT_HEADER_SIZE + FRAGMENT_SIZE_DEFAULT)
+{
+
+}
+
+void SendScheduler::enqueue(Priority priority, const QByteArray &packet, qint64 nowUs)
+{
+    Entry entry;
+    entry.packet     = packet;
+    entry.enqueuedUs = nowUs;
+    entry.offset     = 0;
+    entry.priority   = priority;
+
+    m_queues[m_prioritized ? priority : Control].enqueue(entry);
+    m_queuedBytes += packet.size();
+}
+
+bool SendScheduler::next(QByteArray &packet, qint64 nowUs)
+{
+    for(int i=0;i<PriorityCount;++i)
+    {
+        QQueue<Entry> &queue = m_queues[i];
+
+        if(queue.isEmpty())
+            continue;
+
+        Entry &entry = queue.head();
+        const int total = entry.packet.size() - PREAMBLE_SIZE;
+
+        bool fragment = m_fragmentSize > 0 && entry.priority == Tile &&
+                        (entry.offset > 0 || total > m_fragmentSize);
+
+        if(!fragment)
+        {
+            packet = entry.packet;
+            m_queuedBytes -= entry.packet.size();
+            m_latency[entry.priority].add(static_cast<quint64>(qMax<qint64>(0, nowUs - entry.enqueuedUs)));
+            queue.dequeue();
+            return true;
+        }
+
+        int size = qMin(m_fragmentSize, total - entry.offset);
+
+        QByteArray &buffer = m_fragmentPool.acquire();
+        PacketBuilder builder(buffer);
+        builder.begin(KEY_FRAGMENT);
+        builder.appendUint32(static_cast<quint32>(total));
+        builder.appendUint32(static_cast<quint32>(entry.offset));
+        builder.append(entry.packet.constData() + PREAMBLE_SIZE + entry.offset, size);
+        packet = builder.finish();
+
+        entry.offset += size;
+        m_queuedBytes -= size;
+
+        if(entry.offset >= total)
+        {
+            m_queuedBytes -= PREAMBLE_SIZE;
+            m_latency[entry.priority].add(static_cast<quint64>(qMax<qint64>(0, nowUs - entry.enqueuedUs)));
+            queue.dequeue();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void SendScheduler::clear()
+{
+    for(int i=0;i<PriorityCount;++i)
+        m_queues[i].clear();
+
+    m_queuedBytes = 0;
+}
+
+void SendScheduler::clearLatency()
+{
+    for(int i=0;i<PriorityCount;++i)
+        m_latency[i].clear();
+}
+
+const char *SendScheduler::priorityName(Priority priority)
+{
+    switch(priority)
+    {
+        case Control:   return "control";
+        case Tile:      return "tile";
+        default:        return "unknown";
+    }
+}
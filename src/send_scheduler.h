@@ -0,0 +1,66 @@
+#ifndef SEND_SCHEDULER_H
+#define SEND_SCHEDULER_H
+
+#include <QByteArray>
+#include <QQueue>
+
+#include "buffer_pool.h"
+#include "histogram.h"
+
+/* Outgoing packet queues by priority class. next() always takes from the most
+ * urgent non-empty class; image packets larger than the fragment size are handed
+ * out as KEY_FRAGMENT pieces, so control packets queued meanwhile overtake the
+ * rest of a large image. Within a class the order is kept.
+ *
+ * Time is passed in by the caller (monotonic microseconds), the queueing latency
+ * of every packet is recorded per class. */
+class SendScheduler
+{
+public:
+    enum Priority
+    {
+        Control,    // handshake, parameters, replies, input echoes, stats
+        Tile,       // image data
+        PriorityCount
+    };
+
+    // bytes handed to the socket at a time, the rest waits here where control overtakes tiles
+    static const int SEND_WINDOW = 32 * 1024;
+
+    SendScheduler();
+
+    void setFragmentSize(int bytes){m_fragmentSize = bytes;} // 0 sends whole packets only
+    int fragmentSize() const {return m_fragmentSize;}
+    void setPrioritized(bool state){m_prioritized = state;} // off: one queue in arrival order
+
+    void enqueue(Priority priority, const QByteArray &packet, qint64 nowUs);
+    bool next(QByteArray &packet, qint64 nowUs); // false when nothing is queued
+    void clear();
+
+    bool isEmpty() const {return m_queuedBytes == 0;}
+    qint64 queuedBytes() const {return m_queuedBytes;}
+
+    const Histogram &latency(Priority priority) const {return m_latency[priority];}
+    void clearLatency();
+
+    static const char *priorityName(Priority priority);
+
+private:
+    struct Entry
+    {
+        QByteArray packet;      // complete packet, KEY_PKT_HEADR first
+        qint64     enqueuedUs;
+        int        offset;      // fragmented so far, counted behind KEY_PKT_HEADR
+        Priority   priority;
+    };
+
+    QQueue<Entry> m_queues[PriorityCount];
+    qint64        m_queuedBytes;
+    int           m_fragmentSize;
+    bool          m_prioritized;
+
+    BufferPool    m_fragmentPool;
+    Histogram     m_latency[PriorityCount];
+};
+
+#endif // SEND_SCHEDULER_H
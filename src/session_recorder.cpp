@@ -0,0 +1,477 @@
+#include "session_recorder.h"
+#include "protocol.h"
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+
+#include <algorithm>
+#include <cstring>
+
+static void putUint16(uchar *data, quint16 value)
+{
+    data[0] = static_cast<uchar>(value);
+    data[1] = static_cast<uchar>(value >> 8);
+}
+
+static void putUint32(uchar *data, quint32 value)
+{
+    for(int i=0;i<4;++i)
+        data[i] = static_cast<uchar>(value >> (8 * i));
+}
+
+static void putUint64(uchar *data, quint64 value)
+{
+    for(int i=0;i<8;++i)
+        data[i] = static_cast<uchar>(value >> (8 * i));
+}
+
+static quint64 uint64FromData(const uchar *data)
+{
+    const char *bytes = reinterpret_cast<const char*>(data);
+    return static_cast<quint64>(uint32FromData(bytes)) | static_cast<quint64>(uint32FromData(bytes + 4)) << 32;
+}
+
+SessionRecorder::SessionRecorder() :
+    m_window(Q_NULLPTR),
+    m_windowOffset(0),
+    m_windowSize(0),
+    m_offset(0),
+    m_lastUs(0),
+    m_clockUs(0),
+    m_recordCount(0)
+{
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    close();
+}
+
+bool SessionRecorder::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+
+    if(!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    {
+        qDebug() << "SessionRecorder::open - can't write" << path << m_file.errorString();
+        return false;
+    }
+
+    m_offset = 0;
+    m_index.clear();
+    m_recordCount = 0;
+
+    if(!reserve(SessionFile::HEADER_SIZE))
+        return false;
+
+    uchar *header = m_window;
+    std::memcpy(header, SessionFile::MAGIC, 4);
+    putUint16(header + 4, SessionFile::VERSION);
+    putUint16(header + 6, SessionFile::HEADER_SIZE);
+    putUint64(header + 8, static_cast<quint64>(QDateTime::currentMSecsSinceEpoch()));
+    std::memset(header + 16, 0, SessionFile::HEADER_SIZE - 16); // no index yet
+
+    m_offset = SessionFile::HEADER_SIZE;
+    m_clock.start();
+    m_lastUs = 0;
+    m_clockUs = -SessionFile::CLOCK_INTERVAL_US; // the first record comes after a clock
+    return true;
+}
+
+void SessionRecorder::close()
+{
+    if(!m_file.isOpen())
+        return;
+
+    const bool complete = m_window != Q_NULLPTR;
+
+    if(m_window)
+    {
+        m_file.unmap(m_window);
+        m_window = Q_NULLPTR;
+    }
+
+    m_file.resize(m_offset); // the space reserved past the last record
+
+    if(complete)
+    {
+        QByteArray index(m_index.size() * SessionFile::INDEX_ENTRY_SIZE, 0);
+        uchar *entry = reinterpret_cast<uchar*>(index.data());
+
+        for(int i=0;i<m_index.size();++i, entry += SessionFile::INDEX_ENTRY_SIZE)
+        {
+            putUint64(entry, static_cast<quint64>(m_index.at(i).timeUs));
+            putUint64(entry + 8, static_cast<quint64>(m_index.at(i).offset));
+        }
+
+        uchar fields[16];
+        putUint64(fields, static_cast<quint64>(m_offset));
+        putUint32(fields + 8, static_cast<quint32>(m_index.size()));
+        putUint32(fields + 12, m_recordCount);
+
+        m_file.seek(m_offset);
+        m_file.write(index);
+        m_file.seek(16);
+        m_file.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+    }
+
+    m_file.close();
+    m_index.clear();
+}
+
+void SessionRecorder::record(bool outbound, SessionFile::Kind kind, const char *data, int size)
+{
+    if(!m_window || static_cast<quint32>(size) > SessionFile::RECORD_SIZE_MASK)
+        return;
+
+    const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+
+    // now and then the full time, where a seek can start and so the deltas stay small
+    if(nowUs - m_clockUs >= SessionFile::CLOCK_INTERVAL_US)
+    {
+        uchar time[8];
+        putUint64(time, static_cast<quint64>(nowUs));
+
+        IndexEntry entry;
+        entry.timeUs = nowUs;
+        entry.offset = m_offset;
+
+        write(SessionFile::RECORD_PRESENT | static_cast<quint32>(SessionFile::Clock) << SessionFile::RECORD_KIND_SHIFT | 8,
+              0, reinterpret_cast<const char*>(time), 8);
+
+        if(!m_window)
+            return;
+
+        m_index.append(entry);
+        m_clockUs = nowUs;
+        m_lastUs = nowUs;
+    }
+
+    quint32 sizeFlags = SessionFile::RECORD_PRESENT | static_cast<quint32>(kind) << SessionFile::RECORD_KIND_SHIFT | static_cast<quint32>(size);
+
+    if(outbound)
+        sizeFlags |= SessionFile::RECORD_OUTBOUND;
+
+    write(sizeFlags, static_cast<quint32>(nowUs - m_lastUs), data, size);
+    m_lastUs = nowUs;
+    ++m_recordCount;
+}
+
+/* Maps the next WINDOW_SIZE of the file from the write position, or all of a
+ * larger record, once the current window has no room left */
+bool SessionRecorder::reserve(qint64 size)
+{
+    if(m_window && m_offset + size <= m_windowOffset + m_windowSize)
+        return true;
+
+    if(m_window)
+    {
+        m_file.unmap(m_window);
+        m_window = Q_NULLPTR;
+    }
+
+    const qint64 length = qMax(WINDOW_SIZE, size);
+
+    if(!m_file.resize(m_offset + length))
+    {
+        fail("can't grow");
+        return false;
+    }
+
+    m_window = m_file.map(m_offset, length);
+
+    if(!m_window)
+    {
+        fail("can't map");
+        return false;
+    }
+
+    m_windowOffset = m_offset;
+    m_windowSize = length;
+    return true;
+}
+
+void SessionRecorder::write(quint32 sizeFlags, quint32 deltaUs, const char *data, int size)
+{
+    if(!reserve(SessionFile::RECORD_HEADER_SIZE + size))
+        return;
+
+    uchar *record = m_window + (m_offset - m_windowOffset);
+
+    if(size > 0)
+        std::memcpy(record + SessionFile::RECORD_HEADER_SIZE, data, static_cast<size_t>(size));
+
+    // the size goes in last, a record is there once RECORD_PRESENT is
+    putUint32(record + 4, deltaUs);
+    putUint32(record, sizeFlags);
+
+    m_offset += SessionFile::RECORD_HEADER_SIZE + size;
+}
+
+// the records so far stay, a reader finds them without the index
+void SessionRecorder::fail(const char *what)
+{
+    qDebug() << "SessionRecorder -" << what << m_file.fileName() << m_file.errorString() << "- recording stopped";
+
+    m_file.resize(m_offset);
+    m_file.close();
+    m_index.clear();
+}
+
+QString SessionRecorder::nextPath(const QString &dir)
+{
+    static QAtomicInt sessions(0);
+
+    QDir().mkpath(dir);
+
+    const QString name = QString("session-%1-%2.qvsr")
+            .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"))
+            .arg(sessions.fetchAndAddRelaxed(1) + 1);
+
+    return QDir(dir).filePath(name);
+}
+
+
+SessionRecording::SessionRecording() :
+    m_data(Q_NULLPTR),
+    m_dataEnd(0),
+    m_complete(false),
+    m_startMs(0),
+    m_durationUs(0),
+    m_recordCount(0),
+    m_offset(0),
+    m_timeUs(0)
+{
+}
+
+SessionRecording::~SessionRecording()
+{
+    close();
+}
+
+bool SessionRecording::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+
+    if(!m_file.open(QIODevice::ReadOnly))
+    {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+
+    if(size >= SessionFile::HEADER_SIZE)
+        m_data = m_file.map(0, size);
+
+    if(!m_data || std::memcmp(m_data, SessionFile::MAGIC, 4) != 0)
+    {
+        m_error = "not a session recording";
+        close();
+        return false;
+    }
+
+    const quint16 version = static_cast<quint16>(m_data[4] | m_data[5] << 8);
+    const int headerSize = m_data[6] | m_data[7] << 8;
+
+    if(version > SessionFile::VERSION || headerSize < SessionFile::HEADER_SIZE || headerSize > size)
+    {
+        m_error = QString("recording version %1 is not supported").arg(version);
+        close();
+        return false;
+    }
+
+    m_startMs = static_cast<qint64>(uint64FromData(m_data + 8));
+
+    const qint64 indexOffset = static_cast<qint64>(uint64FromData(m_data + 16));
+    const qint64 indexCount = uint32FromData(reinterpret_cast<const char*>(m_data + 24));
+
+    m_offset = headerSize;
+    m_dataEnd = size;
+    m_complete = indexOffset >= headerSize && indexOffset + indexCount * SessionFile::INDEX_ENTRY_SIZE == size;
+
+    if(m_complete)
+    {
+        m_dataEnd = indexOffset;
+        m_recordCount = uint32FromData(reinterpret_cast<const char*>(m_data + 28));
+
+        for(qint64 i=0;i<indexCount;++i)
+        {
+            const uchar *entry = m_data + indexOffset + i * SessionFile::INDEX_ENTRY_SIZE;
+
+            IndexEntry index;
+            index.timeUs = static_cast<qint64>(uint64FromData(entry));
+            index.offset = static_cast<qint64>(uint64FromData(entry + 8));
+
+            if(index.offset < headerSize || index.offset >= m_dataEnd)
+                break;
+
+            m_index.append(index);
+        }
+    }
+
+    scan();
+    rewind();
+    return true;
+}
+
+void SessionRecording::close()
+{
+    if(m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+
+    m_file.close();
+    m_data = Q_NULLPTR;
+    m_dataEnd = 0;
+    m_complete = false;
+    m_startMs = 0;
+    m_durationUs = 0;
+    m_recordCount = 0;
+    m_index.clear();
+    m_offset = 0;
+    m_timeUs = 0;
+}
+
+/* Walks the records from the last clock the index has, or from the start
+ * without one, to the last record. That one's time is the duration. */
+void SessionRecording::scan()
+{
+    if(!m_index.isEmpty())
+    {
+        m_offset = m_index.last().offset;
+        m_timeUs = m_index.last().timeUs;
+    }
+
+    const bool counting = !m_complete;
+    quint32 sizeFlags = 0;
+    quint32 deltaUs = 0;
+
+    while(readRecord(m_offset, sizeFlags, deltaUs))
+    {
+        const int size = static_cast<int>(sizeFlags & SessionFile::RECORD_SIZE_MASK);
+        const int kind = static_cast<int>((sizeFlags & SessionFile::RECORD_KIND_MASK) >> SessionFile::RECORD_KIND_SHIFT);
+
+        if(kind == SessionFile::Clock && size >= 8)
+        {
+            m_timeUs = static_cast<qint64>(uint64FromData(m_data + m_offset + SessionFile::RECORD_HEADER_SIZE));
+
+            if(counting)
+            {
+                IndexEntry index;
+                index.timeUs = m_timeUs;
+                index.offset = m_offset;
+                m_index.append(index);
+            }
+        }
+        else
+        {
+            m_timeUs += deltaUs;
+
+            if(counting)
+                ++m_recordCount;
+        }
+
+        m_offset += SessionFile::RECORD_HEADER_SIZE + size;
+    }
+
+    if(!m_complete)
+        m_dataEnd = m_offset; // whatever follows was reserved, never written
+
+    m_durationUs = m_timeUs;
+}
+
+bool SessionRecording::readRecord(qint64 offset, quint32 &sizeFlags, quint32 &deltaUs) const
+{
+    if(offset + SessionFile::RECORD_HEADER_SIZE > m_dataEnd)
+        return false;
+
+    sizeFlags = uint32FromData(reinterpret_cast<const char*>(m_data + offset));
+    deltaUs = uint32FromData(reinterpret_cast<const char*>(m_data + offset + 4));
+
+    return (sizeFlags & SessionFile::RECORD_PRESENT) &&
+           offset + SessionFile::RECORD_HEADER_SIZE + (sizeFlags & SessionFile::RECORD_SIZE_MASK) <= m_dataEnd;
+}
+
+void SessionRecording::rewind()
+{
+    m_offset = m_data ? (m_data[6] | m_data[7] << 8) : 0;
+    m_timeUs = 0;
+}
+
+bool SessionRecording::seek(qint64 timeUs)
+{
+    IndexEntry key;
+    key.timeUs = timeUs;
+    key.offset = 0;
+
+    // the last clock at or before timeUs
+    QVector<IndexEntry>::const_iterator entry = std::upper_bound(m_index.constBegin(), m_index.constEnd(), key,
+        [](const IndexEntry &a, const IndexEntry &b) {return a.timeUs < b.timeUs;});
+
+    if(entry == m_index.constBegin())
+        rewind();
+    else
+    {
+        --entry;
+        m_offset = entry->offset;
+        m_timeUs = entry->timeUs;
+    }
+
+    Record record;
+
+    for(;;)
+    {
+        const qint64 offset = m_offset;
+        const qint64 time = m_timeUs;
+
+        if(!next(record))
+            return false;
+
+        if(record.timeUs >= timeUs)
+        {
+            m_offset = offset;
+            m_timeUs = time;
+            return true;
+        }
+    }
+}
+
+bool SessionRecording::next(Record &record)
+{
+    quint32 sizeFlags = 0;
+    quint32 deltaUs = 0;
+
+    while(readRecord(m_offset, sizeFlags, deltaUs))
+    {
+        const char *data = reinterpret_cast<const char*>(m_data + m_offset + SessionFile::RECORD_HEADER_SIZE);
+        const int size = static_cast<int>(sizeFlags & SessionFile::RECORD_SIZE_MASK);
+        const int kind = static_cast<int>((sizeFlags & SessionFile::RECORD_KIND_MASK) >> SessionFile::RECORD_KIND_SHIFT);
+
+        m_offset += SessionFile::RECORD_HEADER_SIZE + size;
+
+        if(kind == SessionFile::Clock)
+        {
+            if(size >= 8)
+                m_timeUs = static_cast<qint64>(uint64FromData(reinterpret_cast<const uchar*>(data)));
+
+            continue;
+        }
+
+        m_timeUs += deltaUs;
+
+        record.timeUs = m_timeUs;
+        record.outbound = (sizeFlags & SessionFile::RECORD_OUTBOUND) != 0;
+        record.kind = static_cast<SessionFile::Kind>(kind);
+        record.data = data;
+        record.size = size;
+        return true;
+    }
+
+    return false;
+}
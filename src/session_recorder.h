@@ -0,0 +1,154 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+/* Every message of a socket session with the time it went in or out, to
+ * replay production traffic offline (QV_RECORD_DIR, QuickViewerReplay).
+ *
+ * File: a HEADER_SIZE header, records, then an index of the clock records.
+ *  - header: "QVSR" + version (UINT16) + header size (UINT16) + start in ms
+ *    since the epoch (UINT64) + index offset (UINT64, 0 until closed) +
+ *    index entries (UINT32) + records (UINT32), all little endian
+ *  - record: size and flags (UINT32) + us since the record before (UINT32)
+ *    + size bytes of message, RECORD_PRESENT is set in every record so the
+ *    zeroed space the file grows by ends the records
+ *  - a Clock record every CLOCK_INTERVAL_US holds the us since the start
+ *    (UINT64), the index lists their times and offsets (2 x UINT64)
+ *
+ * Records go straight into a shared mapping of the file, which grows by
+ * WINDOW_SIZE at a time. A host that dies leaves its records readable up to
+ * the last one, without an index, the reader then scans for the clocks. */
+namespace SessionFile
+{
+    const char    MAGIC[]             = "QVSR";
+    const quint16 VERSION             = 1;
+    const int     HEADER_SIZE         = 32;
+    const int     RECORD_HEADER_SIZE  = 8;
+    const int     INDEX_ENTRY_SIZE    = 16;
+    const qint64  CLOCK_INTERVAL_US   = 1000000;
+
+    const quint32 RECORD_SIZE_MASK    = 0x0fffffff;
+    const quint32 RECORD_KIND_SHIFT   = 28;
+    const quint32 RECORD_KIND_MASK    = 0x30000000;
+    const quint32 RECORD_OUTBOUND     = 0x40000000; // host to viewer
+    const quint32 RECORD_PRESENT      = 0x80000000;
+
+    enum Kind
+    {
+        Binary,
+        Text,   // UTF-8
+        Clock
+    };
+}
+
+class SessionRecorder
+{
+public:
+    static const qint64 WINDOW_SIZE = 4 * 1024 * 1024;
+
+    SessionRecorder();
+    ~SessionRecorder();
+
+    bool open(const QString &path);
+    bool isOpen() const {return m_window != Q_NULLPTR;}
+    void close(); // writes the index
+
+    void record(bool outbound, const QByteArray &data) {record(outbound, SessionFile::Binary, data.constData(), data.size());}
+    void recordText(bool outbound, const QString &message) {const QByteArray text = message.toUtf8(); record(outbound, SessionFile::Text, text.constData(), text.size());}
+    void record(bool outbound, SessionFile::Kind kind, const char *data, int size);
+
+    QString fileName() const {return m_file.fileName();}
+    quint32 recordCount() const {return m_recordCount;}
+    qint64  size() const {return m_offset;}
+
+    // session-<date>-<time>-<n>.qvsr in dir, n counts the host's sessions
+    static QString nextPath(const QString &dir);
+
+private:
+    struct IndexEntry
+    {
+        qint64 timeUs;
+        qint64 offset;
+    };
+
+    bool reserve(qint64 size);
+    void write(quint32 sizeFlags, quint32 deltaUs, const char *data, int size);
+    void fail(const char *what);
+
+    QFile   m_file;
+    uchar  *m_window;       // mapped part of the file, from m_windowOffset
+    qint64  m_windowOffset;
+    qint64  m_windowSize;
+    qint64  m_offset;       // where the next record goes
+
+    QElapsedTimer m_clock;
+    qint64  m_lastUs;       // time of the last record
+    qint64  m_clockUs;      // of the last Clock record
+    quint32 m_recordCount;
+
+    QVector<IndexEntry> m_index;
+};
+
+/* A recording mapped for reading. Records come out in order from the start
+ * or from a seek(), their data points into the mapping and stays valid until
+ * close(). Clock records are taken care of and not handed out. */
+class SessionRecording
+{
+public:
+    struct Record
+    {
+        qint64            timeUs;   // since the start of the session
+        bool              outbound;
+        SessionFile::Kind kind;
+        const char       *data;
+        int               size;
+    };
+
+    SessionRecording();
+    ~SessionRecording();
+
+    bool open(const QString &path);
+    void close();
+    QString errorString() const {return m_error;}
+
+    bool    isComplete() const {return m_complete;} // closed by the host, with its index
+    qint64  startMsecsSinceEpoch() const {return m_startMs;}
+    qint64  durationUs() const {return m_durationUs;}
+    quint32 recordCount() const {return m_recordCount;} // Clock records left out
+
+    void rewind();
+    bool seek(qint64 timeUs); // to the first record at or after timeUs
+    bool next(Record &record);
+
+private:
+    struct IndexEntry
+    {
+        qint64 timeUs;
+        qint64 offset;
+    };
+
+    bool readRecord(qint64 offset, quint32 &sizeFlags, quint32 &deltaUs) const;
+    void scan(); // the index and the end of a recording that was not closed
+
+    QFile   m_file;
+    const uchar *m_data;
+    qint64  m_dataEnd;      // end of the records
+    QString m_error;
+
+    bool    m_complete;
+    qint64  m_startMs;
+    qint64  m_durationUs;
+    quint32 m_recordCount;
+
+    QVector<IndexEntry> m_index;
+
+    qint64  m_offset;       // next record
+    qint64  m_timeUs;       // of the record before it
+};
+
+#endif // SESSION_RECORDER_H
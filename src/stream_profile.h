@@ -0,0 +1,78 @@
+#ifndef STREAM_PROFILE_H
+#define STREAM_PROFILE_H
+
+#include "protocol.h"
+
+/* Encoder settings a viewer's stream is made with. ScreenCapture encodes a
+ * changed tile once for each profile a viewer currently uses, viewers on the
+ * same profile share the encoded packets.
+ *
+ * The profiles are the rungs of the quality ladder, best first. A viewer's
+ * QualityLadder moves it down when its link can't carry the stream and back
+ * up when there is room, relativeCost estimates what the stream would need on
+ * another rung from what it uses on the current one. */
+struct StreamProfile
+{
+    const char *name;
+    const char *format;         // QImageWriter format, the viewer detects it from the data
+    quint16     codec;          // CODEC_* of the format
+    int         tileQuality;    // quality of tile images
+    int         screenQuality;  // and of full screen images
+    int         scale;          // images are encoded at 1/scale of their size, the viewer stretches them
+    int         relativeCost;   // bytes per image, percent of "normal"
+};
+
+const StreamProfile STREAM_PROFILES[] =
+{
+    {"lan",    "JPEG", CODEC_JPEG, 80, 80, 1, 500}, // direct LAN viewers, encode time matters more than bytes
+    {"high",   "WEBP", CODEC_WEBP, 60, 70, 1, 200},
+    {"normal", "WEBP", CODEC_WEBP, 25, 35, 1, 100},
+    {"low",    "WEBP", CODEC_WEBP, 10, 20, 1,  65},
+    {"half",   "WEBP", CODEC_WEBP, 25, 35, 2,  30}  // half resolution, last resort of a slow link
+};
+
+const int STREAM_PROFILE_COUNT  = sizeof(STREAM_PROFILES) / sizeof(STREAM_PROFILES[0]);
+const int STREAM_PROFILE_LAN    = 0;
+const int STREAM_PROFILE_HIGH   = 1;
+const int STREAM_PROFILE_NORMAL = 2;
+const int STREAM_PROFILE_LOW    = 3;
+const int STREAM_PROFILE_HALF   = 4;
+
+/* The rungs from baseTop down a viewer decoding codecs (CODEC_*) may use, the
+ * first one of at most quality (1-100, 0 for any). A quality below every rung
+ * gets the last usable one, codecs no rung from baseTop on is made with the
+ * last one above. False if the codecs rule out every rung. */
+inline bool streamProfileRange(int baseTop, quint16 codecs, int quality, int &top, int &bottom)
+{
+    int first = -1;
+    int last = -1;
+
+    for(int i=baseTop;i<STREAM_PROFILE_COUNT;++i)
+    {
+        bool usable = (STREAM_PROFILES[i].codec & codecs) != 0;
+
+        if(first >= 0)
+        {
+            if(!usable)
+                break; // the ladder has no gaps
+            last = i;
+        }
+        else if(usable && (quality <= 0 || STREAM_PROFILES[i].tileQuality <= quality))
+            first = last = i;
+    }
+
+    for(int i=STREAM_PROFILE_COUNT-1;first<0 && i>=0;--i)
+    {
+        if(STREAM_PROFILES[i].codec & codecs)
+            first = last = i;
+    }
+
+    if(first < 0)
+        return false;
+
+    top = first;
+    bottom = last;
+    return true;
+}
+
+#endif // STREAM_PROFILE_H
@@ -0,0 +1,76 @@
+#include "tile_ack_tracker.h"
+
+TileAckTracker::TileAckTracker() :
+    m_pendingCount(0)
+{
+
+}
+
+void TileAckTracker::reset(int tileCount)
+{
+    m_sentMs.resize(tileCount);
+    m_frameSeq.resize(tileCount);
+    m_resent.resize(tileCount);
+    clear();
+}
+
+void TileAckTracker::clear()
+{
+    m_sentMs.fill(-1);
+    m_frameSeq.fill(0);
+    m_resent.fill(false);
+    m_pendingCount = 0;
+}
+
+void TileAckTracker::tileSent(int tileNum, quint32 frameSeq, qint64 nowMs, bool resend)
+{
+    if(tileNum < 0 || tileNum >= m_sentMs.size())
+        return;
+
+    if(m_sentMs.at(tileNum) < 0)
+        ++m_pendingCount;
+
+    m_sentMs[tileNum] = nowMs;
+    m_frameSeq[tileNum] = frameSeq;
+    m_resent[tileNum] = resend;
+}
+
+bool TileAckTracker::isOverdue(int tileNum, qint64 nowMs, qint64 timeoutMs) const
+{
+    qint64 sentMs = m_sentMs.at(tileNum);
+    return sentMs >= 0 && !m_resent.at(tileNum) && nowMs - sentMs > timeoutMs;
+}
+
+qint64 TileAckTracker::ackTile(int tileNum, qint64 nowMs)
+{
+    if(tileNum < 0 || tileNum >= m_sentMs.size() || m_sentMs.at(tileNum) < 0)
+        return -1;
+
+    const qint64 latencyMs = qMax<qint64>(0, nowMs - m_sentMs.at(tileNum));
+    m_latency.add(static_cast<quint64>(latencyMs));
+    m_sentMs[tileNum] = -1;
+    --m_pendingCount;
+    return latencyMs;
+}
+
+int TileAckTracker::ackFrame(quint32 frameSeq, qint64 nowMs)
+{
+    int acked = 0;
+
+    for(int i=0;i<m_sentMs.size() && m_pendingCount > 0;++i)
+    {
+        if(m_sentMs.at(i) < 0)
+            continue;
+
+        // sent in this frame or before it, sequence numbers may wrap
+        if(static_cast<qint32>(frameSeq - m_frameSeq.at(i)) < 0)
+            continue;
+
+        m_latency.add(static_cast<quint64>(qMax<qint64>(0, nowMs - m_sentMs.at(i))));
+        m_sentMs[i] = -1;
+        --m_pendingCount;
+        ++acked;
+    }
+
+    return acked;
+}
@@ -0,0 +1,42 @@
+#ifndef TILE_ACK_TRACKER_H
+#define TILE_ACK_TRACKER_H
+
+#include <QVector>
+
+#include "histogram.h"
+
+/* Which tiles the viewer has not acknowledged yet. State is kept in flat arrays
+ * indexed by tile number: when the unacknowledged copy was sent (monotonic ms,
+ * -1 once acknowledged), the frame that carried it and whether it was a resend.
+ * A frame ack is cumulative, it acknowledges every tile sent in that frame or
+ * an earlier one. */
+class TileAckTracker
+{
+public:
+    TileAckTracker();
+
+    void reset(int tileCount);
+    void clear(); // everything acknowledged, e.g. a full screen image went out
+
+    void tileSent(int tileNum, quint32 frameSeq, qint64 nowMs, bool resend = false);
+    bool isPending(int tileNum) const {return m_sentMs.at(tileNum) >= 0;}
+    bool isOverdue(int tileNum, qint64 nowMs, qint64 timeoutMs) const; // resends never are
+
+    qint64 ackTile(int tileNum, qint64 nowMs); // ms since it was sent, -1 if it wasn't pending
+    int ackFrame(quint32 frameSeq, qint64 nowMs); // returns the number of tiles acknowledged
+
+    int tileCount() const {return m_sentMs.size();}
+    int pendingCount() const {return m_pendingCount;}
+
+    const Histogram &latency() const {return m_latency;} // ms from send to ack
+    void clearLatency(){m_latency.clear();}
+
+private:
+    QVector<qint64>  m_sentMs;
+    QVector<quint32> m_frameSeq;
+    QVector<bool>    m_resent;
+    int              m_pendingCount;
+    Histogram        m_latency;
+};
+
+#endif // TILE_ACK_TRACKER_H
@@ -0,0 +1,159 @@
+#include "tile_store.h"
+
+#include <QMutexLocker>
+
+TileStore::TileStore() :
+    m_rectSize(0),
+    m_tileCount(0),
+    m_frameSeq(0)
+{
+
+}
+
+void TileStore::setGeometry(const QSize &screenSize, int rectSize, int tileCount)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_screenSize = screenSize;
+    m_rectSize   = rectSize;
+    m_tileCount  = tileCount;
+
+    // nothing stored matches the new grid, every profile in use gets a full image next
+    for(int i=0;i<STREAM_PROFILE_COUNT;++i)
+        clearProfile(m_profiles[i]);
+}
+
+void TileStore::setTile(int profile, int tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ProfileState &state = m_profiles[profile];
+
+    if(state.screen.isEmpty() || tileNum < 0 || tileNum >= state.tiles.size())
+        return; // tiles only count on top of a full image
+
+    state.tiles[tileNum] = packet;
+    state.hashes[tileNum] = hash;
+    m_frameSeq = frameSeq;
+}
+
+void TileStore::setScreen(int profile, const QByteArray &packet, quint32 hash, quint32 frameSeq)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ProfileState &state = m_profiles[profile];
+
+    state.screen = packet;
+    state.screenHash = hash;
+    state.tiles.fill(QByteArray(), m_tileCount); // releases the tile buffers
+    state.hashes.fill(hash, m_tileCount);
+    m_frameSeq = frameSeq;
+}
+
+bool TileStore::isInUse(int profile) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_profiles[profile].viewers > 0;
+}
+
+bool TileStore::takeRefresh(int profile)
+{
+    QMutexLocker locker(&m_mutex);
+
+    bool refresh = m_profiles[profile].refresh;
+    m_profiles[profile].refresh = false;
+    return refresh;
+}
+
+bool TileStore::addViewer(int profile, Snapshot &snapshot)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_profiles[profile].viewers;
+
+    if(fillSnapshot(profile, snapshot))
+        return true;
+
+    m_profiles[profile].refresh = true;
+    return false;
+}
+
+// the images stay, they are still current until ScreenCapture skips a change
+void TileStore::removeViewer(int profile)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(m_profiles[profile].viewers > 0)
+        --m_profiles[profile].viewers;
+}
+
+void TileStore::invalidate(int profile)
+{
+    QMutexLocker locker(&m_mutex);
+    clearProfile(m_profiles[profile]);
+}
+
+int TileStore::viewerCount() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    int count = 0;
+
+    for(int i=0;i<STREAM_PROFILE_COUNT;++i)
+        count += m_profiles[i].viewers;
+
+    return count;
+}
+
+bool TileStore::snapshot(int profile, Snapshot &snapshot) const
+{
+    QMutexLocker locker(&m_mutex);
+    return fillSnapshot(profile, snapshot);
+}
+
+bool TileStore::fillSnapshot(int profile, Snapshot &snapshot) const
+{
+    const ProfileState &state = m_profiles[profile];
+
+    snapshot.screenSize = m_screenSize;
+    snapshot.rectSize   = m_rectSize;
+
+    if(state.screen.isEmpty())
+        return false;
+
+    snapshot.frameSeq   = m_frameSeq;
+    snapshot.screen     = state.screen;
+    snapshot.screenHash = state.screenHash;
+    snapshot.tiles      = state.tiles;
+    snapshot.hashes     = state.hashes;
+    return true;
+}
+
+bool TileStore::tile(int profile, int tileNum, QByteArray &packet, quint32 &hash) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    const ProfileState &state = m_profiles[profile];
+
+    if(tileNum < 0 || tileNum >= state.tiles.size() || state.tiles.at(tileNum).isEmpty())
+        return false;
+
+    packet = state.tiles.at(tileNum);
+    hash = state.hashes.at(tileNum);
+    return true;
+}
+
+void TileStore::tileHashes(int profile, QVector<quint32> &hashes) const
+{
+    QMutexLocker locker(&m_mutex);
+    hashes = m_profiles[profile].hashes;
+}
+
+void TileStore::clearProfile(ProfileState &state)
+{
+    state.screen.clear();
+    state.screenHash = 0;
+    state.tiles.clear();
+    state.hashes.clear();
+    state.refresh = state.viewers > 0;
+}
@@ -0,0 +1,80 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QSize>
+#include <QVector>
+
+#include "stream_profile.h"
+
+/* The latest encoded image of every tile, per stream profile, shared by all
+ * viewers. ScreenCapture writes it before a packet goes out, the viewer
+ * handlers read it from their own threads to bring a new, resumed or lagging
+ * viewer up to date without encoding anything again. Packets are implicitly
+ * shared, a copy handed out costs a reference count.
+ *
+ * A full screen image supersedes the tile images before it, a tile then has
+ * no packet of its own until it changes again. A profile that misses a change
+ * because no viewer used it is cleared, it needs a full image before it can be
+ * read again. */
+class TileStore
+{
+public:
+    struct Snapshot
+    {
+        QSize               screenSize;
+        int                 rectSize;       // 0 before the first capture
+        quint32             frameSeq;
+        QByteArray          screen;     // complete IMGS packet
+        quint32             screenHash;
+        QVector<QByteArray> tiles;      // complete IMGT packets, empty where the screen image is current
+        QVector<quint32>    hashes;     // tileHash() of what each tile shows
+
+        Snapshot() : rectSize(0), frameSeq(0), screenHash(0){}
+    };
+
+    TileStore();
+
+    // ScreenCapture
+    void setGeometry(const QSize &screenSize, int rectSize, int tileCount);
+    void setTile(int profile, int tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq);
+    void setScreen(int profile, const QByteArray &packet, quint32 hash, quint32 frameSeq);
+    bool isInUse(int profile) const;
+    bool takeRefresh(int profile); // a viewer switched to a profile nobody used
+    void invalidate(int profile); // changed tiles were not encoded for it
+
+    // viewer handlers
+    bool addViewer(int profile, Snapshot &snapshot); // false if the profile waits for a full image from ScreenCapture
+    void removeViewer(int profile);
+    int viewerCount() const;
+
+    bool snapshot(int profile, Snapshot &snapshot) const; // false until the profile holds a full image, the geometry is set anyway
+    bool tile(int profile, int tileNum, QByteArray &packet, quint32 &hash) const; // false if only the screen image has it
+    void tileHashes(int profile, QVector<quint32> &hashes) const;
+
+private:
+    struct ProfileState
+    {
+        QByteArray          screen;
+        quint32             screenHash;
+        QVector<QByteArray> tiles;
+        QVector<quint32>    hashes;
+        int                 viewers;
+        bool                refresh;
+
+        ProfileState() : screenHash(0), viewers(0), refresh(false){}
+    };
+
+    void clearProfile(ProfileState &state);
+    bool fillSnapshot(int profile, Snapshot &snapshot) const;
+
+    mutable QMutex m_mutex;
+    QSize          m_screenSize;
+    int            m_rectSize;
+    int            m_tileCount;
+    quint32        m_frameSeq; // of the last image stored
+    ProfileState   m_profiles[STREAM_PROFILE_COUNT];
+};
+
+#endif // TILE_STORE_H
@@ -0,0 +1,207 @@
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+
+struct TraceEvent
+{
+    const char *name;
+    const char *argName;
+    qint64      startNs;
+    qint64      durationNs;
+    qint64      arg;
+};
+
+/* Written by its thread only. The count is published after the event, a
+ * reader copies what it covers and drops whatever was overwritten meanwhile. */
+struct TraceBuffer
+{
+    QVector<TraceEvent>     events;     // never resized once recording
+    QAtomicInteger<quint64> written;
+    QByteArray              threadName;
+    int                     threadId;
+};
+
+static QAtomicInt           s_started(0);
+static int                  s_eventsPerThread = Trace::DEFAULT_EVENTS;
+static QElapsedTimer        s_clock;
+static QMutex               s_buffersMutex; // the lists, and reading or handing out a buffer
+static QVector<TraceBuffer*> s_buffers;
+static QVector<TraceBuffer*> s_freeBuffers; // of finished threads
+
+QAtomicInt Trace::s_enabled(0);
+
+static TraceBuffer *acquireBuffer()
+{
+    QMutexLocker locker(&s_buffersMutex);
+
+    TraceBuffer *buffer;
+
+    if(!s_freeBuffers.isEmpty())
+    {
+        buffer = s_freeBuffers.takeLast();
+        buffer->written.store(0);
+    }
+    else
+    {
+        buffer = new TraceBuffer;
+        buffer->events.resize(s_eventsPerThread);
+        buffer->written.store(0);
+        buffer->threadId = s_buffers.size() + 1;
+        s_buffers.append(buffer);
+    }
+
+    QString name = QThread::currentThread()->objectName();
+
+    if(name.isEmpty())
+        name = QString("thread %1").arg(buffer->threadId);
+
+    buffer->threadName = name.toUtf8();
+    return buffer;
+}
+
+static void releaseBuffer(TraceBuffer *buffer)
+{
+    QMutexLocker locker(&s_buffersMutex);
+    s_freeBuffers.append(buffer);
+}
+
+// the thread's buffer, handed back when the thread ends
+struct TraceThread
+{
+    TraceBuffer *buffer;
+
+    ~TraceThread()
+    {
+        if(buffer)
+            releaseBuffer(buffer);
+    }
+};
+
+static thread_local TraceThread t_thread = {Q_NULLPTR};
+
+void Trace::start(int eventsPerThread)
+{
+    if(s_started.fetchAndStoreOrdered(1) != 0)
+        return;
+
+    s_eventsPerThread = qMax(eventsPerThread, 1024);
+    s_clock.start();
+    s_enabled.storeRelease(1);
+}
+
+qint64 Trace::nowNs()
+{
+    return s_clock.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 startNs, qint64 endNs, const char *argName, qint64 arg)
+{
+    if(!t_thread.buffer)
+        t_thread.buffer = acquireBuffer();
+
+    TraceBuffer *buffer = t_thread.buffer;
+    const quint64 index = buffer->written.load();
+
+    TraceEvent &event = buffer->events[static_cast<int>(index % static_cast<quint64>(buffer->events.size()))];
+    event.name = name;
+    event.argName = argName;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    event.arg = arg;
+
+    buffer->written.storeRelease(index + 1);
+}
+
+static void appendMicroseconds(QByteArray &out, qint64 ns)
+{
+    out.append(QByteArray::number(ns / 1000)).append('.');
+
+    const QByteArray fraction = QByteArray::number(ns % 1000);
+    out.append(QByteArray(3 - fraction.size(), '0')).append(fraction);
+}
+
+static void appendEscaped(QByteArray &out, const QByteArray &text)
+{
+    for(int i=0;i<text.size();++i)
+    {
+        const char c = text.at(i);
+
+        if(c == '"' || c == '\\')
+            out.append('\\');
+
+        if(static_cast<uchar>(c) >= 0x20)
+            out.append(c);
+    }
+}
+
+static void appendBuffer(QByteArray &out, const TraceBuffer *buffer)
+{
+    const int capacity = buffer->events.size();
+    const quint64 written = buffer->written.loadAcquire();
+    const quint64 first = written > static_cast<quint64>(capacity) ? written - capacity : 0;
+
+    QVector<TraceEvent> events;
+    events.reserve(static_cast<int>(written - first));
+
+    for(quint64 i=first;i<written;++i)
+        events.append(buffer->events.at(static_cast<int>(i % capacity)));
+
+    // the thread kept recording meanwhile: the oldest copied may be newer ones, the slot it writes next half written
+    const quint64 writing = buffer->written.loadAcquire() + 1;
+    const quint64 valid = writing > static_cast<quint64>(capacity) ? writing - capacity : 0;
+    const int overwritten = valid > first ? static_cast<int>(qMin<quint64>(valid - first, static_cast<quint64>(events.size()))) : 0;
+
+    out.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":").append(QByteArray::number(buffer->threadId))
+       .append(",\"args\":{\"name\":\"");
+    appendEscaped(out, buffer->threadName);
+    out.append("\"}},\n");
+
+    for(int i=overwritten;i<events.size();++i)
+    {
+        const TraceEvent &event = events.at(i);
+
+        out.append("{\"name\":\"").append(event.name).append("\",\"ph\":\"X\",\"pid\":1,\"tid\":")
+           .append(QByteArray::number(buffer->threadId)).append(",\"ts\":");
+        appendMicroseconds(out, event.startNs);
+        out.append(",\"dur\":");
+        appendMicroseconds(out, event.durationNs);
+
+        if(event.argName)
+            out.append(",\"args\":{\"").append(event.argName).append("\":").append(QByteArray::number(event.arg)).append('}');
+
+        out.append("},\n");
+    }
+}
+
+QByteArray Trace::chromeJson()
+{
+    QByteArray out("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    {
+        QMutexLocker locker(&s_buffersMutex); // no buffer changes hands while it is read
+
+        for(int i=0;i<s_buffers.size();++i)
+            appendBuffer(out, s_buffers.at(i));
+    }
+
+    if(out.endsWith(",\n"))
+        out.chop(2);
+
+    out.append("\n]}\n");
+    return out;
+}
+
+bool Trace::writeFile(const QString &path)
+{
+    QFile file(path);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    return file.write(chromeJson()) >= 0;
+}
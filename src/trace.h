@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+
+/* Spans of the pipeline stages for Chrome's about:tracing or Perfetto, to see
+ * what one slow frame spent its time on (QV_TRACE).
+ *
+ * Every thread records into a ring buffer of its own, the newest events
+ * overwrite the oldest, nothing is locked while recording. Threads show up by
+ * their QThread object name. A finished thread's buffer keeps its events
+ * until the next new thread takes it over. While tracing is off a span costs
+ * one atomic load. */
+class Trace
+{
+public:
+    static const int DEFAULT_EVENTS = 64 * 1024; // per thread
+
+    static void start(int eventsPerThread = DEFAULT_EVENTS); // once, before the spans of interest
+    static bool isEnabled() {return s_enabled.loadAcquire() != 0;}
+
+    static qint64 nowNs();
+    static void record(const char *name, qint64 startNs, qint64 endNs, const char *argName, qint64 arg);
+
+    // what the buffers hold, as Chrome trace event JSON
+    static QByteArray chromeJson();
+    static bool writeFile(const QString &path);
+
+private:
+    static QAtomicInt s_enabled;
+};
+
+// Records from construction to destruction, names are string literals
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const char *argName = Q_NULLPTR, qint64 arg = 0) :
+        m_name(name),
+        m_argName(argName),
+        m_arg(arg),
+        m_startNs(Trace::isEnabled() ? Trace::nowNs() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if(m_startNs >= 0)
+            Trace::record(m_name, m_startNs, Trace::nowNs(), m_argName, m_arg);
+    }
+
+    void setArg(qint64 arg){m_arg = arg;} // known only at the end, e.g. bytes
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *m_name;
+    const char *m_argName;
+    qint64      m_arg;
+    qint64      m_startNs;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,169 @@
+#include "viewer_session.h"
+#include "protocol.h"
+
+#include <QMutexLocker>
+
+ViewerSession::ViewerSession(int topProfile, int startProfile) :
+    m_skippedCount(0),
+    m_ladder(topProfile, startProfile),
+    m_congested(false)
+{
+
+}
+
+qint64 ViewerSession::clockMs()
+{
+    QElapsedTimer clock;
+    clock.start();
+    return clock.msecsSinceReference();
+}
+
+void ViewerSession::reset(int tileCount)
+{
+    m_acks.reset(tileCount);
+    m_sentHashes.fill(0, tileCount);
+    m_hashMismatches.fill(0, tileCount);
+    m_skipped.fill(false, tileCount);
+    m_skippedCount = 0;
+}
+
+void ViewerSession::tileSent(int tileNum, quint32 hash, quint32 frameSeq, qint64 nowMs, bool resend)
+{
+    if(tileNum < 0 || tileNum >= m_sentHashes.size())
+        return;
+
+    m_acks.tileSent(tileNum, frameSeq, nowMs, resend);
+    m_sentHashes[tileNum] = hash;
+    m_hashMismatches[tileNum] = 0;
+
+    if(m_skipped.at(tileNum))
+    {
+        m_skipped[tileNum] = false;
+        --m_skippedCount;
+    }
+}
+
+void ViewerSession::screenSent(quint32 hash)
+{
+    m_acks.clear();
+    m_sentHashes.fill(hash);
+    m_hashMismatches.fill(0);
+    m_skipped.fill(false);
+    m_skippedCount = 0;
+}
+
+void ViewerSession::tileSkipped(int tileNum)
+{
+    if(tileNum < 0 || tileNum >= m_skipped.size() || m_skipped.at(tileNum))
+        return;
+
+    m_skipped[tileNum] = true;
+    ++m_skippedCount;
+}
+
+/* Compare the viewer's tile hashes with what was sent to it. Tiles still awaiting
+ * an ack are skipped, a difference has to show in two reports in a row. */
+void ViewerSession::tileHashesReceived(int firstTile, const char *hashes, int count)
+{
+    if(firstTile + count > m_sentHashes.size())
+        return; // made for another tile grid
+
+    for(int i=0;i<count;++i)
+    {
+        int tileNum = firstTile + i;
+
+        if(m_acks.isPending(tileNum) || m_skipped.at(tileNum) || uint32FromData(hashes + i*4) == m_sentHashes.at(tileNum))
+            m_hashMismatches[tileNum] = 0;
+        else if(m_hashMismatches.at(tileNum) < 2)
+            ++m_hashMismatches[tileNum];
+    }
+}
+
+void ViewerSession::collectResends(qint64 nowMs, QVector<quint16> &tiles)
+{
+    tiles.resize(0);
+
+    if(m_congested)
+        return; // acks are late anyway, resends would only add to the queue
+
+    for(int i=0;i<m_sentHashes.size();++i)
+    {
+        if(m_acks.isOverdue(i, nowMs, ACK_TIMEOUT_MS) || m_hashMismatches.at(i) > 1 || m_skipped.at(i))
+            tiles.append(static_cast<quint16>(i));
+    }
+}
+
+void ViewerSession::collectResumeTiles(const QVector<quint32> &currentHashes, QVector<quint16> &tiles)
+{
+    tiles.resize(0);
+
+    for(int i=0;i<m_sentHashes.size() && i<currentHashes.size();++i)
+    {
+        if(m_acks.isPending(i) || m_skipped.at(i) || m_sentHashes.at(i) != currentHashes.at(i))
+            tiles.append(static_cast<quint16>(i));
+    }
+}
+
+qint64 ViewerSession::ackFrame(quint32 frameSeq, qint64 nowMs)
+{
+    m_acks.ackFrame(frameSeq, nowMs);
+    return m_bandwidth.frameAcked(frameSeq, nowMs);
+}
+
+void ViewerSession::frameSent(quint32 frameSeq, qint64 frameBytes, bool backlogged, qint64 nowMs)
+{
+    m_bandwidth.frameSent(frameSeq, frameBytes, backlogged, nowMs);
+}
+
+bool ViewerSession::updateCongestion(qint64 queuedBytes, qint64 frameBytes, qint64 nowMs)
+{
+    m_congested = m_congested ? queuedBytes > CONGESTION_LOW : queuedBytes > CONGESTION_HIGH;
+
+    return m_ladder.update(m_bandwidth, frameBytes, m_congested, nowMs);
+}
+
+
+ViewerSessionRegistry::ViewerSessionRegistry()
+{
+
+}
+
+void ViewerSessionRegistry::park(const QByteArray &token, const ViewerSession &session)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const qint64 nowMs = ViewerSession::clockMs();
+
+    // forget whatever expired meanwhile
+    QMap<QByteArray, ParkedSession>::iterator it = m_sessions.begin();
+
+    while(it != m_sessions.end())
+    {
+        if(it.value().deadlineMs < nowMs)
+            it = m_sessions.erase(it);
+        else ++it;
+    }
+
+    ParkedSession parked;
+    parked.session = session;
+    parked.deadlineMs = nowMs + RESUME_GRACE_MS;
+    m_sessions.insert(token, parked);
+}
+
+bool ViewerSessionRegistry::claim(const QByteArray &token, ViewerSession &session)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QMap<QByteArray, ParkedSession>::iterator it = m_sessions.find(token);
+
+    if(it == m_sessions.end())
+        return false;
+
+    bool valid = it.value().deadlineMs >= ViewerSession::clockMs();
+
+    if(valid)
+        session = it.value().session;
+
+    m_sessions.erase(it);
+    return valid;
+}
@@ -0,0 +1,106 @@
+#ifndef VIEWER_SESSION_H
+#define VIEWER_SESSION_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+
+#include "bandwidth_estimator.h"
+#include "quality_ladder.h"
+#include "stream_profile.h"
+#include "tile_ack_tracker.h"
+
+/* What one viewer holds and how its link is doing: the tile acks, the hash of
+ * every tile as sent to it, tile hash reports that disagreed, tiles skipped
+ * while the link was congested, what the link carries and the stream profile
+ * it is served with.
+ * WebSocketHandler keeps one per connection, encoded tiles come from the
+ * shared TileStore. */
+class ViewerSession
+{
+public:
+    // queued bytes of a viewer, over CONGESTION_HIGH tile updates are skipped
+    // until it drains below CONGESTION_LOW, then the latest images go out
+    static const qint64 CONGESTION_HIGH = 256 * 1024;
+    static const qint64 CONGESTION_LOW  = 32 * 1024;
+    static const qint64 ACK_TIMEOUT_MS  = 1000;     // unacknowledged tiles are resent once
+
+    explicit ViewerSession(int topProfile = STREAM_PROFILE_HIGH, int startProfile = STREAM_PROFILE_NORMAL);
+
+    // monotonic ms all of a session's times are on, the same in every handler
+    // since a parked session may be resumed by any of them
+    static qint64 clockMs();
+
+    void reset(int tileCount);
+    int tileCount() const {return m_sentHashes.size();}
+
+    int profile() const {return m_ladder.rung();}
+    void setProfile(int profile){m_ladder.setRung(profile);}
+    void setProfileRange(int top, int bottom){m_ladder.setRange(top, bottom);} // the profile moves into it
+
+    void tileSent(int tileNum, quint32 hash, quint32 frameSeq, qint64 nowMs, bool resend = false);
+    void screenSent(quint32 hash); // every tile, a full screen image is not acknowledged
+    void tileSkipped(int tileNum);
+
+    // ms the tile or the newest frame acknowledged took, -1 if the ack held nothing new
+    qint64 ackTile(int tileNum, qint64 nowMs){return m_acks.ackTile(tileNum, nowMs);}
+    qint64 ackFrame(quint32 frameSeq, qint64 nowMs);
+    void clearAcks(){m_acks.clear();}
+    void tileHashesReceived(int firstTile, const char *hashes, int count);
+
+    // tiles to send again from the store once the link is not congested: overdue
+    // acks, confirmed hash mismatches and tiles skipped meanwhile
+    void collectResends(qint64 nowMs, QVector<quint16> &tiles);
+    // after a resume, every tile the viewer may not hold
+    void collectResumeTiles(const QVector<quint32> &currentHashes, QVector<quint16> &tiles);
+
+    void frameSent(quint32 frameSeq, qint64 frameBytes, bool backlogged, qint64 nowMs);
+    void bytesDrained(qint64 bytes, bool backlogged, qint64 nowMs){m_bandwidth.bytesDrained(bytes, backlogged, nowMs);}
+
+    // after a frame of frameBytes was queued, true if the profile changed
+    bool updateCongestion(qint64 queuedBytes, qint64 frameBytes, qint64 nowMs);
+    bool isCongested() const {return m_congested;}
+    int skippedCount() const {return m_skippedCount;}
+
+    const TileAckTracker &acks() const {return m_acks;}
+    TileAckTracker &acks(){return m_acks;}
+    const BandwidthEstimator &bandwidth() const {return m_bandwidth;}
+    const QualityLadder &ladder() const {return m_ladder;}
+
+private:
+    TileAckTracker   m_acks;
+    QVector<quint32> m_sentHashes;
+    QVector<quint8>  m_hashMismatches;  // reports in a row the viewer disagreed, resent at 2
+    QVector<bool>    m_skipped;
+    int              m_skippedCount;
+
+    BandwidthEstimator m_bandwidth;
+    QualityLadder      m_ladder; // its rung is the profile
+    bool               m_congested;
+};
+
+/* Sessions of viewers whose link dropped, kept for RESUME_GRACE_MS under their
+ * resume token. Any of the host's proxy connections may get the viewer back,
+ * so the registry is shared by all of them. */
+class ViewerSessionRegistry
+{
+public:
+    ViewerSessionRegistry();
+
+    void park(const QByteArray &token, const ViewerSession &session);
+    bool claim(const QByteArray &token, ViewerSession &session); // removes it
+
+private:
+    struct ParkedSession
+    {
+        ViewerSession session;
+        qint64        deadlineMs;
+    };
+
+    QMutex                          m_mutex;
+    QMap<QByteArray, ParkedSession> m_sessions;
+};
+
+#endif // VIEWER_SESSION_H
@@ -1,6 +1,8 @@
 #include "ws_handler.h"
+#include "packet_builder.h"
+#include "protocol.h"
+#include "trace.h"
 
-#include <QCryptographicHash>
 #include <QDebug>
 #include <QUuid>
 #include <QJsonArray>
@@ -10,52 +12,88 @@
  *  But if you just want to reverse the array, I'd use std::reverse from the C++ algorithms library. – bnaecker May 9 '18 at 15:54
  */
 
-// Packet & Proxy Control
-static const QByteArray KEY_PKT_HEADR           = QString("1111").toUtf8(); // 8bit ASCI CODE 219 - https://theasciicode.com.ar/extended-ascii-code/block-graphic-character-ascii-code-219.html
-static const QByteArray KEY_REGISTER            = QString("REGO").toUtf8();
-
-// Actual Desktop Sharing
-static const QByteArray KEY_SET_NAME            = QString("STNM").toUtf8(); // i.e. 'DESKTOP-XYZ'
-static const QByteArray KEY_GET_IMAGE           = QString("GIMG").toUtf8();
-static const QByteArray KEY_IMAGE_PARAM         = QString("IMGP").toUtf8();
-static const QByteArray KEY_IMAGE_TILE          = QString("IMGT").toUtf8();
-static const QByteArray KEY_IMAGE_SCREEN        = QString("IMGS").toUtf8();
-static const QByteArray KEY_SET_KEY_STATE       = QString("SKST").toUtf8();
-static const QByteArray KEY_SET_CURSOR_POS      = QString("SCUP").toUtf8();
-static const QByteArray KEY_SET_CURSOR_DELTA    = QString("SCUD").toUtf8();
-static const QByteArray KEY_SET_MOUSE_KEY       = QString("SMKS").toUtf8();
-static const QByteArray KEY_SET_MOUSE_WHEEL     = QString("SMWH").toUtf8();
-static const QByteArray KEY_CHANGE_DISPLAY      = QString("CHDP").toUtf8();
-static const QByteArray KEY_REFRESH_DISPLAY     = QString("REFH").toUtf8();
-static const QByteArray KEY_TILE_RECEIVED       = QString("TLRD").toUtf8();
-
-// Authentication etc.
-static const QByteArray KEY_CONNECT_UUID                = QString("CTUU").toUtf8();
-static const QByteArray KEY_SET_NONCE                   = QString("STNC").toUtf8();
-static const QByteArray KEY_SET_AUTH_REQUEST            = QString("SARQ").toUtf8();
-static const QByteArray KEY_SET_AUTH_RESPONSE           = QString("SARP").toUtf8();
-
-static const QByteArray KEY_CONNECTED_PROXY_CLIENT      = QString("CNPC").toUtf8();
-static const QByteArray KEY_DISCONNECTED_PROXY_CLIENT   = QString("DNPC").toUtf8();
-
-const int CLIENT_VERSION    = 2;
 
 WebSocketHandler::WebSocketHandler(QObject *parent) : QObject(parent),
     m_webSocket(Q_NULLPTR),
+    m_isDirect(false),
     m_timerReconnect(Q_NULLPTR),
+    m_timerWaitResponse(Q_NULLPTR),
+    m_timerStats(Q_NULLPTR),
     m_client_isAuthenticated(false),
-    m_ws_stream(QByteArray())
+    m_tileStore(Q_NULLPTR),
+    m_isStreaming(false),
+    m_sessionRegistry(Q_NULLPTR),
+    m_inputQueue(Q_NULLPTR),
+    m_reconnectDelay(RECONNECT_DELAY_MIN),
+    m_packetPool(16 * 1024),
+    m_debugStats(qEnvironmentVariableIsSet("QV_DEBUG_STATS")),
+    m_metrics(Metrics::unshared()),
+    m_sentBytes(0),
+    m_recordDir(QString::fromLocal8Bit(qgetenv("QV_RECORD_DIR"))),
+    m_bytesInFlight(0),
+    m_capabilities(0),
+    m_protocolVersion(0),
+    m_codecs(HOST_CODECS),
+    m_quality(0),
+    m_frameInterval(0),
+    m_captureInterval(0),
+    m_rectSize(0),
+    m_lastFrameMs(0),
+    m_batchPool(BATCH_SIZE_DEFAULT + 16 * 1024),
+    m_batchBytes(0),
+    m_batchSize(BATCH_SIZE_DEFAULT),
+    m_batchFrameSeq(0),
+    m_frameBytes(0)
 {
+    if(qEnvironmentVariableIsSet("QV_BATCH_SIZE"))
+        setBatchSize(qEnvironmentVariableIntValue("QV_BATCH_SIZE"));
 
+    m_clock.start();
+}
+
+WebSocketHandler::~WebSocketHandler()
+{
+    if(m_inputQueue)
+        m_inputQueue->close();
 }
 
 void WebSocketHandler::createSocket()
 {
+    if(m_isDirect)
+    {
+        connectSocket(); // already open, the viewer speaks first
+        startRecording();
+        return;
+    }
+
     if(m_webSocket)
         return;
 
     m_webSocket = new QWebSocket("",QWebSocketProtocol::VersionLatest,  this);
+    connectSocket();
+
+    if(!m_timerReconnect) {
+        m_timerReconnect = new QTimer(this);
+        connect(m_timerReconnect, &QTimer::timeout, this, &WebSocketHandler::timerReconnectTick);
+    }
+
+    // qDebug()<<"WebSocketHandler::createSocket: "<< m_url;
+
+    m_webSocket->open(QUrl(m_url)); // open socket @ url
 
+} // create socket
+
+/* A viewer that connected straight to the host. Nothing to register or to
+ * reconnect to, the handler finishes when the viewer leaves. */
+void WebSocketHandler::setSocket(QWebSocket *socket)
+{
+    m_webSocket = socket;
+    m_webSocket->setParent(this); // moves to the handler's thread with it
+    m_isDirect = true;
+}
+
+void WebSocketHandler::connectSocket()
+{
     // Socket State
     connect(m_webSocket, &QWebSocket::stateChanged,          this, &WebSocketHandler::WSocketStateChanged);
 
@@ -69,26 +107,22 @@ void WebSocketHandler::createSocket()
     connect(m_webSocket, &QWebSocket::textMessageReceived,  this, &WebSocketHandler::textMessageReceived);
     connect(m_webSocket, &QWebSocket::binaryMessageReceived,this, &WebSocketHandler::binaryMessageReceived);
 
-    if(!m_timerReconnect) {
-        m_timerReconnect = new QTimer(this);
-        connect(m_timerReconnect, &QTimer::timeout, this, &WebSocketHandler::timerReconnectTick);
-    }
-
-    // qDebug()<<"WebSocketHandler::createSocket: "<< m_url;
-
-    m_webSocket->open(QUrl(m_url)); // open socket @ url
-
-} // create socket
+    // socket drained, feed it from the send queues
+    connect(m_webSocket, &QWebSocket::bytesWritten,         this, &WebSocketHandler::socketBytesWritten);
+}
 
 
 void WebSocketHandler::WSocketConnected()
 {
+    m_reconnectDelay = RECONNECT_DELAY_MIN;
+    startRecording();
+
     // qDebug()<<"WebSocketHandler::WSocketConnected - Sending Registration Request";
 
     // Send proxy hello and registration request -> largely pointless
     QByteArray data;
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_REGISTER);
+    appendFourCC(data, KEY_PKT_HEADR);
+    appendFourCC(data, KEY_REGISTER);
     data.append("|");
     data.append(m_login.toUtf8());
     data.append("|");
@@ -98,6 +132,27 @@ void WebSocketHandler::WSocketConnected()
 
 }
 
+// one file per socket session, from before the first message
+void WebSocketHandler::startRecording()
+{
+    if(m_recordDir.isEmpty())
+        return;
+
+    if(m_recorder.open(SessionRecorder::nextPath(m_recordDir)))
+        qDebug() << "WebSocketHandler - recording the session to" << m_recorder.fileName();
+}
+
+void WebSocketHandler::stopRecording()
+{
+    if(!m_recorder.isOpen())
+        return;
+
+    if(m_debugStats)
+        qDebug() << "WebSocketHandler - recorded" << m_recorder.recordCount() << "messages," << m_recorder.size() / 1024 << "KB to" << m_recorder.fileName();
+
+    m_recorder.close();
+}
+
 QWebSocket *WebSocketHandler::getSocket()
 {
     return m_webSocket;
@@ -179,14 +234,11 @@ void WebSocketHandler::sendLoginNonce()
     m_uuid  = QUuid::createUuid().toRfc4122();
     m_nonce = QUuid::createUuid().toRfc4122();
 
-    QByteArray data;
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_SET_NONCE);
+    packet.append(m_nonce);
 
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_SET_NONCE);
-    data.append(arrayFromUint32(static_cast<quint32>(m_nonce.size()))); // packet size
-    data.append(m_nonce);
-
-    sendBinaryMessage(data);
+    sendBinaryMessage(packet.finish());
 }
 
 
@@ -197,68 +249,537 @@ void WebSocketHandler::sendImageParameters(const QSize &imageSize, int rectWidth
     if(!m_client_isAuthenticated)
         return;
 
-    QByteArray data;
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_IMAGE_PARAM);
-    data.append(arrayFromUint32(sizeof(quint32)*3)); //payload size
-    data.append(arrayFromUint32(static_cast<quint32>(imageSize.width())));
-    data.append(arrayFromUint32(static_cast<quint32>(imageSize.height())));
-    data.append(arrayFromUint32(static_cast<quint32>(rectWidth)));
+    // a new tile grid, nothing the viewer held counts any more
+    int columnCount = (imageSize.width() + rectWidth - 1) / rectWidth;
+    int rowCount = (imageSize.height() + rectWidth - 1) / rectWidth;
+    m_session.reset(columnCount * rowCount);
+
+    bool rectChanged = rectWidth != m_rectSize;
+    m_rectSize = rectWidth;
+
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_IMAGE_PARAM);
+    packet.appendUint32(static_cast<quint32>(imageSize.width()));
+    packet.appendUint32(static_cast<quint32>(imageSize.height()));
+    packet.appendUint32(static_cast<quint32>(rectWidth));
 
     // qDebug()<<"WebSocketHandler::sendImageParameters - screen width: " <<imageSize.width();
     // qDebug()<<"WebSocketHandler::sendImageParameters - screen height: " <<imageSize.height();
 
 
-    sendBinaryMessage(data);
+    sendBinaryMessage(packet.finish());
+
+    if(rectChanged && (m_capabilities & CAP_STREAM_PARAMS))
+        sendStreamParams();
 }
 
-void WebSocketHandler::sendImageTile(quint16 posX, quint16 posY, const QByteArray &imageData, quint16 tileNum)
+/* The tile packet is complete, ScreenCapture encoded it behind a reserved header
+ * and shares it with every viewer on the profile. A congested viewer skips it
+ * and gets the latest image of the tile from the store once its link drained. */
+void WebSocketHandler::sendImageTile(quint16 tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq, int profile)
 {
-    if(!m_client_isAuthenticated)
+    if(!m_isStreaming || profile != m_session.profile())
         return;
 
-    QByteArray data;
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_IMAGE_TILE);
-    data.append(arrayFromUint32(static_cast<quint32>(imageData.size() + sizeof(quint32)*3))); // payload size
-    data.append(arrayFromUint32(static_cast<quint32>(posX)));
-    data.append(arrayFromUint32(static_cast<quint32>(posY)));
-    data.append(arrayFromUint32(static_cast<quint32>(tileNum)));
-    data.append(imageData);
+    if(m_session.isCongested() || isPaced(ViewerSession::clockMs()))
+    {
+        m_session.tileSkipped(tileNum);
+        return;
+    }
 
-    sendBinaryMessage(data);
+    queueImageTile(tileNum, packet, hash, frameSeq, false);
+}
+
+/* A viewer that supports batches gets the tile with the rest of the frame */
+void WebSocketHandler::queueImageTile(quint16 tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq, bool resend)
+{
+    m_session.tileSent(tileNum, hash, frameSeq, ViewerSession::clockMs(), resend);
+    m_frameBytes += packet.size();
+
+    if(!(m_capabilities & CAP_IMAGE_BATCH))
+    {
+        sendBinaryMessage(packet, SendScheduler::Tile);
+        return;
+    }
+
+    int size = packet.size() - PREAMBLE_SIZE;
+
+    // split, the rest of the frame follows in the next part
+    if(!m_batchTiles.isEmpty() && m_batchBytes + size > m_batchSize)
+        sendImageBatch(false);
+
+    m_batchFrameSeq = frameSeq;
+    m_batchTiles.append(packet);
+    m_batchBytes += size;
     // qDebug()<<"WebSocketHandler::sendImageTile";
 }
 
-void WebSocketHandler::sendImageScreen(const QByteArray &imageData)
+void WebSocketHandler::flushImageBatch(quint32 frameSeq, qint64 captureMs)
 {
-    if(!m_client_isAuthenticated)
+    if(!m_isStreaming)
+    {
+        clearImageBatch();
         return;
+    }
 
-    QByteArray data;
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_IMAGE_SCREEN);
-    data.append(arrayFromUint32(static_cast<quint32>(imageData.size()))); // UINT 32!!!!!!!!!
-    data.append(imageData);
+    qint64 nowMs = ViewerSession::clockMs();
 
-    sendBinaryMessage(data);
+    if(isPaced(nowMs))
+        return; // its tiles were skipped, they go out with the next frame it gets
+
+    m_lastFrameMs = nowMs;
+
+    int profile = m_session.profile();
+    qint64 queuedBytes = m_sendScheduler.queuedBytes() + m_bytesInFlight;
+    m_metrics->sendQueueBytes.add(static_cast<quint64>(queuedBytes));
+    bool backlogged = m_sendScheduler.queuedBytes() > 0; // earlier packets still wait for the window
+
+    // the viewer's own backlog decides whether it skips tiles, its link's estimate which profile it gets
+    if(m_session.updateCongestion(queuedBytes, m_frameBytes, nowMs))
+        switchProfile(profile);
+    else sendResends(frameSeq, nowMs);
+
+    const bool batched = !m_batchTiles.isEmpty();
+
+    if(batched)
+    {
+        m_batchFrameSeq = frameSeq;
+        sendImageBatch(true);
+    }
+
+    if(m_frameBytes > 0)
+    {
+        m_session.frameSent(frameSeq, m_frameBytes, backlogged, nowMs);
+        sendInputEcho(frameSeq, captureMs, batched);
+    }
+
+    m_frameBytes = 0;
+
+    if(m_debugStats && m_session.acks().latency().count() >= 100)
+    {
+        qDebug()<<"WebSocketHandler::flushImageBatch - tile ack latency (ms)"<<m_session.acks().latency().summary()
+                <<"awaiting ack:"<<m_session.acks().pendingCount()<<"skipped:"<<m_session.skippedCount()
+                <<"profile:"<<STREAM_PROFILES[m_session.profile()].name
+                <<"bandwidth (KB/s):"<<m_session.bandwidth().estimate() / 1024
+                <<(m_session.bandwidth().isSaturated() ? "measured" : "at least")
+                <<"demand (KB/s):"<<m_session.ladder().demand() / 1024
+                <<"rtt (ms):"<<m_session.bandwidth().smoothedRttMs()<<"min"<<m_session.bandwidth().minRttMs();
+        m_session.acks().clearLatency();
+    }
+}
+
+/* The frame went out with tiles, if it is the first one captured since the
+ * latency probe was injected the viewer learns which frame to time. */
+void WebSocketHandler::sendInputEcho(quint32 frameSeq, qint64 captureMs, bool batched)
+{
+    if(!(m_capabilities & CAP_INPUT_ECHO))
+        return;
+
+    if(m_inputLatency.awaitsInjection() && m_inputQueue)
+    {
+        qint64 injectedMs = m_inputQueue->takeProbeInjected();
+        if(injectedMs > 0)
+            m_inputLatency.injected(injectedMs);
+    }
+
+    quint32 eventMs = 0;
+    if(!m_inputLatency.frameSent(captureMs, inputClockMs(), batched, eventMs))
+        return;
+
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_INPUT_ECHO);
+    packet.appendUint32(eventMs);
+    packet.appendUint32(frameSeq);
+
+    sendBinaryMessage(packet.finish());
+}
+
+/* Overdue, mismatched and skipped tiles, from the store. A tile only the full
+ * screen image holds means the viewer gets everything again. */
+void WebSocketHandler::sendResends(quint32 frameSeq, qint64 nowMs)
+{
+    if(!m_tileStore)
+        return;
+
+    m_session.collectResends(nowMs, m_resendTiles);
+
+    for(int i=0;i<m_resendTiles.size();++i)
+    {
+        quint16 tileNum = m_resendTiles.at(i);
+        QByteArray packet;
+        quint32 hash = 0;
+
+        if(!m_tileStore->tile(m_session.profile(), tileNum, packet, hash))
+        {
+            TileStore::Snapshot snapshot;
+            if(m_tileStore->snapshot(m_session.profile(), snapshot))
+                sendSnapshot(snapshot);
+            return;
+        }
+
+        // resent once, only its own ack counts
+        queueImageTile(tileNum, packet, hash, frameSeq, m_session.acks().isPending(tileNum));
+    }
+}
+
+/* Join the stream of the viewer's profile. If the tile store holds a full image of
+ * it (another viewer is watching) the viewer starts from there, otherwise
+ * ScreenCapture sends one. */
+void WebSocketHandler::startStreaming()
+{
+    stopStreaming();
+
+    // LAN viewers start on the top rung, proxied ones in the middle and work their way up
+    if(m_isDirect)
+        m_session = ViewerSession(STREAM_PROFILE_LAN, STREAM_PROFILE_LAN);
+    else m_session = ViewerSession(STREAM_PROFILE_HIGH, STREAM_PROFILE_NORMAL);
+    m_frameBytes = 0;
+
+    applyProfileRange();
+    m_isStreaming = true;
+
+    TileStore::Snapshot snapshot;
+
+    if(m_tileStore && m_tileStore->addViewer(m_session.profile(), snapshot))
+    {
+        sendSnapshot(snapshot);
+        emit resumeDesktop();
+        return;
+    }
+
+    // the capture may be running for others already, then the full image comes with its next frame
+    if(snapshot.rectSize > 0)
+        sendImageParameters(snapshot.screenSize, snapshot.rectSize);
+
+    emit getDesktop();
+}
+
+void WebSocketHandler::stopStreaming()
+{
+    if(!m_isStreaming)
+        return;
+
+    m_isStreaming = false;
+
+    if(m_tileStore)
+        m_tileStore->removeViewer(m_session.profile());
+
+    clearImageBatch();
+}
+
+void WebSocketHandler::switchProfile(int oldProfile)
+{
+    // qDebug()<<"WebSocketHandler::switchProfile"<<STREAM_PROFILES[m_session.profile()].name;
+
+    clearImageBatch(); // tiles of the old profile
+
+    if(!m_tileStore)
+        return;
+
+    m_tileStore->removeViewer(oldProfile);
+
+    TileStore::Snapshot snapshot;
+
+    if(m_tileStore->addViewer(m_session.profile(), snapshot))
+        sendSnapshot(snapshot);
+    // else ScreenCapture encodes a full image of the new profile next frame
+}
+
+/* Everything the store holds: the screen image and the tiles changed since */
+void WebSocketHandler::sendSnapshot(const TileStore::Snapshot &snapshot)
+{
+    clearImageBatch();
+
+    sendImageParameters(snapshot.screenSize, snapshot.rectSize);
+
+    m_session.screenSent(snapshot.screenHash);
+    m_frameBytes += snapshot.screen.size();
+    sendBinaryMessage(snapshot.screen, SendScheduler::Tile);
+
+    for(int i=0;i<snapshot.tiles.size();++i)
+    {
+        if(!snapshot.tiles.at(i).isEmpty())
+            queueImageTile(static_cast<quint16>(i), snapshot.tiles.at(i), snapshot.hashes.at(i), snapshot.frameSeq, false);
+    }
+
+    if(!m_batchTiles.isEmpty())
+    {
+        m_batchFrameSeq = snapshot.frameSeq;
+        sendImageBatch(true);
+    }
+}
+
+void WebSocketHandler::setBatchSize(int bytes)
+{
+    m_batchSize = qBound(BATCH_SIZE_MIN, bytes, BATCH_SIZE_MAX);
+}
+
+void WebSocketHandler::sendImageBatch(bool finalPart)
+{
+    TraceSpan span("build batch", "tiles", m_batchTiles.size());
+
+    PacketBuilder packet(m_batchPool.acquire());
+    packet.begin(KEY_IMAGE_BATCH);
+    packet.appendUint32(m_batchFrameSeq);
+    packet.appendUint16(static_cast<quint16>(m_batchTiles.size()));
+    packet.appendUint16(finalPart ? BATCH_FLAG_FINAL : quint16(0));
+
+    for(int i=0;i<m_batchTiles.size();++i)
+    {
+        const QByteArray &tile = m_batchTiles.at(i);
+        packet.append(tile.constData() + PREAMBLE_SIZE, tile.size() - PREAMBLE_SIZE); // without KEY_PKT_HEADR
+    }
+
+    if(m_debugStats)
+        qDebug()<<"WebSocketHandler::sendImageBatch - frame:"<<m_batchFrameSeq<<"tiles:"<<m_batchTiles.size()
+                <<"bytes:"<<packet.payloadSize()<<(finalPart ? "final" : "split");
+
+    sendBinaryMessage(packet.finish(), SendScheduler::Tile);
+    clearImageBatch();
+}
+
+void WebSocketHandler::clearImageBatch()
+{
+    m_batchTiles.resize(0); // hands the tile buffers back to ScreenCapture's pool
+    m_batchBytes = 0;
+}
+
+void WebSocketHandler::sendImageScreen(const QByteArray &packet, quint32 hash, int profile)
+{
+    if(!m_isStreaming || profile != m_session.profile())
+        return;
+
+    clearImageBatch();
+
+    if(m_session.isCongested() || isPaced(ViewerSession::clockMs()))
+    {
+        // every tile is behind now, the store has them once the link drained
+        for(int i=0;i<m_session.tileCount();++i)
+            m_session.tileSkipped(i);
+        return;
+    }
+
+    m_session.screenSent(hash);
+    m_frameBytes += packet.size();
+    sendBinaryMessage(packet, SendScheduler::Tile);
     // qDebug()<<"WebSocketHandler::sendImageScreen";
      // qDebug()<<"WebSocketHandler::sendImageScreen - payload size: " << (quint32)imageData.size() << " bytes.";
 }
 
+/* Totals of the host and of this viewer's link, the viewer takes the differences */
+void WebSocketHandler::sendHostStats()
+{
+    quint32 stats[STAT_COUNT];
+    stats[STAT_FRAMES]          = static_cast<quint32>(m_metrics->frames.value());
+    stats[STAT_FULL_FRAMES]     = static_cast<quint32>(m_metrics->fullFrames.value());
+    stats[STAT_TILES]           = static_cast<quint32>(m_metrics->tiles.value());
+    stats[STAT_DIRTY_TILES]     = static_cast<quint32>(m_metrics->dirtyTiles.value());
+    stats[STAT_CAPTURE_US]      = static_cast<quint32>(m_metrics->captureUs.sum());
+    stats[STAT_DIFF_US]         = static_cast<quint32>(m_metrics->diffUs.sum());
+    stats[STAT_ENCODE_US]       = static_cast<quint32>(m_metrics->encodeTileUs.sum());
+    stats[STAT_ENCODED_IMAGES]  = static_cast<quint32>(m_metrics->encodeTileUs.count());
+    stats[STAT_SENT_BYTES]      = static_cast<quint32>(m_sentBytes);
+    stats[STAT_QUEUED_BYTES]    = static_cast<quint32>(m_sendScheduler.queuedBytes() + m_bytesInFlight);
+    stats[STAT_RTT_MS]          = static_cast<quint32>(qMax<qint64>(m_session.bandwidth().smoothedRttMs(), 0));
+    stats[STAT_RECONNECTS]      = static_cast<quint32>(m_metrics->reconnects.value());
+
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_HOST_STATS);
+    packet.appendUint16(STAT_COUNT);
+    packet.appendUint16(0);
+
+    for(int i=0;i<STAT_COUNT;++i)
+        packet.appendUint32(stats[i]);
+
+    sendBinaryMessage(packet.finish());
+}
+
+void WebSocketHandler::sendCapabilities()
+{
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_CAPABILITIES);
+    packet.appendUint32(m_capabilities);
+
+    if(m_protocolVersion > 0)
+    {
+        packet.appendUint16(m_protocolVersion);
+        packet.appendUint16(HOST_CODECS);
+    }
+
+    sendBinaryMessage(packet.finish());
+}
+
+/* Requests of 0 leave a parameter as it is, the rest is bounded to what the
+ * host supports. The answer holds what applies now. */
+void WebSocketHandler::setStreamParams(int intervalMs, int rectSize, quint16 codecs, int quality)
+{
+    // qDebug()<<"WebSocketHandler::setStreamParams"<<intervalMs<<rectSize<<codecs<<quality;
+
+    if(intervalMs > 0)
+    {
+        m_frameInterval = qBound(STREAM_INTERVAL_MIN, intervalMs, STREAM_INTERVAL_MAX);
+        emit frameIntervalRequested(this, m_frameInterval);
+    }
+
+    if(rectSize > 0)
+    {
+        rectSize = qBound(STREAM_RECT_SIZE_MIN, rectSize, STREAM_RECT_SIZE_MAX);
+
+        if(rectSize != m_rectSize)
+            emit rectSizeRequested(rectSize); // IMGP follows with the next frame
+    }
+
+    if(codecs & HOST_CODECS)
+        m_codecs = codecs & HOST_CODECS;
+
+    if(quality > 0)
+        m_quality = qMin(quality, 100);
+
+    applyProfileRange();
+    sendStreamParams();
+}
+
+void WebSocketHandler::sendStreamParams()
+{
+    int top = m_session.ladder().topRung();
+
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_STREAM_PARAMS);
+    packet.appendUint16(static_cast<quint16>(qMax(m_frameInterval, m_captureInterval)));
+    packet.appendUint16(static_cast<quint16>(m_rectSize));
+    packet.appendUint16(m_codecs);
+    packet.appendUint16(static_cast<quint16>(STREAM_PROFILES[top].tileQuality));
+
+    sendBinaryMessage(packet.finish());
+}
+
+void WebSocketHandler::setCaptureInterval(int msec)
+{
+    m_captureInterval = msec;
+
+    if(m_capabilities & CAP_STREAM_PARAMS)
+        sendStreamParams();
+}
+
+/* The profiles the viewer's codecs and quality cap leave it, a switch if its
+ * current one is not among them any more */
+void WebSocketHandler::applyProfileRange()
+{
+    int top = 0;
+    int bottom = 0;
+
+    if(!streamProfileRange(m_isDirect ? STREAM_PROFILE_LAN : STREAM_PROFILE_HIGH, m_codecs, m_quality, top, bottom))
+        return;
+
+    int oldProfile = m_session.profile();
+    m_session.setProfileRange(top, bottom);
+
+    if(m_isStreaming && m_session.profile() != oldProfile)
+        switchProfile(oldProfile);
+}
+
+bool WebSocketHandler::isPaced(qint64 nowMs)
+{
+    // half a capture interval early is closer than a whole one late
+    return m_frameInterval > m_captureInterval && nowMs - m_lastFrameMs < m_frameInterval - m_captureInterval / 2;
+}
+
+void WebSocketHandler::sendResumeToken()
+{
+    if(m_resumeToken.isEmpty())
+        return;
+
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_RESUME_TOKEN);
+    packet.append(m_resumeToken);
+
+    sendBinaryMessage(packet.finish());
+}
+
+/* The session may have been parked by any of the host's connections, the proxy
+ * pairs a returning viewer with whichever one is free */
+void WebSocketHandler::resumeSession(const QByteArray &token)
+{
+    ViewerSession session;
+
+    bool resumed = (m_capabilities & CAP_RESUME) &&
+                   token.size() == RESUME_TOKEN_SIZE &&
+                   m_sessionRegistry && m_tileStore &&
+                   m_sessionRegistry->claim(token, session);
+
+    // qDebug()<<"WebSocketHandler::resumeSession"<<resumed;
+
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_RESUME);
+    packet.appendUint32(resumed ? 1 : 0);
+    sendBinaryMessage(packet.finish());
+
+    if(!resumed)
+        return; // the viewer starts over with GIMG
+
+    m_metrics->resumes.add();
+    stopStreaming();
+
+    m_resumeToken = token;
+    m_session = session;
+    applyProfileRange(); // the viewer may have come back with other codecs
+    m_isStreaming = true;
+
+    sendName(m_name);
+
+    TileStore::Snapshot snapshot;
+
+    if(!m_tileStore->addViewer(m_session.profile(), snapshot))
+    {
+        if(snapshot.rectSize > 0)
+            sendImageParameters(snapshot.screenSize, snapshot.rectSize);
+
+        emit getDesktop(); // nothing to resume from, a full image comes
+        return;
+    }
+
+    if(snapshot.tiles.size() != m_session.tileCount())
+    {
+        sendSnapshot(snapshot); // the tile grid changed meanwhile
+        emit resumeDesktop();
+        return;
+    }
+
+    // only what changed meanwhile or was never acknowledged
+    m_session.collectResumeTiles(snapshot.hashes, m_resendTiles);
+
+    for(int i=0;i<m_resendTiles.size();++i)
+    {
+        quint16 tileNum = m_resendTiles.at(i);
+
+        if(snapshot.tiles.at(tileNum).isEmpty())
+        {
+            sendSnapshot(snapshot); // only the full screen image has it
+            break;
+        }
+
+        queueImageTile(tileNum, snapshot.tiles.at(tileNum), snapshot.hashes.at(tileNum), snapshot.frameSeq, false);
+    }
+
+    if(!m_batchTiles.isEmpty())
+    {
+        m_batchFrameSeq = snapshot.frameSeq;
+        sendImageBatch(true);
+    }
+
+    emit resumeDesktop();
+}
+
 void WebSocketHandler::sendName(const QString &name)
 {
     if(!m_client_isAuthenticated)
         return;
 
-    QByteArray nameArray = name.toUtf8();
-    QByteArray data;
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_SET_NAME);
-    data.append(arrayFromUint32(static_cast<quint32>(nameArray.size()))); // payload size
-    data.append(nameArray);
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_SET_NAME);
+    packet.append(name.toUtf8());
 
-    sendBinaryMessage(data);
+    sendBinaryMessage(packet.finish());
 }
 
 /*
@@ -298,163 +819,338 @@ void WebSocketHandler::proxyHandlerDisconnected(const QByteArray &uuid)
 }
 */
 
-void WebSocketHandler::newData(const QByteArray &command, const QByteArray &data)
+void WebSocketHandler::newData(quint32 command, const char *data, int size)
 {
     #ifdef QT_DEBUG_1
-        qDebug()<<"DataParser::newData"<<command<<data;
+        qDebug()<<"DataParser::newData"<<commandName(command)<<QByteArray(data, size);
     #endif
 
+    m_metrics->receivedBytes[Metrics::packetType(command)].add(static_cast<quint64>(size) + 8); // with command and size
+
     if(!m_client_isAuthenticated)
     {
-        if(command == KEY_REGISTER) // register request response from server
+        switch(command)
         {
-            if (m_login == QString(data))
+            case KEY_REGISTER: // register request response from server
             {
-                // qDebug() << "Proxy server has acknowledged our ID.";
-                emit connectedStatus(true);
+                if (m_login == QString::fromUtf8(data, size))
+                {
+                    // qDebug() << "Proxy server has acknowledged our ID.";
+                    emit connectedStatus(true);
+                }
+                break;
             }
-        }
-        else if(command == KEY_CONNECT_UUID) // we have an incoming request from a web client via. proxy server
-        {
-            // qDebug() << "Remote ID connecting: " << QString(data);
-            m_client_uuid = data; //QString(data).left(36); // UUID is 36 chars: Remote ID connecting:  "7f0d63be-03bd-4894-9b48-069f2e93ae2d"
-            sendLoginNonce(); // Send and then see what happens next
-        }
-        else if(command == KEY_SET_AUTH_REQUEST)
-        {
-            if(data.toBase64() == getHashSum(m_nonce, m_login, m_pass))
+            case KEY_CONNECT_UUID: // we have an incoming request from a web client via. proxy server
             {
-                if(!m_client_isAuthenticated)
+                // qDebug() << "Remote ID connecting: " << QString(data);
+                m_client_uuid = QByteArray(data, size); // UUID is 36 chars: Remote ID connecting:  "7f0d63be-03bd-4894-9b48-069f2e93ae2d"
+                sendLoginNonce(); // Send and then see what happens next
+                break;
+            }
+            case KEY_SET_AUTH_REQUEST:
+            {
+                if(QByteArray::fromRawData(data, size).toBase64() == getHashSum(m_nonce, m_login, m_pass))
                 {
-                    m_client_isAuthenticated = true;
+                    if(!m_client_isAuthenticated)
+                    {
+                        m_client_isAuthenticated = true;
+                    }
+                        // qDebug() << "Remote Client is authenticted!";
+                        emit connectedProxyClient(m_client_uuid);
+
+                } else {
+                    m_client_isAuthenticated = false;
                 }
-                    // qDebug() << "Remote Client is authenticted!";
-                    emit connectedProxyClient(m_client_uuid);
 
-            } else {
-                m_client_isAuthenticated = false;
+                sendAuthenticationResponse(m_client_isAuthenticated);
+                // qDebug()<<"Authentication attempt: "<<m_client_isAuthenticated;
+                break;
+            }
+            default:
+            {
+                // qDebug() << "Unknown command.";
+                debugHexData(QByteArray::fromRawData(data, size));
+                break;
             }
+        }
 
-            // qDebug()<<"data.toBase64: "<< data.toBase64();
-            // qDebug()<<"getHash: "<< getHashSum(m_nonce, m_login, m_pass);
+        return;
 
-            sendAuthenticationResponse(m_client_isAuthenticated);
-            // qDebug()<<"Authentication attempt: "<<m_client_isAuthenticated;
+    } // end is Not Authenticated code
 
-            return;
+    switch(command)
+    {
+        case KEY_IMAGE_TILE:
+        case KEY_IMAGE_SCREEN:
+        case KEY_IMAGE_BATCH:
+            break;
+
+        case KEY_CAPABILITIES:
+        {
+            CapabilitiesPayload payload;
+            if(payload.decode(data, size))
+            {
+                m_capabilities = payload.flags & HOST_CAPABILITIES;
+                m_protocolVersion = qMin(payload.version, PROTOCOL_VERSION);
+
+                if(m_protocolVersion < 1)
+                    m_capabilities &= ~CAP_STREAM_PARAMS;
+
+                // the echo names an input event of a batch and the frame sequence of a batch
+                if((m_capabilities & (CAP_INPUT_BATCH | CAP_IMAGE_BATCH)) != (CAP_INPUT_BATCH | CAP_IMAGE_BATCH))
+                    m_capabilities &= ~CAP_INPUT_ECHO;
+
+                if(payload.codecs & HOST_CODECS)
+                    m_codecs = payload.codecs & HOST_CODECS;
+
+                m_sendScheduler.setFragmentSize((m_capabilities & CAP_FRAGMENT) ? FRAGMENT_SIZE_DEFAULT : 0);
+                applyProfileRange();
+                sendCapabilities();
+
+                if(m_capabilities & CAP_HOST_STATS)
+                {
+                    if(!m_timerStats)
+                    {
+                        m_timerStats = new QTimer(this);
+                        connect(m_timerStats, &QTimer::timeout, this, &WebSocketHandler::sendHostStats);
+                    }
+
+                    m_timerStats->start(STATS_INTERVAL_MS);
+                }
+                else if(m_timerStats)
+                    m_timerStats->stop();
+            }
+            break;
         }
-        else
+        case KEY_STREAM_PARAMS:
         {
-            // qDebug() << "Unknown command.";
-            debugHexData(data);
+            StreamParamsPayload payload;
+            if((m_capabilities & CAP_STREAM_PARAMS) && payload.decode(data, size))
+                setStreamParams(payload.intervalMs, payload.rectSize, payload.codecs, payload.quality);
+            break;
         }
+        case KEY_GET_IMAGE:
+        {
+            // a new session, whatever an earlier viewer held is gone
+            if(m_capabilities & CAP_RESUME)
+                m_resumeToken = QUuid::createUuid().toRfc4122();
+            else m_resumeToken.clear();
 
-        return;
+            sendResumeToken();
 
-    } // end is Not Authenticated code
+            sendName(m_name);
+            startStreaming();
+            break;
+        }
+        case KEY_RESUME:
+        {
+            resumeSession(QByteArray::fromRawData(data, size));
+            break;
+        }
+        case KEY_TILE_RECEIVED:
+        {
+            TileReceivedPayload payload;
+            if(!payload.decode(data, size))
+                break;
 
-    if(command == KEY_IMAGE_TILE)
-    {
-        return;
-    }
-    else if(command == KEY_IMAGE_SCREEN)
-    {
-        return;
-    }
-    else if(command == KEY_GET_IMAGE)
-    {
-        sendName(m_name);
-        emit getDesktop();
-    }
-    else if(command == KEY_TILE_RECEIVED)
-    {
-        quint16 tileNum = uint16FromArray(data.mid(0,2));
-        emit receivedTileNum(tileNum);
-    }
-    else if(command == KEY_CHANGE_DISPLAY)
-    {
-        emit changeDisplayNum();
-    }
-    else if(command == KEY_REFRESH_DISPLAY)
-    {
-        emit refreshDisplay();
-    }
-    else if(command == KEY_SET_CURSOR_POS)
-    {
-        if(data.size() >= 4)
+            TraceSpan span("ack tile", "tile", payload.tileNum);
+
+            if(payload.tileNum == 9999) // the viewer drew a full screen image, see displayField.js
+            {
+                m_session.clearAcks();
+                break;
+            }
+
+            const qint64 rttMs = m_session.ackTile(payload.tileNum, ViewerSession::clockMs());
+            if(rttMs >= 0)
+                m_metrics->ackRttMs.add(static_cast<quint64>(rttMs));
+            break;
+        }
+        case KEY_FRAME_RECEIVED:
         {
-            quint16 posX = uint16FromArray(data.mid(0,2));
-            quint16 posY = uint16FromArray(data.mid(2,2));
-            emit setMouseMove(posX, posY);
+            FrameReceivedPayload payload;
+            if(!payload.decode(data, size))
+                break;
+
+            TraceSpan span("ack frame", "frame", payload.frameSeq);
+
+            const qint64 rttMs = m_session.ackFrame(payload.frameSeq, ViewerSession::clockMs());
+            if(rttMs >= 0)
+                m_metrics->ackRttMs.add(static_cast<quint64>(rttMs));
+            break;
         }
-    }
-    else if(command == KEY_SET_CURSOR_DELTA)
-    {
-        if(data.size() >= 4)
+        case KEY_TILE_HASHES:
         {
-            qint16 deltaX = static_cast<qint16>(uint16FromArray(data.mid(0,2)));
-            qint16 deltaY = static_cast<qint16>(uint16FromArray(data.mid(2,2)));
-            emit setMouseDelta(deltaX, deltaY);
+            TileHashesPayload payload;
+            if(payload.decode(data, size))
+                m_session.tileHashesReceived(payload.firstTile, payload.hashes, payload.count);
+            break;
         }
-    }
-    else if(command == KEY_SET_KEY_STATE)
-    {
-        if(data.size() >= 4)
+        case KEY_CHANGE_DISPLAY:
         {
-            quint16 keyCode = uint16FromArray(data.mid(0,2));
-            quint16 keyState = uint16FromArray(data.mid(2,2));
-            emit setKeyPressed(keyCode,static_cast<bool>(keyState));
+            emit changeDisplayNum();
+            break;
         }
-    }
-    else if(command == KEY_SET_MOUSE_KEY)
-    {
-        if(data.size() >= 4)
+        case KEY_REFRESH_DISPLAY:
         {
-            quint16 keyCode = uint16FromArray(data.mid(0,2));
-            quint16 keyState = uint16FromArray(data.mid(2,2));
-            emit setMousePressed(keyCode,static_cast<bool>(keyState));
+            // from the store if it has a full image, the other viewers need nothing new
+            TileStore::Snapshot snapshot;
+
+            if(m_isStreaming && m_tileStore && m_tileStore->snapshot(m_session.profile(), snapshot))
+                sendSnapshot(snapshot);
+            else emit refreshDisplay();
+            break;
         }
-    }
-    else if(command == KEY_SET_MOUSE_WHEEL)
-    {
-        if(data.size() >= 4)
+        case KEY_SET_CURSOR_POS:
         {
-            quint16 keyState = uint16FromArray(data.mid(2,2));
-            emit setWheelChanged(static_cast<bool>(keyState));
+            CursorPosPayload payload;
+            if(payload.decode(data, size))
+                pushInput(InputEvent::MOVE, 0, false, payload.posX, payload.posY);
+            break;
         }
-    }
-    else if(command == KEY_SET_NAME)
-    {
-     //   m_name = QString::fromUtf8(data);
-        // qDebug()<<"New desktop connected:"<<m_name;
-    }
+        case KEY_SET_CURSOR_DELTA:
+        {
+            CursorDeltaPayload payload;
+            if(payload.decode(data, size))
+                pushInput(InputEvent::MOVE_BY, 0, false, payload.deltaX, payload.deltaY);
+            break;
+        }
+        case KEY_SET_KEY_STATE:
+        {
+            KeyStatePayload payload;
+            if(payload.decode(data, size))
+                pushInput(InputEvent::KEY, payload.keyCode, static_cast<bool>(payload.keyState));
+            break;
+        }
+        case KEY_SET_MOUSE_KEY:
+        {
+            KeyStatePayload payload;
+            if(payload.decode(data, size))
+                pushInput(InputEvent::MOUSE_KEY, payload.keyCode, static_cast<bool>(payload.keyState));
+            break;
+        }
+        case KEY_SET_MOUSE_WHEEL:
+        {
+            KeyStatePayload payload;
+            if(payload.decode(data, size))
+                pushInput(InputEvent::WHEEL, 0, false, 0, payload.keyState ? WHEEL_NOTCH : -WHEEL_NOTCH);
+            break;
+        }
+        case KEY_INPUT_BATCH:
+        {
+            InputBatchPayload payload;
+            if(payload.decode(data, size))
+                replayInputBatch(payload);
+            break;
+        }
+        case KEY_INPUT_LATENCY:
+        {
+            InputLatencyPayload payload;
+            if(payload.decode(data, size) && m_inputLatency.reportReceived(payload.eventMs, payload.latencyMs))
+            {
+                m_metrics->inputLatencyMs.add(payload.latencyMs);
 
-    else if(command == KEY_CONNECTED_PROXY_CLIENT)
-    {
-        //emit connectedProxyClient(data);
-    }
-    else if(command == KEY_DISCONNECTED_PROXY_CLIENT)
-    {
-        //emit disconnectedProxyClient(data);
+                if(m_debugStats && m_inputLatency.total().count() % 20 == 0)
+                    qDebug()<<"WebSocketHandler::newData - input latency (ms)"<<m_inputLatency.summary();
+            }
+            break;
+        }
+        case KEY_SET_NAME:
+        {
+            //   m_name = QString::fromUtf8(data);
+            // qDebug()<<"New desktop connected:"<<m_name;
+            break;
+        }
+        case KEY_CONNECTED_PROXY_CLIENT:
+        {
+            //emit connectedProxyClient(data);
+            break;
+        }
+        case KEY_DISCONNECTED_PROXY_CLIENT:
+        {
+            //emit disconnectedProxyClient(data);
+            break;
+        }
+        default:
+        {
+            qDebug()<<"DataParser::newData unknown command & data: "<<commandName(command)<<QByteArray(data, size);
+            debugHexData(QByteArray::fromRawData(data, size));
+            break;
+        }
     }
+}
+
+/* The events go to the input thread with the time they are due, it holds
+ * them until then. Types it doesn't know are skipped. */
+void WebSocketHandler::replayInputBatch(const InputBatchPayload &batch)
+{
+    if(batch.count == 0)
+        return;
+
+    InputBatchEvent event;
+    event.decode(batch, batch.count - 1);
+
+    const qint64 arrivalMs = inputClockMs();
+    m_inputReplay.batchArrived(batch.baseMs, event.offsetMs, arrivalMs);
 
-    else
+    for(int i=0;i<batch.count;++i)
     {
+        event.decode(batch, i);
+        const qint64 dueMs = m_inputReplay.dueMs(event.offsetMs);
 
-        qDebug()<<"DataParser::newData unknown command & data: "<<command<<data;
-        debugHexData(data);
+        // presses and wheel turns tend to change the screen, releases and moves seldom do
+        const bool probe = (m_capabilities & CAP_INPUT_ECHO) &&
+                           (event.type == INPUT_WHEEL || ((event.type == INPUT_KEY || event.type == INPUT_MOUSE_KEY) && event.value2 != 0)) &&
+                           m_inputLatency.startProbe(batch.baseMs + event.offsetMs, arrivalMs);
+
+        switch(event.type)
+        {
+            case INPUT_KEY:
+                pushInput(InputEvent::KEY, event.value1, event.value2 != 0, 0, 0, dueMs, probe);
+                break;
+            case INPUT_MOUSE_KEY:
+                pushInput(InputEvent::MOUSE_KEY, event.value1, event.value2 != 0, 0, 0, dueMs, probe);
+                break;
+            case INPUT_WHEEL:
+                pushInput(InputEvent::WHEEL, 0, false, static_cast<qint16>(event.value1), static_cast<qint16>(event.value2), dueMs, probe);
+                break;
+            case INPUT_MOVE:
+                pushInput(InputEvent::MOVE, 0, false, event.value1, event.value2, dueMs);
+                break;
+            case INPUT_MOVE_BY:
+                pushInput(InputEvent::MOVE_BY, 0, false, static_cast<qint16>(event.value1), static_cast<qint16>(event.value2), dueMs);
+                break;
+            default:
+                break;
+        }
     }
 }
 
+void WebSocketHandler::pushInput(int type, quint16 code, bool state, int x, int y, qint64 dueMs, bool probe)
+{
+    if(!m_inputQueue)
+        return;
+
+    InputEvent event;
+    event.type = static_cast<quint8>(type);
+    event.state = state;
+    event.code = code;
+    event.x = x;
+    event.y = y;
+    event.probe = probe;
+    event.dueMs = dueMs;
+
+    if(!m_inputQueue->push(event) && m_debugStats)
+        qDebug() << "WebSocketHandler: input queue full," << m_inputQueue->droppedCount() << "events dropped";
+}
+
 void WebSocketHandler::sendAuthenticationResponse(bool state)
 {
-    QByteArray data;
-    data.append(KEY_PKT_HEADR);
-    data.append(KEY_SET_AUTH_RESPONSE);
-    data.append(arrayFromUint32(sizeof(quint32))); // payload size
-    data.append(arrayFromUint32(static_cast<quint32>(state)));
+    PacketBuilder packet(m_packetPool.acquire());
+    packet.begin(KEY_SET_AUTH_RESPONSE);
+    packet.appendUint32(static_cast<quint32>(state));
 
-    sendBinaryMessage(data);
+    sendBinaryMessage(packet.finish());
 
     WebSocketHandler *handler = static_cast<WebSocketHandler*>(sender());
     disconnect(handler, &WebSocketHandler::proxyConnectionCreated, this, &WebSocketHandler::sendAuthenticationResponse);
@@ -463,11 +1159,7 @@ void WebSocketHandler::sendAuthenticationResponse(bool state)
 
 QByteArray WebSocketHandler::getHashSum(const QByteArray &nonce, const QString &login, const QString &pass)
 {
-    QString sum = login + pass;
-    QByteArray concatFirst = QCryptographicHash::hash(sum.toUtf8(),QCryptographicHash::Md5).toBase64();
-    concatFirst.append(nonce.toBase64());
-    QByteArray result = QCryptographicHash::hash(concatFirst,QCryptographicHash::Md5).toBase64();
-    return result;
+    return authHashSum(nonce, login, pass);
 }
 
 void WebSocketHandler::WSocketStateChanged(QAbstractSocket::SocketState state)
@@ -478,7 +1170,7 @@ void WebSocketHandler::WSocketStateChanged(QAbstractSocket::SocketState state)
         {
             if(m_timerReconnect)
                 if(!m_timerReconnect->isActive())
-                    m_timerReconnect->start(5000);
+                    m_timerReconnect->start(m_reconnectDelay);
             break;
         }
         case QAbstractSocket::HostLookupState:
@@ -489,7 +1181,7 @@ void WebSocketHandler::WSocketStateChanged(QAbstractSocket::SocketState state)
         {
             if(m_timerReconnect)
                 if(!m_timerReconnect->isActive())
-                    m_timerReconnect->start(5000);
+                    m_timerReconnect->start(m_reconnectDelay);
             break;
         }
         case QAbstractSocket::ConnectedState:
@@ -507,7 +1199,7 @@ void WebSocketHandler::WSocketStateChanged(QAbstractSocket::SocketState state)
 
             if(m_timerReconnect)
                 if(!m_timerReconnect->isActive())
-                    m_timerReconnect->start(5000);
+                    m_timerReconnect->start(m_reconnectDelay);
 
             break;
         }
@@ -525,131 +1217,175 @@ void WebSocketHandler::WSocketDisconnected()
     emit disconnectedProxyClient(m_client_uuid);
     m_client_isAuthenticated = false;
     m_client_uuid = QByteArray();
+    m_parser.clear(); // a partial packet from the old link must not prefix the next one
+    m_capabilities = 0;
+    m_protocolVersion = 0;
+
+    // the next viewer on this connection asks for its own
+    if(m_frameInterval > 0)
+        emit frameIntervalRequested(this, 0);
+
+    m_frameInterval = 0;
+    m_codecs = HOST_CODECS;
+    m_quality = 0;
+    m_inputReplay.reset(); // the next viewer has its own clock
+
+    if(m_debugStats && (m_inputLatency.total().count() > 0 || m_inputLatency.lostCount() > 0))
+        qDebug()<<"WebSocketHandler::WSocketDisconnected - input latency of the session (ms)"<<m_inputLatency.summary();
+
+    m_inputLatency.reset();
+
+    if(m_timerStats)
+        m_timerStats->stop();
+
+    m_sentBytes = 0;
+
+    // the viewer may come back for a while, on this connection or another one
+    if(m_isStreaming && !m_resumeToken.isEmpty() && m_sessionRegistry)
+        m_sessionRegistry->park(m_resumeToken, m_session);
+
+    m_resumeToken.clear();
+    stopStreaming();
+
+    // whatever is still queued was meant for the old link
+    if(m_debugStats)
+        printSendLatency();
+
+    m_sendScheduler.clear();
+    m_sendScheduler.clearLatency();
+    m_sendScheduler.setFragmentSize(0);
+    m_bytesInFlight = 0;
+
+    stopRecording();
 
     emit disconnected(this);
 
+    if(m_isDirect)
+        removeSocket(); // a direct viewer does not come back on this socket
+
 }
 
-void WebSocketHandler::sendBinaryMessage(const QByteArray &data)
+void WebSocketHandler::sendBinaryMessage(const QByteArray &data, SendScheduler::Priority priority)
 {
     if(m_webSocket)
+    {
         if(m_webSocket->state() == QAbstractSocket::ConnectedState)
-            m_webSocket->sendBinaryMessage(data);
-}
+        {
+            if(data.size() >= PREAMBLE_SIZE + 4)
+                m_metrics->sentBytes[Metrics::packetType(fourCCFromData(data.constData() + PREAMBLE_SIZE))].add(static_cast<quint64>(data.size()));
 
-void WebSocketHandler::textMessageReceived(const QString &message)
-{
-    // qDebug() << "WebSocketHandler::textMessageReceived:" << message;
-    if (message.startsWith("TXTMSG:") && message.length() > 16)
+            m_sentBytes += data.size();
+            m_sendScheduler.enqueue(priority, data, m_clock.nsecsElapsed() / 1000);
+            pumpSendQueue();
+        }
+    }
+
+    if(m_debugStats)
     {
-        emit sendTextMessage(message.mid(7));
+        quint32 allocations = m_packetPool.takeAllocationCount();
+
+        if(allocations > 0)
+            qDebug()<<"WebSocketHandler::sendBinaryMessage - packet buffer allocations:"<<allocations<<"pooled buffers:"<<m_packetPool.count();
     }
 }
 
-
-// It's a fucking stream protocol like TCP. Treat it as such.
-// QT client does not recieve data with a packet start header, javascript Web Client Does
-void WebSocketHandler::binaryMessageReceived(const QByteArray &data)
+/* Hand queued packets to the socket while less than SendScheduler::SEND_WINDOW
+ * bytes wait in it, the rest stays in the scheduler where a more urgent packet
+ * can still overtake */
+void WebSocketHandler::pumpSendQueue()
 {
-#ifdef QT_DEBUG_1
-    qDebug() << "WebSocketHandler::binaryMessageReceived!";
-    debugHexData(data);
-#endif
-
-    /*
-
- //   if (!data.startsWith(KEY_PKT_HEADR)) {
-   //         // qDebug() << "Did not get packet start header.";
-    //        return;
-  //  }
-
-
-    if (data.length() < 4) { // always have a message header and then the COMMAND_SIZE
-            // qDebug() << "Recieved binary message is too short.";
-            return;
-    }
-    else if (data.length() > 1024) {
-        // qDebug() << "Recieved binary message is too large.";
+    if(!m_webSocket || m_webSocket->state() != QAbstractSocket::ConnectedState)
         return;
-    }
-    else if ( data.length() == 4 ) { // packet header only
 
-        QByteArray command = QByteArray(data.mid(0,4));
-        newData(command, QByteArray());
-    }
-    else
-    {
-        QByteArray command = data.mid(0,4);
-        quint32 size       = uint32FromArray(data.mid(4,4)); // ignored to be honest
-        QByteArray payload = data.mid(8);
+    QByteArray packet;
 
-        // qDebug() << "Command recieved: " + command;
-        //// qDebug() << "Payload Size: "     + size;
-        // qDebug() << "Payload recieved: " + payload;
+    while(m_bytesInFlight < SendScheduler::SEND_WINDOW && m_sendScheduler.next(packet, m_clock.nsecsElapsed() / 1000))
+    {
+        TraceSpan span("socket write", "bytes", packet.size());
 
-        newData(command, payload);
+        m_bytesInFlight += packet.size();
+        m_webSocket->sendBinaryMessage(packet);
 
+        if(m_recorder.isOpen())
+            m_recorder.record(true, packet);
     }
-    */
+}
 
-    const quint32 msg_command_size_bytes = 4;
-    const quint32 msg_payload_size_bytes = 4;
+void WebSocketHandler::socketBytesWritten(qint64 bytes)
+{
+    // frame headers are counted too, never go below zero
+    m_bytesInFlight = qMax<qint64>(0, m_bytesInFlight - bytes);
 
+    // with packets waiting for the window the socket drains as fast as the link goes
+    m_session.bytesDrained(bytes, m_sendScheduler.queuedBytes() > 0, ViewerSession::clockMs());
+    pumpSendQueue();
+}
 
+void WebSocketHandler::printSendLatency()
+{
+    for(int i=0;i<SendScheduler::PriorityCount;++i)
+    {
+        SendScheduler::Priority priority = static_cast<SendScheduler::Priority>(i);
+        const Histogram &latency = m_sendScheduler.latency(priority);
 
-    QByteArray activeBuf = m_ws_stream;
-    activeBuf.append(data);
-    m_ws_stream.clear();
+        if(latency.count() > 0)
+            qDebug()<<"WebSocketHandler - send latency (us)"<<SendScheduler::priorityName(priority)<<latency.summary();
+    }
+}
 
-    quint32 size = activeBuf.size(); // How much do we have in the stream buffer so far
+void WebSocketHandler::textMessageReceived(const QString &message)
+{
+    // qDebug() << "WebSocketHandler::textMessageReceived:" << message;
+    if(m_recorder.isOpen())
+        m_recorder.recordText(false, message);
 
-    if (size < msg_command_size_bytes) { // need to wait for more data
-            // qDebug() << "Recieved binary message is too short.";
-            return;
-    }
-    else if (size == msg_command_size_bytes) // command only, no size, so 4 bytes.
+    if (message.startsWith("TXTMSG:") && message.length() > 16)
     {
-        newData(data, QByteArray());
-        return;
+        emit sendTextMessage(message.mid(7));
     }
-    else // search for command + size + payload
+    else if(m_isDirect && message.startsWith("1111CONN|")) // asks for a desktop like it would ask the proxy
     {
-        quint32 dataStep = 0;
-
-        for(quint32 i=0;i<size;++i) // iterate through every received byte of the appended buffer
-        {
-            QByteArray command = activeBuf.mid(dataStep, msg_command_size_bytes);
-            quint32 dataSize = uint32FromArray(activeBuf.mid(dataStep + msg_command_size_bytes, msg_payload_size_bytes));
+        QString id = message.section('|', 1, 1);
 
-            //qDebug() << "Data size is: " << dataSize;
+        PacketBuilder packet(m_packetPool.acquire());
+        packet.begin(KEY_PROXY_CONNECT);
 
-            if(size >= (dataStep + msg_command_size_bytes + dataSize))
-            {
-                QByteArray payload = activeBuf.mid(dataStep + msg_command_size_bytes + msg_payload_size_bytes, dataSize);
-                dataStep += msg_command_size_bytes + msg_payload_size_bytes + dataSize;
-                newData(command, payload);
+        if(id == m_login)
+            packet.append(id.toUtf8()); // the viewer goes on with KEY_CONNECT_UUID, then the nonce
 
-                i = dataStep;
-            }
-            else
-            {
-              //  debugHexData(activeBuf);
-
-                m_ws_stream = activeBuf.mid(dataStep, size - dataStep);
+        sendBinaryMessage(packet.finish());
+    }
+}
 
-                if(m_ws_stream.size() > 2000)
-                    m_ws_stream.clear();
 
-                break;
-            }
-         }
-    }
+// It's a fucking stream protocol like TCP. Treat it as such.
+// QT client does not recieve data with a packet start header, javascript Web Client Does
+void WebSocketHandler::binaryMessageReceived(const QByteArray &data)
+{
+#ifdef QT_DEBUG_1
+    qDebug() << "WebSocketHandler::binaryMessageReceived!";
+    debugHexData(data);
+#endif
 
+    if(m_recorder.isOpen())
+        m_recorder.record(false, data);
 
+    m_parser.append(data);
 
+    // packets are spans into the message or the parser's ring, nothing is copied here
+    PacketParser::Packet packet;
 
+    while(m_parser.next(packet))
+        newData(fourCCFromData(packet.command), packet.payload, packet.size);
 
+    // out of step with the viewer, nothing after a bad header can be trusted
+    if(m_parser.hasFailed() && m_webSocket)
+    {
+        if(m_debugStats)
+            qDebug() << "WebSocketHandler::binaryMessageReceived - invalid packet header, closing";
 
+        m_webSocket->close(QWebSocketProtocol::CloseCodeProtocolError, "invalid packet header");
+    }
 
 } //binaryMessageRecieved
 
@@ -665,6 +1401,11 @@ void WebSocketHandler::timerReconnectTick()
         m_webSocket->abort();
 
     m_webSocket->open(QUrl(m_url));
+    m_metrics->reconnects.add();
+
+    // retry soon after a drop so a viewer can resume, then back off
+    m_reconnectDelay = qMin(m_reconnectDelay * 2, int(RECONNECT_DELAY_MAX)); // copy, qMin() binds a reference
+    m_timerReconnect->setInterval(m_reconnectDelay);
 }
 
 void WebSocketHandler::startWaitResponseTimer(int msec, int type)
@@ -710,6 +1451,13 @@ void WebSocketHandler::debugHexData(const QByteArray &data)
     qDebug()<<"DataParser::debugHexData:"<<textHex<<data;
 }
 
+QByteArray WebSocketHandler::commandName(quint32 command)
+{
+    QByteArray name;
+    appendFourCC(name, command);
+    return name;
+}
+
 QByteArray WebSocketHandler::arrayFromUint32(quint32 number)
 {
     QByteArray buf;
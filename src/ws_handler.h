@@ -7,18 +7,35 @@
 #include <QtWebSockets/qwebsocket.h>
 #include <QSize>
 #include <QMap>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "buffer_pool.h"
+#include "input_latency.h"
+#include "input_queue.h"
+#include "input_replay.h"
+#include "metrics.h"
+#include "packet_parser.h"
+#include "protocol.h"
+#include "send_scheduler.h"
+#include "session_recorder.h"
+#include "tile_store.h"
+#include "viewer_session.h"
 
 class WebSocketHandler : public QObject
 {
     Q_OBJECT
 public:
     explicit WebSocketHandler(QObject *parent = Q_NULLPTR);
+    ~WebSocketHandler();
 
 private:
     QWebSocket *m_webSocket;
+    bool    m_isDirect; // a LAN viewer on the host's listener, no proxy in between
     QTimer *m_timerReconnect;
     QTimer *m_timerWaitResponse;
     int     m_waitType;
+    QTimer *m_timerStats; // KEY_HOST_STATS
 
     QString m_url;
     QString m_name;
@@ -31,20 +48,67 @@ private:
     QByteArray m_uuid; // not used
     QByteArray m_nonce;
 
-    QByteArray m_ws_stream;
+    // the viewer on this connection, encoded images come from ScreenCapture's tile
+    // store, without one nothing is resent or resumed
+    TileStore             *m_tileStore;
+    ViewerSession          m_session;
+    bool                   m_isStreaming; // counted as a viewer of its profile in the store
+    QVector<quint16>       m_resendTiles;
+
+    // resumable session, parked in the registry under the token when the link drops,
+    // none without a registry
+    ViewerSessionRegistry *m_sessionRegistry;
+    QByteArray             m_resumeToken;
+
+    InputQueue *m_inputQueue; // the viewer's input to InputSimulator's thread, closed with the handler
+    InputReplay m_inputReplay; // when its batched events are due
+    InputLatency m_inputLatency; // input to photon, probes with CAP_INPUT_ECHO
+
+    int        m_reconnectDelay; // ms, backs off from RECONNECT_DELAY_MIN
+    static const int RECONNECT_DELAY_MIN = 1000;
+    static const int RECONNECT_DELAY_MAX = 5000;
+
+    PacketParser m_parser; // inbound stream
+
+    BufferPool m_packetPool; // outgoing packets, reused once the socket has copied them
+    bool       m_debugStats;
+    Metrics   *m_metrics;   // the host's, shared, Metrics::unshared() until set
+    qint64     m_sentBytes; // to this viewer
+
+    QString         m_recordDir;    // QV_RECORD_DIR, a recording of every socket session
+    SessionRecorder m_recorder;
+
+    // outgoing queues, only about SendScheduler::SEND_WINDOW bytes are handed to the socket at a time
+    SendScheduler m_sendScheduler;
+    QElapsedTimer m_clock;         // of the send queue, the session's times are ViewerSession::clockMs()
+    qint64        m_bytesInFlight;
+
+    quint32    m_capabilities; // negotiated with the viewer, CAP_*
+    quint16    m_protocolVersion;
+
+    // stream parameters the viewer asked for, KEY_STREAM_PARAMS
+    quint16    m_codecs;           // CODEC_* it decodes
+    int        m_quality;          // cap, 0 for none
+    int        m_frameInterval;    // ms, 0 for every frame of the capture
+    int        m_captureInterval;  // ScreenCapture's
+    int        m_rectSize;         // of the tile grid the viewer has
+    qint64     m_lastFrameMs;      // of the last frame it got, for the pace
+
+    // tile packets of the frame being batched, shared with ScreenCapture's pool
+    BufferPool          m_batchPool;
+    QVector<QByteArray> m_batchTiles;
+    int                 m_batchBytes;
+    int                 m_batchSize;    // split point of a frame batch
+    quint32             m_batchFrameSeq;
+    qint64              m_frameBytes;   // image bytes queued for the viewer since the last frame
 
 signals:
     void finished();
-    void getDesktop();
+    void getDesktop();      // the viewer needs a full image
+    void resumeDesktop();   // the viewer is up to date with the tile store
     void connectedStatus(bool);
     void authenticatedStatus(bool);
-    void receivedTileNum(quint16 num);
     void changeDisplayNum();
-    void setKeyPressed(quint16 keyCode, bool state);
-    void setMousePressed(quint16 keyCode, bool state);
-    void setWheelChanged(bool deltaPos);
-    void setMouseMove(quint16 posX, quint16 posY);
-    void setMouseDelta(qint16 deltaX, qint16 deltaY);
     void refreshDisplay();
 
     void disconnected(WebSocketHandler *pointer);
@@ -57,8 +121,12 @@ signals:
 
     void sendTextMessage(QString message);
 
+    void frameIntervalRequested(QObject *viewer, int msec); // 0 withdraws it
+    void rectSizeRequested(int size);
+
 public slots:
     void createSocket();
+    void setSocket(QWebSocket *socket); // accepted by the LAN listener, before createSocket()
     void removeSocket();
     void setUrl(const QString &url);
     void setName(const QString &name);
@@ -66,30 +134,62 @@ public slots:
     QByteArray getUuid();
 
     void setLoginPass(const QString &login, const QString &pass);
+    void setTileStore(TileStore *store){m_tileStore = store;}
+    void setSessionRegistry(ViewerSessionRegistry *registry){m_sessionRegistry = registry;}
+    void setInputQueue(InputQueue *queue){m_inputQueue = queue;}
+    void setMetrics(Metrics *metrics){m_metrics = metrics ? metrics : Metrics::unshared();}
 
     QWebSocket *getSocket();
 
     void sendLoginNonce();
 
     void sendImageParameters(const QSize &imageSize, int rectWidth);
-    void sendImageTile(quint16 posX, quint16 posY, const QByteArray &imageData, quint16 tileNum);
-    void sendImageScreen(const QByteArray &imageData);
+    void sendImageTile(quint16 tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq, int profile);
+    void sendImageScreen(const QByteArray &packet, quint32 hash, int profile);
+    void flushImageBatch(quint32 frameSeq, qint64 captureMs); // end of a frame, resends go out with it
+    void setBatchSize(int bytes);
+    void setCaptureInterval(int msec);
     void sendName(const QString &name);
     //void createProxyConnection(WebSocketHandler *handler, const QByteArray &uuid); // not used
     //void proxyHandlerDisconnected(const QByteArray &uuid);
 
 private slots:
+    void connectSocket();
     void textMessageReceived(const QString &message);
     void binaryMessageReceived(const QByteArray &data);
-    void newData(const QByteArray &command, const QByteArray &data);
-    void sendBinaryMessage(const QByteArray &data);
+    void newData(quint32 command, const char *data, int size);
+    void replayInputBatch(const InputBatchPayload &batch);
+    void pushInput(int type, quint16 code, bool state, int x = 0, int y = 0, qint64 dueMs = 0, bool probe = false);
+    void sendInputEcho(quint32 frameSeq, qint64 captureMs, bool batched);
+    void sendBinaryMessage(const QByteArray &data, SendScheduler::Priority priority = SendScheduler::Control);
+    void pumpSendQueue();
+    void socketBytesWritten(qint64 bytes);
+    void printSendLatency();
 
     void sendAuthenticationResponse(bool state);
+    void sendCapabilities();
+    void sendHostStats();
+    void setStreamParams(int intervalMs, int rectSize, quint16 codecs, int quality);
+    void sendStreamParams();
+    void applyProfileRange();
+    bool isPaced(qint64 nowMs); // the viewer asked for fewer frames than the capture makes
+    void sendResumeToken();
+    void resumeSession(const QByteArray &token);
+    void startStreaming();
+    void stopStreaming();
+    void switchProfile(int oldProfile);
+    void sendSnapshot(const TileStore::Snapshot &snapshot);
+    void sendResends(quint32 frameSeq, qint64 nowMs);
+    void queueImageTile(quint16 tileNum, const QByteArray &packet, quint32 hash, quint32 frameSeq, bool resend);
+    void sendImageBatch(bool finalPart);
+    void clearImageBatch();
     QByteArray getHashSum(const QByteArray &nonce, const QString &login, const QString &pass);
     void WSocketStateChanged(QAbstractSocket::SocketState state);
 
     void WSocketConnected();
     void WSocketDisconnected();
+    void startRecording();
+    void stopRecording();
 
     void timerReconnectTick();
     void startWaitResponseTimer(int msec, int type);
@@ -101,6 +201,7 @@ private slots:
 public:
     //static QByteArray arrayFromUint16(quint16 number);
     static QByteArray arrayFromUint32(quint32 number);
+    static QByteArray commandName(quint32 command);
     static quint16 uint16FromArray(const QByteArray &buf);
     static quint32 uint32FromArray(const QByteArray &buf);
 };